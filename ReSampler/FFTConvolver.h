@@ -0,0 +1,219 @@
+// FFTConvolver.h : FFT-based (overlap-save) FIR convolution for long filters
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "FIRFilter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <fftw3.h>
+//}}}
+
+namespace ReSampler {
+  //{{{
+  template <typename FloatType> class FFTConvolver {
+  // FFTConvolver : streaming overlap-save convolution, y[t] = sum(kernel[j] * x[t - j])
+  // Each call to process() produces exactly one output for each input (no additional latency),
+  // so it is a drop-in replacement for a direct-form FIR. Arithmetic is done in double precision.
+  public:
+    //{{{
+    FFTConvolver (const FloatType* taps, int length) : length(length) {
+
+      // FFT size: power of 2, at least 4x the kernel length, so that each transform yields >= 3/4 of a frame of output
+      fftSize = 1;
+      while (fftSize < 4 * static_cast<size_t>(length)) {
+        fftSize <<= 1;
+        }
+      hopSize = fftSize - length + 1;
+      spectrumSize = fftSize / 2 + 1;
+
+      frame = static_cast<double*>(fftw_malloc(fftSize * sizeof(double)));
+      result = static_cast<double*>(fftw_malloc(fftSize * sizeof(double)));
+      spectrum = static_cast<fftw_complex*>(fftw_malloc(spectrumSize * sizeof(fftw_complex)));
+      kernelSpectrum = static_cast<fftw_complex*>(fftw_malloc(spectrumSize * sizeof(fftw_complex)));
+
+      {
+        std::lock_guard<std::mutex> lock(getFFTWPlannerMutex());
+        forwardPlan = fftw_plan_dft_r2c_1d(static_cast<int>(fftSize), frame, spectrum, FFTW_ESTIMATE);
+        inversePlan = fftw_plan_dft_c2r_1d(static_cast<int>(fftSize), spectrum, result, FFTW_ESTIMATE);
+      }
+
+      // transform the kernel (pre-scaled, to take care of fftw's unnormalised inverse transform):
+      const double scale = 1.0 / fftSize;
+      std::fill_n(frame, fftSize, 0.0);
+      for (int i = 0; i < length; ++i) {
+        frame[i] = scale * taps[i];
+        }
+      fftw_execute(forwardPlan);
+      memcpy(kernelSpectrum, spectrum, spectrumSize * sizeof(fftw_complex));
+
+      reset();
+      }
+    //}}}
+    //{{{
+    ~FFTConvolver() {
+
+      {
+        std::lock_guard<std::mutex> lock(getFFTWPlannerMutex());
+        fftw_destroy_plan(forwardPlan);
+        fftw_destroy_plan(inversePlan);
+      }
+      fftw_free(frame);
+      fftw_free(result);
+      fftw_free(spectrum);
+      fftw_free(kernelSpectrum);
+      }
+    //}}}
+
+    FFTConvolver (const FFTConvolver&) = delete;
+    FFTConvolver& operator = (const FFTConvolver&) = delete;
+
+    //{{{
+    // process() : convolve n samples. in and out may point to the same buffer
+    void process (const FloatType* in, FloatType* out, size_t n) {
+
+      const size_t historyLength = length - 1;
+      while (n != 0) {
+        size_t count = std::min(n, hopSize);
+
+        // frame layout: [ historyLength previous inputs | count new inputs | zeros ]
+        double* p = frame + historyLength;
+        for (size_t i = 0; i < count; ++i) {
+          p[i] = in[i];
+          }
+        std::fill(p + count, frame + fftSize, 0.0);
+
+        fftw_execute(forwardPlan); // (out-of-place r2c preserves the frame)
+        for (size_t k = 0; k < spectrumSize; ++k) {
+          double re = spectrum[k][0] * kernelSpectrum[k][0] - spectrum[k][1] * kernelSpectrum[k][1];
+          double im = spectrum[k][0] * kernelSpectrum[k][1] + spectrum[k][1] * kernelSpectrum[k][0];
+          spectrum[k][0] = re;
+          spectrum[k][1] = im;
+          }
+        fftw_execute(inversePlan);
+
+        // the first historyLength results are circularly aliased; the rest are valid
+        const double* r = result + historyLength;
+        for (size_t i = 0; i < count; ++i) {
+          out[i] = static_cast<FloatType>(r[i]);
+          }
+
+        // keep the most recent historyLength inputs for the next frame
+        memmove(frame, frame + count, historyLength * sizeof(double));
+
+        in += count;
+        out += count;
+        n -= count;
+        }
+      }
+    //}}}
+    //{{{
+    void reset() {
+
+      std::fill_n(frame, fftSize, 0.0);
+      }
+    //}}}
+    //{{{
+    size_t getFFTSize() const {
+      return fftSize;
+      }
+    //}}}
+
+  private:
+    int length;
+    size_t fftSize;
+    size_t hopSize;       // number of new outputs per transform
+    size_t spectrumSize;  // fftSize / 2 + 1 (r2c)
+
+    double* frame;
+    double* result;
+    fftw_complex* spectrum;
+    fftw_complex* kernelSpectrum;
+    fftw_plan forwardPlan;
+    fftw_plan inversePlan;
+    };
+  //}}}
+
+  //{{{
+  // benchmarkFFTConvolution() : compare throughput of direct-form FIRFilter::process() against FFTConvolver
+  // for a range of filter lengths, and report the crossover point (the value to use for --fftThreshold)
+  template <typename FloatType> int benchmarkFFTConvolution() {
+
+    const size_t numSamples = 1 << 18;
+    const size_t blockSize = 32768; // BUFFERSIZE
+    int crossover = 0;
+
+    std::vector<FloatType> input(numSamples);
+    srand(1);
+    for (auto& x : input) {
+      x = static_cast<FloatType>(rand()) / RAND_MAX - 0.5;
+      }
+
+    std::vector<FloatType> directOutput(numSamples);
+    std::vector<FloatType> fftOutput(numSamples);
+
+    std::cout << std::setw(8) << "taps" << std::setw(12) << "fftSize"
+              << std::setw(16) << "direct Ms/s" << std::setw(14) << "fft Ms/s" << std::setw(14) << "max diff" << "\n";
+
+    for (int length = 15; length <= 65535; length = 2 * length + 1) {
+      std::vector<FloatType> taps(length);
+      makeLPF<FloatType>(taps.data(), length, 0.2, 1.0);
+      applyKaiserWindow<FloatType>(taps.data(), length, calcKaiserBeta(160));
+
+      // FIRFilter's output (see FIRFilter::get()) corresponds to convolution with the kernel rotated by one tap
+      std::vector<FloatType> rotated(taps.begin() + 1, taps.end());
+      rotated.push_back(taps[0]);
+
+      FIRFilter<FloatType> filter(taps.data(), length);
+      FFTConvolver<FloatType> convolver(rotated.data(), length);
+
+      double seconds[2];
+      for (int mode = 0; mode < 2; ++mode) {
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < numSamples; i += blockSize) {
+          size_t n = std::min(blockSize, numSamples - i);
+          if (mode == 0) {
+            filter.process(input.data() + i, directOutput.data() + i, n);
+            }
+          else {
+            convolver.process(input.data() + i, fftOutput.data() + i, n);
+            }
+          }
+        auto end = std::chrono::high_resolution_clock::now();
+        seconds[mode] = std::chrono::duration<double>(end - begin).count();
+        }
+
+      double maxDiff = 0.0;
+      for (size_t i = 0; i < numSamples; ++i) {
+        maxDiff = std::max(maxDiff, static_cast<double>(std::abs(directOutput[i] - fftOutput[i])));
+        }
+
+      if (crossover == 0 && seconds[1] < seconds[0]) {
+        crossover = length;
+        }
+
+      std::cout << std::setw(8) << length << std::setw(12) << convolver.getFFTSize()
+                << std::setw(16) << numSamples / seconds[0] / 1.0e6
+                << std::setw(14) << numSamples / seconds[1] / 1.0e6
+                << std::setw(14) << maxDiff << (seconds[1] < seconds[0] ? "  *" : "") << "\n";
+      }
+
+    std::cout << "\ncrossover: " << crossover << " taps (use with --fftThreshold)\n" << std::endl;
+    return crossover;
+    }
+  //}}}
+}
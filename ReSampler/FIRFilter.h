@@ -24,6 +24,7 @@
 #include <cstdint>
 #include <cassert>
 #include <vector>
+#include <mutex>
 
 #if defined(__ANDROID__)
   #ifndef COMPILING_ON_ANDROID
@@ -43,10 +44,9 @@
 
 #else
 
-  #define ALIGNMENT_SIZE 16
-
   #if (defined(_M_X64) || defined(__x86_64__) || defined(USE_SSE2)) // All x64 CPUs have SSE2 instructions, but some older 32-bit CPUs do not.
     #include <xmmintrin.h>
+    #include <emmintrin.h>
     #define USE_SIMD 1 // Vectorise main loop in FIRFilter::get() by using SSE2 SIMD instrinsics
     #define USE_SIMD_FOR_DOUBLES
   #endif
@@ -60,10 +60,379 @@
     #endif
   #endif
 
+  // Run-time CPU dispatch: FIRFilter::get() uses the best of SSE2 / AVX / AVX2+FMA / AVX-512 available on the host.
+  // (Builds which define USE_AVX keep using the fixed AVX code path)
+  #if defined(USE_SIMD) && !defined(FIR_QUAD_PRECISION) && !defined(NO_CPU_DISPATCH)
+    #define USE_CPU_DISPATCH
+    #include <immintrin.h>
+    #include "cpufeatures.h"
+    #if defined(__GNUC__) || defined(__clang__)
+      #define FIR_TARGET(isa) __attribute__((target(isa)))
+    #else
+      #define FIR_TARGET(isa) // MSVC allows all intrinsics without special compiler flags
+    #endif
+    #define ALIGNMENT_SIZE 64
+  #else
+    #define ALIGNMENT_SIZE 16
+  #endif
+
 #endif
 //}}}
 
 namespace ReSampler {
+  // Block convolution kernels (used by FIRFilter::process()):
+  // Several output samples are computed per pass over the filter kernel. Each tap is loaded (broadcast) once,
+  // and multiplied against a block of consecutive signal vectors, so that there is no horizontal sum in the inner loop.
+  // The kernel is applied with the same tap ordering as FIRFilter::get(): for the window w[0..length-1] (oldest first),
+  // y = kernel[0] * w[0] + sum(kernel[length - k] * w[k]) for k = 1 .. length - 1
+
+  #if defined(USE_AVX)
+    //{{{
+    struct VecOpsFloat {
+      typedef float Scalar;
+      typedef __m256 Vec;
+      static const int width = 8;
+      static inline Vec zero() { return _mm256_setzero_ps(); }
+      static inline Vec set1 (float x) { return _mm256_set1_ps(x); }
+      static inline Vec loadu (const float* p) { return _mm256_loadu_ps(p); }
+      static inline void storeu (float* p, Vec v) { _mm256_storeu_ps(p, v); }
+      #ifdef USE_FMA
+        static inline Vec madd (Vec a, Vec b, Vec acc) { return _mm256_fmadd_ps(a, b, acc); }
+      #else
+        static inline Vec madd (Vec a, Vec b, Vec acc) { return _mm256_add_ps(_mm256_mul_ps(a, b), acc); }
+      #endif
+      };
+    //}}}
+    //{{{
+    struct VecOpsDouble {
+      typedef double Scalar;
+      typedef __m256d Vec;
+      static const int width = 4;
+      static inline Vec zero() { return _mm256_setzero_pd(); }
+      static inline Vec set1 (double x) { return _mm256_set1_pd(x); }
+      static inline Vec loadu (const double* p) { return _mm256_loadu_pd(p); }
+      static inline void storeu (double* p, Vec v) { _mm256_storeu_pd(p, v); }
+      #ifdef USE_FMA
+        static inline Vec madd (Vec a, Vec b, Vec acc) { return _mm256_fmadd_pd(a, b, acc); }
+      #else
+        static inline Vec madd (Vec a, Vec b, Vec acc) { return _mm256_add_pd(_mm256_mul_pd(a, b), acc); }
+      #endif
+      };
+    //}}}
+  #elif defined(USE_SIMD)
+    //{{{
+    struct VecOpsFloat {
+      typedef float Scalar;
+      typedef __m128 Vec;
+      static const int width = 4;
+      static inline Vec zero() { return _mm_setzero_ps(); }
+      static inline Vec set1 (float x) { return _mm_set1_ps(x); }
+      static inline Vec loadu (const float* p) { return _mm_loadu_ps(p); }
+      static inline void storeu (float* p, Vec v) { _mm_storeu_ps(p, v); }
+      static inline Vec madd (Vec a, Vec b, Vec acc) { return _mm_add_ps(_mm_mul_ps(a, b), acc); }
+      };
+    //}}}
+    //{{{
+    struct VecOpsDouble {
+      typedef double Scalar;
+      typedef __m128d Vec;
+      static const int width = 2;
+      static inline Vec zero() { return _mm_setzero_pd(); }
+      static inline Vec set1 (double x) { return _mm_set1_pd(x); }
+      static inline Vec loadu (const double* p) { return _mm_loadu_pd(p); }
+      static inline void storeu (double* p, Vec v) { _mm_storeu_pd(p, v); }
+      static inline Vec madd (Vec a, Vec b, Vec acc) { return _mm_add_pd(_mm_mul_pd(a, b), acc); }
+      };
+    //}}}
+  #endif
+
+  //{{{
+  template <typename FloatType> void convolveBlockScalar (const FloatType* kernel, int length, const FloatType* x, FloatType* out, size_t n) {
+  // scalar version: 4 outputs per pass
+
+    #ifdef FIR_QUAD_PRECISION
+      typedef __float128 AccType;
+    #else
+      typedef FloatType AccType;
+    #endif
+
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+      AccType k = kernel[0];
+      AccType a0 = k * x[j];
+      AccType a1 = k * x[j + 1];
+      AccType a2 = k * x[j + 2];
+      AccType a3 = k * x[j + 3];
+      for (int i = 1; i < length; ++i) {
+        k = kernel[length - i];
+        const FloatType* w = x + j + i;
+        a0 += k * w[0];
+        a1 += k * w[1];
+        a2 += k * w[2];
+        a3 += k * w[3];
+        }
+      out[j] = static_cast<FloatType>(a0);
+      out[j + 1] = static_cast<FloatType>(a1);
+      out[j + 2] = static_cast<FloatType>(a2);
+      out[j + 3] = static_cast<FloatType>(a3);
+      }
+
+    for (; j < n; ++j) {
+      AccType a = static_cast<AccType>(kernel[0]) * x[j];
+      for (int i = 1; i < length; ++i) {
+        a += static_cast<AccType>(kernel[length - i]) * x[j + i];
+        }
+      out[j] = static_cast<FloatType>(a);
+      }
+    }
+  //}}}
+
+  #if defined(USE_AVX) || defined(USE_SIMD)
+    //{{{
+    template <typename Ops> void convolveBlockVec (const typename Ops::Scalar* kernel, int length,
+                                                   const typename Ops::Scalar* x, typename Ops::Scalar* out, size_t n) {
+    // SIMD version: register-blocked; 4 vectors of outputs per pass (ie 4 x Ops::width output samples)
+
+      typedef typename Ops::Vec Vec;
+      const size_t W = Ops::width;
+      size_t j = 0;
+
+      for (; j + 4 * W <= n; j += 4 * W) {
+        Vec k = Ops::set1(kernel[0]);
+        Vec a0 = Ops::madd(k, Ops::loadu(x + j), Ops::zero());
+        Vec a1 = Ops::madd(k, Ops::loadu(x + j + W), Ops::zero());
+        Vec a2 = Ops::madd(k, Ops::loadu(x + j + 2 * W), Ops::zero());
+        Vec a3 = Ops::madd(k, Ops::loadu(x + j + 3 * W), Ops::zero());
+        for (int i = 1; i < length; ++i) {
+          k = Ops::set1(kernel[length - i]);
+          const typename Ops::Scalar* w = x + j + i;
+          a0 = Ops::madd(k, Ops::loadu(w), a0);
+          a1 = Ops::madd(k, Ops::loadu(w + W), a1);
+          a2 = Ops::madd(k, Ops::loadu(w + 2 * W), a2);
+          a3 = Ops::madd(k, Ops::loadu(w + 3 * W), a3);
+          }
+        Ops::storeu(out + j, a0);
+        Ops::storeu(out + j + W, a1);
+        Ops::storeu(out + j + 2 * W, a2);
+        Ops::storeu(out + j + 3 * W, a3);
+        }
+
+      for (; j + W <= n; j += W) {
+        Vec a = Ops::madd(Ops::set1(kernel[0]), Ops::loadu(x + j), Ops::zero());
+        for (int i = 1; i < length; ++i) {
+          a = Ops::madd(Ops::set1(kernel[length - i]), Ops::loadu(x + j + i), a);
+          }
+        Ops::storeu(out + j, a);
+        }
+
+      convolveBlockScalar(kernel, length, x + j, out + j, n - j);
+      }
+    //}}}
+  #endif
+
+  //{{{
+  template <typename FloatType> inline void convolveBlock (const FloatType* kernel, int length, const FloatType* x, FloatType* out, size_t n) {
+    convolveBlockScalar(kernel, length, x, out, n);
+    }
+  //}}}
+  #if (defined(USE_AVX) || defined(USE_SIMD)) && !defined(FIR_QUAD_PRECISION)
+    //{{{
+    template <> inline void convolveBlock (const float* kernel, int length, const float* x, float* out, size_t n) {
+      convolveBlockVec<VecOpsFloat>(kernel, length, x, out, n);
+      }
+    //}}}
+    //{{{
+    template <> inline void convolveBlock (const double* kernel, int length, const double* x, double* out, size_t n) {
+      convolveBlockVec<VecOpsDouble>(kernel, length, x, out, n);
+      }
+    //}}}
+  #endif
+
+  #ifdef USE_CPU_DISPATCH
+    // Dot-product kernels for FIRFilter::get(), one per instruction set.
+    // Each computes sum(s[i] * k[i]) for i = 0 .. n-1, where n is a multiple of the kernel's width,
+    // and s, k are aligned to (width * sizeof(FloatType)) bytes.
+
+    //{{{
+    template <typename FloatType> FloatType dotScalar (const FloatType* s, const FloatType* k, int n) {
+    // reference version (also used by the self-test)
+
+      double output = 0.0;
+      for (int i = 0; i < n; ++i) {
+        output += static_cast<double>(s[i]) * k[i];
+        }
+      return static_cast<FloatType>(output);
+      }
+    //}}}
+    //{{{
+    inline float dotSSE2 (const float* s, const float* k, int n) {
+
+      __m128 accumulator = _mm_setzero_ps();
+      for (int i = 0; i < n; i += 4) {
+        accumulator = _mm_add_ps(_mm_mul_ps(_mm_load_ps(s + i), _mm_load_ps(k + i)), accumulator);
+        }
+      __m128 shuf = _mm_shuffle_ps(accumulator, accumulator, _MM_SHUFFLE(2, 3, 0, 1));
+      __m128 sums = _mm_add_ps(accumulator, shuf);
+      shuf = _mm_movehl_ps(shuf, sums);
+      return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+      }
+    //}}}
+    //{{{
+    inline double dotSSE2 (const double* s, const double* k, int n) {
+
+      __m128d accumulator = _mm_setzero_pd();
+      for (int i = 0; i < n; i += 2) {
+        accumulator = _mm_add_pd(_mm_mul_pd(_mm_load_pd(s + i), _mm_load_pd(k + i)), accumulator);
+        }
+      return _mm_cvtsd_f64(_mm_add_sd(accumulator, _mm_unpackhi_pd(accumulator, accumulator)));
+      }
+    //}}}
+    //{{{
+    FIR_TARGET("avx") inline float dotAVX (const float* s, const float* k, int n) {
+
+      __m256 accumulator = _mm256_setzero_ps();
+      for (int i = 0; i < n; i += 8) {
+        accumulator = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(s + i), _mm256_load_ps(k + i)), accumulator);
+        }
+      __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(accumulator, 1), _mm256_castps256_ps128(accumulator));
+      __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
+      return _mm_cvtss_f32(_mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55)));
+      }
+    //}}}
+    //{{{
+    FIR_TARGET("avx") inline double dotAVX (const double* s, const double* k, int n) {
+
+      __m256d accumulator = _mm256_setzero_pd();
+      for (int i = 0; i < n; i += 4) {
+        accumulator = _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(s + i), _mm256_load_pd(k + i)), accumulator);
+        }
+      __m128d x128 = _mm_add_pd(_mm256_extractf128_pd(accumulator, 1), _mm256_castpd256_pd128(accumulator));
+      return _mm_cvtsd_f64(_mm_add_pd(_mm_permute_pd(x128, 1), x128));
+      }
+    //}}}
+    //{{{
+    FIR_TARGET("avx2,fma") inline float dotAVX2FMA (const float* s, const float* k, int n) {
+
+      __m256 accumulator = _mm256_setzero_ps();
+      for (int i = 0; i < n; i += 8) {
+        accumulator = _mm256_fmadd_ps(_mm256_load_ps(s + i), _mm256_load_ps(k + i), accumulator);
+        }
+      __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(accumulator, 1), _mm256_castps256_ps128(accumulator));
+      __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
+      return _mm_cvtss_f32(_mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55)));
+      }
+    //}}}
+    //{{{
+    FIR_TARGET("avx2,fma") inline double dotAVX2FMA (const double* s, const double* k, int n) {
+
+      __m256d accumulator = _mm256_setzero_pd();
+      for (int i = 0; i < n; i += 4) {
+        accumulator = _mm256_fmadd_pd(_mm256_load_pd(s + i), _mm256_load_pd(k + i), accumulator);
+        }
+      __m128d x128 = _mm_add_pd(_mm256_extractf128_pd(accumulator, 1), _mm256_castpd256_pd128(accumulator));
+      return _mm_cvtsd_f64(_mm_add_pd(_mm_permute_pd(x128, 1), x128));
+      }
+    //}}}
+    //{{{
+    FIR_TARGET("avx512f") inline float dotAVX512 (const float* s, const float* k, int n) {
+
+      __m512 accumulator = _mm512_setzero_ps();
+      for (int i = 0; i < n; i += 16) {
+        accumulator = _mm512_fmadd_ps(_mm512_load_ps(s + i), _mm512_load_ps(k + i), accumulator);
+        }
+      // (reduce through explicit zero-masked extracts: gcc's _mm512_reduce_add_ps(), _mm512_extractf64x4_pd() and _mm512_castps512_ps256()
+      // start from an undefined register and draw -Wuninitialized, and the 256-bit float extract needs AVX-512DQ)
+      __m512d halves = _mm512_castps_pd(accumulator);
+      __m256 x256 = _mm256_add_ps(_mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xff, halves, 1)),
+                                  _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xff, halves, 0)));
+      __m128 x128 = _mm_add_ps(_mm256_extractf128_ps(x256, 1), _mm256_castps256_ps128(x256));
+      __m128 x64 = _mm_add_ps(x128, _mm_movehl_ps(x128, x128));
+      return _mm_cvtss_f32(_mm_add_ss(x64, _mm_shuffle_ps(x64, x64, 0x55)));
+      }
+    //}}}
+    //{{{
+    FIR_TARGET("avx512f") inline double dotAVX512 (const double* s, const double* k, int n) {
+
+      __m512d accumulator = _mm512_setzero_pd();
+      for (int i = 0; i < n; i += 8) {
+        accumulator = _mm512_fmadd_pd(_mm512_load_pd(s + i), _mm512_load_pd(k + i), accumulator);
+        }
+      __m256d x256 = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xff, accumulator, 1), _mm512_maskz_extractf64x4_pd(0xff, accumulator, 0));
+      __m128d x128 = _mm_add_pd(_mm256_extractf128_pd(x256, 1), _mm256_castpd256_pd128(x256));
+      return _mm_cvtsd_f64(_mm_add_pd(_mm_permute_pd(x128, 1), x128));
+      }
+    //}}}
+
+    //{{{
+    template <typename FloatType> struct FIRKernel {
+      typedef FloatType (*DotFunction) (const FloatType* s, const FloatType* k, int n);
+      DotFunction dot;
+      int width; // number of FloatType elements per vector
+      const char* name;
+      };
+    //}}}
+    //{{{
+    template <typename FloatType> std::vector<FIRKernel<FloatType>> getFIRKernels() {
+    // getFIRKernels() : returns all the kernels which can run on this CPU (best one last)
+
+      const CpuFeatures& cpu = getCpuFeatures();
+      const int vecBytes[] = { 16, 32, 32, 64 };
+      std::vector<FIRKernel<FloatType>> kernels;
+
+      kernels.push_back({ &dotSSE2, static_cast<int>(vecBytes[0] / sizeof(FloatType)), "SSE2" });
+      if (cpu.avx) {
+        kernels.push_back({ &dotAVX, static_cast<int>(vecBytes[1] / sizeof(FloatType)), "AVX" });
+        }
+      if (cpu.avx2 && cpu.fma) {
+        kernels.push_back({ &dotAVX2FMA, static_cast<int>(vecBytes[2] / sizeof(FloatType)), "AVX2+FMA" });
+        }
+      if (cpu.avx512f) {
+        kernels.push_back({ &dotAVX512, static_cast<int>(vecBytes[3] / sizeof(FloatType)), "AVX-512" });
+        }
+
+      return kernels;
+      }
+    //}}}
+    //{{{
+    template <typename FloatType> const FIRKernel<FloatType>& getBestFIRKernel() {
+      static const FIRKernel<FloatType> best = getFIRKernels<FloatType>().back();
+      return best;
+      }
+    //}}}
+    //{{{
+    template <typename FloatType> bool testFIRKernels() {
+    // testFIRKernels() : self-test - check each of the host's kernels against the scalar reference
+
+      bool ok = true;
+      const int lengths[] = { 16, 48, 1024, 16384 };
+      for (const FIRKernel<FloatType>& kernel : getFIRKernels<FloatType>()) {
+        double maxError = 0.0;
+        for (int n : lengths) {
+          auto s = static_cast<FloatType*>(aligned_malloc(n * sizeof(FloatType), ALIGNMENT_SIZE));
+          auto k = static_cast<FloatType*>(aligned_malloc(n * sizeof(FloatType), ALIGNMENT_SIZE));
+          double magnitude = 0.0;
+          for (int i = 0; i < n; ++i) {
+            s[i] = static_cast<FloatType>(std::sin(0.37 * i));
+            k[i] = static_cast<FloatType>(std::cos(1.21 * i) / (1 + i % 7));
+            magnitude += std::abs(static_cast<double>(s[i]) * k[i]);
+            }
+          double error = std::abs(static_cast<double>(kernel.dot(s, k, n)) - dotScalar(s, k, n)) / magnitude;
+          maxError = std::max(maxError, error);
+          aligned_free(s);
+          aligned_free(k);
+          }
+
+        bool pass = maxError < ((sizeof(FloatType) == 4) ? 1.0e-5 : 1.0e-13);
+        ok = ok && pass;
+        std::cout << kernel.name << " (" << ((sizeof(FloatType) == 4) ? "float" : "double") << "): "
+                  << (pass ? "pass" : "FAIL") << " (max relative error " << maxError << ")" << std::endl;
+        }
+
+      return ok;
+      }
+    //}}}
+  #endif
+
   //{{{
   template <typename FloatType> class FIRFilter {
   public:
@@ -88,9 +457,9 @@ namespace ReSampler {
         signal[i + length] = 0.0;
         }
 
-      // Populate additional kernel Phases:
+      // Populate additional kernel Phases (phase n is the whole kernel, shifted by n):
       for(int n = 1; n < numVecElements; n++) {
-        memcpy(1 + kernelphases[n], kernelphases[n - 1], (length - 1) * sizeof(FloatType));
+        memcpy(n + kernelphases[n], kernelphases[0], length * sizeof(FloatType));
         }
       }
     //}}}
@@ -278,6 +647,12 @@ namespace ReSampler {
 
         output += sum8floats(accumulator);
 
+      #elif defined(USE_CPU_DISPATCH)
+        // vector processing of float or double types, using the best kernel for the host CPU
+        int index = currentIndex & -numVecElements;
+        int phase = currentIndex & (numVecElements - 1);
+        FloatType output = dotFunction(signal + index, kernelphases[phase], paddedLength);
+
       #elif defined(USE_SIMD)
         // vector processing of float types (doubles require separate specialisation)
         FloatType output = 0.0;
@@ -337,18 +712,64 @@ namespace ReSampler {
       }
     //}}}
 
+    //{{{
+    void process (const FloatType* in, FloatType* out, size_t n) {
+    // process() : block equivalent of { put(in[i]); out[i] = get(); } for i = 0 .. n-1
+    // The history and the new input are laid out contiguously (oldest first), so that the block kernel
+    // can compute many outputs per pass over the filter kernel.
+
+      if (n == 0)
+        return;
+
+      size_t historyLength = static_cast<size_t>(length);
+      if (blockBuffer.size() < historyLength + n) {
+        blockBuffer.resize(historyLength + n);
+        }
+
+      // window for the first output starts with the oldest sample still in the delay line
+      FloatType* x = blockBuffer.data();
+      x[0] = signal[currentIndex];
+      for (int i = 1; i < length; ++i) {
+        x[length - i] = signal[currentIndex + i];
+        }
+
+      // append new input. Note: the first output's window is x[1 .. length] (the put() discards the oldest sample)
+      memcpy(x + historyLength, in, n * sizeof(FloatType));
+      convolveBlock(kernelphases[0], length, x + 1, out, n);
+
+      // bring the delay line up to date, so that put() / get() may continue after process()
+      for (size_t i = (n > historyLength) ? n - historyLength : 0; i < n; ++i) {
+        put(in[i]);
+        }
+      }
+    //}}}
+    //{{{
+    const FloatType* getKernel() const {
+      return kernelphases[0];
+      }
+    //}}}
+    //{{{
+    int getLength() const {
+      return length;
+      }
+    //}}}
+
   private:
     //{{{
     void calcPaddedLength() {
 
-      #if defined(USE_AVX) || defined(USE_SIMD)
+      #if defined(USE_CPU_DISPATCH)
+        dotFunction = getBestFIRKernel<FloatType>().dot;
+        numVecElements = getBestFIRKernel<FloatType>().width;
+      #elif defined(USE_AVX) || defined(USE_SIMD)
         numVecElements = ALIGNMENT_SIZE / sizeof(FloatType);
       #else
         numVecElements = 1; // Scalar mode
       #endif
 
+      // leave room for the most-shifted kernel phase (length + numVecElements - 1), rounded up to a whole vector
       alignMask = static_cast<uintptr_t>(-numVecElements);
-      paddedLength = (length & alignMask) + numVecElements;
+      paddedLength = ((length + 2 * numVecElements - 2) & alignMask);
       }
     //}}}
     //{{{
@@ -431,13 +852,17 @@ namespace ReSampler {
     int paddedLength{};
 
     FloatType* signal; // Double-length signal buffer, to facilitate fast emulation of a circular buffe
+    std::vector<FloatType> blockBuffer; // linear (oldest-first) history + input, for process()
     int currentIndex;
     int lastPut;
     int numVecElements{};
     uintptr_t alignMask{};
 
     // Polyphase Filter Kernel table:
-    #if defined(USE_AVX)
+    #if defined(USE_CPU_DISPATCH)
+      FloatType* kernelphases[16]; // note: number used depends on the kernel selected at run-time
+      typename FIRKernel<FloatType>::DotFunction dotFunction;
+    #elif defined(USE_AVX)
       FloatType* kernelphases[8]; // note:  will only use half of these if FloatType = double
     #elif defined(USE_SIMD)
       FloatType* kernelphases[4]; // note: will only use half of these if FloatType = double
@@ -481,7 +906,7 @@ namespace ReSampler {
       return output;
       }
     //}}}
-  #elif defined(USE_SIMD) && defined(USE_SIMD_FOR_DOUBLES) && !defined(FIR_QUAD_PRECISION)
+  #elif defined(USE_SIMD) && defined(USE_SIMD_FOR_DOUBLES) && !defined(FIR_QUAD_PRECISION) && !defined(USE_CPU_DISPATCH)
     //{{{
     template <> inline double FIRFilter<double>::get() {
     // SSE Implementation: Processes two doubles at a time.
@@ -732,12 +1157,21 @@ namespace ReSampler {
     }
   //}}}
   //{{{
+  // getFFTWPlannerMutex() : fftw's planner is not thread-safe (fftw_execute() is),
+  // so all plan creation / destruction is serialised through this mutex
+  inline std::mutex& getFFTWPlannerMutex() {
+    static std::mutex plannerMutex;
+    return plannerMutex;
+    }
+  //}}}
+  //{{{
   // fftV() : FFT of vector of Complex doubles
   inline std::vector<std::complex<double>> fftV (std::vector<std::complex<double>> input) {
 
     std::vector<std::complex<double>> output(input.size(), 0); // output vector
 
     // create, execute, destroy plan:
+    std::lock_guard<std::mutex> lock(getFFTWPlannerMutex());
     fftw_plan p = fftw_plan_dft_1d (static_cast<int>(input.size()),
       reinterpret_cast<fftw_complex*>(&input[0]),
       reinterpret_cast<fftw_complex*>(&output[0]),
@@ -757,14 +1191,17 @@ namespace ReSampler {
     std::vector<std::complex<double>> output(input.size(), 0); // output vector
 
     // create, execute, destroy plan:
-    fftw_plan p = fftw_plan_dft_1d(static_cast<int>(input.size()),
-      reinterpret_cast<fftw_complex*>(&input[0]),
-      reinterpret_cast<fftw_complex*>(&output[0]),
-      FFTW_BACKWARD,
-      FFTW_ESTIMATE);
-
-    fftw_execute(p);
-    fftw_destroy_plan(p);
+    {
+      std::lock_guard<std::mutex> lock(getFFTWPlannerMutex());
+      fftw_plan p = fftw_plan_dft_1d(static_cast<int>(input.size()),
+        reinterpret_cast<fftw_complex*>(&input[0]),
+        reinterpret_cast<fftw_complex*>(&output[0]),
+        FFTW_BACKWARD,
+        FFTW_ESTIMATE);
+
+      fftw_execute(p);
+      fftw_destroy_plan(p);
+    }
 
     // scale output:
     double reciprocalSize = 1.0 / input.size();
@@ -885,6 +1322,39 @@ namespace ReSampler {
     }
   //}}}
 
+  //{{{
+  template<typename FloatType> bool testFIRFilterProcess (int length, size_t blockSize) {
+  // testFIRFilterProcess() : check that FIRFilter::process() agrees with put() / get() (within a tolerance allowing for summation order)
+
+    std::vector<FloatType> taps(length);
+    makeLPF<FloatType>(taps.data(), length, 0.2, 1.0);
+
+    FIRFilter<FloatType> f1(taps.data(), length);
+    FIRFilter<FloatType> f2(taps.data(), length);
+
+    std::vector<FloatType> input(blockSize);
+    std::vector<FloatType> output(blockSize);
+    double maxError = 0.0;
+    for (int block = 0; block < 3; ++block) {
+      for (size_t i = 0; i < blockSize; ++i) {
+        input[i] = static_cast<FloatType>(std::sin(0.01 * (i + block * blockSize)));
+        }
+
+      f2.process(input.data(), output.data(), blockSize);
+      for (size_t i = 0; i < blockSize; ++i) {
+        f1.put(input[i]);
+        FloatType expected = f1.get();
+        maxError = std::max(maxError, std::abs(static_cast<double>(expected) - output[i]));
+        }
+      }
+
+    bool pass = maxError < ((sizeof(FloatType) == 4) ? 1.0e-5 : 1.0e-12);
+    std::cout << "FIRFilter::process() (" << ((sizeof(FloatType) == 4) ? "float" : "double") << ", " << length << " taps, blocks of "
+              << blockSize << "): " << (pass ? "pass" : "FAIL") << " (max error " << maxError << ")" << std::endl;
+    return pass;
+    }
+  //}}}
+
   //{{{
   template<typename FloatType> void dumpFilter (const FloatType* Filter, int Length) {
   // dumpFilter() - utility function for displaying filter coefficients:
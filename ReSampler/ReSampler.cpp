@@ -11,11 +11,19 @@
 //{{{  includes
 #include "ReSampler.h"
 #include "csv.h" // to-do: check macOS
+#include "npy.h"
+#include "pcmstream.h"
+#include "interleave.h"
 #include "ctpl/ctpl_stl.h"
 #include "raiitimer.h"
 #include "fraction.h"
 #include "srconvert.h"
 #include "ditherer.h"
+#include "cpufeatures.h"
+#include "limiter.h"
+#include "blockqueue.h"
+#include "batch.h"
+#include "streamconverter.h"
 
 #include <cstdio>
 #include <string>
@@ -23,6 +31,7 @@
 #include <vector>
 #include <iomanip>
 #include <regex>
+#include <thread>
 //}}}
 
 namespace ReSampler {
@@ -71,6 +80,86 @@ namespace ReSampler {
       return true;
     }
 
+    // self-test of the FIR kernels (run-time dispatched ones against the scalar reference), and of block processing against put() / get()
+    if (getCmdlineParam(argv, argv + argc, "--testFIRKernels")) {
+      bool ok = true;
+      #ifdef USE_CPU_DISPATCH
+        ok = testFIRKernels<float>() && ok;
+        ok = testFIRKernels<double>() && ok;
+      #endif
+      for (int length : { 15, 16, 17, 255, 1031 }) {
+        for (size_t blockSize : { 1, 7, 64, 1000 }) {
+          ok = testFIRFilterProcess<float>(length, blockSize) && ok;
+          ok = testFIRFilterProcess<double>(length, blockSize) && ok;
+        }
+      }
+      std::cout << (ok ? "all FIR kernels ok" : "FIR kernel self-test FAILED") << std::endl;
+      return true;
+    }
+
+    // self-test of the look-ahead limiter
+    if (getCmdlineParam(argv, argv + argc, "--testLimiter")) {
+      bool ok = testLookAheadLimiter<float>();
+      ok = testLookAheadLimiter<double>() && ok;
+      std::cout << (ok ? "limiter ok" : "limiter self-test FAILED") << std::endl;
+      return true;
+    }
+
+    // benchmark polyphase engine
+    if (getCmdlineParam(argv, argv + argc, "--benchmarkPolyphase")) {
+      if (getCmdlineParam(argv, argv + argc, "--doubleprecision")) {
+        benchmarkPolyphase<double>();
+      }
+      else {
+        benchmarkPolyphase<float>();
+      }
+      return true;
+    }
+
+    // benchmark FFT convolution (find crossover for --fftThreshold)
+    if (getCmdlineParam(argv, argv + argc, "--benchmarkFFT")) {
+      if (getCmdlineParam(argv, argv + argc, "--doubleprecision")) {
+        benchmarkFFTConvolution<double>();
+      }
+      else {
+        benchmarkFFTConvolution<float>();
+      }
+      return true;
+    }
+
+    // benchmark dither (sample-at-a-time vs block) for each dither profile
+    if (getCmdlineParam(argv, argv + argc, "--benchmarkDither")) {
+      if (getCmdlineParam(argv, argv + argc, "--doubleprecision")) {
+        benchmarkDither<double>();
+      }
+      else {
+        benchmarkDither<float>();
+      }
+      return true;
+    }
+
+    // benchmark de-interleave / re-interleave
+    if (getCmdlineParam(argv, argv + argc, "--benchmarkInterleave")) {
+      if (getCmdlineParam(argv, argv + argc, "--doubleprecision")) {
+        benchmarkInterleave<double>();
+      }
+      else {
+        benchmarkInterleave<float>();
+      }
+      return true;
+    }
+
+    // benchmark csv / npy output
+    if (getCmdlineParam(argv, argv + argc, "--benchmarkCsv")) {
+      if (getCmdlineParam(argv, argv + argc, "--doubleprecision")) {
+        benchmarkCsv<double>();
+      }
+      else {
+        benchmarkCsv<float>();
+      }
+      return true;
+    }
+
     // generate
     if (getCmdlineParam(argv, argv + argc, "--generate")) {
       std::string filename;
@@ -89,6 +178,8 @@ namespace ReSampler {
   // 2. use the default subformat for outfile.
   // store best bit format as a string in BitFormat
 
+    std::ostream& out = OutputManager::getStream();
+
     // get infile's extension from filename:
     std::string inFileExt;
     if (ci.inputFilename.find_last_of('.') != std::string::npos) {
@@ -121,7 +212,7 @@ namespace ReSampler {
 
         if (int e = infile.error())
         {
-          std::cout << "Couldn't Open Input File (" << sf_error_number(e) << ")" << std::endl;
+          out << "Couldn't Open Input File (" << sf_error_number(e) << ")" << std::endl;
           return false;
         }
       }
@@ -150,7 +241,7 @@ namespace ReSampler {
     // when the input file is dsf/dff, use default output subformat:
     if (dsfInput || dffInput) { // choose default output subformat for chosen output file format
       bitFormat = defaultSubFormats.find(outFileExt)->second;
-      std::cout << "defaulting to " << bitFormat << std::endl;
+      out << "defaulting to " << bitFormat << std::endl;
       return true;
     }
 
@@ -181,10 +272,10 @@ namespace ReSampler {
         }
 
         // infile's subformat is not valid for outfile's format; use outfile's default subformat
-        std::cout << "Output file format " << outFileExt << " and subformat " << bitFormat << " combination not valid ... ";
+        out << "Output file format " << outFileExt << " and subformat " << bitFormat << " combination not valid ... ";
         bitFormat.clear();
         bitFormat = defaultSubFormats.find(outFileExt)->second;
-        std::cout << "defaulting to " << bitFormat << std::endl;
+        out << "defaulting to " << bitFormat << std::endl;
         break;
 
       }
@@ -196,6 +287,8 @@ namespace ReSampler {
   // determineOutputFormat() : returns an integer representing a libsndfile output format:
   int determineOutputFormat (const std::string& outFileExt, const std::string& bitFormat)
   {
+    std::ostream& out = OutputManager::getStream();
+
     SF_FORMAT_INFO info;
     int format = 0;
     int major_count;
@@ -219,7 +312,7 @@ namespace ReSampler {
       if (sf != subFormats.end()) {
         format = info.format | sf->second;
       } else {
-        std::cout << "Warning: bit format " << bitFormat << " not recognised !" << std::endl;
+        out << "Warning: bit format " << bitFormat << " not recognised !" << std::endl;
       }
     }
 
@@ -275,6 +368,19 @@ namespace ReSampler {
   }
   //}}}
 
+  //{{{
+  // getWorkerPool() : returns the process-wide pool used by the central conversion loop.
+  // The pool is created on first use and sized to the hardware concurrency (not the channel count),
+  // so that threads are never spawned / joined per block, and are shared by successive conversions.
+  // Note: a conversion pushes one task per channel per block, so it keeps at most nChannels workers busy
+  // (a stereo file uses 2 cores). A channel's block cannot be split between workers, because each converter
+  // carries its filter history from one sample to the next; to use more cores, convert several files at once (batch mode).
+  ctpl::thread_pool& getWorkerPool() {
+    static ctpl::thread_pool pool(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    return pool;
+  }
+  //}}}
+
   //{{{
   // explicit instantiations - generate all required flavors of convert()
   bool convert_DffFile_Float (ConversionInfo& ci) {
@@ -322,6 +428,7 @@ namespace ReSampler {
   seek(position, whence)
   */
 
+    std::ostream& out = OutputManager::getStream(); // (console, or this thread's own stream: see runBatch())
     bool multiThreaded = ci.bMultiThreaded;
 
     // pointer for temp file;
@@ -347,7 +454,7 @@ namespace ReSampler {
         infileFormat = SF_FORMAT_RAW | infileSubFormat;
         infileChannels = ci.rawInputChannels;
         infileRate = ci.rawInputSampleRate;
-        std::cout << "raw input" << std::endl;
+        out << "raw input" << std::endl;
       }
     }
 
@@ -355,10 +462,18 @@ namespace ReSampler {
     FileReader infile(ci.inputFilename, infileMode, infileFormat, infileChannels, infileRate);
 
     if (int e = infile.error()) {
-      std::cout << "Error: Couldn't Open Input File (" << sf_error_number(e) << ")" << std::endl;
+      out << "Error: Couldn't Open Input File (" << sf_error_number(e) << ")" << std::endl;
       return false;
     }
 
+    // decode DSD input directly to PCM (instead of converting from the DSD sample rate):
+    if (ci.bDsdFrontEnd) {
+      unsigned int dsdSampleRate = infile.samplerate();
+      if (enableDsdFrontEnd(infile, ci.outputSampleRate)) {
+        out << "DSD front end: decimating from " << dsdSampleRate << " to " << infile.samplerate() << std::endl;
+      }
+    }
+
     // read input file metadata:
     MetaData m;
     getMetaData(m, infile);
@@ -381,13 +496,18 @@ namespace ReSampler {
 
     // allocate buffers:
     std::vector<FloatType> inputBlock(inputBlockSize, 0);   // input buffer for storing interleaved samples from input file
-    std::vector<FloatType> outputBlock(outputBlockSize, 0);   // output buffer for storing interleaved samples to be saved to output file
     std::vector<std::vector<FloatType>> inputChannelBuffers;  // input buffer for each channel to store deinterleaved samples
     std::vector<std::vector<FloatType>> outputChannelBuffers; // output buffer for each channel to store converted deinterleaved samples
     for (int n = 0; n < nChannels; n++) {
       inputChannelBuffers.emplace_back(std::vector<FloatType>(inputChannelBufferSize, 0));
       outputChannelBuffers.emplace_back(std::vector<FloatType>(outputChannelBufferSize, 0));
     }
+    std::vector<FloatType*> inputChannelPointers;        // (for deinterleave())
+    std::vector<const FloatType*> outputChannelPointers; // (for interleave())
+    for (int n = 0; n < nChannels; n++) {
+      inputChannelPointers.push_back(inputChannelBuffers[n].data());
+      outputChannelPointers.push_back(outputChannelBuffers[n].data());
+    }
 
     int inputFileFormat = infile.format();
     if (inputFileFormat != DFF_FORMAT && inputFileFormat != DSF_FORMAT) { // this block only relevant to libsndfile ...
@@ -405,21 +525,21 @@ namespace ReSampler {
 
       for (auto& subformat : subFormats) { // scan subformats for a match:
         if (subformat.second == (inputFileFormat & SF_FORMAT_SUBMASK)) {
-          std::cout << "input bit format: " << subformat.first;
+          out << "input bit format: " << subformat.first;
           break;
         }
       }
 
       if (bFloat)
-        std::cout << " (float)";
+        out << " (float)";
       if (bDouble)
-        std::cout << " (double precision)";
+        out << " (double precision)";
 
-      std::cout << std::endl;
+      out << std::endl;
     }
 
-    std::cout << "source file channels: " << nChannels << std::endl;
-    std::cout << "input sample rate: " << ci.inputSampleRate << "\noutput sample rate: " << ci.outputSampleRate << std::endl;
+    out << "source file channels: " << nChannels << std::endl;
+    out << "input sample rate: " << ci.inputSampleRate << "\noutput sample rate: " << ci.outputSampleRate << std::endl;
 
     FloatType peakInputSample;
     sf_count_t peakInputPosition = 0LL;
@@ -428,7 +548,7 @@ namespace ReSampler {
 
     if (ci.bEnablePeakDetection) {
       peakInputSample = 0.0;
-      std::cout << "Scanning input file for peaks ...";
+      out << "Scanning input file for peaks ...";
 
       do {
         samplesRead = infile.read(inputBlock.data(), inputBlockSize);
@@ -441,10 +561,10 @@ namespace ReSampler {
         totalSamplesRead += samplesRead;
       } while (samplesRead > 0);
 
-      std::cout << "Done\n";
-      std::cout << "Peak input sample: " << std::fixed << peakInputSample << " (" << 20 * log10(peakInputSample) << " dBFS) at ";
+      out << "Done\n";
+      out << "Peak input sample: " << std::fixed << peakInputSample << " (" << 20 * log10(peakInputSample) << " dBFS) at ";
       printSamplePosAsTime(peakInputPosition, ci.inputSampleRate);
-      std::cout << std::endl;
+      out << std::endl;
       infile.seek(0, SEEK_SET); // rewind back to start of file
     }
 
@@ -455,24 +575,24 @@ namespace ReSampler {
     }
 
     if (ci.bNormalize) { // echo Normalization settings to user
-      auto prec = std::cout.precision();
-      std::cout << "Normalizing to " << std::setprecision(2) << ci.limit << std::endl;
-      std::cout.precision(prec);
+      auto prec = out.precision();
+      out << "Normalizing to " << std::setprecision(2) << ci.limit << std::endl;
+      out.precision(prec);
     }
 
     // echo filter settings to user:
     double targetNyquist = std::min(ci.inputSampleRate, ci.outputSampleRate) / 2.0;
     double ft = (ci.lpfCutoff / 100.0) * targetNyquist;
-    auto prec = std::cout.precision();
-    std::cout << "LPF transition frequency: " << std::fixed << std::setprecision(2) << ft << " Hz (" << 100 * ft / targetNyquist << " %)" << std::endl;
-    std::cout.precision(prec);
+    auto prec = out.precision();
+    out << "LPF transition frequency: " << std::fixed << std::setprecision(2) << ft << " Hz (" << 100 * ft / targetNyquist << " %)" << std::endl;
+    out.precision(prec);
     if (ci.bMinPhase) {
-      std::cout << "Using Minimum-Phase LPF" << std::endl;
+      out << "Using Minimum-Phase LPF" << std::endl;
     }
 
     // echo conversion ratio to user:
     FloatType resamplingFactor = static_cast<FloatType>(ci.outputSampleRate) / ci.inputSampleRate;
-    std::cout << "Conversion ratio: " << resamplingFactor
+    out << "Conversion ratio: " << resamplingFactor
           << " (" << fraction.numerator << ":" << fraction.denominator << ")" << std::endl;
 
     // if the outputFormat is zero, it means "No change to file format"
@@ -488,7 +608,7 @@ namespace ReSampler {
     if ((outputFileFormat & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV || (outputFileFormat & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAVEX) {
       if (ci.bRf64 ||
           checkWarnOutputSize(inputSampleCount, getSfBytesPerSample(outputFileFormat), fraction.numerator, fraction.denominator)) {
-        std::cout << "Switching to rf64 format !" << std::endl;
+        out << "Switching to rf64 format !" << std::endl;
         outputFileFormat &= ~SF_FORMAT_TYPEMASK; // clear file type
         outputFileFormat |= SF_FORMAT_RF64;
       }
@@ -528,12 +648,12 @@ namespace ReSampler {
 
     // confirm dithering options for user:
     if (ci.bDither) {
-      auto prec = std::cout.precision();
-      std::cout << "Generating " << std::setprecision(2) << ci.ditherAmount << " bits of " << ditherProfileList[ci.ditherProfileID].name << " dither for " << outputSignalBits << "-bit output format";
-      std::cout.precision(prec);
+      auto prec = out.precision();
+      out << "Generating " << std::setprecision(2) << ci.ditherAmount << " bits of " << ditherProfileList[ci.ditherProfileID].name << " dither for " << outputSignalBits << "-bit output format";
+      out.precision(prec);
       if (ci.bAutoBlankingEnabled)
-        std::cout << ", with auto-blanking";
-      std::cout << std::endl;
+        out << ", with auto-blanking";
+      out << std::endl;
     }
 
     // make a vector of ditherers (one ditherer for each channel):
@@ -548,11 +668,36 @@ namespace ReSampler {
       ditherers.emplace_back(outputSignalBits, ci.ditherAmount, ci.bAutoBlankingEnabled, n + seed, static_cast<DitherProfileID>(ci.ditherProfileID));
     }
 
+    // compare the candidate multi-stage configurations (predicted vs measured cost):
+    if (ci.bShowStages && !ci.bSingleStage && ci.inputSampleRate != ci.outputSampleRate) {
+      showConversionPlans<FloatType>(ci);
+    }
+
     // make a vector of Resamplers
+    auto filterBegin = std::chrono::high_resolution_clock::now();
+    int filtersLoaded = getFilterCacheStats().loaded;
+    int filtersSaved = getFilterCacheStats().saved;
+    // (the plan of stages is chosen once, and shared by every channel)
     std::vector<Converter<FloatType>> converters;
     converters.reserve(static_cast<size_t>(nChannels));
+    ConversionPlan plan = Converter<FloatType>::choosePlan(ci);
     for (int n = 0; n < nChannels; n++) {
-      converters.emplace_back(ci);
+      converters.emplace_back(ci, plan);
+    }
+
+    // report filter start-up time (so that the effect of the filter cache can be seen):
+    if (!ci.filterCacheDir.empty() || ci.bShowStages) {
+      double filterSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - filterBegin).count();
+      filtersLoaded = getFilterCacheStats().loaded - filtersLoaded;
+      filtersSaved = getFilterCacheStats().saved - filtersSaved;
+      out << "Filter initialization: " << filterSeconds * 1000.0 << " ms";
+      if (filtersLoaded != 0) {
+        out << " (" << filtersLoaded << " filter(s) loaded from filter cache)";
+      }
+      if (filtersSaved != 0) {
+        out << " (" << filtersSaved << " filter(s) designed, and saved to filter cache)";
+      }
+      out << std::endl;
     }
 
     // Calculate initial gain:
@@ -560,17 +705,53 @@ namespace ReSampler {
         static_cast<FloatType>(ci.bNormalize ? fraction.numerator * (ci.limit / static_cast<double>(peakInputSample)) : fraction.numerator * ci.limit);
 
     // todo: more testing with very low bit depths (eg 4 bits)
+    FloatType ditherCompensation = 1.0;
     if (ci.bDither) { // allow headroom for dithering:
-      FloatType ditherCompensation =
+      ditherCompensation =
           (pow(2, outputSignalBits - 1) - pow(2, ci.ditherAmount - 1)) / pow(2, outputSignalBits - 1); // eg 32767/32768 = 0.999969 (-0.00027 dB)
       gain *= ditherCompensation;
     }
 
+    // single-pass clipping protection (look-ahead limiter) replaces the temp file:
+    std::unique_ptr<LookAheadLimiter<FloatType>> limiter;
+    size_t limiterFlushSize = 0; // (extra samples released from the look-ahead at the end)
+    FloatType peakLimiterInput = 0.0;
+    if (ci.bLimiter && !ci.disableClippingProtection) {
+      int lookahead = std::max(1, static_cast<int>(std::round(ci.limiterLookahead * ci.outputSampleRate / 1000.0)));
+      limiter.reset(new LookAheadLimiter<FloatType>(nChannels, lookahead, static_cast<FloatType>(ci.limit) * ditherCompensation));
+      limiterFlushSize = static_cast<size_t>(lookahead) * nChannels;
+      ci.bTmpFile = false;
+      auto prec = out.precision();
+      out << "Using look-ahead limiter for clipping protection (" << std::setprecision(2) << ci.limiterLookahead << " ms)" << std::endl;
+      out.precision(prec);
+    }
+
     int groupDelay = static_cast<int>(converters[0].getGroupDelay());
 
+    // blocks for the read -> convert -> write pipeline (allocated once, and recycled through queues):
+    const int numPipelineBlocks = 3;
+    struct InputSlot {
+      std::vector<FloatType> samples;   // interleaved samples from input file
+      sf_count_t count;
+    };
+    struct OutputSlot {
+      std::vector<FloatType> samples;   // interleaved samples to be saved to output file
+      size_t start;
+      size_t count;
+      bool last;
+    };
+    std::vector<InputSlot> inputSlots(numPipelineBlocks);
+    std::vector<OutputSlot> outputSlots(numPipelineBlocks);
+    for (auto& slot : inputSlots) {
+      slot.samples.resize(inputBlockSize, 0);
+    }
+    for (auto& slot : outputSlots) {
+      slot.samples.resize(outputBlockSize + limiterFlushSize, 0);
+    }
+
     FloatType peakOutputSample;
     bool bClippingDetected;
-    RaiiTimer timer(inputDuration);
+    RaiiTimer timer(inputDuration, out);
 
     int clippingProtectionAttempts = 0;
 
@@ -581,6 +762,7 @@ namespace ReSampler {
       bClippingDetected = false;
       std::unique_ptr<SndfileHandle> outFile;
       std::unique_ptr<CsvFile> csvFile;
+      std::unique_ptr<NpyFile> npyFile;
 
       if (ci.csvOutput) { // csv output
         csvFile.reset(new CsvFile(ci.outputFilename));
@@ -628,6 +810,14 @@ namespace ReSampler {
         }
       }
 
+      else if (ci.npyOutput) { // npy output (float32, or float64 if the bit format is 64f)
+        npyFile.reset(new NpyFile(ci.outputFilename, nChannels, ci.outBitFormat == "64f"));
+        if (npyFile->isErr()) {
+          out << "Error: Couldn't Open Output File " << ci.outputFilename << std::endl;
+          return false;
+        }
+      }
+
       else {
        //{{{  libSndFile output
 
@@ -638,7 +828,7 @@ namespace ReSampler {
            outFile.reset(new SndfileHandle(ci.outputFilename, SFM_WRITE, outputFileFormat, nChannels, ci.outputSampleRate));
 
            if (int e = outFile->error()) {
-             std::cout << "Error: Couldn't Open Output File (" << sf_error_number(e) << ")" << std::endl;
+             out << "Error: Couldn't Open Output File (" << sf_error_number(e) << ")" << std::endl;
              return false;
            }
 
@@ -648,13 +838,13 @@ namespace ReSampler {
 
            if (ci.bWriteMetaData) {
              if (!setMetaData(m, *outFile)) {
-               std::cout << "Warning: problem writing metadata to output file ( " << outFile->strError() << " )" << std::endl;
+               out << "Warning: problem writing metadata to output file ( " << outFile->strError() << " )" << std::endl;
              }
            }
 
            // if the minor (sub) format of outputFileFormat is flac, and user has requested a specific compression level, set compression level:
            if (((outputFileFormat & SF_FORMAT_FLAC) == SF_FORMAT_FLAC) && ci.bSetFlacCompression) {
-             std::cout << "setting flac compression level to " << ci.flacCompressionLevel << std::endl;
+             out << "setting flac compression level to " << ci.flacCompressionLevel << std::endl;
              double cl = ci.flacCompressionLevel / 8.0; // there are 9 flac compression levels from 0-8. Normalize to 0-1.0
              outFile->command(SFC_SET_COMPRESSION_LEVEL, &cl, sizeof(cl));
            }
@@ -662,10 +852,10 @@ namespace ReSampler {
            // if the minor (sub) format of outputFileFormat is vorbis, and user has requested a specific quality level, set quality level:
            if (((outputFileFormat & SF_FORMAT_VORBIS) == SF_FORMAT_VORBIS) && ci.bSetVorbisQuality) {
 
-             auto prec = std::cout.precision();
-             std::cout.precision(1);
-             std::cout << "setting vorbis quality level to " << ci.vorbisQuality << std::endl;
-             std::cout.precision(prec);
+             auto prec = out.precision();
+             out.precision(1);
+             out << "setting vorbis quality level to " << ci.vorbisQuality << std::endl;
+             out.precision(prec);
 
              double cl = (1.0 - ci.vorbisQuality) / 11.0; // Normalize from (-1 to 10), to (1.0 to 0) ... why is it backwards ?
              outFile->command(SFC_SET_COMPRESSION_LEVEL, &cl, sizeof(cl));
@@ -673,7 +863,7 @@ namespace ReSampler {
          }
 
          catch (std::exception& e) {
-           std::cout << "Error: Couldn't Open Output File " << e.what() << std::endl;
+           out << "Error: Couldn't Open Output File " << e.what() << std::endl;
            return false;
          }
        }
@@ -690,7 +880,15 @@ namespace ReSampler {
       // echo conversion mode to user (multi-stage/single-stage, multi-threaded/single-threaded)
       std::string stageness(ci.bMultiStage ? "multi-stage" : "single-stage");
       std::string threadedness(ci.bMultiThreaded ? ", multi-threaded" : "");
-      std::cout << "Converting (" << stageness << threadedness << ") ..." << std::endl;
+      std::string polyphase(ci.bPolyphase ? ", polyphase" : "");
+      out << "Converting (" << stageness << threadedness << polyphase << ") ..." << std::endl;
+
+      // note: disable dither for temp files and limiter (dithering to be done in post)
+      const bool ditherInKernel = ci.bDither && !ci.bTmpFile && !limiter;
+      if (limiter) {
+        limiter->reset();
+        peakLimiterInput = 0.0;
+      }
 
       peakOutputSample = 0.0;
       totalSamplesRead = 0;
@@ -699,48 +897,101 @@ namespace ReSampler {
 
       int outStartOffset = std::min(groupDelay * nChannels, static_cast<int>(outputBlockSize) - nChannels);
 
+      struct Result {
+        size_t outFrames;
+        FloatType peak;
+      };
+
+      // worker threads are persistent (created once per process) - only the futures are per-block
+      ctpl::thread_pool& threadPool = getWorkerPool();
+      std::vector<std::future<Result>> results(nChannels);
+
+      // The conversion is a three-stage pipeline: a reader thread, the converters (this thread), and a writer thread.
+      // Blocks circulate between the stages through queues of block indices, so memory use is bounded,
+      // file I/O overlaps with conversion, and blocks are written in the order in which they were read.
+      BlockQueue<int> freeInputs(numPipelineBlocks);
+      BlockQueue<int> fullInputs(numPipelineBlocks);
+      BlockQueue<int> freeOutputs(numPipelineBlocks);
+      BlockQueue<int> fullOutputs(numPipelineBlocks);
+      for (int b = 0; b < numPipelineBlocks; ++b) {
+        freeInputs.push(b);
+        freeOutputs.push(b);
+      }
+
+      std::thread reader([&] {
+        sf_count_t count;
+        do { // (an empty block marks the end of the input)
+          int b = freeInputs.pop();
+          count = infile.read(inputSlots[b].samples.data(), inputBlockSize);
+          inputSlots[b].count = std::max(count, static_cast<sf_count_t>(0));
+          fullInputs.push(b);
+        } while (count > 0);
+      });
+
+      std::thread writer([&] {
+        bool last;
+        do {
+          int b = fullOutputs.pop();
+          const OutputSlot& slot = outputSlots[b];
+          const FloatType* p = slot.samples.data() + slot.start;
+          // write to either temp file or outfile:
+          if (ci.bTmpFile) {
+            tmpSndfileHandle->write(p, slot.count);
+          }
+          else if (ci.csvOutput) {
+            csvFile->write(p, slot.count);
+          }
+          else if (ci.npyOutput) {
+            npyFile->write(p, slot.count);
+          }
+          else {
+            outFile->write(p, slot.count);
+          }
+          last = slot.last;
+          freeOutputs.push(b);
+        } while (!last);
+      });
+
       do { // central conversion loop (the heart of the matter ...)
 
-        // Grab a block of interleaved samples from file:
-        samplesRead = infile.read(inputBlock.data(), inputBlockSize);
+        // Grab a block of interleaved samples from the reader:
+        int inputIndex = fullInputs.pop();
+        const FloatType* inputSamples = inputSlots[inputIndex].samples.data();
+        samplesRead = inputSlots[inputIndex].count;
         totalSamplesRead += samplesRead;
 
         // de-interleave into channel buffers
-        size_t i = 0;
-        for (int s = 0; s < samplesRead; s += nChannels) {
-          for (int ch = 0; ch < nChannels; ++ch) {
-            inputChannelBuffers[ch][i] = inputBlock[s + ch];
-          }
-          ++i;
-        }
-
-        struct Result {
-          size_t outBlockindex;
-          FloatType peak;
-        };
+        size_t i = static_cast<size_t>(samplesRead / nChannels);
+        deinterleave(inputSamples, inputChannelPointers.data(), i, nChannels);
+        freeInputs.push(inputIndex); // (input block can be refilled as soon as it has been de-interleaved)
 
-        std::vector<std::future<Result>> results(nChannels);
-        ctpl::thread_pool threadPool(nChannels);
-        size_t outputBlockIndex = 0;
+        int outputIndex = freeOutputs.pop();
+        OutputSlot& outputSlot = outputSlots[outputIndex];
+        FloatType* outputBlock = outputSlot.samples.data();
+        size_t outputFrames = 0;
+        FloatType blockPeak = 0.0;
 
         for (int ch = 0; ch < nChannels; ++ch) { // run convert stage for each channel (concurrently)
 
+          // each channel is staged in its own output buffer (so that threads don't write to the same cache lines),
+          // and the channels are interleaved into the output block in one pass, once they are all complete
           auto kernel = [&, ch](int) {
             FloatType* iBuf = inputChannelBuffers[ch].data();
             FloatType* oBuf = outputChannelBuffers[ch].data();
             size_t o = 0;
             FloatType localPeak = 0.0;
-            size_t localOutputBlockIndex = 0;
             converters[ch].convert(oBuf, o, iBuf, i);
             for (size_t f = 0; f < o; ++f) {
-              // note: disable dither for temp files (dithering to be done in post)
-              FloatType outputSample = (ci.bDither && !ci.bTmpFile) ? ditherers[ch].dither(gain * oBuf[f]) : gain * oBuf[f]; // gain, dither
-              localPeak = std::max(localPeak, std::abs(outputSample)); // peak
-              outputBlock[localOutputBlockIndex + ch] = outputSample; // interleave
-              localOutputBlockIndex += nChannels;
+              oBuf[f] *= gain; // gain
+            }
+            if (ditherInKernel) {
+              ditherers[ch].dither(oBuf, oBuf, o); // dither (in-place)
+            }
+            for (size_t f = 0; f < o; ++f) {
+              localPeak = std::max(localPeak, std::abs(oBuf[f])); // peak
             }
             Result res{};
-            res.outBlockindex = localOutputBlockIndex;
+            res.outFrames = o;
             res.peak = localPeak;
             return res;
           };
@@ -750,31 +1001,53 @@ namespace ReSampler {
           }
           else {
             Result res = kernel(0);
-            peakOutputSample = std::max(peakOutputSample, res.peak);
-            outputBlockIndex = res.outBlockindex;
+            blockPeak = std::max(blockPeak, res.peak);
+            outputFrames = res.outFrames;
           }
         }
 
-        if (multiThreaded) { // collect results:
+        if (multiThreaded) { // collect results (barrier: block is complete when every channel has finished)
           for (int ch = 0; ch < nChannels; ++ch) {
             Result res = results[ch].get();
-            peakOutputSample = std::max(peakOutputSample, res.peak);
-            outputBlockIndex = res.outBlockindex;
+            blockPeak = std::max(blockPeak, res.peak);
+            outputFrames = res.outFrames;
           }
         }
 
-        // write to either temp file or outfile (with Group Delay Compensation):
-        if (ci.bTmpFile) {
-          tmpSndfileHandle->write(outputBlock.data() + outStartOffset, outputBlockIndex - outStartOffset);
-        }
-        else {
-          if (ci.csvOutput) {
-            csvFile->write(outputBlock.data() + outStartOffset, outputBlockIndex - outStartOffset);
+        interleave(outputChannelPointers.data(), outputBlock, outputFrames, nChannels);
+        size_t outputBlockIndex = outputFrames * nChannels;
+
+        // (Group Delay Compensation):
+        size_t writeStart = outStartOffset;
+        size_t writeCount = outputBlockIndex - outStartOffset;
+
+        if (limiter) {
+          // limit (in-place, LookAheadLimiter stores each frame before writing any output, see --testLimiter), then dither
+          // (the limiter holds back its look-ahead; release it at the end of the input, the block has room for it):
+          peakLimiterInput = std::max(peakLimiterInput, blockPeak);
+          writeCount = limiter->process(outputBlock + writeStart, writeCount, outputBlock);
+          if (samplesRead == 0) {
+            writeCount += limiter->flush(outputBlock + writeCount);
           }
-          else {
-            outFile->write(outputBlock.data() + outStartOffset, outputBlockIndex - outStartOffset);
+          writeStart = 0;
+          if (ci.bDither) { // (each channel in-place, in the interleaved block)
+            for (int ch = 0; ch < nChannels; ++ch) {
+              ditherers[ch].dither(outputBlock + ch, outputBlock + ch, writeCount / nChannels, nChannels);
+            }
           }
+          for (size_t s = 0; s < writeCount; ++s) {
+            peakOutputSample = std::max(std::abs(outputBlock[s]), peakOutputSample);
+          }
+        }
+        else {
+          peakOutputSample = std::max(peakOutputSample, blockPeak);
         }
+
+        // hand the block to the writer:
+        outputSlot.start = writeStart;
+        outputSlot.count = writeCount;
+        outputSlot.last = (samplesRead == 0);
+        fullOutputs.push(outputIndex);
         outStartOffset = 0; // reset after first use
 
         // conditionally send progress update:
@@ -786,22 +1059,44 @@ namespace ReSampler {
 
       } while (samplesRead > 0); // ends central conversion loop
 
+      reader.join();
+      writer.join();
+
+      { // report time each stage spent stalled:
+        auto prec = out.precision();
+        out << std::fixed << std::setprecision(1)
+                  << "Pipeline stalls: reader " << 1000.0 * freeInputs.getWaitTime() << " ms (waiting for converter), "
+                  << "converter " << 1000.0 * fullInputs.getWaitTime() << " ms (waiting for reader) + "
+                  << 1000.0 * freeOutputs.getWaitTime() << " ms (waiting for writer), "
+                  << "writer " << 1000.0 * fullOutputs.getWaitTime() << " ms (waiting for converter)" << std::endl;
+        out.unsetf(std::ios_base::floatfield);
+        out.precision(prec);
+      }
+
       if (ci.bTmpFile) {
         gain = 1.0; // output file must start with unity gain relative to temp file
       }
       else {
         // notify user:
-        std::cout << "Done" << std::endl;
-        auto prec = std::cout.precision();
-        std::cout << "Peak output sample: " << std::setprecision(6) << peakOutputSample << " (" << 20 * log10(peakOutputSample) << " dBFS)" << std::endl;
-        std::cout.precision(prec);
+        out << "Done" << std::endl;
+        auto prec = out.precision();
+        out << "Peak output sample: " << std::setprecision(6) << peakOutputSample << " (" << 20 * log10(peakOutputSample) << " dBFS)" << std::endl;
+        if (limiter) {
+          out << "Limiter: peak input " << peakLimiterInput << " (" << 20 * log10(peakLimiterInput) << " dBFS), "
+                    << limiter->getFramesLimited() << " frames limited, max gain reduction "
+                    << -20 * log10(limiter->getMinGain()) << " dB" << std::endl;
+          if (limiter->getFramesOverLimit() != 0) {
+            out << "Warning: limiter gain exceeded the required gain on " << limiter->getFramesOverLimit() << " frames" << std::endl;
+          }
+        }
+        out.precision(prec);
       }
 
       do {
         // test for clipping:
         if (!ci.disableClippingProtection && peakOutputSample > ci.limit) {
 
-          std::cout << "\nClipping detected !" << std::endl;
+          out << "\nClipping detected !" << std::endl;
 
           // calculate gain adjustment
           FloatType gainAdjustment = static_cast<FloatType>(clippingTrim) * ci.limit / peakOutputSample;
@@ -809,10 +1104,10 @@ namespace ReSampler {
 
           // echo gain adjustment to user - use slightly differnt message if using temp file:
           if (ci.bTmpFile) {
-            std::cout << "Adjusting gain by " << 20 * log10(gainAdjustment) << " dB" << std::endl;
+            out << "Adjusting gain by " << 20 * log10(gainAdjustment) << " dB" << std::endl;
           }
           else {
-            std::cout << "Re-doing with " << 20 * log10(gainAdjustment) << " dB gain adjustment" << std::endl;
+            out << "Re-doing with " << 20 * log10(gainAdjustment) << " dB gain adjustment" << std::endl;
           }
 
           // reset the ditherers
@@ -833,14 +1128,20 @@ namespace ReSampler {
         // if using temp file, write to outFile
         if (ci.bTmpFile) {
 
-          std::cout << "Writing to output file ...\n";
+          out << "Writing to output file ...\n";
           std::vector<FloatType> outBuf(inputBlockSize, 0);
           peakOutputSample = 0.0;
           totalSamplesRead = 0;
           nextProgressThreshold = incrementalProgressThreshold;
 
           tmpSndfileHandle->seek(0, SEEK_SET);
-          if (!ci.csvOutput) {
+          if (ci.csvOutput) {
+            csvFile->rewind();
+          }
+          else if (ci.npyOutput) {
+            npyFile->rewind();
+          }
+          else {
             outFile->seek(0, SEEK_SET);
           }
 
@@ -848,21 +1149,27 @@ namespace ReSampler {
             samplesRead = tmpSndfileHandle->read(inputBlock.data(), inputBlockSize);
             totalSamplesRead += samplesRead;
 
-            // de-interleave into channels, apply gain, add dither, and save to output buffer
-            size_t i = 0;
-            for (int s = 0; s < samplesRead; s += nChannels) {
+            // apply gain, add dither (to each channel of the interleaved block), and save to output buffer
+            size_t i = static_cast<size_t>(samplesRead);
+            for (size_t s = 0; s < i; ++s) {
+              outBuf[s] = gain * inputBlock[s];
+            }
+            if (ci.bDither) {
               for (int ch = 0; ch < nChannels; ++ch) {
-                FloatType smpl = ci.bDither ? ditherers[ch].dither(gain * inputBlock[i]) :
-                                gain * inputBlock[i];
-                peakOutputSample = std::max(std::abs(smpl), peakOutputSample);
-                outBuf[i++] = smpl;
+                ditherers[ch].dither(outBuf.data() + ch, outBuf.data() + ch, i / nChannels, nChannels);
               }
             }
+            for (size_t s = 0; s < i; ++s) {
+              peakOutputSample = std::max(std::abs(outBuf[s]), peakOutputSample);
+            }
 
             // write output buffer to outfile
             if (ci.csvOutput) {
               csvFile->write(outBuf.data(), i);
             }
+            else if (ci.npyOutput) {
+              npyFile->write(outBuf.data(), i);
+            }
             else {
               outFile->write(outBuf.data(), i);
             }
@@ -877,10 +1184,10 @@ namespace ReSampler {
 
           } while (samplesRead > 0);
 
-          std::cout << "Done" << std::endl;
-          auto prec = std::cout.precision();
-          std::cout << "Peak output sample: " << std::setprecision(6) << peakOutputSample << " (" << 20 * log10(peakOutputSample) << " dBFS)" << std::endl;
-          std::cout.precision(prec);
+          out << "Done" << std::endl;
+          auto prec = out.precision();
+          out << "Peak output sample: " << std::setprecision(6) << peakOutputSample << " (" << 20 * log10(peakOutputSample) << " dBFS)" << std::endl;
+          out.precision(prec);
 
         } // ends if (ci.bTmpFile)
 
@@ -914,6 +1221,7 @@ namespace ReSampler {
   // Returns nullptr if unsuccessful.
 
   template <typename FloatType> SndfileHandle* getTempFile (int inputFileFormat, int nChannels, const ConversionInfo& ci, std::string& tmpFilename) {
+    std::ostream& out = OutputManager::getStream();
 
     SndfileHandle* tmpSndfileHandle = nullptr;
     bool tmpFileError;
@@ -949,7 +1257,7 @@ namespace ReSampler {
         tmpFileError = false;
         std::wstring_convert<std::codecvt_utf8<wchar_t>> wchar2utf8;
         tmpFilename = wchar2utf8.to_bytes(_tmpFilename);
-        if (ci.bShowTempFile) std::cout << "Temp Filename: " << tmpFilename << std::endl;
+        if (ci.bShowTempFile) out << "Temp Filename: " << tmpFilename << std::endl;
         tmpSndfileHandle = new SndfileHandle(tmpFilename, SFM_RDWR, tmpFileFormat, nChannels, ci.outputSampleRate); // open using filename
       }
     }
@@ -980,15 +1288,15 @@ namespace ReSampler {
     // tmpnam() method
     tmpFileError = false;
     tmpFilename = std::string(std::string(std::tmpnam(nullptr)) + ".wav");
-    if (ci.bShowTempFile) std::cout << "Temp Filename: " << tmpFilename << std::endl;
+    if (ci.bShowTempFile) out << "Temp Filename: " << tmpFilename << std::endl;
     tmpSndfileHandle = new SndfileHandle(tmpFilename, SFM_RDWR, tmpFileFormat, nChannels, ci.outputSampleRate); // open using filename
 
   #endif
 
     int e = 0;
     if (tmpFileError || tmpSndfileHandle == nullptr || (e = tmpSndfileHandle->error())) {
-      std::cout << "Error: Couldn't Open Temporary File (" << sf_error_number(e) << ")\n";
-      std::cout << "Disabling temp file mode." << std::endl;
+      out << "Error: Couldn't Open Temporary File (" << sf_error_number(e) << ")\n";
+      out << "Disabling temp file mode." << std::endl;
       tmpSndfileHandle = nullptr;
     }
     else {
@@ -1009,6 +1317,8 @@ namespace ReSampler {
   //{{{
   // retrieve metadata using libsndfile API :
   bool getMetaData (MetaData& metadata, SndfileHandle& infile) {
+    std::ostream& out = OutputManager::getStream();
+
     const char* empty = "";
     const char* str;
 
@@ -1027,7 +1337,7 @@ namespace ReSampler {
     metadata.has_bext_fields = (infile.command(SFC_GET_BROADCAST_INFO, (void*)&metadata.broadcastInfo, sizeof(SF_BROADCAST_INFO)) == SF_TRUE);
 
     if (metadata.has_bext_fields) {
-      std::cout << "Input file contains a Broadcast Extension (bext) chunk" << std::endl;
+      out << "Input file contains a Broadcast Extension (bext) chunk" << std::endl;
     }
 
     // retrieve cart chunk, if it exists:
@@ -1038,7 +1348,7 @@ namespace ReSampler {
       if (metadata.cartInfo.tag_text_size > MAX_CART_TAG_TEXT_SIZE) {
         metadata.cartInfo.tag_text_size = MAX_CART_TAG_TEXT_SIZE; // apply hard limit on number of characters (spec says unlimited ...)
       }
-      std::cout << "Input file contains a cart chunk" << std::endl;
+      out << "Input file contains a cart chunk" << std::endl;
     }
     return true;
   }
@@ -1046,8 +1356,9 @@ namespace ReSampler {
   //{{{
   // set metadata using libsndfile API :
   bool setMetaData (const MetaData& metadata, SndfileHandle& outfile) {
+    std::ostream& out = OutputManager::getStream();
 
-    std::cout << "Writing Metadata" << std::endl;
+    out << "Writing Metadata" << std::endl;
     if (!metadata.title.empty()) outfile.setString(SF_STR_TITLE, metadata.title.c_str());
     if (!metadata.copyright.empty()) outfile.setString(SF_STR_COPYRIGHT, metadata.copyright.c_str());
     if (!metadata.software.empty()) outfile.setString(SF_STR_SOFTWARE, metadata.software.c_str());
@@ -1129,11 +1440,13 @@ namespace ReSampler {
   //{{{
   bool checkWarnOutputSize (sf_count_t inputSamples, int bytesPerSample, int numerator, int denominator)
   {
+    std::ostream& out = OutputManager::getStream();
+
     sf_count_t outputDataSize = inputSamples * bytesPerSample * numerator / denominator;
 
     const sf_count_t limit4G = 1ULL << 32;
     if (outputDataSize >= limit4G) {
-      std::cout << "Warning: output file ( " << fmtNumberWithCommas(outputDataSize) << " bytes of data ) will exceed 4GB limit" << std::endl;
+      out << "Warning: output file ( " << fmtNumberWithCommas(outputDataSize) << " bytes of data ) will exceed 4GB limit" << std::endl;
       return true;
     }
     return false;
@@ -1153,16 +1466,35 @@ namespace ReSampler {
   //}}}
   //{{{
   void printSamplePosAsTime (sf_count_t samplePos, unsigned int sampleRate) {
+    std::ostream& out = OutputManager::getStream();
+
     double seconds = static_cast<double>(samplePos) / sampleRate;
     auto h = static_cast<int>(seconds / 3600);
     auto m = static_cast<int>((seconds - (h * 3600)) / 60);
     double s = seconds - (h * 3600) - (m * 60);
-    std::ios::fmtflags f(std::cout.flags());
-    std::cout << std::setprecision(0) << h << ":" << m << ":" << std::setprecision(6) << s;
-    std::cout.flags(f);
+    std::ios::fmtflags f(out.flags());
+    out << std::setprecision(0) << h << ":" << m << ":" << std::setprecision(6) << s;
+    out.flags(f);
   }
   //}}}
 
+  //{{{
+  bool enableDsdFrontEnd (SndfileHandle& infile, unsigned int outputSampleRate) {
+    (void)infile; // unused
+    (void)outputSampleRate; // unused
+    return false; // (not DSD)
+  }
+  //}}}
+  //{{{
+  bool enableDsdFrontEnd (DsfFile& infile, unsigned int outputSampleRate) {
+    return infile.enableDecimation(outputSampleRate);
+  }
+  //}}}
+  //{{{
+  bool enableDsdFrontEnd (DffFile& infile, unsigned int outputSampleRate) {
+    return infile.enableDecimation(outputSampleRate);
+  }
+  //}}}
   //{{{
   bool testSetMetaData (DsfFile& outfile) {
     (void)outfile; // unused
@@ -1245,60 +1577,28 @@ namespace ReSampler {
   //{{{
   bool checkSSE2() {
 
-    #if defined (_MSC_VER) || defined (__INTEL_COMPILER)
-
-      bool bSSE2ok = false;
-      int CPUInfo[4] = { 0,0,0,0 };
-      __cpuid (CPUInfo, 0);
-
-      if (CPUInfo[0] != 0) {
-        __cpuid (CPUInfo, 1);
-
-        if (CPUInfo[3] & (1 << 26))
-          bSSE2ok = true;
-        }
-
-      if (bSSE2ok) {
-        std::cout << "CPU supports SSE2 (ok)";
-        return true;
-        }
-      else {
-        std::cout << "Your CPU doesn't support SSE2 - please try a non-SSE2 build on this machine" << std::endl;
-        return false;
-        }
-    #endif // defined (_MSC_VER) || defined (__INTEL_COMPILER)
-
-    return true; // todo: fix the check on gcc
+    if (getCpuFeatures().sse2) {
+      std::cout << "CPU supports SSE2 (ok)";
+      return true;
+      }
+    else {
+      std::cout << "Your CPU doesn't support SSE2 - please try a non-SSE2 build on this machine" << std::endl;
+      return false;
+      }
     }
   //}}}
   //{{{
   bool checkAVX() {
+  // Note: getCpuFeatures() confirms both CPU and OS capability
 
-    #if defined (_MSC_VER) || defined (__INTEL_COMPILER)
-      // Verify CPU capabilities:
-      bool bAVXok = false;
-      int cpuInfo[4] = { 0,0,0,0 };
-      __cpuid(cpuInfo, 0);
-
-      if (cpuInfo[0] != 0) {
-        __cpuid(cpuInfo, 1);
-        if (cpuInfo[2] & (1 << 28)) {
-          bAVXok = true; // Note: this test only confirms CPU AVX capability, and does not check OS capability.
-          // to-do: check for AVX2 ...
-          }
-        }
-
-      if (bAVXok) {
-        std::cout << "CPU supports AVX (ok)";
-        return true;
-        }
-      else {
-        std::cout << "Your CPU doesn't support AVX - please try a non-AVX build on this machine" << std::endl;
-        return false;
-        }
-    #endif // defined (_MSC_VER) || defined (__INTEL_COMPILER)
-
-    return true; // todo: gcc detection
+    if (getCpuFeatures().avx) {
+      std::cout << "CPU supports AVX (ok)";
+      return true;
+      }
+    else {
+      std::cout << "Your CPU doesn't support AVX - please try a non-AVX build on this machine" << std::endl;
+      return false;
+      }
     }
   //}}}
   //{{{
@@ -1316,6 +1616,9 @@ namespace ReSampler {
           std::cout << "\nusing FMA (Fused Multiply-Add) instruction ... ";
         #endif
       #endif // USE_AVX
+      #ifdef USE_CPU_DISPATCH
+        std::cout << " (FIR kernel: " << getBestFIRKernel<float>().name << ")";
+      #endif
       std::cout << std::endl;
 
     #else
@@ -1367,39 +1670,9 @@ namespace ReSampler {
   //}}}
 
   //{{{
-  int runCommand (int argc, char** argv) {
-
-    // test for global options
-    if (parseGlobalOptions(argc, argv)) {
-      return EXIT_SUCCESS;
-    }
-
-    // ConversionInfo instance to hold parameters
-    ConversionInfo ci;
-
-    // get path/name of this app
-    ci.appName = argv[0];
-    ci.overSamplingFactor = 1;
-
-    // get conversion parameters
-    ci.fromCmdLineArgs(argc, argv);
-    if (ci.bBadParams) {
-      std::cout << strUsage << std::endl;
-      return EXIT_FAILURE;
-    }
-
-    // query build version AND cpu
-    if (!showBuildVersion()) {
-      return EXIT_FAILURE; // can't continue (CPU / build mismatch)
-    }
-
-    // echo filenames to user
-    std::cout << "Input file: " << ci.inputFilename << std::endl;
-    std::cout << "Output file: " << ci.outputFilename << std::endl;
-
-    if (ci.disableClippingProtection) {
-      std::cout << "clipping protection disabled " << std::endl;
-    }
+  // determineFileFormats() : set input type (dsf / dff) and output format / csv output, from the file extensions and bit format
+  void determineFileFormats (ConversionInfo& ci) {
+    std::ostream& out = OutputManager::getStream();
 
     // Isolate the file extensions
     std::string inFileExt;
@@ -1417,18 +1690,23 @@ namespace ReSampler {
     ci.dsfInput = (inFileExt == "dsf");
     ci.dffInput = (inFileExt == "dff");
 
-    // detect csv output
+    // detect csv / npy output
     ci.csvOutput = (outFileExt == "csv");
+    ci.npyOutput = (outFileExt == "npy");
 
     if (ci.csvOutput) {
-      std::cout << "Outputting to csv format" << std::endl;
+      out << "Outputting to csv format" << std::endl;
+    }
+
+    else if (ci.npyOutput) {
+      out << "Outputting to npy format (" << (ci.outBitFormat == "64f" ? "float64" : "float32") << ")" << std::endl;
     }
 
     else {
       if (!ci.outBitFormat.empty()) {  // new output bit format requested
         ci.outputFormat = determineOutputFormat(outFileExt, ci.outBitFormat);
         if (ci.outputFormat) {
-          std::cout << "Changing output bit format to " << ci.outBitFormat << std::endl;
+          out << "Changing output bit format to " << ci.outBitFormat << std::endl;
         }
         else { // user-supplied bit format not valid; try choosing appropriate format
           std::string outBitFormat;
@@ -1436,10 +1714,10 @@ namespace ReSampler {
           ci.outputFormat = determineOutputFormat(outFileExt, outBitFormat);
           if (ci.outputFormat) {
             ci.outBitFormat = outBitFormat;
-            std::cout << "Changing output bit format to " << ci.outBitFormat << std::endl;
+            out << "Changing output bit format to " << ci.outBitFormat << std::endl;
           }
           else {
-            std::cout << "Warning: NOT Changing output file bit format !" << std::endl;
+            out << "Warning: NOT Changing output file bit format !" << std::endl;
             ci.outputFormat = 0; // back where it started
           }
         }
@@ -1449,64 +1727,476 @@ namespace ReSampler {
 
         std::string outBitFormat{ci.outBitFormat};
         if (ci.outBitFormat.empty()) { // user changed file extension only. Attempt to choose appropriate output sub format:
-          std::cout << "Output Bit Format not specified" << std::endl;
+          out << "Output Bit Format not specified" << std::endl;
           determineBestBitFormat(outBitFormat, ci);
         }
         ci.outputFormat = determineOutputFormat(outFileExt, outBitFormat);
         if (ci.outputFormat) {
           ci.outBitFormat = outBitFormat;
-          std::cout << "Changing output file format to " << outFileExt << std::endl;
+          out << "Changing output file format to " << outFileExt << std::endl;
         } else { // cannot determine subformat of output file
-          std::cout << "Warning: NOT Changing output file format ! (extension different, but format will remain the same)" << std::endl;
+          out << "Warning: NOT Changing output file format ! (extension different, but format will remain the same)" << std::endl;
         }
       }
     }
+  }
+  //}}}
+  //{{{
+  // convertFile() : convert using the engine appropriate to the input file type and requested precision
+  bool convertFile (ConversionInfo& ci) {
 
-    try {
+    if (ci.bUseDoublePrecision) {
+      if (ci.dsfInput) {
+        ci.bEnablePeakDetection = false;
+        return convert_DsfFile_Double(ci);
+      }
 
-      if (ci.bUseDoublePrecision) {
+      if (ci.dffInput) {
+        ci.bEnablePeakDetection = false;
+        return convert_DffFile_Double(ci);
+      }
 
-  #ifdef USE_QUADMATH
-        std::cout << "Using quadruple-precision for calculations.\n";
-  #else
-        std::cout << "Using double precision for calculations." << std::endl;
-  #endif
+      ci.bEnablePeakDetection = true;
+      return convert_SndfileHandle_Double(ci);
+    }
+
+    else {
+      if (ci.dsfInput) {
+        ci.bEnablePeakDetection = false;
+        return convert_DsfFile_Float(ci);
+      }
+
+      if (ci.dffInput) {
+        ci.bEnablePeakDetection = false;
+        return convert_DffFile_Float(ci);
+      }
 
-        if (ci.dsfInput) {
-          ci.bEnablePeakDetection = false;
-          return convert_DsfFile_Double(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+      ci.bEnablePeakDetection = true;
+      return convert_SndfileHandle_Float(ci);
+    }
+  }
+  //}}}
+  //{{{
+  // runBatch() : convert every file listed by a directory or manifest (ci.inputFilename) into a mirrored tree below ci.outputFilename.
+  // Files are converted concurrently (one file per worker thread), and share the process-wide filter coefficient cache.
+  bool runBatch (const ConversionInfo& ci) {
+
+    std::vector<BatchJob> jobs = getBatchJobs(ci.inputFilename, ci.outputFilename, ci.batchExt);
+    if (jobs.empty()) {
+      std::cout << "Error: no input files found in " << ci.inputFilename << std::endl;
+      return false;
+    }
+
+    int numWorkers = (ci.batchJobs > 0) ? ci.batchJobs : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    numWorkers = std::min(numWorkers, static_cast<int>(jobs.size()));
+    std::cout << "Batch mode: " << jobs.size() << " files, " << numWorkers << " concurrent conversion(s)" << std::endl;
+
+    // The console output of the individual conversions is discarded (it would be interleaved): each conversion writes to
+    // a stream of its own (so that no formatting state is shared between threads), and shows no progress.
+    // Instead, a one-line summary is shown as each file completes:
+    std::mutex consoleMutex;
+    int completed = 0;
+    int failures = 0;
+    ctpl::thread_pool batchPool(numWorkers);
+    std::vector<std::future<void>> futures;
+    futures.reserve(jobs.size());
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    for (size_t n = 0; n < jobs.size(); ++n) {
+      futures.push_back(batchPool.push([&, n](int) {
+        const BatchJob& job = jobs[n];
+        ConversionInfo fileCi = ci;
+        fileCi.inputFilename = job.inputFilename;
+        fileCi.outputFilename = job.outputFilename;
+        fileCi.bMultiThreaded = false; // (parallelism is across files instead)
+        fileCi.bShowStages = false;
+
+        NullStreamBuffer nullBuffer;
+        std::ostream nullStream(&nullBuffer);
+        OutputManager::setThreadStream(&nullStream);
+
+        auto fileBegin = std::chrono::high_resolution_clock::now();
+        bool ok = makeDirectories(getParentPath(job.outputFilename));
+        if (ok) {
+          try {
+            determineFileFormats(fileCi);
+            ok = convertFile(fileCi);
+          }
+          catch (const std::exception&) {
+            ok = false;
+          }
         }
+        OutputManager::setThreadStream(nullptr);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - fileBegin).count();
 
-        if (ci.dffInput) {
-          ci.bEnablePeakDetection = false;
-          return convert_DffFile_Double(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+        std::lock_guard<std::mutex> lock(consoleMutex);
+        ++completed;
+        if (!ok) {
+          ++failures;
         }
+        std::cout << "[" << completed << "/" << jobs.size() << "] " << job.inputFilename << " -> " << job.outputFilename
+                  << (ok ? " (" : " FAILED (") << seconds << " s)" << std::endl;
+      }));
+    }
+
+    for (auto& f : futures) {
+      f.get();
+    }
+
+    int designedFloat, reusedFloat, designedDouble, reusedDouble;
+    FilterCoefficientCache<float>::getStats(designedFloat, reusedFloat);
+    FilterCoefficientCache<double>::getStats(designedDouble, reusedDouble);
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
 
-        ci.bEnablePeakDetection = true;
-        return convert_SndfileHandle_Double(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+    std::cout << "Batch complete: " << jobs.size() - failures << " converted, " << failures << " failed, in " << seconds << " s\n"
+              << "Filter designs: " << designedFloat + designedDouble << " computed, " << reusedFloat + reusedDouble << " reused" << std::endl;
+    if (!ci.filterCacheDir.empty()) {
+      std::cout << "Filter cache: " << getFilterCacheStats().loaded << " loaded, " << getFilterCacheStats().saved << " saved" << std::endl;
+    }
 
+    return failures == 0;
+  }
+  //}}}
+  //{{{
+  // testStreamConverter() : convert ci.inputFilename with the file converter (to 64-bit float, with no gain, dither
+  // or clipping protection), and then with StreamConverter (in irregular blocks, pulled one 1024-frame block at a time),
+  // and check that the outputs match sample for sample.
+  template<typename FloatType> bool testStreamConverter (ConversionInfo ci) {
+
+    if (ci.dsfInput || ci.dffInput || ci.bRawInput || ci.csvOutput || ci.npyOutput) {
+      std::cout << "Error: streaming test requires an input and output file supported by libsndfile" << std::endl;
+      return false;
+    }
+
+    // file converter:
+    ci.gain = 1.0;
+    ci.limit = 1.0;
+    ci.bNormalize = false;
+    ci.bDither = false;
+    ci.bLimiter = false;
+    ci.bTmpFile = false;
+    ci.disableClippingProtection = true;
+    ci.outBitFormat = "64f";
+    determineFileFormats(ci);
+    if (!convertFile(ci)) {
+      return false;
+    }
+
+    SndfileHandle infile(ci.inputFilename);
+    SndfileHandle outfile(ci.outputFilename);
+    if (infile.error() || outfile.error()) {
+      std::cout << "Error: couldn't open files for comparison" << std::endl;
+      return false;
+    }
+    const int nChannels = infile.channels();
+    std::vector<double> fileOutput(static_cast<size_t>(outfile.frames() * nChannels));
+    outfile.read(fileOutput.data(), fileOutput.size());
+
+    // streaming converter:
+    const size_t blockSizes[] = { 1, 17, 480, 1024, 4096, 333 };
+    const size_t pullSize = 1024;
+    StreamConverter<FloatType> streamConverter(nChannels, infile.samplerate(), ci.outputSampleRate, 4096, 0, ci);
+    std::vector<FloatType> inputBlock(4096 * nChannels);
+    std::vector<FloatType> outputBlock(pullSize * nChannels);
+
+    size_t skip = streamConverter.getLatency(); // (the file converter trims the filter delay)
+    size_t compared = 0;
+    double maxDiff = 0.0;
+    sf_count_t framesRead;
+    size_t b = 0;
+    do {
+      framesRead = infile.readf(inputBlock.data(), blockSizes[b++ % 6]);
+      if (!streamConverter.pushInterleaved(inputBlock.data(), static_cast<size_t>(std::max<sf_count_t>(framesRead, 0)))) {
+        std::cout << "\nStreaming test: input block rejected (output FIFO full) - FAILED" << std::endl;
+        return false;
       }
+      while (streamConverter.getAvailableFrames() >= pullSize || (framesRead <= 0 && streamConverter.getAvailableFrames() != 0)) {
+        size_t count = streamConverter.pullInterleaved(outputBlock.data(), pullSize);
+        size_t start = std::min(skip, count);
+        skip -= start;
+        for (size_t f = start; f < count && compared < fileOutput.size(); ++f) {
+          for (int ch = 0; ch < nChannels; ++ch) {
+            maxDiff = std::max(maxDiff, std::abs(static_cast<double>(outputBlock[f * nChannels + ch]) - fileOutput[compared++]));
+          }
+        }
+      }
+    } while (framesRead > 0);
+
+    // (the FFT engine's rounding depends on how the input is divided into blocks):
+    const double tolerance = std::is_same<FloatType, double>::value ? 1.0e-12 : 1.0e-6;
+    bool ok = (compared == fileOutput.size()) && (maxDiff <= tolerance);
+    std::cout << "\nStreaming test: " << compared / nChannels << " of " << fileOutput.size() / nChannels << " frames compared, latency "
+              << streamConverter.getLatency() << " frames, max difference " << maxDiff
+              << (maxDiff == 0.0 ? " (bit-identical)" : "") << (ok ? " - passed" : " - FAILED") << std::endl;
+    return ok;
+  }
+  //}}}
+  //{{{
+  // convertStream() : convert a wav (or raw PCM) stream, eg from stdin to stdout, without seeking.
+  // The input is read and converted in small fixed-size blocks, and each block is written as soon as it has been
+  // converted, so memory use is bounded and the delay through the pipeline is constant (regardless of the length of the input).
+  // Clipping protection is provided by the look-ahead limiter (the two-pass method needs the whole output before writing).
+  template<typename FloatType> bool convertStream (const ConversionInfo& ci) {
+
+    PcmFormat rawFormat{pcm16, 0, 0};
+    if (ci.bRawInput) {
+      rawFormat.numChannels = ci.rawInputChannels;
+      rawFormat.sampleRate = ci.rawInputSampleRate;
+      if (!getPcmSampleFormat(ci.rawInputBitFormat, rawFormat.sampleFormat)) {
+        std::cout << "Error: bit format " << ci.rawInputBitFormat << " not supported for streaming raw input" << std::endl;
+        return false;
+      }
+    }
 
-      else {
+    PcmStreamReader reader(ci.inputFilename, ci.bRawInput, rawFormat);
+    if (reader.isErr()) {
+      std::cout << "Error: " << reader.getErrorMessage() << std::endl;
+      return false;
+    }
+
+    const PcmFormat inputFormat = reader.getFormat();
+    const int nChannels = inputFormat.numChannels;
+    PcmFormat outputFormat{inputFormat.sampleFormat, nChannels, ci.outputSampleRate};
+    if (!ci.outBitFormat.empty() && !getPcmSampleFormat(ci.outBitFormat, outputFormat.sampleFormat)) {
+      std::cout << "Error: bit format " << ci.outBitFormat << " not supported for streaming output (use 8, u8, s8, 16, 24, 32, 32f or 64f)" << std::endl;
+      return false;
+    }
+    if (!ci.bRawOutput && outputFormat.sampleFormat == pcmS8) { // (8-bit wav is always unsigned)
+      outputFormat.sampleFormat = pcmU8;
+    }
+
+    std::cout << "Streaming: " << inputFormat.sampleRate << " Hz, " << getPcmSampleFormatName(inputFormat.sampleFormat)
+              << (ci.bRawInput ? " raw" : " wav") << " -> " << outputFormat.sampleRate << " Hz, " << getPcmSampleFormatName(outputFormat.sampleFormat)
+              << (ci.bRawOutput ? " raw" : " wav") << ", " << nChannels << " channel(s)" << std::endl;
+
+    if (ci.bNormalize) {
+      std::cout << "Warning: normalization needs the whole input, and is not available when streaming (use --gain)" << std::endl;
+    }
+
+    // LSB level for dithering (as for the corresponding file formats):
+    int outputSignalBits;
+    switch (outputFormat.sampleFormat) {
+    case pcm24:
+      outputSignalBits = 24;
+      break;
+    case pcmS8:
+    case pcmU8:
+      outputSignalBits = 8;
+      break;
+    case pcmFloat64:
+      outputSignalBits = 53;
+      break;
+    case pcmFloat32:
+      outputSignalBits = 21;
+      break;
+    default:
+      outputSignalBits = 16;
+    }
+
+    if (ci.quantize) {
+      outputSignalBits = std::max(1, std::min(ci.quantizeBits, outputSignalBits));
+    }
+
+    std::vector<Ditherer<FloatType>> ditherers;
+    ditherers.reserve(static_cast<size_t>(nChannels));
+    auto seed = static_cast<int>(ci.bUseSeed ? ci.seed : time(nullptr));
+    for (int n = 0; n < nChannels; n++) {
+      ditherers.emplace_back(outputSignalBits, ci.ditherAmount, ci.bAutoBlankingEnabled, n + seed, static_cast<DitherProfileID>(ci.ditherProfileID));
+    }
+
+    FloatType ditherCompensation = 1.0;
+    if (ci.bDither) {
+      ditherCompensation =
+          (pow(2, outputSignalBits - 1) - pow(2, ci.ditherAmount - 1)) / pow(2, outputSignalBits - 1);
+    }
+    const FloatType gain = static_cast<FloatType>(ci.gain) * ditherCompensation; // (StreamConverter applies the filter gain)
+
+    std::unique_ptr<LookAheadLimiter<FloatType>> limiter;
+    int lookahead = 0;
+    if (!ci.disableClippingProtection) {
+      lookahead = std::max(1, static_cast<int>(std::round(ci.limiterLookahead * ci.outputSampleRate / 1000.0)));
+      limiter.reset(new LookAheadLimiter<FloatType>(nChannels, lookahead, ditherCompensation));
+      auto prec = std::cout.precision();
+      std::cout << "Using look-ahead limiter for clipping protection (" << std::setprecision(2) << ci.limiterLookahead << " ms)" << std::endl;
+      std::cout.precision(prec);
+    }
+
+    const size_t blockFrames = 1024;
+    StreamConverter<FloatType> streamConverter(nChannels, inputFormat.sampleRate, ci.outputSampleRate, blockFrames, 0, ci);
+    std::vector<FloatType> inputBlock(blockFrames * nChannels);
+    std::vector<FloatType> outputBlock(std::max<size_t>(blockFrames, static_cast<size_t>(lookahead)) * nChannels);
+
+    PcmStreamWriter writer(ci.outputFilename, ci.bRawOutput, outputFormat);
+    if (writer.isErr()) {
+      std::cout << "Error: " << writer.getErrorMessage() << std::endl;
+      return false;
+    }
+
+    size_t skip = ci.bDelayTrim ? streamConverter.getLatency() : 0; // (frames of filter delay to trim from the start, as for files)
+    FloatType peakOutputSample = 0.0;
+    uint64_t framesRead = 0;
+    uint64_t framesWritten = 0;
+
+    // finish() : dither and write n frames (already limited) from outputBlock
+    auto finish = [&] (size_t n) -> bool {
+      if (ci.bDither) {
+        for (int ch = 0; ch < nChannels; ++ch) {
+          ditherers[ch].dither(outputBlock.data() + ch, outputBlock.data() + ch, n, nChannels);
+        }
+      }
+      for (size_t s = 0; s < n * nChannels; ++s) {
+        peakOutputSample = std::max(peakOutputSample, std::abs(outputBlock[s]));
+      }
+      framesWritten += n;
+      return writer.write(outputBlock.data(), n);
+    };
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    size_t count;
+    while ((count = reader.read(inputBlock.data(), blockFrames)) != 0) {
+      framesRead += count;
+      if (!streamConverter.pushInterleaved(inputBlock.data(), count)) {
+        std::cout << "Error: stream converter rejected an input block (output FIFO full)" << std::endl;
+        return false;
+      }
+      size_t pulled;
+      while ((pulled = streamConverter.pullInterleaved(outputBlock.data(), blockFrames)) != 0) {
+        size_t start = std::min(skip, pulled);
+        skip -= start;
+        size_t n = pulled - start;
+        FloatType* p = outputBlock.data() + start * nChannels;
+        for (size_t s = 0; s < n * nChannels; ++s) {
+          outputBlock[s] = p[s] * gain; // (gain, and move to the start of the block)
+        }
+        if (limiter) { // (in-place: LookAheadLimiter stores each frame before writing any output, see --testLimiter)
+          n = limiter->process(outputBlock.data(), n * nChannels, outputBlock.data()) / nChannels;
+        }
+        if (n != 0 && !finish(n)) {
+          std::cout << "Error: " << writer.getErrorMessage() << std::endl;
+          return false;
+        }
+      }
+    }
+
+    if (limiter && !finish(limiter->flush(outputBlock.data()) / nChannels)) {
+      std::cout << "Error: " << writer.getErrorMessage() << std::endl;
+      return false;
+    }
+    if (!writer.close()) {
+      std::cout << "Error: " << writer.getErrorMessage() << std::endl;
+      return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+    std::cout << "Done: " << framesRead << " frames in, " << framesWritten << " frames out, peak output sample "
+              << std::setprecision(6) << peakOutputSample << " (" << 20 * std::log10(std::max<double>(peakOutputSample, 1.0e-30)) << " dBFS), "
+              << "latency " << streamConverter.getLatency() + static_cast<size_t>(lookahead) << " frames, " << seconds << " s" << std::endl;
+    if (writer.getClippedSamples() != 0) {
+      std::cout << "Warning: " << writer.getClippedSamples() << " sample(s) clipped" << std::endl;
+    }
+    return true;
+  }
+  //}}}
+  //{{{
+  int runCommand (int argc, char** argv) {
+
+    // test for global options
+    if (parseGlobalOptions(argc, argv)) {
+      return EXIT_SUCCESS;
+    }
+
+    // ConversionInfo instance to hold parameters
+    ConversionInfo ci;
+
+    // get path/name of this app
+    ci.appName = argv[0];
+    ci.overSamplingFactor = 1;
+
+    // when the output goes to stdout, keep messages out of the audio data:
+    std::string outputFilename;
+    if (!getCmdlineParam(argv, argv + argc, "-o", outputFilename)) {
+      getCmdlineParam(argv, argv + argc, "-i", outputFilename); // (input from stdin defaults to output to stdout)
+    }
+    if (outputFilename == "-") {
+      std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    // get conversion parameters
+    ci.fromCmdLineArgs(argc, argv);
+    if (ci.bBadParams) {
+      std::cout << strUsage << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // query build version AND cpu
+    if (!showBuildVersion()) {
+      return EXIT_FAILURE; // can't continue (CPU / build mismatch)
+    }
+
+    // echo filenames to user
+    std::cout << "Input file: " << ci.inputFilename << std::endl;
+    std::cout << "Output file: " << ci.outputFilename << std::endl;
+
+    if (ci.disableClippingProtection) {
+      std::cout << "clipping protection disabled " << std::endl;
+    }
+
+    // batch mode (input is a directory or manifest):
+    if (ci.bBatch || isDirectory(ci.inputFilename)) {
+      return runBatch(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!ci.bStream) {
+      determineFileFormats(ci);
+    }
+
+    try {
 
   #ifdef USE_QUADMATH
-        std::cout << "Using quadruple-precision for calculations.\n";
+      std::cout << "Using quadruple-precision for calculations.\n";
+  #else
+      if (ci.bUseDoublePrecision) {
+        std::cout << "Using double precision for calculations." << std::endl;
+      }
   #endif
-        if (ci.dsfInput) {
-          ci.bEnablePeakDetection = false;
-          return convert_DsfFile_Float(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
-        }
 
-        if (ci.dffInput) {
-          ci.bEnablePeakDetection = false;
-          return convert_DffFile_Float(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
-        }
+      // streaming mode (eg stdin -> stdout):
+      if (ci.bStream) {
+        bool ok = ci.bUseDoublePrecision ? convertStream<double>(ci) : convertStream<float>(ci);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
 
-        ci.bEnablePeakDetection = true;
-        return convert_SndfileHandle_Float(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+      // benchmark single-pass clipping protection (limiter) against the two-pass temp file method:
+      if (getCmdlineParam(argv, argv + argc, "--benchmarkLimiter")) {
+        ConversionInfo twoPassCi = ci;
+        twoPassCi.bLimiter = false;
+        twoPassCi.bTmpFile = true;
+        ConversionInfo limiterCi = ci;
+        limiterCi.bLimiter = true;
+
+        std::cout << "\n*** two-pass (temp file) ***" << std::endl;
+        auto begin = std::chrono::high_resolution_clock::now();
+        bool ok = convertFile(twoPassCi);
+        auto middle = std::chrono::high_resolution_clock::now();
+        std::cout << "\n*** single-pass (look-ahead limiter) ***" << std::endl;
+        ok = ok && convertFile(limiterCi);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double twoPassSeconds = std::chrono::duration<double>(middle - begin).count();
+        double limiterSeconds = std::chrono::duration<double>(end - middle).count();
+        std::cout << "two-pass: " << twoPassSeconds << " s\nsingle-pass: " << limiterSeconds << " s"
+                  << " [" << twoPassSeconds / limiterSeconds << "x]" << std::endl;
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
 
+      // check the streaming interface (StreamConverter) against the file converter:
+      if (getCmdlineParam(argv, argv + argc, "--testStreaming")) {
+        bool ok = ci.bUseDoublePrecision ? testStreamConverter<double>(ci) : testStreamConverter<float>(ci);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
       }
 
+      return convertFile(ci) ? EXIT_SUCCESS : EXIT_FAILURE;
+
     } //ends try block
 
     catch (const std::exception& e) {
@@ -1541,7 +2231,21 @@ namespace ReSampler {
   //}}}
   //{{{
   void OutputManager::callProgressFunc (int percentComplete) {
-    return progressFunc(percentComplete);
+    if (threadStream == nullptr) {
+      progressFunc(percentComplete);
+    }
+  }
+  //}}}
+
+  thread_local std::ostream* OutputManager::threadStream = nullptr;
+  //{{{
+  std::ostream& OutputManager::getStream() {
+    return (threadStream != nullptr) ? *threadStream : std::cout;
+  }
+  //}}}
+  //{{{
+  void OutputManager::setThreadStream (std::ostream* value) {
+    threadStream = value;
   }
   //}}}
   }
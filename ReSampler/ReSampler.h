@@ -64,7 +64,12 @@ namespace ReSampler {
     "--multiStage\n"
     "--maxStages\n"
     "--showStages\n"
+    "--polyphase\n"
+    "--fftThreshold <taps>\n"
+    "--noDsdFrontEnd\n"
     "--rawInput <samplerate> <bitformat> [numChannels]\n"
+    "--rawOutput\n"
+    "--stream\n"
     "--progress-updates <0..100>\n"
 
     #if defined (_WIN32) || defined (_WIN64)
@@ -73,6 +78,11 @@ namespace ReSampler {
 
     "--showTempFile\n"
     "--noTempFile\n"
+    "--limiter [lookahead ms]\n"
+    "--batch\n"
+    "--batchExt <ext>\n"
+    "--batchJobs <n>\n"
+    "--filter-cache <dir>\n"
     );
   //}}}
 
@@ -169,12 +179,19 @@ namespace ReSampler {
 
   //{{{
   class OutputManager {
+  // console output of a conversion goes to getStream(), which is std::cout unless the calling thread has its own stream
+  // (runBatch() gives each of its workers one, so that concurrent conversions never share a stream or its formatting state).
+  // Progress is only reported on std::cout.
     static std::function<void(int)> progressFunc;
+    static thread_local std::ostream* threadStream;
 
   public:
     static std::function<void (int)> getProgressFunc();
     static void setProgressFunc (const std::function<void (int)> &value);
     static void callProgressFunc (int percentComplete);
+
+    static std::ostream& getStream();
+    static void setThreadStream (std::ostream* value); // (nullptr: back to std::cout)
     };
   //}}}
 
@@ -195,6 +212,11 @@ namespace ReSampler {
   bool convert_SndfileHandle_Double (ConversionInfo & ci);
 
   template<typename FileReader, typename FloatType> bool convert(ConversionInfo & ci);
+  void determineFileFormats (ConversionInfo& ci);
+  bool convertFile (ConversionInfo& ci);
+  bool runBatch (const ConversionInfo& ci);
+  template<typename FloatType> bool testStreamConverter (ConversionInfo ci);
+  template<typename FloatType> bool convertStream (const ConversionInfo& ci);
   template<typename FloatType> SndfileHandle* getTempFile(int inputFileFormat, int nChannels, const ConversionInfo& ci, std::string& tmpFilename);
 
   void showDitherProfiles();
@@ -215,6 +237,7 @@ namespace ReSampler {
   //}}}
 
   bool getMetaData (MetaData& metadata, SndfileHandle& infile);
+  bool enableDsdFrontEnd (SndfileHandle& infile, unsigned int outputSampleRate);
   bool setMetaData (const MetaData& metadata, SndfileHandle& outfile);
   void showCompiler();
   int runCommand (int argc, char** argv);
@@ -0,0 +1,269 @@
+// batch.h : helpers for batch mode (directory / manifest in, mirrored directory tree out)
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "osspecific.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#if defined (_WIN32) || defined (_WIN64)
+  #include <direct.h>
+#else
+  #include <dirent.h>
+  #include <sys/stat.h>
+  #include <sys/types.h>
+#endif
+//}}}
+
+namespace ReSampler {
+  //{{{
+  struct BatchJob {
+    std::string inputFilename;
+    std::string outputFilename;
+    };
+  //}}}
+
+  //{{{
+  // NullStreamBuffer : discards everything written to it
+  class NullStreamBuffer : public std::streambuf {
+  protected:
+    int overflow (int c) override {
+      return traits_type::not_eof(c);
+      }
+    };
+  //}}}
+
+  //{{{
+  inline bool isPathSeparator (char c) {
+    #if defined (_WIN32) || defined (_WIN64)
+      return c == '\\' || c == '/';
+    #else
+      return c == '/';
+    #endif
+    }
+  //}}}
+  //{{{
+  inline std::string joinPath (const std::string& dir, const std::string& name) {
+
+    if (dir.empty()) {
+      return name;
+      }
+    return isPathSeparator(dir.back()) ? dir + name : dir + "/" + name;
+    }
+  //}}}
+  //{{{
+  inline std::string getParentPath (const std::string& path) {
+
+    for (size_t i = path.size(); i > 0; --i) {
+      if (isPathSeparator(path[i - 1])) {
+        return path.substr(0, i - 1);
+        }
+      }
+    return std::string();
+    }
+  //}}}
+  //{{{
+  inline std::string getExtension (const std::string& path) {
+
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (path.size() > dot && std::any_of(path.begin() + dot, path.end(), isPathSeparator))) {
+      return std::string();
+      }
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+    return ext;
+    }
+  //}}}
+  //{{{
+  inline std::string replaceExtension (const std::string& path, const std::string& ext) {
+
+    if (ext.empty()) {
+      return path;
+      }
+    size_t dot = path.find_last_of('.');
+    std::string stem = (dot == std::string::npos || std::any_of(path.begin() + dot, path.end(), isPathSeparator)) ? path : path.substr(0, dot);
+    return stem + "." + ext;
+    }
+  //}}}
+  //{{{
+  inline bool isAudioFile (const std::string& path) {
+  // isAudioFile() : true for file types which ReSampler can read (decided by extension)
+
+    static const std::set<std::string> extensions {
+      "aif", "aifc", "aiff", "au", "caf", "dff", "dsf", "flac", "htk", "iff", "mat", "mpc", "oga", "ogg",
+      "paf", "pvf", "raw", "rf64", "sd2", "sds", "sf", "snd", "svx", "voc", "w64", "wav", "wve", "xi"
+      };
+    return extensions.count(getExtension(path)) != 0;
+    }
+  //}}}
+
+  #if defined (_WIN32) || defined (_WIN64)
+  //{{{
+  inline std::wstring toWide (const std::string& s) {
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> widener;
+    return widener.from_bytes(s);
+    }
+  //}}}
+  //{{{
+  inline std::string fromWide (const std::wstring& s) {
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> widener;
+    return widener.to_bytes(s);
+    }
+  //}}}
+  #endif
+
+  //{{{
+  inline bool isDirectory (const std::string& path) {
+
+    #if defined (_WIN32) || defined (_WIN64)
+      DWORD attributes = GetFileAttributesW(toWide(path).c_str());
+      return (attributes != INVALID_FILE_ATTRIBUTES) && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+    #else
+      struct stat st;
+      return (stat(path.c_str(), &st) == 0) && S_ISDIR(st.st_mode);
+    #endif
+    }
+  //}}}
+  //{{{
+  inline bool makeDirectories (const std::string& path) {
+  // makeDirectories() : create directory, including any missing parent directories
+
+    if (path.empty() || isDirectory(path)) {
+      return true;
+      }
+
+    std::string parent = getParentPath(path);
+    if (!parent.empty() && parent != path && !makeDirectories(parent)) {
+      return false;
+      }
+
+    #if defined (_WIN32) || defined (_WIN64)
+      return (_wmkdir(toWide(path).c_str()) == 0) || isDirectory(path);
+    #else
+      return (mkdir(path.c_str(), 0777) == 0) || isDirectory(path);
+    #endif
+    }
+  //}}}
+  //{{{
+  inline void listFiles (const std::string& root, const std::string& relativeDir, std::vector<std::string>& relativePaths) {
+  // listFiles() : recursively collect the paths (relative to root) of all audio files below root
+
+    std::string dir = relativeDir.empty() ? root : joinPath(root, relativeDir);
+    std::vector<std::string> names;
+    std::vector<std::string> subdirs;
+
+    #if defined (_WIN32) || defined (_WIN64)
+      WIN32_FIND_DATAW findData;
+      HANDLE h = FindFirstFileW(toWide(joinPath(dir, "*")).c_str(), &findData);
+      if (h == INVALID_HANDLE_VALUE) {
+        return;
+        }
+      do {
+        std::string name = fromWide(findData.cFileName);
+        if (name == "." || name == "..") {
+          continue;
+          }
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+          subdirs.push_back(name);
+          }
+        else {
+          names.push_back(name);
+          }
+        } while (FindNextFileW(h, &findData));
+      FindClose(h);
+    #else
+      DIR* d = opendir(dir.c_str());
+      if (d == nullptr) {
+        return;
+        }
+      while (struct dirent* entry = readdir(d)) {
+        std::string name(entry->d_name);
+        if (name == "." || name == "..") {
+          continue;
+          }
+        if (isDirectory(joinPath(dir, name))) {
+          subdirs.push_back(name);
+          }
+        else {
+          names.push_back(name);
+          }
+        }
+      closedir(d);
+    #endif
+
+    // sort, so that the order of jobs is repeatable
+    std::sort(names.begin(), names.end());
+    std::sort(subdirs.begin(), subdirs.end());
+
+    for (auto& name : names) {
+      if (isAudioFile(name)) {
+        relativePaths.push_back(relativeDir.empty() ? name : joinPath(relativeDir, name));
+        }
+      }
+    for (auto& subdir : subdirs) {
+      listFiles(root, relativeDir.empty() ? subdir : joinPath(relativeDir, subdir), relativePaths);
+      }
+    }
+  //}}}
+  //{{{
+  inline std::vector<BatchJob> getBatchJobs (const std::string& source, const std::string& destination, const std::string& outputExtension) {
+  // getBatchJobs() : source is either a directory (which is scanned recursively for audio files),
+  // or a manifest (text file listing one input file per line; relative paths are relative to the manifest's directory).
+  // Each output file has the same path relative to destination as its input has relative to the source directory.
+
+    std::vector<std::string> relativePaths;
+    std::string root;
+
+    if (isDirectory(source)) {
+      root = source;
+      listFiles(root, std::string(), relativePaths);
+      }
+    else {
+      root = getParentPath(source);
+      std::ifstream manifest(source);
+      std::string line;
+      while (std::getline(manifest, line)) {
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty() || line[0] == '#') {
+          continue;
+          }
+        relativePaths.push_back(line);
+        }
+      }
+
+    std::vector<BatchJob> jobs;
+    for (auto& relativePath : relativePaths) {
+      BatchJob job;
+      bool isAbsolute = isPathSeparator(relativePath[0]) || (relativePath.size() > 1 && relativePath[1] == ':');
+      job.inputFilename = isAbsolute ? relativePath : joinPath(root, relativePath);
+
+      // (absolute paths in a manifest can't be mirrored, so their outputs go directly into destination)
+      std::string outputRelativePath = relativePath;
+      if (isAbsolute) {
+        std::string parent = getParentPath(relativePath);
+        outputRelativePath = relativePath.substr(parent.size() + (parent.empty() ? 0 : 1));
+        }
+      job.outputFilename = replaceExtension(joinPath(destination, outputRelativePath), outputExtension);
+      jobs.push_back(job);
+      }
+
+    return jobs;
+    }
+  //}}}
+}
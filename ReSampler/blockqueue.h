@@ -0,0 +1,76 @@
+// blockqueue.h : fixed-capacity blocking queue, for passing blocks between pipeline stages
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+//}}}
+
+namespace ReSampler {
+  //{{{
+  template <typename T> class BlockQueue {
+  // BlockQueue : FIFO of (typically) block indices. Storage is allocated once, at construction.
+  // push() never blocks (the capacity must be >= the number of items in circulation);
+  // pop() blocks until an item is available, and accumulates the time spent waiting (ie stage stall time).
+  public:
+    //{{{
+    explicit BlockQueue (size_t capacity) : items(capacity), head(0), size(0), waitTime(0.0) {
+      }
+    //}}}
+    //{{{
+    void push (const T& item) {
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        items[(head + size) % items.size()] = item;
+        ++size;
+      }
+      available.notify_one();
+      }
+    //}}}
+    //{{{
+    T pop() {
+
+      std::unique_lock<std::mutex> lock(mutex);
+      if (size == 0) {
+        auto begin = std::chrono::high_resolution_clock::now();
+        available.wait(lock, [this] { return size != 0; });
+        waitTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+        }
+      T item = items[head];
+      head = (head + 1) % items.size();
+      --size;
+      return item;
+      }
+    //}}}
+    //{{{
+    // getWaitTime() : total time (in seconds) that consumers have spent waiting in pop()
+    double getWaitTime() {
+
+      std::lock_guard<std::mutex> lock(mutex);
+      return waitTime;
+      }
+    //}}}
+
+  private:
+    std::vector<T> items;
+    size_t head;
+    size_t size;
+    double waitTime;
+    std::mutex mutex;
+    std::condition_variable available;
+    };
+  //}}}
+}
@@ -18,6 +18,9 @@ namespace ReSampler {
 
   std::string sanitize (const std::string& str) {
     std::string r(str);
+    if (r.find_first_not_of('-') == std::string::npos) { // (nothing but hyphens, eg "-" for stdin / stdout)
+      return r;
+    }
     auto s = static_cast<std::string::iterator::difference_type>(r.find_first_not_of('-')); // get position of first non-hyphen
     r.erase(std::remove(r.begin() + s, r.end(), '-'), r.end()); // remove all hyphens after the first non-hyphen
     std::transform(r.begin(), r.end(), r.begin(), ::tolower); // change to lower-case
@@ -81,9 +84,10 @@ namespace ReSampler {
         found = true;
         // read parameters until we hit a hyphen or the end of args
         for (auto next = std::next(it); next != args.end(); next++) {
-          if ((*next).find("-") == std::string::npos) {
-            parameters.push_back(*next);
+          if ((*next).find("-") != std::string::npos) {
+            break;
           }
+          parameters.push_back(*next);
         }
         break;
       }
@@ -137,6 +141,17 @@ namespace ReSampler {
       args.push_back(std::to_string(lpfTransitionWidth));
     }
 
+    if (bPolyphase)
+      args.emplace_back("--polyphase");
+
+    if (fftThreshold != 1024) {
+      args.emplace_back("--fftThreshold");
+      args.push_back(std::to_string(fftThreshold));
+    }
+
+    if (!bDsdFrontEnd)
+      args.emplace_back("--noDsdFrontEnd");
+
     if (maxStages == 1) {
       args.emplace_back("--maxStages");
       args.push_back(std::to_string(maxStages));
@@ -210,6 +225,15 @@ namespace ReSampler {
     bSingleStage = false;
     bMultiStage = true;
     bShowStages = false;
+    bPolyphase = false;
+    fftThreshold = 1024; // crossover (in taps) of a 1:1 filter; see --benchmarkFFT
+    bDsdFrontEnd = true;
+    bLimiter = false;
+    bBatch = false;
+    batchExt.clear();
+    batchJobs = 0;
+    filterCacheDir.clear();
+    limiterLookahead = 2.0;
     bTmpFile = true;
     bShowTempFile = false;
     overSamplingFactor = 1;
@@ -217,6 +241,8 @@ namespace ReSampler {
     bBadParams = false;
     appName.clear();
     bRawInput = false;
+    bRawOutput = false;
+    bStream = false;
 
     // get core parameters:
     getCmdlineParam(argv, argv + argc, "-i", inputFilename);
@@ -272,6 +298,14 @@ namespace ReSampler {
       bSingleStage = false;
 
     bShowStages = getCmdlineParam(argv, argv + argc, "--showStages");
+    bPolyphase = getCmdlineParam(argv, argv + argc, "--polyphase");
+    getCmdlineParam(argv, argv + argc, "--fftThreshold", fftThreshold);
+    bDsdFrontEnd = !getCmdlineParam(argv, argv + argc, "--noDsdFrontEnd");
+    bLimiter = getCmdlineParam(argv, argv + argc, "--limiter", limiterLookahead);
+    bBatch = getCmdlineParam(argv, argv + argc, "--batch");
+    getCmdlineParam(argv, argv + argc, "--batchExt", batchExt);
+    getCmdlineParam(argv, argv + argc, "--batchJobs", batchJobs);
+    getCmdlineParam(argv, argv + argc, "--filter-cache", filterCacheDir);
 
     // LPFilter settings:
     if (getCmdlineParam(argv, argv + argc, "--relaxedLPF")) {
@@ -309,6 +343,14 @@ namespace ReSampler {
       }
     }
 
+    bRawOutput = getCmdlineParam(argv, argv + argc, "--raw-output");
+
+    // streaming mode ("-" is stdin / stdout):
+    if (inputFilename == "-" && outputFilename.empty()) {
+      outputFilename = "-";
+    }
+    bStream = getCmdlineParam(argv, argv + argc, "--stream") || inputFilename == "-" || outputFilename == "-";
+
     double qb = 0.0;
     quantize = getCmdlineParam(argv, argv + argc, "--quantize-bits", qb);
     quantizeBits = static_cast<int>(std::floor(qb));
@@ -326,6 +368,8 @@ namespace ReSampler {
     constrainInt(flacCompressionLevel, 0, 8);
     constrainDouble(vorbisQuality, -1, 10);
     constrainInt(maxStages, 1, 10);
+    constrainInt(fftThreshold, 0, 1 << 20);
+    constrainDouble(limiterLookahead, 0.01, 100.0);
     constrainDouble(lpfCutoff, 1.0, 99.9);
     constrainDouble(lpfTransitionWidth, 0.1, 400.0);
     constrainInt(progressUpdates, 0, 100);
@@ -369,7 +413,7 @@ namespace ReSampler {
       }
     }
 
-    else if (outputFilename == inputFilename) {
+    else if (outputFilename == inputFilename && outputFilename != "-") {
       std::cout << "\nError: Input and Output filenames cannot be the same" << std::endl;
       bBadParams = true;
     }
@@ -54,6 +54,7 @@ namespace ReSampler {
     bool dsfInput;
     bool dffInput;
     bool csvOutput;
+    bool npyOutput;
     bool bEnablePeakDetection;
     bool bMultiThreaded;
     bool bRf64;
@@ -63,6 +64,15 @@ namespace ReSampler {
     bool bSingleStage;
     bool bMultiStage;
     bool bShowStages;
+    bool bPolyphase;
+    int fftThreshold;
+    bool bDsdFrontEnd;
+    bool bLimiter;
+    bool bBatch;
+    std::string batchExt;
+    int batchJobs;
+    std::string filterCacheDir;
+    double limiterLookahead; // ms
     int progressUpdates;
     int overSamplingFactor;
     bool bBadParams;
@@ -82,6 +92,8 @@ namespace ReSampler {
     int rawInputChannels;
     int rawInputSampleRate;
     std::string rawInputBitFormat;
+    bool bRawOutput;
+    bool bStream; // sequential (non-seeking) conversion, eg stdin to stdout
 
     // functions
     bool fromCmdLineArgs (int argc, char **argv); // populate ConversionInfo from args
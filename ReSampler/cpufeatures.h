@@ -0,0 +1,104 @@
+// cpufeatures.h : run-time detection of CPU instruction-set extensions (x86 / x64)
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #define CPUFEATURES_X86
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+namespace ReSampler {
+  //{{{
+  struct CpuFeatures {
+    bool sse2;
+    bool avx;     // note: AVX flags are only set when the OS also saves the YMM registers
+    bool fma;
+    bool avx2;
+    bool avx512f; // ... and the ZMM registers
+    };
+  //}}}
+
+  #ifdef CPUFEATURES_X86
+    //{{{
+    inline void cpuid (int leaf, int subleaf, unsigned int regs[4]) {
+
+      #if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; ++i)
+          regs[i] = static_cast<unsigned int>(r[i]);
+      #else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+      #endif
+      }
+    //}}}
+    //{{{
+    inline unsigned long long xgetbv0() {
+    // read XCR0 (which register states are saved by the OS). Only call when OSXSAVE is set.
+
+      #if defined(_MSC_VER)
+        return _xgetbv(0);
+      #else
+        unsigned int eax, edx;
+        __asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+      #endif
+      }
+    //}}}
+  #endif
+
+  //{{{
+  inline CpuFeatures detectCpuFeatures() {
+
+    CpuFeatures f{};
+
+    #ifdef CPUFEATURES_X86
+      unsigned int regs[4] = { 0, 0, 0, 0 };
+      cpuid(0, 0, regs);
+      unsigned int maxLeaf = regs[0];
+      if (maxLeaf < 1)
+        return f;
+
+      cpuid(1, 0, regs);
+      f.sse2 = (regs[3] & (1u << 26)) != 0;
+      bool osxsave = (regs[2] & (1u << 27)) != 0;
+      bool cpuAvx = (regs[2] & (1u << 28)) != 0;
+      bool cpuFma = (regs[2] & (1u << 12)) != 0;
+
+      unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+      bool osYmm = (xcr0 & 0x06) == 0x06; // XMM and YMM state
+      bool osZmm = (xcr0 & 0xe6) == 0xe6; // ... plus opmask and ZMM state
+
+      f.avx = cpuAvx && osYmm;
+      f.fma = f.avx && cpuFma;
+
+      if (maxLeaf >= 7) {
+        cpuid(7, 0, regs);
+        f.avx2 = f.avx && (regs[1] & (1u << 5)) != 0;
+        f.avx512f = osZmm && (regs[1] & (1u << 16)) != 0;
+        }
+    #endif
+
+    return f;
+    }
+  //}}}
+  //{{{
+  inline const CpuFeatures& getCpuFeatures() {
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+    }
+  //}}}
+  }
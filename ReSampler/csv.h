@@ -17,11 +17,20 @@
 #include <iomanip>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <cmath>
 #include <string>
 #include <vector>
+
+#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+  #include <charconv>
+#endif
+#if defined(__cpp_lib_to_chars) && (__cpp_lib_to_chars >= 201611L)
+  #define CSV_USE_TO_CHARS // floating-point std::to_chars() is available (otherwise, snprintf() is used)
+#endif
 //}}}
 
 namespace ReSampler {
@@ -109,7 +118,53 @@ namespace ReSampler {
     }
     //}}}
     //{{{
+    // write() : format count samples (interleaved) into a text buffer, and write the whole buffer to the file in one go.
+    // The text is identical to that produced by writeStream().
     template <typename T> int64_t write(const T* buffer, int64_t count) {
+      if(err) {
+        return 0;
+      }
+      const size_t maxFieldLength = static_cast<size_t>(std::max(precision, 17)) + 32; // (number, separator and line ending)
+      textBuffer.resize(static_cast<size_t>(count) * maxFieldLength);
+      char* p = textBuffer.data();
+      const char* const end = p + textBuffer.size();
+
+      int64_t i;
+      for(i = 0; i < count; i++) {
+        switch(numericFormat) {
+          case CsvNumericFormat::FloatingPoint:
+            p = formatFloat(p, end, static_cast<double>(buffer[i]));
+            break;
+
+          default:
+            p = formatInt(p, scaleToInt<int>(buffer[i]));
+            break;
+        }
+
+        if(++currentChannel < numChannels) {
+          *p++ = ',';
+        } else {
+          *p++ = '\r';
+          *p++ = '\n';
+          currentChannel = 0;
+        }
+      }
+
+      try {
+        file.write(textBuffer.data(), p - textBuffer.data());
+      }
+      catch (std::ios_base::failure& e) {
+        e.what();
+        err = true;
+        return 0;
+      }
+      return i;
+    }
+    //}}}
+    //{{{
+    // writeStream() : write count samples (interleaved), formatting each value with the stream's operator<<.
+    // (This was the original implementation of write(); benchmarkCsv() uses it as the reference)
+    template <typename T> int64_t writeStream(const T* buffer, int64_t count) {
       if(err) {
         return 0;
       }
@@ -135,6 +190,25 @@ namespace ReSampler {
       return i;
     }
     //}}}
+    //{{{
+    // rewind() : discard everything written so far, and start again at the beginning of the file
+    void rewind() {
+      if(file.is_open()) {
+        file.close();
+      }
+      try {
+        file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        err = false;
+      }
+      catch (std::ios_base::failure& e) {
+        e.what();
+        err = true;
+        return;
+      }
+      currentChannel = 0;
+      setStreamFormat();
+    }
+    //}}}
 
     //{{{
     CsvNumericFormat getNumericFormat() const {
@@ -222,6 +296,62 @@ namespace ReSampler {
     //}}}
 
   private:
+    //{{{
+    // formatInt() : format x in the numeric base, the same way as the stream (with showbase for octal and hexadecimal,
+    // which prints negative values as their unsigned two's-complement equivalent). Returns the end of the text.
+    char* formatInt(char* p, int x) const {
+      char digits[32];
+      char* d = digits + sizeof(digits);
+
+      if (numericBase == Hexadecimal || numericBase == Octal) {
+        auto u = static_cast<unsigned int>(x);
+        if (numericBase == Hexadecimal) {
+          do {
+            *--d = "0123456789abcdef"[u & 15];
+            u >>= 4;
+          } while (u != 0);
+          if (x != 0) {
+            *--d = 'x';
+            *--d = '0';
+          }
+        }
+        else {
+          do {
+            *--d = static_cast<char>('0' + (u & 7));
+            u >>= 3;
+          } while (u != 0);
+          if (x != 0) {
+            *--d = '0';
+          }
+        }
+      }
+      else {
+        unsigned int u = (x < 0) ? 0u - static_cast<unsigned int>(x) : static_cast<unsigned int>(x);
+        do {
+          *--d = static_cast<char>('0' + u % 10);
+          u /= 10;
+        } while (u != 0);
+        if (x < 0) {
+          *--d = '-';
+        }
+      }
+
+      auto length = static_cast<size_t>(digits + sizeof(digits) - d);
+      memcpy(p, d, length);
+      return p + length;
+    }
+    //}}}
+    //{{{
+    // formatFloat() : format x with the stream's precision (%g style). Returns the end of the text.
+    char* formatFloat(char* p, const char* end, double x) const {
+    #ifdef CSV_USE_TO_CHARS
+      return std::to_chars(p, const_cast<char*>(end), x, std::chars_format::general, std::max(precision, 1)).ptr;
+    #else
+      int length = snprintf(p, static_cast<size_t>(end - p), "%.*g", precision, x);
+      return p + std::max(length, 0);
+    #endif
+    }
+    //}}}
     //{{{
     template <typename IntType, typename FloatType> IntType scaleToInt(FloatType x) {
       return unsignedOffset + std::min(std::max(-intMaxAmplitude, static_cast<IntType>(std::round(scaleFactor * x))), intMaxAmplitude - 1);
@@ -277,6 +407,7 @@ namespace ReSampler {
     bool err;
     int intMaxAmplitude;
     int unsignedOffset;
+    std::vector<char> textBuffer;
     };
 
 } // namespace ReSampler
@@ -10,6 +10,7 @@
 //}}}
 #pragma once
 #include "osspecific.h"
+#include "dsddecimator.h"
 
 #ifdef BYTESWAP_METHOD_MSVCRT
   #include <stdlib.h>
@@ -19,6 +20,7 @@
 #include <iostream>
 #include <cassert>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <fstream>
 
@@ -235,6 +237,23 @@ public:
   }
   //}}}
   //{{{
+  // enableDecimation() : decode the DSD stream directly to PCM (at 1/8 or less of the DSD sample rate),
+  // instead of one sample per bit. samplerate(), frames() and samples() then describe the PCM stream.
+  // Returns false (and leaves the file unchanged) if there is no decimation ratio suitable for outputSampleRate.
+  bool enableDecimation(unsigned int outputSampleRate) {
+    int decimation = DsdDecimator::getDecimation(_sampleRate, outputSampleRate);
+    if (err || decimation == 0 || numChannels > DFF_MAX_CHANNELS || numChannels > DsdDecimator::maxChannels) {
+      return false;
+    }
+    decimator.reset(new DsdDecimator(static_cast<int>(numChannels), _sampleRate, decimation, false, blockSize));
+    _sampleRate /= 8 * decimation;
+    numFrames /= 8 * decimation;
+    numSamples = numFrames * numChannels;
+    framesDecoded = 0;
+    return true;
+  }
+  //}}}
+  //{{{
   template<typename FloatType> uint64_t read(FloatType* buffer, uint64_t count) {
 
     /*
@@ -248,6 +267,10 @@ public:
 
     // Caller expects interleaving to be done at the _sample_ level
 
+    if (decimator) {
+      return readDecimated(buffer, count);
+    }
+
     uint64_t samplesRead = 0;
 
     for (uint64_t i = 0; i < count; ++i) {
@@ -301,6 +324,10 @@ public:
     bufferIndex = endOfBlock; // empty (zero -> full)
     currentBit = 0;
     currentChannel = 0;
+    if (decimator) {
+      decimator->reset();
+      framesDecoded = 0;
+    }
 
     // rewind file pointer
     file.clear(); // in case of eof
@@ -330,6 +357,8 @@ private:
   uint32_t currentBit;
   uint64_t startOfData{};
   double samplTbl[256][8]{};
+  std::unique_ptr<DsdDecimator> decimator;
+  uint64_t framesDecoded{};
 
   //{{{
   void getChunkHeader(dffChunkHeader* chunkHeader) {
@@ -597,6 +626,28 @@ private:
   }
   //}}}
   //{{{
+  // readDecimated() : reads count interleaved FloatType samples (at the decimated rate) into buffer
+  template<typename FloatType> uint64_t readDecimated(FloatType* buffer, uint64_t count) {
+    uint64_t framesWanted = std::min(count / numChannels, numFrames - framesDecoded);
+    uint64_t framesRead = 0;
+    while (framesRead < framesWanted) {
+      if (decimator->getAvailableFrames() == 0) {
+        uint64_t bytesRead = readBlocks();
+        if (bytesRead != 0) {
+          decimator->pushInterleaved(inputBuffer, static_cast<size_t>(bytesRead / numChannels));
+        } else if (!decimator->isFlushed()) {
+          decimator->flush();
+        } else {
+          break; // no more data
+        }
+      }
+      framesRead += decimator->pull(buffer + framesRead * numChannels, framesWanted - framesRead);
+    }
+    framesDecoded += framesRead;
+    return framesRead * numChannels;
+  }
+  //}}}
+  //{{{
   void makeTbl() { // generate sample translation table
     for (int i = 0; i < 256; ++i) {
       for (int j = 0; j < 8; ++j) {
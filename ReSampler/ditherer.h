@@ -15,10 +15,31 @@
 
 // configuration:
 #define MAX_FIR_FILTER_SIZE 41
+#define DITHER_BLOCK_SIZE 256 // number of samples for which noise is generated at a time by the block dither() function
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <random>
+#include <cstdint>
 #include <cstring>
+#include <iostream>
+#include <vector>
+
+// SIMD random-number generation: SSE2 on x64 (all x64 CPUs have it), plus AVX2 when the host supports it (detected at run-time)
+#if defined(USE_AVX) || defined(_M_X64) || defined(__x86_64__) || defined(USE_SSE2)
+  #include <emmintrin.h>
+  #define DITHER_USE_SSE2
+  #if !defined(NO_CPU_DISPATCH)
+    #include <immintrin.h>
+    #include "cpufeatures.h"
+    #define DITHER_USE_AVX2
+    #if defined(__GNUC__) || defined(__clang__)
+      #define DITHER_TARGET(isa) __attribute__((target(isa)))
+    #else
+      #define DITHER_TARGET(isa) // MSVC allows all intrinsics without special compiler flags
+    #endif
+  #endif
+#endif
 
 #include "biquad.h"
 #include "noiseshape.h"
@@ -93,6 +114,155 @@ const DitherProfile ditherProfileList[] = {
   { Rpdf_f, "flat rpdf (with error-correction feedback)", RPDF, bypass, 44100, 1, noiseShaperPassThrough, true }
 };
 
+// DitherRandom : counter-based pseudo-random number generator for the ditherer.
+// The n-th number of the sequence is a pure function of the seed and n (two keyed rounds of a 32-bit integer hash of n),
+// so any run of numbers can be computed in parallel (SIMD), and the sequence doesn't depend on how it is divided into blocks.
+// The numbers are 24 bits (0 ... randMax).
+
+class DitherRandom
+{
+public:
+  static const int randMax = 16777215; // 2^24 - 1
+
+  explicit DitherRandom(int seed = 0) {
+    key0 = hash(static_cast<uint32_t>(seed) ^ 0x9e3779b9u);
+    key1 = hash(key0 + 0x85ebca6bu);
+    restart();
+  }
+
+  // restart() : go back to the beginning of the sequence
+  void restart() {
+    counterLo = 0;
+    counterHi = 0;
+    hiKey = key1;
+  }
+
+  // next() : next number of the sequence
+  int next() {
+    auto r = static_cast<int>(hash(hash(counterLo ^ key0) ^ hiKey) >> 8);
+    advance(1);
+    return r;
+  }
+
+  // generate() : next count numbers of the sequence (identical to calling next() count times)
+  void generate(int32_t* dst, size_t count) {
+    while (count != 0) {
+      // (the high word of the counter is folded into hiKey, so split the run wherever the low word wraps)
+      uint64_t untilWrap = (static_cast<uint64_t>(1) << 32) - counterLo;
+      auto n = static_cast<uint32_t>(std::min<uint64_t>(std::min<uint64_t>(count, untilWrap), 0x80000000u));
+      fill(dst, counterLo, n, key0, hiKey);
+      advance(n);
+      dst += n;
+      count -= n;
+    }
+  }
+
+  // hash() : "lowbias32" integer hash (Chris Wellons) - a bijection on 32-bit integers with very low bias
+  static uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+  }
+
+  // fillScalar() : dst[i] = number i of the run of count numbers starting at counter (portable reference version)
+  static void fillScalar(int32_t* dst, uint32_t counter, uint32_t count, uint32_t k0, uint32_t k1) {
+    for (uint32_t i = 0; i < count; ++i) {
+      dst[i] = static_cast<int32_t>(hash(hash((counter + i) ^ k0) ^ k1) >> 8);
+    }
+  }
+
+#ifdef DITHER_USE_SSE2
+  static __m128i mulloSSE2(__m128i a, __m128i b) { // (SSE2 has no 32-bit mullo; build it from two 32x32->64 multiplies)
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+  }
+
+  static __m128i hashSSE2(__m128i x) {
+    const __m128i m1 = _mm_set1_epi32(0x7feb352d);
+    const __m128i m2 = _mm_set1_epi32(static_cast<int>(0x846ca68bu));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = mulloSSE2(x, m1);
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = mulloSSE2(x, m2);
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    return x;
+  }
+
+  static void fillSSE2(int32_t* dst, uint32_t counter, uint32_t count, uint32_t k0, uint32_t k1) {
+    const __m128i vk0 = _mm_set1_epi32(static_cast<int>(k0));
+    const __m128i vk1 = _mm_set1_epi32(static_cast<int>(k1));
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i c = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(counter)), _mm_setr_epi32(0, 1, 2, 3));
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      __m128i r = _mm_srli_epi32(hashSSE2(_mm_xor_si128(hashSSE2(_mm_xor_si128(c, vk0)), vk1)), 8);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+      c = _mm_add_epi32(c, step);
+    }
+    fillScalar(dst + i, counter + i, count - i, k0, k1);
+  }
+#endif
+
+#ifdef DITHER_USE_AVX2
+  DITHER_TARGET("avx2") static __m256i hashAVX2(__m256i x) {
+    const __m256i m1 = _mm256_set1_epi32(0x7feb352d);
+    const __m256i m2 = _mm256_set1_epi32(static_cast<int>(0x846ca68bu));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, m1);
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, m2);
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    return x;
+  }
+
+  DITHER_TARGET("avx2") static void fillAVX2(int32_t* dst, uint32_t counter, uint32_t count, uint32_t k0, uint32_t k1) {
+    const __m256i vk0 = _mm256_set1_epi32(static_cast<int>(k0));
+    const __m256i vk1 = _mm256_set1_epi32(static_cast<int>(k1));
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i c = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m256i r = _mm256_srli_epi32(hashAVX2(_mm256_xor_si256(hashAVX2(_mm256_xor_si256(c, vk0)), vk1)), 8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+      c = _mm256_add_epi32(c, step);
+    }
+    fillScalar(dst + i, counter + i, count - i, k0, k1);
+  }
+#endif
+
+private:
+  uint32_t key0;
+  uint32_t key1;
+  uint32_t counterLo;
+  uint32_t counterHi;
+  uint32_t hiKey; // key for the second round: depends on key1 and counterHi
+
+  void advance(uint32_t n) {
+    uint32_t old = counterLo;
+    counterLo += n;
+    if (counterLo < old) { // low word wrapped: next 2^32 numbers
+      ++counterHi;
+      hiKey = hash(key1 + counterHi);
+    }
+  }
+
+  static void fill(int32_t* dst, uint32_t counter, uint32_t count, uint32_t k0, uint32_t k1) {
+    typedef void (*FillFunction)(int32_t*, uint32_t, uint32_t, uint32_t, uint32_t);
+#if defined(DITHER_USE_AVX2)
+    static const FillFunction f = getCpuFeatures().avx2 ? &fillAVX2 : &fillSSE2;
+#elif defined(DITHER_USE_SSE2)
+    static const FillFunction f = &fillSSE2;
+#else
+    static const FillFunction f = &fillScalar;
+#endif
+    f(dst, counter, count, k0, k1);
+  }
+};
+
 template<typename FloatType>
 class Ditherer
 {
@@ -108,8 +278,7 @@ public:
     seed(seed),
     Z1(0),
     masterVolume(1.0),
-    randGenerator(static_cast<unsigned int>(seed)),   // initialize (seed) RNG
-    dist(0, randMax),   // set the range of the random number distribution
+    random(seed),   // initialize (seed) RNG
     signalBits(signalBits),
     ditherBits(ditherBits),
     selectedDitherProfile(ditherProfileList[ditherProfileID]),
@@ -160,6 +329,25 @@ public:
       noiseShapingFilter = &Ditherer::noiseShaperCascadedBiquad;
     }
 
+    // set-up the specialised loop for the block dither() function:
+    ShaperType shaper = !bUseErrorFeedback ? shaperNone :
+      (selectedDitherProfile.filterType == bypass) ? shaperPassThrough :
+      (selectedDitherProfile.filterType == fir) ? shaperFIR : shaperCascadedBiquad;
+    switch (shaper) {
+    case shaperNone:
+      ditherBlock = bAutoBlankingEnabled ? &Ditherer::ditherLoop<true, shaperNone> : &Ditherer::ditherLoop<false, shaperNone>;
+      break;
+    case shaperPassThrough:
+      ditherBlock = bAutoBlankingEnabled ? &Ditherer::ditherLoop<true, shaperPassThrough> : &Ditherer::ditherLoop<false, shaperPassThrough>;
+      break;
+    case shaperFIR:
+      ditherBlock = bAutoBlankingEnabled ? &Ditherer::ditherLoop<true, shaperFIR> : &Ditherer::ditherLoop<false, shaperFIR>;
+      break;
+    case shaperCascadedBiquad:
+    default:
+      ditherBlock = bAutoBlankingEnabled ? &Ditherer::ditherLoop<true, shaperCascadedBiquad> : &Ditherer::ditherLoop<false, shaperCascadedBiquad>;
+    }
+
     //// IIR-specific stuff:
     if (ditherBits < 1.5)
     {
@@ -194,12 +382,13 @@ public:
 
     // FIR-specific stuff:
     const FloatType scale = 1.0;
-    FIRLength = selectedDitherProfile.N;
-    for (int n = 0; n < FIRLength; ++n) {
-      FIRCoeffs[n] = static_cast<FloatType>(scale * selectedDitherProfile.coeffs[n]);
+    FIRLength = (selectedDitherProfile.filterType == fir) ? selectedDitherProfile.N : 0; // (N isn't the length of coeffs for other filter types)
+    for (int n = 0; n < FIRLength; ++n) { // (stored in reverse order, to line up with the history, which runs from oldest to newest)
+      FIRCoeffs[FIRLength - 1 - n] = static_cast<FloatType>(scale * selectedDitherProfile.coeffs[n]);
     }
 
-    memset(FIRHistory, 0, MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+    memset(FIRHistory, 0, 2 * MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+    FIRIndex = 0;
 
     // set-up Auto-blanking:
     if (bAutoBlankingEnabled) { // initial state: silence
@@ -227,10 +416,11 @@ public:
     f2.reset();
     f3.reset();
 
-    memset(FIRHistory, 0, MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+    memset(FIRHistory, 0, 2 * MAX_FIR_FILTER_SIZE * sizeof(FloatType));
+    FIRIndex = 0;
 
-    // re-seed PRNG
-    randGenerator.seed(static_cast<unsigned int>(seed));
+    // restart PRNG sequence
+    random.restart();
     oldRandom = 0;
     Z1 = 0;
     zeroCount = 0;
@@ -267,37 +457,41 @@ public:
 
 FloatType dither(FloatType inSample) {
 
-  // Auto-Blanking
   if (bAutoBlankingEnabled) {
-    if (std::abs(inSample) < autoBlankLevelThreshold) {
-      ++zeroCount;
-      if (zeroCount > autoBlankTimeThreshold) {
-        ditherScaleFactor *= autoBlankDecayFactor; // decay
-        if (ditherScaleFactor < autoBlankDecayCutoff) {
-          ditherScaleFactor = 0.0; // decay cutoff
-          masterVolume = 0.0; // mute
-        }
-      }
-    }
-    else {
-      zeroCount = 0; // reset
-      ditherScaleFactor = maxDitherScaleFactor; // restore
-      masterVolume = 1.0;
-    }
-  } // ends auto-blanking
+    autoBlank(inSample);
+  }
 
-  FloatType noise = (this->*noiseGenerator)() * ditherScaleFactor;
+  FloatType noise = (this->*noiseGenerator)();
   FloatType preDither = bUseErrorFeedback ? inSample - (this->*noiseShapingFilter)(Z1) : inSample;
-  FloatType preQuantize, postQuantize;
-  preQuantize = masterVolume * (preDither + noise);
-  postQuantize = reciprocalSignalMagnitude * round(maxSignalMagnitude * preQuantize); // quantize
-  Z1 = (postQuantize - preDither);
-  return postQuantize;
+  return quantize(preDither, noise);
 } // ends function: dither()
 
+// Block dither function: dither n samples (in[0], in[stride], in[2 * stride] ...) into out[] (which may be the same as in[]).
+// The noise for up to DITHER_BLOCK_SIZE samples is generated at a time (vectorised), and each combination of
+// auto-blanking and noise-shaping filter has its own loop. The result is identical to calling dither(inSample) n times.
+
+void dither(const FloatType* in, FloatType* out, size_t n, size_t stride = 1) {
+  FloatType noise[DITHER_BLOCK_SIZE];
+  while (n != 0) {
+    size_t count = std::min<size_t>(n, DITHER_BLOCK_SIZE);
+    generateNoise(noise, count);
+    (this->*ditherBlock)(in, out, noise, count, stride);
+    in += count * stride;
+    out += count * stride;
+    n -= count;
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 private:
+  enum ShaperType {
+    shaperNone, // (no error feedback)
+    shaperPassThrough,
+    shaperFIR,
+    shaperCascadedBiquad
+  };
+
   int oldRandom;
   int seed;
   FloatType Z1;       // last Quantization error
@@ -307,9 +501,8 @@ private:
   FloatType masterVolume;
   int64_t zeroCount; // number of consecutive zeroes in input;
   FloatType autoBlankDecayCutoff; // threshold at which ditherScaleFactor is set to zero during active blanking
-  std::mt19937 randGenerator; // Mersenne Twister - one of the best random number algorithms available
-  std::uniform_int_distribution<int> dist; // random number distribution
-  static const int randMax = 16777215; // 2^24 - 1 */
+  DitherRandom random; // counter-based PRNG (identical sequence for the sample-at-a-time and block functions)
+  static const int randMax = DitherRandom::randMax; // 2^24 - 1 */
   unsigned int signalBits;
   FloatType ditherBits;
   DitherProfile selectedDitherProfile;
@@ -318,6 +511,7 @@ private:
   FloatType outputLimit;
   FloatType(Ditherer::*noiseShapingFilter)(FloatType); // function pointer to noise-shaping filter
   FloatType(Ditherer::*noiseGenerator)(); // function pointer to noise-generator
+  void(Ditherer::*ditherBlock)(const FloatType*, FloatType*, const FloatType*, size_t, size_t); // function pointer to block dither loop
   bool bPulseEmitted;
 
   // Auto-Blanking parameters:
@@ -334,17 +528,104 @@ private:
 
   // FIR Filter-related stuff:
   int FIRLength;
-  FloatType FIRCoeffs[MAX_FIR_FILTER_SIZE];
-  FloatType FIRHistory[MAX_FIR_FILTER_SIZE]; // (circular) buffer for noise history
+  int FIRIndex; // position of newest sample in FIRHistory
+  FloatType FIRCoeffs[MAX_FIR_FILTER_SIZE]; // (reversed)
+  FloatType FIRHistory[2 * MAX_FIR_FILTER_SIZE]; // circular buffer for noise history (two copies, so that it can always be read contiguously)
+
+  // --- the dither engine (shared by both dither() functions) ---
+
+  void autoBlank(FloatType inSample) {
+    if (std::abs(inSample) < autoBlankLevelThreshold) {
+      ++zeroCount;
+      if (zeroCount > autoBlankTimeThreshold) {
+        ditherScaleFactor *= autoBlankDecayFactor; // decay
+        if (ditherScaleFactor < autoBlankDecayCutoff) {
+          ditherScaleFactor = 0.0; // decay cutoff
+          masterVolume = 0.0; // mute
+        }
+      }
+    }
+    else {
+      zeroCount = 0; // reset
+      ditherScaleFactor = maxDitherScaleFactor; // restore
+      masterVolume = 1.0;
+    }
+  }
+
+  FloatType quantize(FloatType preDither, FloatType noise) {
+    FloatType preQuantize, postQuantize;
+    preQuantize = masterVolume * (preDither + noise * ditherScaleFactor);
+    postQuantize = reciprocalSignalMagnitude * roundHalfAway(maxSignalMagnitude * preQuantize); // quantize
+    Z1 = (postQuantize - preDither);
+    return postQuantize;
+  }
+
+  // roundHalfAway() : identical to std::round() (halfway cases away from zero), but inline and branchless
+  // (std::round() is a library call on x64). Adding the largest value below one half, then truncating, rounds correctly
+  // for every value below 2^52; beyond that, every value is an integer already.
+  static FloatType roundHalfAway(FloatType x) {
+    if (!(std::abs(x) < static_cast<FloatType>(4503599627370496.0))) { // (also NaN)
+      return std::round(x);
+    }
+    const FloatType almostHalf = (sizeof(FloatType) == sizeof(float)) ? static_cast<FloatType>(0.49999997f) : static_cast<FloatType>(0.49999999999999994);
+    auto t = static_cast<FloatType>(static_cast<int64_t>(x + std::copysign(almostHalf, x)));
+    return std::copysign(t, x); // (keep the sign of zero)
+  }
+
+  template<bool AutoBlank, int Shaper>
+  void ditherLoop(const FloatType* in, FloatType* out, const FloatType* noise, size_t count, size_t stride) {
+    for (size_t i = 0; i < count; ++i) {
+      FloatType inSample = in[i * stride];
+      if (AutoBlank) {
+        autoBlank(inSample);
+      }
+      FloatType preDither;
+      switch (Shaper) { // (resolved at compile-time)
+      case shaperNone:
+        preDither = inSample;
+        break;
+      case shaperPassThrough:
+        preDither = inSample - noiseShaperPassThrough(Z1);
+        break;
+      case shaperFIR:
+        preDither = inSample - noiseShaperFIR(Z1);
+        break;
+      default:
+        preDither = inSample - noiseShaperCascadedBiquad(Z1);
+      }
+      out[i * stride] = quantize(preDither, noise[i]);
+    }
+  }
 
   // --- Noise-generating functions ---
+  // (the noise formulas are shared with generateNoise(), which produces the same noise for a block of samples)
+
+  static FloatType tpdf(int a, int b) {
+    return static_cast<FloatType>(a - b);
+  }
+
+  static FloatType rpdf(int r) {
+    static constexpr int halfRand = (randMax + 1) >> 1;
+    return static_cast<FloatType>(halfRand - r);
+  }
+
+  static const int gpdfN = 5; // number of PRNGs averaged by the Gaussian generator
+
+  static FloatType gpdf(const int* r) {
+    static constexpr int halfRand = (randMax + 1) >> 1;
+    FloatType sum = 0;
+    for (int i = 0; i < gpdfN; ++i) {
+      sum += r[i];
+    }
+    return static_cast<FloatType>(halfRand - sum / gpdfN);
+  }
 
   // pure flat tpdf generator
   // calculate two random numbers and subtracts them, yielding a triangular distribution (which is 'fattest' at zero).
   FloatType noiseGeneratorFlatTPDF() {
-    int a = dist(randGenerator);
-    int b = dist(randGenerator);
-    return static_cast<FloatType>(a - b);
+    int a = random.next();
+    int b = random.next();
+    return tpdf(a, b);
   }
 
   // The sloped TPDF generator remembers and subtracts the previous random number from the new random number,
@@ -353,26 +634,23 @@ private:
   // Thus, the resulting noise is violet noise instead of white, which is quite effective for dithering purposes.
   // It also has the advantage of only calcluating one random number on each iteration, instead of two.
   FloatType noiseGeneratorSlopedTPDF() {
-    int newRandom = dist(randGenerator);
-    auto tpdfNoise = static_cast<FloatType>(newRandom - oldRandom);
+    int newRandom = random.next();
+    FloatType tpdfNoise = tpdf(newRandom, oldRandom);
     oldRandom = newRandom;
     return tpdfNoise;
   }
 
   FloatType noiseGeneratorRPDF() { // rectangular PDF (single PRNG)
-    static constexpr int halfRand = (randMax + 1) >> 1;
-    return static_cast<FloatType>(halfRand - dist(randGenerator));
+    return rpdf(random.next());
   }
 
   FloatType noiseGeneratorGPDF() { // Gaussian PDF (n PRNGs)
     // calculate n random numbers and average them
-    static constexpr int halfRand = (randMax + 1) >> 1;
-    const int n = 5;
-    FloatType r = 0;
-    for (int i = 0; i < n; ++i) {
-      r += dist(randGenerator);
+    int r[gpdfN];
+    for (int i = 0; i < gpdfN; ++i) {
+      r[i] = random.next();
     }
-    return static_cast<FloatType>(halfRand - r/n);
+    return gpdf(r);
   }
 
   FloatType noiseGeneratorImpulse() { // impulse - emits a single pulse at the begininng, followed by zeroes (for testing only)
@@ -384,12 +662,58 @@ private:
   }
 
   FloatType noiseGeneratorLegacy() { // legacy noise generator (from previous version of ReSampler) - applies filter to noise _before_ injection into dither engine
-    int newRandom = dist(randGenerator);
-    auto tpdfNoise = static_cast<FloatType>(newRandom - oldRandom); // sloped TDPF
+    int newRandom = random.next();
+    FloatType tpdfNoise = tpdf(newRandom, oldRandom); // sloped TDPF
     oldRandom = newRandom;
     return static_cast<FloatType>(f2.filter(f1.filter(tpdfNoise)));
   }
 
+  // generateNoise() : the output of the noise generator for the next n (<= DITHER_BLOCK_SIZE) samples.
+  // The random numbers for the whole block are generated in one go (SIMD) and then shaped into the required distribution.
+  void generateNoise(FloatType* noise, size_t n) {
+    int32_t r[gpdfN * DITHER_BLOCK_SIZE];
+    switch (selectedDitherProfile.noiseGeneratorType) {
+    case flatTPDF:
+      random.generate(r, 2 * n);
+      for (size_t i = 0; i < n; ++i) {
+        noise[i] = tpdf(r[2 * i], r[2 * i + 1]);
+      }
+      break;
+    case RPDF:
+      random.generate(r, n);
+      for (size_t i = 0; i < n; ++i) {
+        noise[i] = rpdf(r[i]);
+      }
+      break;
+    case GPDF:
+      random.generate(r, gpdfN * n);
+      for (size_t i = 0; i < n; ++i) {
+        noise[i] = gpdf(r + gpdfN * i);
+      }
+      break;
+    case impulse:
+      for (size_t i = 0; i < n; ++i) {
+        noise[i] = noiseGeneratorImpulse();
+      }
+      break;
+    case legacyTPDF:
+      random.generate(r, n);
+      for (size_t i = 0; i < n; ++i) {
+        noise[i] = static_cast<FloatType>(f2.filter(f1.filter(tpdf(r[i], oldRandom))));
+        oldRandom = r[i];
+      }
+      break;
+    case slopedTPDF:
+    default:
+      random.generate(r, n);
+      noise[0] = tpdf(r[0], oldRandom);
+      for (size_t i = 1; i < n; ++i) {
+        noise[i] = tpdf(r[i], r[i - 1]);
+      }
+      oldRandom = r[n - 1];
+    }
+  }
+
   // --- Noise-shaping functions ---
 
   FloatType noiseShaperPassThrough(FloatType x) {
@@ -402,23 +726,81 @@ private:
 
   FloatType noiseShaperFIR(FloatType x) { // very simple FIR ...
 
-    // put sample at end of buffer:
-    FloatType* historyPtr = &FIRHistory[FIRLength - 1];
-    *historyPtr = x;
-
-    FloatType filterOutput = 0.0;
-
-    // macc with coefficients:
-    for (int k = 0; k < FIRLength; k++) {
-      filterOutput += *historyPtr-- * FIRCoeffs[k];
+    // macc the older samples with coefficients (oldest first, four independent sums).
+    // x is in the feedback loop, so it is added last, straight from the register - the rest doesn't have to wait for it.
+    const FloatType* history = &FIRHistory[FIRIndex + 1];
+    const int numOld = FIRLength - 1;
+    FloatType sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    int k = 0;
+    for (; k + 4 <= numOld; k += 4) {
+      sum0 += history[k] * FIRCoeffs[k];
+      sum1 += history[k + 1] * FIRCoeffs[k + 1];
+      sum2 += history[k + 2] * FIRCoeffs[k + 2];
+      sum3 += history[k + 3] * FIRCoeffs[k + 3];
+    }
+    for (; k < numOld; k++) {
+      sum0 += history[k] * FIRCoeffs[k];
     }
 
-    // shift buffer backwards for next time:
-    memmove(FIRHistory, &FIRHistory[1],
-      (FIRLength - 1) * sizeof(FloatType));
+    // put sample into both copies of the history, and advance for next time:
+    FIRHistory[FIRIndex] = x;
+    FIRHistory[FIRIndex + FIRLength] = x;
+    if (++FIRIndex == FIRLength) {
+      FIRIndex = 0;
+    }
 
-    return filterOutput;
+    return ((sum0 + sum1) + (sum2 + sum3)) + x * FIRCoeffs[numOld];
   }
 };
 
+//{{{
+// benchmarkDither() : compare the throughput of the sample-at-a-time and block dither() functions for every dither profile,
+// and check that they produce identical output (also when the block function is called with irregular block sizes)
+template <typename FloatType> void benchmarkDither() {
+
+  const size_t length = 1 << 20;
+  const int seed = 1;
+  std::vector<FloatType> input(length);
+  for (size_t i = 0; i < length; ++i) { // (quiet sine, with occasional silence for auto-blanking)
+    input[i] = ((i >> 16) % 4 == 3) ? static_cast<FloatType>(0.0) : static_cast<FloatType>(0.01 * std::sin(0.05 * static_cast<double>(i)));
+  }
+  std::vector<FloatType> outputs[3] { input, input, input };
+
+  bool allOk = true;
+  for (int p = 0; p < static_cast<int>(end); ++p) {
+    auto id = static_cast<DitherProfileID>(p);
+    for (bool bAutoBlank : { false, true }) {
+      Ditherer<FloatType> sampleDitherer(16, 1.0, bAutoBlank, seed, id);
+      Ditherer<FloatType> blockDitherer(16, 1.0, bAutoBlank, seed, id);
+      Ditherer<FloatType> irregularDitherer(16, 1.0, bAutoBlank, seed, id);
+
+      auto begin = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < length; ++i) {
+        outputs[0][i] = sampleDitherer.dither(input[i]);
+      }
+      auto middle = std::chrono::high_resolution_clock::now();
+      blockDitherer.dither(input.data(), outputs[1].data(), length);
+      auto finish = std::chrono::high_resolution_clock::now();
+
+      for (size_t i = 0, n = 1; i < length; i += n, n = n * 7 % 1009) {
+        irregularDitherer.dither(input.data() + i, outputs[2].data() + i, std::min(n, length - i));
+      }
+
+      double sampleSeconds = std::chrono::duration<double>(middle - begin).count();
+      double blockSeconds = std::chrono::duration<double>(finish - middle).count();
+      bool ok = std::equal(outputs[0].begin(), outputs[0].end(), outputs[1].begin()) &&
+                std::equal(outputs[0].begin(), outputs[0].end(), outputs[2].begin());
+      allOk = allOk && ok;
+
+      std::cout << p << " : " << ditherProfileList[p].name << (bAutoBlank ? " (autoblank)" : "") << "\n";
+      std::cout << "  sample: " << length / sampleSeconds / 1.0e6 << " Msamples/sec"
+                << "  block: " << length / blockSeconds / 1.0e6 << " Msamples/sec"
+                << " [" << sampleSeconds / blockSeconds << "x]"
+                << (ok ? " (bit-identical)" : " MISMATCH") << std::endl;
+    }
+  }
+  std::cout << (allOk ? "all dither profiles ok" : "dither self-test FAILED") << std::endl;
+}
+//}}}
+
 } // namespace ReSampler
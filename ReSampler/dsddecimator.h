@@ -0,0 +1,414 @@
+// dsddecimator.h : decimation of 1-bit DSD streams to multi-bit PCM (table-driven front end, followed by half-rate FIR stages)
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "FIRFilter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+//}}}
+
+namespace ReSampler {
+  /*
+  DsdDecimator decodes DSD directly to PCM at 1/8, 1/16, 1/32 ... of the DSD sample rate, in several stages:
+
+  1. The first stage decimates by 8, 16, 32 ... (one output sample per 1, 2, 4 ... bytes). Since every DSD sample is +1 or -1,
+  the contribution of 8 consecutive taps of its low-pass filter to an output sample depends only on the value
+  of the byte which lines up with those taps. Those contributions are pre-computed for all 256 byte values,
+  so that the filter costs one table lookup (and one addition) per byte, instead of 8 multiply-adds.
+
+  2. Each further stage decimates by 2, with a half-band FIR filter (only the output samples which are kept are calculated,
+  and the taps which are zero - every second one, except the centre tap - are skipped).
+
+  Each filter only needs to protect the final passband (dsdFrontEndPassband) from aliasing, so the early stages,
+  which run at the highest rates, have short filters. The split between the two kinds of stage is chosen
+  to minimize the number of operations per output sample.
+
+  Samples of all channels are held interleaved, and the channels are filtered together, so that each table row
+  (or coefficient) is fetched once for all channels, and each channel has its own independent accumulator.
+  */
+
+  const unsigned int dsdFrontEndMinRate = 352800;   // lowest PCM rate produced by the front end
+  const double dsdFrontEndPassband = 0.3;           // passband (as a fraction of the PCM rate) which is protected from aliasing
+  const double dsdFrontEndAttenuation = 140.0;      // stop-band attenuation (dB)
+  const uint8_t dsdSilence = 0x69;                  // DSD idle pattern (zero mean)
+
+  //{{{
+  class DsdDecimator {
+  public:
+    static const int maxChannels = 8; // dsf/dff readers check this before enabling decimation
+
+    //{{{
+    DsdDecimator (int numChannels, unsigned int dsdSampleRate, int decimation, bool lsbFirst, size_t maxPushBytes)
+      : numChannels(numChannels), decimation(decimation) {
+    // decimation : number of DSD bytes per output sample (ie PCM rate = dsdSampleRate / (8 * decimation)); must be a power of 2
+    // lsbFirst : bit order of the bytes (true: LSB is played first)
+    // maxPushBytes : largest number of bytes (per channel) that will be pushed at once
+
+      assert(numChannels <= maxChannels);
+      double pcmRate = static_cast<double>(dsdSampleRate) / (8 * decimation);
+      double passband = dsdFrontEndPassband * pcmRate;
+
+      // choose the decimation of the first stage (table lookups, plus multiply-adds of the half-rate stages, per output sample):
+      tableDecimation = 1;
+      double bestCost = 0.0;
+      for (int d = 1; d <= decimation; d *= 2) {
+        double rate = dsdSampleRate / (8.0 * d);
+        double cost = getTableBytes(dsdSampleRate, rate, passband) * rate;
+        for (; rate > pcmRate; rate /= 2.0) {
+          cost += (getHalfRateTaps(rate, passband) + 3) / 2 * rate / 2.0;
+          }
+        if (d == 1 || cost < bestCost) {
+          bestCost = cost;
+          tableDecimation = d;
+          }
+        }
+
+      // first stage (table-driven) : an even number of bytes, so that the centre of the filter falls on a byte boundary
+      double rate = dsdSampleRate / (8.0 * tableDecimation);
+      numBytes = getTableBytes(dsdSampleRate, rate, passband);
+      int numTaps = 8 * numBytes;
+      std::vector<double> taps = makeTaps(numTaps, rate, dsdSampleRate);
+
+      // table[k * 256 + b] : contribution of byte b, in position k of the filter
+      table.resize(static_cast<size_t>(numBytes) * 256);
+      for (int k = 0; k < numBytes; ++k) {
+        for (int b = 0; b < 256; ++b) {
+          double acc = 0.0;
+          for (int j = 0; j < 8; ++j) {
+            int bit = lsbFirst ? (b >> j) & 1 : (b >> (7 - j)) & 1;
+            acc += bit ? taps[8 * k + j] : -taps[8 * k + j];
+            }
+          table[k * 256 + b] = acc;
+          }
+        }
+
+      // group delay (in bytes) of the whole chain (the first stage contributes 4 * numBytes - 0.5 bits)
+      delay = static_cast<size_t>(numBytes / 2);
+
+      // half-rate stages (odd lengths, so that each delays by a whole number of bytes):
+      for (int d = 2 * tableDecimation; d <= decimation; d *= 2) {
+        HalfRateStage stage;
+        stage.numTaps = getHalfRateTaps(rate, passband);
+        std::vector<double> taps = makeTaps(stage.numTaps, rate / 2.0, rate);
+        for (int k = 0; k < stage.numTaps; ++k) {
+          if ((k & 1) == 0 || k == (stage.numTaps - 1) / 2) {
+            stage.taps.push_back(taps[k]);
+            stage.offsets.push_back(k);
+            }
+          }
+        delay += static_cast<size_t>((stage.numTaps - 1) / 2) * (d / 2);
+        stages.push_back(stage);
+        rate /= 2.0;
+        }
+
+      // allocate everything up front (bytes are only pushed once all previous output has been pulled):
+      // (before the first push, the buffer holds the priming; after that, less than numBytes)
+      size_t maxBytes = std::max(maxPushBytes, 2 * (delay + decimation)) + std::max(delay, static_cast<size_t>(numBytes));
+      bytes.resize(maxBytes * numChannels);
+      size_t maxFrames = maxBytes + 1;
+      for (auto& stage : stages) {
+        stage.samples.resize((stage.numTaps + maxFrames) * numChannels);
+        maxFrames = maxFrames / 2 + 1;
+        }
+      output.resize(maxFrames * numChannels);
+
+      reset();
+      }
+    //}}}
+
+    //{{{
+    static int getDecimation (unsigned int dsdSampleRate, unsigned int outputSampleRate) {
+    // getDecimation() : the largest decimation (bytes per output sample) which still leaves a PCM rate of
+    // at least dsdFrontEndMinRate, and keeps the final output band within the front end's passband.
+    // Returns 0 if there is no suitable decimation (in which case the DSD stream must be converted bit-by-bit).
+
+      double minRate = std::max(static_cast<double>(dsdFrontEndMinRate), outputSampleRate / (2.0 * dsdFrontEndPassband));
+      int decimation = 0;
+      for (int d = 1; dsdSampleRate % (8 * d) == 0 && dsdSampleRate / (8.0 * d) >= minRate; d *= 2) {
+        decimation = d;
+        }
+      return decimation;
+      }
+    //}}}
+    //{{{
+    void reset() {
+    // reset() : clear history
+
+      begin = 0;
+      end = 0;
+      for (auto& stage : stages) {
+        stage.begin = 0;
+        stage.end = 0;
+        }
+      outputBegin = 0;
+      outputEnd = 0;
+      flushed = false;
+
+      // Each output sample is calculated from a window which starts at the corresponding input sample.
+      // Priming with silence equal to the group delay centres the windows instead, so that the output isn't delayed.
+      memset(bytes.data(), dsdSilence, delay * numChannels);
+      end = delay;
+      }
+    //}}}
+    //{{{
+    void pushInterleaved (const uint8_t* input, size_t numBytesPerChannel) {
+    // pushInterleaved() : input has the bytes of each channel interleaved (eg dff)
+
+      memcpy(bytes.data() + end * numChannels, input, numBytesPerChannel * numChannels);
+      end += numBytesPerChannel;
+      process();
+      }
+    //}}}
+    //{{{
+    void pushPlanar (uint8_t* const* input, size_t numBytesPerChannel) {
+    // pushPlanar() : input has a separate block of bytes for each channel (eg dsf)
+
+      uint8_t* p = bytes.data() + end * numChannels;
+      for (size_t i = 0; i < numBytesPerChannel; ++i) {
+        for (int ch = 0; ch < numChannels; ++ch) {
+          *p++ = input[ch][i];
+          }
+        }
+      end += numBytesPerChannel;
+      process();
+      }
+    //}}}
+    //{{{
+    void flush() {
+    // flush() : push enough silence to release the output samples centred on the last bytes pushed
+
+      size_t n = 2 * (delay + decimation);
+      memset(bytes.data() + end * numChannels, dsdSilence, n * numChannels);
+      end += n;
+      process();
+      flushed = true;
+      }
+    //}}}
+    //{{{
+    bool isFlushed() const {
+      return flushed;
+      }
+    //}}}
+    //{{{
+    size_t getAvailableFrames() const {
+      return outputEnd - outputBegin;
+      }
+    //}}}
+    //{{{
+    template <typename FloatType> size_t pull (FloatType* buffer, size_t maxFrames) {
+    // pull() : read up to maxFrames interleaved PCM frames. Returns number of frames read.
+    // (Call until no more frames are available before pushing more bytes)
+
+      size_t frames = std::min(maxFrames, getAvailableFrames());
+      const double* p = output.data() + outputBegin * numChannels;
+      for (size_t i = 0; i < frames * numChannels; ++i) {
+        buffer[i] = static_cast<FloatType>(p[i]);
+        }
+      outputBegin += frames;
+      return frames;
+      }
+    //}}}
+
+  private:
+    //{{{
+    struct HalfRateStage {
+      int numTaps;
+      std::vector<double> taps;  // non-zero taps
+      std::vector<int> offsets;  // positions of the non-zero taps
+      std::vector<double> samples; // interleaved
+      size_t begin;             // (in frames) first frame of the next output sample's window
+      size_t end;               // (in frames) end of data
+      };
+    //}}}
+
+    int numChannels;
+    int decimation;           // bytes per output sample
+    int tableDecimation;      // bytes per output sample of the first stage
+    int numBytes;             // length of first stage's filter, in bytes
+    std::vector<double> table;
+    std::vector<uint8_t> bytes; // interleaved
+    size_t begin;             // (in bytes per channel) first byte of the next output sample's window
+    size_t end;               // (in bytes per channel) end of data
+    std::vector<HalfRateStage> stages;
+    std::vector<double> output; // interleaved
+    size_t outputBegin;
+    size_t outputEnd;
+    size_t delay;             // group delay of all stages, in bytes
+    bool flushed;
+
+    //{{{
+    static int getNumTaps (double sampleRate, double transitionWidth) {
+    // getNumTaps() : length of Kaiser-windowed filter for the given transition width (Hz) and dsdFrontEndAttenuation
+
+      return static_cast<int>(std::ceil((dsdFrontEndAttenuation - 7.95) / (2.285 * 2.0 * M_PI * transitionWidth / sampleRate)));
+      }
+    //}}}
+    //{{{
+    static int getTableBytes (unsigned int dsdSampleRate, double outputRate, double passband) {
+    // getTableBytes() : length (in bytes - always even) of the first stage's filter
+
+      return ((getNumTaps(dsdSampleRate, outputRate - 2.0 * passband) + 15) / 16) * 2;
+      }
+    //}}}
+    //{{{
+    static int getHalfRateTaps (double sampleRate, double passband) {
+    // getHalfRateTaps() : length of a half-rate stage's filter (4n + 3, which puts the centre tap at an odd index)
+
+      return ((getNumTaps(sampleRate, sampleRate / 2.0 - 2.0 * passband) + 1) / 4) * 4 + 3;
+      }
+    //}}}
+    //{{{
+    static std::vector<double> makeTaps (int numTaps, double outputRate, double sampleRate) {
+    // makeTaps() : low-pass filter with cutoff at the output Nyquist frequency, and unity gain at DC
+
+      std::vector<double> taps(static_cast<size_t>(numTaps));
+      makeLPF<double>(taps.data(), numTaps, 0.5 * outputRate, sampleRate);
+      applyKaiserWindow<double>(taps.data(), numTaps, calcKaiserBeta<double>(dsdFrontEndAttenuation));
+      double sum = 0.0;
+      for (double t : taps) {
+        sum += t;
+        }
+      for (double& t : taps) {
+        t /= sum;
+        }
+      return taps;
+      }
+    //}}}
+    //{{{
+    void process() {
+    // process() : run all available samples through every stage
+
+      switch (numChannels) {
+        case 1:
+          processChannels<1>();
+          break;
+        case 2:
+          processChannels<2>();
+          break;
+        case 6:
+          processChannels<6>();
+          break;
+        default:
+          processChannels<0>();
+          break;
+        }
+      }
+    //}}}
+    //{{{
+    template <int NumChannels> void processChannels() {
+    // processChannels() : NumChannels is known at compile time (when it is non-zero), so that the accumulators can be kept in registers
+
+      // the output is only appended to once it has all been pulled:
+      assert(outputBegin == outputEnd);
+      outputBegin = 0;
+      outputEnd = 0;
+
+      double* out = stages.empty() ? output.data() : stages[0].samples.data() + stages[0].end * numChannels;
+      size_t frames = tableStage<NumChannels>(out);
+      if (stages.empty()) {
+        outputEnd = frames;
+        }
+      else {
+        stages[0].end += frames;
+        for (size_t i = 0; i < stages.size(); ++i) {
+          bool last = (i == stages.size() - 1);
+          HalfRateStage& next = stages[last ? i : i + 1];
+          double* out = last ? output.data() : next.samples.data() + next.end * numChannels;
+          frames = halfRateStage<NumChannels>(stages[i], out);
+          if (last) {
+            outputEnd = frames;
+            }
+          else {
+            next.end += frames;
+            }
+          }
+        }
+      }
+    //}}}
+    //{{{
+    template <int NumChannels> size_t tableStage (double* out) {
+    // tableStage() : decimate by 8 * tableDecimation, one table lookup per byte. The even and odd table rows are summed separately,
+    // to shorten the chains of dependent additions.
+
+      const int nc = (NumChannels != 0) ? NumChannels : numChannels;
+      const int stride = nc;
+      const double* tbl = table.data();
+
+      size_t frames = 0;
+      for (; end - begin >= static_cast<size_t>(numBytes); begin += tableDecimation, ++frames) {
+        const uint8_t* window = bytes.data() + begin * stride;
+        double acc0[maxChannels] {};
+        double acc1[maxChannels] {};
+
+        for (int k = 0; k < numBytes; k += 2) { // (numBytes is even)
+          const double* row0 = tbl + k * 256;
+          const double* row1 = row0 + 256;
+          const uint8_t* b0 = window + k * stride;
+          const uint8_t* b1 = b0 + stride;
+          for (int ch = 0; ch < nc; ++ch) {
+            acc0[ch] += row0[b0[ch]];
+            acc1[ch] += row1[b1[ch]];
+            }
+          }
+
+        for (int ch = 0; ch < nc; ++ch) {
+          out[frames * stride + ch] = acc0[ch] + acc1[ch];
+          }
+        }
+
+      // move the unconsumed bytes to the start of the buffer:
+      memmove(bytes.data(), bytes.data() + begin * stride, (end - begin) * stride);
+      end -= begin;
+      begin = 0;
+      return frames;
+      }
+    //}}}
+    //{{{
+    template <int NumChannels> size_t halfRateStage (HalfRateStage& stage, double* out) {
+    // halfRateStage() : decimate by 2
+
+      const int nc = (NumChannels != 0) ? NumChannels : numChannels;
+      const int stride = nc;
+      const double* taps = stage.taps.data();
+      const int* offsets = stage.offsets.data();
+      const auto numTaps = static_cast<int>(stage.taps.size());
+
+      size_t frames = 0;
+      for (; stage.end - stage.begin >= static_cast<size_t>(stage.numTaps); stage.begin += 2, ++frames) {
+        const double* window = stage.samples.data() + stage.begin * stride;
+        double acc[maxChannels] {};
+        for (int k = 0; k < numTaps; ++k) {
+          const double* x = window + offsets[k] * stride;
+          for (int ch = 0; ch < nc; ++ch) {
+            acc[ch] += taps[k] * x[ch];
+            }
+          }
+        for (int ch = 0; ch < nc; ++ch) {
+          out[frames * stride + ch] = acc[ch];
+          }
+        }
+
+      // move the unconsumed samples to the start of the buffer:
+      std::copy(stage.samples.begin() + stage.begin * stride, stage.samples.begin() + stage.end * stride, stage.samples.begin());
+      stage.end -= stage.begin;
+      stage.begin = 0;
+      return frames;
+      }
+    //}}}
+    };
+  //}}}
+}
@@ -13,10 +13,12 @@
 // simple dsf file reader
 //{{{  includes
 #include "osspecific.h"
+#include "dsddecimator.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -182,11 +184,34 @@ namespace ReSampler {
     }
     //}}}
 
+    //{{{
+    // enableDecimation() : decode the DSD stream directly to PCM (at 1/8 or less of the DSD sample rate),
+    // instead of one sample per bit. samplerate(), frames() and samples() then describe the PCM stream.
+    // Returns false (and leaves the file unchanged) if there is no decimation ratio suitable for outputSampleRate.
+    bool enableDecimation(unsigned int outputSampleRate) {
+      int decimation = DsdDecimator::getDecimation(_sampleRate, outputSampleRate);
+      if (err || decimation == 0 || numChannels > static_cast<uint32_t>(DsdDecimator::maxChannels)) {
+        return false;
+      }
+      decimator.reset(new DsdDecimator(static_cast<int>(numChannels), _sampleRate, decimation, dsfFmtChunk.bitOrder != 8, blockSize));
+      _sampleRate /= 8 * decimation;
+      numFrames /= 8 * decimation;
+      numSamples = numFrames * numChannels;
+      framesDecoded = 0;
+      bytesPushed = 0;
+      return true;
+    }
+    //}}}
+
     // read() : reads count interleaved FloatType samples into buffer
 
     //{{{
     template<typename FloatType> uint64_t read(FloatType* buffer, uint64_t count) {
 
+      if (decimator) {
+        return readDecimated(buffer, count);
+      }
+
       /*
 
       In a dsf file,
@@ -265,6 +290,11 @@ namespace ReSampler {
       bufferIndex = blockSize; // empty (zero -> full)
       currentBit = 0;
       currentChannel = 0;
+      if (decimator) {
+        decimator->reset();
+        framesDecoded = 0;
+        bytesPushed = pos / numChannels; // (pos is a whole number of blocks for every channel)
+      }
 
       // seek:
       file.clear();
@@ -294,6 +324,9 @@ namespace ReSampler {
     uint64_t startOfData;
     uint64_t endOfData;
     double samplTbl[256][8];
+    std::unique_ptr<DsdDecimator> decimator;
+    uint64_t framesDecoded;
+    uint64_t bytesPushed; // per channel, of the (dsfFmtChunk.numSamples + 7) / 8 in the stream
 
     //{{{
     void assertSizes() {
@@ -402,6 +435,31 @@ namespace ReSampler {
     }
     //}}}
     //{{{
+    // readDecimated() : reads count interleaved FloatType samples (at the decimated rate) into buffer
+    template<typename FloatType> uint64_t readDecimated(FloatType* buffer, uint64_t count) {
+      uint64_t framesWanted = std::min(count / numChannels, numFrames - framesDecoded);
+      uint64_t framesRead = 0;
+      while (framesRead < framesWanted) {
+        if (decimator->getAvailableFrames() == 0) {
+          if (readBlocks() != 0) {
+            // the last block is padded with zeros, which would decode as full scale negative DC : push only the stream
+            uint64_t streamBytes = (dsfFmtChunk.numSamples + 7) / 8;
+            uint64_t n = std::min<uint64_t>(blockSize, streamBytes - std::min(bytesPushed, streamBytes));
+            decimator->pushPlanar(channelBuffer, static_cast<size_t>(n));
+            bytesPushed += blockSize;
+          } else if (!decimator->isFlushed()) {
+            decimator->flush();
+          } else {
+            break; // no more data
+          }
+        }
+        framesRead += decimator->pull(buffer + framesRead * numChannels, framesWanted - framesRead);
+      }
+      framesDecoded += framesRead;
+      return framesRead * numChannels;
+    }
+    //}}}
+    //{{{
     // makeTbl() : translates all possible uint8_t values into sets of 8 floating point sample values.
     void makeTbl() { // generate sample translation table
       for (int i = 0; i < 256; ++i) {
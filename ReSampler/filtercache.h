@@ -0,0 +1,285 @@
+// filtercache.h : persistent (on-disk) cache of designed filter coefficients
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "osspecific.h"
+#include "batch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined (_WIN32) && !defined (_WIN64)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+//}}}
+
+namespace ReSampler {
+  // Cache file format version. Increment whenever the file layout changes.
+  const uint32_t filterCacheFormatVersion = 1;
+
+  // Filter design version. Increment whenever makeFilterCoefficients() (or anything it calls)
+  // is changed in a way which alters its output, so that stale designs are not loaded.
+  const uint32_t filterDesignVersion = 1;
+
+  //{{{
+  // FilterDesignKey : every parameter which affects the design of a filter
+  struct FilterDesignKey {
+    int32_t inputSampleRate;
+    int32_t outputSampleRate;
+    int32_t numerator;
+    int32_t denominator;
+    int32_t overSamplingFactor;
+    int32_t minPhase;
+    double lpfCutoff;
+    double lpfTransitionWidth;
+    };
+  //}}}
+  //{{{
+  // FilterCacheHeader : header of a cache file, which is followed by numTaps coefficients
+  struct FilterCacheHeader {
+    char magic[4];              // "RSFC"
+    uint32_t formatVersion;
+    uint32_t designVersion;
+    uint32_t sampleSize;        // sizeof(FloatType)
+    FilterDesignKey key;
+    uint64_t numTaps;
+    uint64_t checksum;          // FNV-1a of the coefficients
+    };
+  //}}}
+  static_assert(sizeof(FilterDesignKey) == 40, "FilterDesignKey must not contain padding");
+  static_assert(sizeof(FilterCacheHeader) == 72, "FilterCacheHeader must not contain padding");
+
+  //{{{
+  // FilterCacheStats : process-wide counts of cache files loaded, saved, and rejected (wrong version, or failed checksum)
+  struct FilterCacheStats {
+    std::atomic<int> loaded;
+    std::atomic<int> saved;
+    std::atomic<int> rejected;
+    };
+  //}}}
+  //{{{
+  inline FilterCacheStats& getFilterCacheStats() {
+    static FilterCacheStats stats {{0}, {0}, {0}};
+    return stats;
+    }
+  //}}}
+
+  //{{{
+  inline uint64_t fnv1a (const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ p[i]) * 1099511628211ull;
+      }
+    return hash;
+    }
+  //}}}
+  //{{{
+  template <typename FloatType> std::string getFilterCacheFilename (const std::string& directory, const FilterDesignKey& key) {
+  // getFilterCacheFilename() : file name is derived from a hash of the key (the key itself is verified when loading)
+
+    uint32_t versions[3] {filterCacheFormatVersion, filterDesignVersion, static_cast<uint32_t>(sizeof(FloatType))};
+    uint64_t hash = fnv1a(&key, sizeof(key), fnv1a(versions, sizeof(versions)));
+    char name[40];
+    snprintf(name, sizeof(name), "filter-%016llx.rsfc", static_cast<unsigned long long>(hash));
+    return joinPath(directory, name);
+    }
+  //}}}
+
+  //{{{
+  class MappedFile {
+  // MappedFile : read-only memory mapping of an entire file
+  public:
+    //{{{
+    explicit MappedFile (const std::string& path) : data(nullptr), size(0) {
+
+      #if defined (_WIN32) || defined (_WIN64)
+        file = CreateFileW(toWide(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        mapping = nullptr;
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+          return;
+          }
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+          return;
+          }
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data != nullptr) {
+          size = static_cast<size_t>(fileSize.QuadPart);
+          }
+      #else
+        fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+          return;
+          }
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          data = p;
+          size = static_cast<size_t>(st.st_size);
+          }
+      #endif
+      }
+    //}}}
+    //{{{
+    ~MappedFile() {
+
+      #if defined (_WIN32) || defined (_WIN64)
+        if (data != nullptr) {
+          UnmapViewOfFile(data);
+          }
+        if (mapping != nullptr) {
+          CloseHandle(mapping);
+          }
+        if (file != INVALID_HANDLE_VALUE) {
+          CloseHandle(file);
+          }
+      #else
+        if (data != nullptr) {
+          munmap(data, size);
+          }
+        if (fd >= 0) {
+          close(fd);
+          }
+      #endif
+      }
+    //}}}
+
+    MappedFile (const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    //{{{
+    const void* getData() const {
+      return data;
+      }
+    //}}}
+    //{{{
+    size_t getSize() const {
+      return size;
+      }
+    //}}}
+
+  private:
+    void* data;
+    size_t size;
+    #if defined (_WIN32) || defined (_WIN64)
+      HANDLE file;
+      HANDLE mapping;
+    #else
+      int fd;
+    #endif
+    };
+  //}}}
+
+  //{{{
+  template <typename FloatType> bool loadFilterFromCache (const std::string& directory, const FilterDesignKey& key, std::vector<FloatType>& taps) {
+  // loadFilterFromCache() : returns true if a valid design was found. Files with a different version, key or sample size,
+  // or which are truncated or fail the checksum, are rejected (and will be overwritten by a fresh design).
+
+    MappedFile file(getFilterCacheFilename<FloatType>(directory, key));
+    if (file.getData() == nullptr) {
+      return false;
+      }
+
+    FilterCacheHeader header;
+    bool valid = file.getSize() >= sizeof(header);
+    if (valid) {
+      memcpy(&header, file.getData(), sizeof(header));
+      valid = memcmp(header.magic, "RSFC", 4) == 0
+        && header.formatVersion == filterCacheFormatVersion
+        && header.designVersion == filterDesignVersion
+        && header.sampleSize == sizeof(FloatType)
+        && memcmp(&header.key, &key, sizeof(key)) == 0
+        && header.numTaps != 0
+        && file.getSize() == sizeof(header) + header.numTaps * sizeof(FloatType);
+      }
+
+    const char* coefficients = static_cast<const char*>(file.getData()) + sizeof(header);
+    if (valid) {
+      valid = fnv1a(coefficients, header.numTaps * sizeof(FloatType)) == header.checksum;
+      }
+
+    if (!valid) {
+      ++getFilterCacheStats().rejected;
+      return false;
+      }
+
+    taps.resize(static_cast<size_t>(header.numTaps));
+    memcpy(taps.data(), coefficients, taps.size() * sizeof(FloatType));
+    ++getFilterCacheStats().loaded;
+    return true;
+    }
+  //}}}
+  //{{{
+  template <typename FloatType> bool saveFilterToCache (const std::string& directory, const FilterDesignKey& key, const std::vector<FloatType>& taps) {
+  // saveFilterToCache() : the file is written under a temporary name, and then renamed,
+  // so that other processes sharing the cache never see a partially-written file
+
+    if (!makeDirectories(directory)) {
+      return false;
+      }
+
+    FilterCacheHeader header;
+    memcpy(header.magic, "RSFC", 4);
+    header.formatVersion = filterCacheFormatVersion;
+    header.designVersion = filterDesignVersion;
+    header.sampleSize = sizeof(FloatType);
+    header.key = key;
+    header.numTaps = taps.size();
+    header.checksum = fnv1a(taps.data(), taps.size() * sizeof(FloatType));
+
+    std::string filename = getFilterCacheFilename<FloatType>(directory, key);
+    std::string tmpFilename = filename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+      static_cast<size_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())) + ".tmp";
+
+    #if defined (_WIN32) || defined (_WIN64)
+      FILE* f = _wfopen(toWide(tmpFilename).c_str(), L"wb");
+    #else
+      FILE* f = fopen(tmpFilename.c_str(), "wb");
+    #endif
+    if (f == nullptr) {
+      return false;
+      }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+           && fwrite(taps.data(), sizeof(FloatType), taps.size(), f) == taps.size();
+    ok = (fclose(f) == 0) && ok;
+
+    #if defined (_WIN32) || defined (_WIN64)
+      ok = ok && MoveFileExW(toWide(tmpFilename).c_str(), toWide(filename).c_str(), MOVEFILE_REPLACE_EXISTING);
+      if (!ok) {
+        _wremove(toWide(tmpFilename).c_str());
+        }
+    #else
+      ok = ok && (rename(tmpFilename.c_str(), filename.c_str()) == 0);
+      if (!ok) {
+        remove(tmpFilename.c_str());
+        }
+    #endif
+
+    if (ok) {
+      ++getFilterCacheStats().saved;
+      }
+    return ok;
+    }
+  //}}}
+}
@@ -0,0 +1,310 @@
+// interleave.h : conversion between interleaved samples (as read from / written to files) and planar samples (one buffer per channel)
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(USE_AVX) || defined(_M_X64) || defined(__x86_64__) || defined(USE_SSE2)
+  #include <emmintrin.h>
+  #include <xmmintrin.h>
+  #define INTERLEAVE_USE_SSE2
+#endif
+//}}}
+
+// Both directions are a transpose of a (frames x channels) matrix. The common layouts (mono, stereo, 5.1 and 7.1)
+// have kernels with the number of channels fixed at compile time; with SSE2, stereo is done by shuffles, and 5.1 / 7.1
+// by 4x4 (float) or 2x2 (double) transposes in registers, so that every load and store is a whole vector.
+// (For 6 channels of float, the transposes cover channels 0-3 and 2-5; the overlapping channels are simply written twice.)
+// Other numbers of channels use a plain loop.
+
+namespace ReSampler {
+
+  //{{{
+  // deinterleaveSIMD() / interleaveSIMD() : transpose as many frames as possible with vector instructions.
+  // Return the number of frames done (the remainder is left to the scalar loop)
+  template <int N, typename FloatType> inline size_t deinterleaveSIMD (const FloatType*, FloatType* const*, size_t) {
+    return 0;
+    }
+
+  template <int N, typename FloatType> inline size_t interleaveSIMD (const FloatType* const*, FloatType*, size_t) {
+    return 0;
+    }
+
+  #ifdef INTERLEAVE_USE_SSE2
+    //{{{
+    template <int N> inline size_t deinterleaveSIMD (const float* in, float* const* out, size_t frames) {
+
+      size_t f = 0;
+      if (N == 2) {
+        for (; f + 4 <= frames; f += 4) {
+          __m128 a = _mm_loadu_ps(in + 2 * f);     // L0 R0 L1 R1
+          __m128 b = _mm_loadu_ps(in + 2 * f + 4); // L2 R2 L3 R3
+          _mm_storeu_ps(out[0] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+          _mm_storeu_ps(out[1] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+          }
+        }
+      else if (N >= 4) {
+        for (; f + 4 <= frames; f += 4) {
+          const float* p = in + f * N;
+          for (int c = 0; c < N; c += 4) {
+            int c0 = std::min(c, N - 4);
+            __m128 r0 = _mm_loadu_ps(p + c0);
+            __m128 r1 = _mm_loadu_ps(p + N + c0);
+            __m128 r2 = _mm_loadu_ps(p + 2 * N + c0);
+            __m128 r3 = _mm_loadu_ps(p + 3 * N + c0);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out[c0] + f, r0);
+            _mm_storeu_ps(out[c0 + 1] + f, r1);
+            _mm_storeu_ps(out[c0 + 2] + f, r2);
+            _mm_storeu_ps(out[c0 + 3] + f, r3);
+            }
+          }
+        }
+      return f;
+      }
+    //}}}
+    //{{{
+    template <int N> inline size_t interleaveSIMD (const float* const* in, float* out, size_t frames) {
+
+      size_t f = 0;
+      if (N == 2) {
+        for (; f + 4 <= frames; f += 4) {
+          __m128 l = _mm_loadu_ps(in[0] + f);
+          __m128 r = _mm_loadu_ps(in[1] + f);
+          _mm_storeu_ps(out + 2 * f, _mm_unpacklo_ps(l, r));
+          _mm_storeu_ps(out + 2 * f + 4, _mm_unpackhi_ps(l, r));
+          }
+        }
+      else if (N >= 4) {
+        for (; f + 4 <= frames; f += 4) {
+          float* p = out + f * N;
+          for (int c = 0; c < N; c += 4) {
+            int c0 = std::min(c, N - 4);
+            __m128 r0 = _mm_loadu_ps(in[c0] + f);
+            __m128 r1 = _mm_loadu_ps(in[c0 + 1] + f);
+            __m128 r2 = _mm_loadu_ps(in[c0 + 2] + f);
+            __m128 r3 = _mm_loadu_ps(in[c0 + 3] + f);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(p + c0, r0);
+            _mm_storeu_ps(p + N + c0, r1);
+            _mm_storeu_ps(p + 2 * N + c0, r2);
+            _mm_storeu_ps(p + 3 * N + c0, r3);
+            }
+          }
+        }
+      return f;
+      }
+    //}}}
+    //{{{
+    template <int N> inline size_t deinterleaveSIMD (const double* in, double* const* out, size_t frames) {
+
+      size_t f = 0;
+      if (N % 2 == 0) {
+        for (; f + 2 <= frames; f += 2) {
+          const double* p = in + f * N;
+          for (int c = 0; c < N; c += 2) {
+            __m128d a = _mm_loadu_pd(p + c);     // frame f: channels c, c + 1
+            __m128d b = _mm_loadu_pd(p + N + c); // frame f + 1
+            _mm_storeu_pd(out[c] + f, _mm_unpacklo_pd(a, b));
+            _mm_storeu_pd(out[c + 1] + f, _mm_unpackhi_pd(a, b));
+            }
+          }
+        }
+      return f;
+      }
+    //}}}
+    //{{{
+    template <int N> inline size_t interleaveSIMD (const double* const* in, double* out, size_t frames) {
+
+      size_t f = 0;
+      if (N % 2 == 0) {
+        for (; f + 2 <= frames; f += 2) {
+          double* p = out + f * N;
+          for (int c = 0; c < N; c += 2) {
+            __m128d a = _mm_loadu_pd(in[c] + f);     // channel c: frames f, f + 1
+            __m128d b = _mm_loadu_pd(in[c + 1] + f); // channel c + 1
+            _mm_storeu_pd(p + c, _mm_unpacklo_pd(a, b));
+            _mm_storeu_pd(p + N + c, _mm_unpackhi_pd(a, b));
+            }
+          }
+        }
+      return f;
+      }
+    //}}}
+  #endif
+  //}}}
+  //{{{
+  // deinterleaveN() / interleaveN() : transpose with a fixed number of channels
+  template <int N, typename FloatType> inline void deinterleaveN (const FloatType* in, FloatType* const* out, size_t frames) {
+
+    for (size_t f = deinterleaveSIMD<N>(in, out, frames); f < frames; ++f) {
+      for (int ch = 0; ch < N; ++ch) {
+        out[ch][f] = in[f * N + ch];
+        }
+      }
+    }
+
+  template <int N, typename FloatType> inline void interleaveN (const FloatType* const* in, FloatType* out, size_t frames) {
+
+    for (size_t f = interleaveSIMD<N>(in, out, frames); f < frames; ++f) {
+      for (int ch = 0; ch < N; ++ch) {
+        out[f * N + ch] = in[ch][f];
+        }
+      }
+    }
+  //}}}
+
+  //{{{
+  // deinterleave() : split 'frames' frames of interleaved samples into one buffer per channel
+  template <typename FloatType> void deinterleave (const FloatType* in, FloatType* const* out, size_t frames, int numChannels) {
+
+    switch (numChannels) {
+    case 1:
+      memcpy(out[0], in, frames * sizeof(FloatType));
+      break;
+    case 2:
+      deinterleaveN<2>(in, out, frames);
+      break;
+    case 6:
+      deinterleaveN<6>(in, out, frames);
+      break;
+    case 8:
+      deinterleaveN<8>(in, out, frames);
+      break;
+    default:
+      for (int ch = 0; ch < numChannels; ++ch) {
+        FloatType* o = out[ch];
+        for (size_t f = 0; f < frames; ++f) {
+          o[f] = in[f * numChannels + ch];
+          }
+        }
+      }
+    }
+  //}}}
+  //{{{
+  // interleave() : combine 'frames' frames from one buffer per channel into interleaved samples
+  template <typename FloatType> void interleave (const FloatType* const* in, FloatType* out, size_t frames, int numChannels) {
+
+    switch (numChannels) {
+    case 1:
+      memcpy(out, in[0], frames * sizeof(FloatType));
+      break;
+    case 2:
+      interleaveN<2>(in, out, frames);
+      break;
+    case 6:
+      interleaveN<6>(in, out, frames);
+      break;
+    case 8:
+      interleaveN<8>(in, out, frames);
+      break;
+    default:
+      for (int ch = 0; ch < numChannels; ++ch) {
+        const FloatType* i = in[ch];
+        for (size_t f = 0; f < frames; ++f) {
+          out[f * numChannels + ch] = i[f];
+          }
+        }
+      }
+    }
+  //}}}
+
+  //{{{
+  // benchmarkInterleave() : compare the throughput of the frame-by-frame loops previously used by the converter
+  // against deinterleave() / interleave(), for stereo, 5.1 and 7.1 material (checking that the results are identical)
+  template <typename FloatType> void benchmarkInterleave() {
+
+    const size_t frames = 32768; // (BUFFERSIZE)
+    const int repeats = 200;
+
+    std::cout << "de-interleave / re-interleave, " << frames << " frames per block, " << 8 * sizeof(FloatType) << "-bit samples\n";
+    for (int numChannels : {2, 6, 8}) {
+      std::vector<FloatType> interleaved(frames * numChannels);
+      std::vector<FloatType> result(frames * numChannels);
+      for (size_t s = 0; s < interleaved.size(); ++s) {
+        interleaved[s] = static_cast<FloatType>(s);
+        }
+      std::vector<std::vector<FloatType>> planar(numChannels, std::vector<FloatType>(frames));
+      std::vector<FloatType*> planarPointers;
+      for (auto& p : planar) {
+        planarPointers.push_back(p.data());
+        }
+
+      double seconds[2][2]; // [method][direction]
+      bool identical = true;
+      for (int method = 0; method < 2; ++method) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+          if (method == 0) {
+            size_t i = 0;
+            for (size_t s = 0; s < interleaved.size(); s += numChannels) {
+              for (int ch = 0; ch < numChannels; ++ch) {
+                planar[ch][i] = interleaved[s + ch];
+                }
+              ++i;
+              }
+            }
+          else {
+            deinterleave(interleaved.data(), planarPointers.data(), frames, numChannels);
+            }
+          }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        for (int ch = 0; ch < numChannels; ++ch) {
+          for (size_t f = 0; f < frames; ++f) {
+            identical = identical && (planar[ch][f] == interleaved[f * numChannels + ch]);
+            planar[ch][f] = -planar[ch][f]; // (so that a stale result can't pass)
+            }
+          }
+
+        auto t2 = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+          if (method == 0) {
+            for (int ch = 0; ch < numChannels; ++ch) {
+              size_t index = 0;
+              for (size_t f = 0; f < frames; ++f) {
+                result[index + ch] = planar[ch][f];
+                index += numChannels;
+                }
+              }
+            }
+          else {
+            interleave(planarPointers.data(), result.data(), frames, numChannels);
+            }
+          }
+        auto t3 = std::chrono::high_resolution_clock::now();
+        for (size_t s = 0; s < result.size(); ++s) {
+          identical = identical && (result[s] == -interleaved[s]);
+          result[s] = 0;
+          }
+
+        seconds[method][0] = std::chrono::duration<double>(t1 - t0).count();
+        seconds[method][1] = std::chrono::duration<double>(t3 - t2).count();
+        }
+
+      const double samples = static_cast<double>(repeats) * frames * numChannels;
+      std::cout << numChannels << " channels:\n";
+      const char* directions[2] = {"de-interleave: ", "interleave:    "};
+      for (int d = 0; d < 2; ++d) {
+        std::cout << "  " << directions[d] << samples / seconds[0][d] / 1.0e6 << " -> " << samples / seconds[1][d] / 1.0e6
+                  << " Msamples/sec [" << seconds[0][d] / seconds[1][d] << "x]\n";
+        }
+      std::cout << "  " << (identical ? "(identical)" : "MISMATCH") << std::endl;
+      }
+    std::cout << std::endl;
+    }
+  //}}}
+
+} // namespace ReSampler
@@ -0,0 +1,286 @@
+// limiter.h : look-ahead peak limiter, for single-pass clipping protection
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+//}}}
+
+namespace ReSampler {
+  //{{{
+  template <typename FloatType> class LookAheadLimiter {
+  // LookAheadLimiter : operates on interleaved frames (all channels share one gain, to preserve the stereo image),
+  // delaying the signal by (lookahead - 1) frames. The gain for each frame is the minimum gain required over a window of
+  // 'lookahead' frames (sliding minimum), smoothed by a moving average over another 'lookahead' frames.
+  // Every input to the moving average covers the frame being output, so the average is <= that frame's requirement
+  // (checked for every frame: see getFramesOverLimit()), and gain changes are ramped (no steps); the output is clamped to the
+  // ceiling only to absorb rounding. Frames which don't need limiting are passed through unchanged (gain of exactly 1).
+  // Memory is fixed at construction; process() and flush() don't allocate.
+  public:
+    //{{{
+    LookAheadLimiter (int numChannels, int lookahead, FloatType ceiling)
+        : numChannels(numChannels), lookahead(std::max(1, lookahead)), ceiling(ceiling) {
+
+      delayLine.assign(static_cast<size_t>(numChannels) * LookAheadLimiter::lookahead, 0.0);
+      required.assign(LookAheadLimiter::lookahead, 1.0);
+      held.assign(LookAheadLimiter::lookahead, 1.0);
+      minQueue.assign(LookAheadLimiter::lookahead, 0);
+      silence.assign(numChannels, 0.0);
+      reset();
+      }
+    //}}}
+    //{{{
+    void reset() {
+
+      std::fill(delayLine.begin(), delayLine.end(), 0.0);
+      std::fill(required.begin(), required.end(), 1.0);
+      std::fill(held.begin(), held.end(), 1.0);
+      frameCount = 0;
+      queueHead = queueSize = 0;
+      heldSum = lookahead;
+      heldNonUnity = 0;
+      minGain = 1.0;
+      framesLimited = 0;
+      framesOverLimit = 0;
+      }
+    //}}}
+
+    //{{{
+    // process() : push numSamples interleaved samples, and write the delayed (limited) samples to out.
+    // Returns the number of samples written (less than numSamples until the look-ahead buffer has filled).
+    // in and out may point to the same buffer (the output never runs ahead of the input, and each frame is stored before
+    // any output is written).
+    size_t process (const FloatType* in, size_t numSamples, FloatType* out) {
+
+      size_t o = 0;
+      for (size_t s = 0; s < numSamples; s += numChannels) {
+        o += pushFrame(in + s, out + o);
+        }
+      return o;
+      }
+    //}}}
+    //{{{
+    // flush() : write out the frames still held in the look-ahead buffer (at the end of the stream)
+    size_t flush (FloatType* out) {
+
+      size_t o = 0;
+      size_t pending = static_cast<size_t>(std::min<long long>(frameCount, lookahead - 1));
+      for (size_t f = 0; f < pending; ++f) {
+        o += pushFrame(silence.data(), out + o);
+        }
+      return o;
+      }
+    //}}}
+
+    //{{{
+    int getLatency() const {
+      return lookahead - 1;
+      }
+    //}}}
+    //{{{
+    FloatType getMinGain() const {
+      return minGain;
+      }
+    //}}}
+    //{{{
+    long long getFramesLimited() const {
+      return framesLimited;
+      }
+    //}}}
+    //{{{
+    // getFramesOverLimit() : number of frames given more gain than they required (should always be zero)
+    long long getFramesOverLimit() const {
+      return framesOverLimit;
+      }
+    //}}}
+
+  private:
+    //{{{
+    // pushFrame() : returns number of samples written to out (either 0 or numChannels)
+    size_t pushFrame (const FloatType* frame, FloatType* out) {
+
+      const size_t slot = static_cast<size_t>(frameCount % lookahead);
+
+      // required gain for incoming frame:
+      FloatType peak = 0.0;
+      for (int ch = 0; ch < numChannels; ++ch) {
+        peak = std::max(peak, std::abs(frame[ch]));
+        }
+      FloatType g = (peak > ceiling) ? ceiling / peak : 1.0;
+
+      // sliding minimum of required gain over the last 'lookahead' frames (monotonic queue of frame numbers).
+      // The expired frame is removed before pushing, so the queue never holds more than 'lookahead' entries:
+      if (queueSize != 0 && minQueue[queueHead] + lookahead <= frameCount) {
+        queueHead = (queueHead + 1) % lookahead;
+        --queueSize;
+        }
+      required[slot] = g;
+      while (queueSize != 0 && required[minQueue[(queueHead + queueSize - 1) % lookahead] % lookahead] >= g) {
+        --queueSize;
+        }
+      minQueue[(queueHead + queueSize) % lookahead] = frameCount;
+      ++queueSize;
+      FloatType h = required[minQueue[queueHead] % lookahead];
+
+      // moving average of held gain:
+      FloatType oldH = held[slot];
+      held[slot] = h;
+      heldSum += static_cast<double>(h) - oldH;
+      heldNonUnity += (h != 1.0) - (oldH != 1.0);
+      if (heldNonUnity == 0) {
+        heldSum = lookahead; // avoid drift
+        }
+      else if (slot == 0) {
+        heldSum = 0.0; // (re-sum once per window, so that rounding in the running sum can't accumulate)
+        for (FloatType x : held) {
+          heldSum += x;
+          }
+        }
+
+      // store the incoming frame first (frame and out may be the same memory):
+      FloatType* d = delayLine.data() + slot * numChannels;
+      for (int ch = 0; ch < numChannels; ++ch) {
+        d[ch] = frame[ch];
+        }
+      bool haveOutput = frameCount >= lookahead - 1;
+      ++frameCount;
+
+      if (haveOutput) {
+        // (the oldest frame occupies the slot of the next frame; with a lookahead of 1, that is the frame just stored)
+        const FloatType* oldest = delayLine.data() + static_cast<size_t>(frameCount % lookahead) * numChannels;
+
+        FloatType gain = (heldNonUnity == 0) ? 1.0 : static_cast<FloatType>(std::min(1.0, heldSum / lookahead));
+        if (gain != 1.0) {
+          ++framesLimited;
+          minGain = std::min(minGain, gain);
+          }
+        const FloatType requiredGain = required[frameCount % lookahead]; // (requirement of the oldest frame)
+        if (gain > requiredGain * (1 + 2 * lookahead * std::numeric_limits<FloatType>::epsilon())) { // (allowing for rounding in the sum)
+          ++framesOverLimit;
+          }
+
+        for (int ch = 0; ch < numChannels; ++ch) {
+          FloatType y = gain * oldest[ch];
+          out[ch] = (std::abs(y) > ceiling) ? std::copysign(ceiling, y) : y; // (guard against rounding in the moving average)
+          }
+        }
+
+      return haveOutput ? static_cast<size_t>(numChannels) : 0;
+      }
+    //}}}
+
+    int numChannels;
+    int lookahead; // frames
+    FloatType ceiling;
+
+    std::vector<FloatType> delayLine; // lookahead frames (interleaved)
+    std::vector<FloatType> required;  // required gain of each frame in the window
+    std::vector<FloatType> held;      // sliding-minimum of required gain (input to the moving average)
+    std::vector<long long> minQueue;  // monotonic queue (frame numbers) for sliding minimum
+    std::vector<FloatType> silence;   // one frame of zeros (for flushing)
+    size_t queueHead;
+    size_t queueSize;
+    long long frameCount;
+    double heldSum;
+    int heldNonUnity;
+
+    // statistics:
+    FloatType minGain;
+    long long framesLimited;
+    long long framesOverLimit;
+    };
+  //}}}
+
+  //{{{
+  // testLookAheadLimiter() : self-test - limit bursts of random noise (and a signal which needs no limiting) with a range of
+  // look-ahead lengths and channel counts, and check that no frame gets more gain than it requires, that the output stays
+  // within the ceiling, that every frame is released, that processing in place (in blocks) gives the same output, and that
+  // a signal which needs no limiting passes through unchanged
+  template <typename FloatType> bool testLookAheadLimiter() {
+
+    bool ok = true;
+    const FloatType ceiling = static_cast<FloatType>(0.9);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> noise(-1.5, 1.5);
+    std::uniform_int_distribution<int> lookaheads(1, 64);
+
+    for (int test = 0; test < 200; ++test) {
+      const int numChannels = 1 + test % 6;
+      const int lookahead = (test < 4) ? 1 << (2 * test) : lookaheads(rng);
+      const size_t numFrames = 5000;
+      const size_t blockSize = (1 + test % 13) * 37 * numChannels;
+
+      // alternate loud and quiet bursts, with isolated spikes in the quiet ones:
+      std::vector<FloatType> in(numFrames * numChannels);
+      for (size_t s = 0; s < in.size(); ++s) {
+        const size_t frame = s / numChannels;
+        const double level = ((frame / 300) % 2 || frame % 97 == 0) ? 1.0 : 0.4;
+        in[s] = static_cast<FloatType>(level * noise(rng));
+        }
+
+      LookAheadLimiter<FloatType> limiter(numChannels, lookahead, ceiling);
+      std::vector<FloatType> out(in.size() + lookahead * numChannels);
+      size_t o = 0;
+      for (size_t s = 0; s < in.size(); s += blockSize) {
+        o += limiter.process(in.data() + s, std::min(blockSize, in.size() - s), out.data() + o);
+        }
+      o += limiter.flush(out.data() + o);
+
+      // the same signal again, each block limited in place (as the converters do), must give the same output:
+      LookAheadLimiter<FloatType> inPlaceLimiter(numChannels, lookahead, ceiling);
+      std::vector<FloatType> block(std::max(blockSize, static_cast<size_t>(lookahead * numChannels)));
+      std::vector<FloatType> inPlace;
+      for (size_t s = 0; s < in.size(); s += blockSize) {
+        const size_t n = std::min(blockSize, in.size() - s);
+        std::copy(in.begin() + s, in.begin() + s + n, block.begin());
+        const size_t written = inPlaceLimiter.process(block.data(), n, block.data());
+        inPlace.insert(inPlace.end(), block.begin(), block.begin() + written);
+        }
+      const size_t flushed = inPlaceLimiter.flush(block.data());
+      inPlace.insert(inPlace.end(), block.begin(), block.begin() + flushed);
+      const bool inPlaceOk = (inPlace.size() == o) && std::equal(inPlace.begin(), inPlace.end(), out.begin());
+
+      FloatType peak = 0.0;
+      for (size_t s = 0; s < o; ++s) {
+        peak = std::max(peak, std::abs(out[s]));
+        }
+
+      if (limiter.getFramesOverLimit() != 0 || peak > ceiling || o != in.size() || !inPlaceOk) {
+        ok = false;
+        std::cout << "LookAheadLimiter (" << ((sizeof(FloatType) == 4) ? "float" : "double") << ", " << numChannels << " channels, lookahead "
+                  << lookahead << "): FAIL (" << limiter.getFramesOverLimit() << " frames over limit, peak " << peak << ", "
+                  << o << " of " << in.size() << " samples out" << (inPlaceOk ? "" : ", in-place output differs") << ")" << std::endl;
+        }
+      }
+
+    // a signal which never needs limiting must come out bit-identical:
+    LookAheadLimiter<FloatType> limiter(2, 64, 1.0);
+    std::vector<FloatType> in(4000);
+    std::vector<FloatType> out(in.size() + 128);
+    for (size_t s = 0; s < in.size(); ++s) {
+      in[s] = static_cast<FloatType>(0.99 * std::sin(0.1 * s));
+      }
+    size_t o = limiter.process(in.data(), in.size(), out.data());
+    o += limiter.flush(out.data() + o);
+    bool identical = (o == in.size()) && std::equal(in.begin(), in.end(), out.begin());
+    ok = ok && identical;
+
+    std::cout << "LookAheadLimiter (" << ((sizeof(FloatType) == 4) ? "float" : "double") << "): " << (ok ? "pass" : "FAIL") << std::endl;
+    return ok;
+    }
+  //}}}
+}
@@ -0,0 +1,256 @@
+// npy.h : defines module for exporting audio data as a NumPy (.npy) file, for analysis
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "csv.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+//}}}
+
+// The file is a version 1.0 .npy file: a fixed-size (128-byte) header, followed by the samples as one contiguous array
+// of float32 (or float64) values in native byte order, with shape (frames, channels) in C order - ie interleaved.
+// Because the data starts on a 64-byte boundary and is uncompressed, downstream tools can memory-map it
+// (eg numpy.load(path, mmap_mode='r'), or simply map the file and skip the first 128 bytes).
+
+namespace ReSampler {
+
+  class NpyFile {
+  public:
+    static const int headerLength = 128;
+
+    //{{{
+    NpyFile(const std::string& path, int numChannels, bool doublePrecision) : path(path), numChannels(numChannels), doublePrecision(doublePrecision) {
+      file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+      rewind();
+    }
+    //}}}
+    //{{{
+    ~NpyFile() {
+      if (file.is_open()) {
+        try {
+          writeHeader(); // (final shape)
+          file.close();
+        }
+        catch (std::ios_base::failure& e) {
+          e.what();
+        }
+      }
+    }
+    //}}}
+    //{{{
+    bool isErr() const {
+      return err;
+    }
+    //}}}
+    //{{{
+    // write() : append count samples (interleaved), converted to the file's sample type, in one write
+    template <typename T> int64_t write(const T* buffer, int64_t count) {
+      if (err) {
+        return 0;
+      }
+      try {
+        if (doublePrecision) {
+          writeAs<double>(buffer, count);
+        }
+        else {
+          writeAs<float>(buffer, count);
+        }
+      }
+      catch (std::ios_base::failure& e) {
+        e.what();
+        err = true;
+        return 0;
+      }
+      numSamples += count;
+      return count;
+    }
+    //}}}
+    //{{{
+    // rewind() : discard everything written so far, and start again at the beginning of the file
+    void rewind() {
+      if (file.is_open()) {
+        file.close();
+      }
+      numSamples = 0;
+      try {
+        file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        writeHeader(); // (placeholder shape: rewritten when the file is closed)
+        err = false;
+      }
+      catch (std::ios_base::failure& e) {
+        e.what();
+        err = true;
+      }
+    }
+    //}}}
+    //{{{
+    int64_t getNumFrames() const {
+      return numSamples / numChannels;
+    }
+    //}}}
+
+  private:
+    //{{{
+    template <typename SampleType, typename T> void writeAs(const T* buffer, int64_t count) {
+      if (std::is_same<SampleType, T>::value) {
+        file.write(reinterpret_cast<const char*>(buffer), count * static_cast<int64_t>(sizeof(T)));
+      }
+      else {
+        conversionBuffer.resize(static_cast<size_t>(count) * sizeof(SampleType));
+        auto p = reinterpret_cast<SampleType*>(conversionBuffer.data());
+        for (int64_t i = 0; i < count; ++i) {
+          p[i] = static_cast<SampleType>(buffer[i]);
+        }
+        file.write(conversionBuffer.data(), static_cast<std::streamsize>(conversionBuffer.size()));
+      }
+    }
+    //}}}
+    //{{{
+    // writeHeader() : magic string, version, header length, and the array description (padded to headerLength)
+    void writeHeader() {
+      const uint16_t one = 1;
+      bool littleEndian = (*reinterpret_cast<const char*>(&one) == 1);
+
+      std::string description = std::string("{'descr': '") + (littleEndian ? '<' : '>') + (doublePrecision ? "f8" : "f4") +
+        "', 'fortran_order': False, 'shape': (" + std::to_string(getNumFrames()) + ", " + std::to_string(numChannels) + "), }";
+      const size_t preambleLength = 10;
+      description.resize(headerLength - preambleLength - 1, ' ');
+      description += '\n';
+
+      char preamble[preambleLength] = { '\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                        static_cast<char>(description.size() & 0xff), static_cast<char>(description.size() >> 8) };
+
+      auto position = file.tellp();
+      file.seekp(0);
+      file.write(preamble, preambleLength);
+      file.write(description.data(), static_cast<std::streamsize>(description.size()));
+      if (position > static_cast<std::streamoff>(headerLength)) {
+        file.seekp(position);
+      }
+    }
+    //}}}
+
+    std::string path;
+    std::ofstream file;
+    int numChannels;
+    bool doublePrecision;
+    bool err{true};
+    int64_t numSamples{0};
+    std::vector<char> conversionBuffer;
+    };
+
+  //{{{
+  // benchmarkCsv() : compare the throughput of csv output using the stream operator<< (the original method) against the
+  // block formatter (checking that the files are identical), and against .npy output.
+  // (The files are written to the current directory, and removed afterwards)
+  template <typename FloatType> void benchmarkCsv() {
+
+    const int numChannels = 2;
+    const int64_t numSamples = numChannels * (1 << 20);
+    const int64_t blockSize = 8192; // (samples per write)
+    std::vector<FloatType> samples(static_cast<size_t>(numSamples));
+    for (int64_t i = 0; i < numSamples; ++i) {
+      samples[i] = static_cast<FloatType>(0.9 * std::sin(0.001 * static_cast<double>(i)) * std::cos(0.37 * static_cast<double>(i)));
+      }
+
+    auto fileSize = [] (const std::string& filename) -> double {
+      std::ifstream f(filename, std::ios::binary | std::ios::ate);
+      return static_cast<double>(f.tellg());
+      };
+
+    auto fileContents = [] (const std::string& filename) -> std::string {
+      std::ifstream f(filename, std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+      };
+
+    auto report = [numSamples] (const char* method, double seconds, double bytes) {
+      std::cout << "  " << method << numSamples / seconds / 1.0e6 << " Msamples/sec, " << bytes / seconds / 1.0e6 << " MB/sec\n";
+      };
+
+    struct Format {
+      const char* name;
+      int numBits;
+      CsvNumericFormat numericFormat;
+      CsvNumericBase numericBase;
+      };
+    const std::vector<Format> formats {
+      {"16-bit integer (decimal)", 16, Integer, Decimal},
+      {"24-bit integer (hexadecimal)", 24, Integer, Hexadecimal},
+      {"floating-point", 16, FloatingPoint, Decimal}
+      };
+
+    const std::string streamFilename("ReSampler-benchmark-stream.csv");
+    const std::string blockFilename("ReSampler-benchmark-block.csv");
+    const std::string npyFilename("ReSampler-benchmark.npy");
+
+    for (auto& format : formats) {
+      double seconds[2];
+      for (int method = 0; method < 2; ++method) {
+        CsvFile csvFile(method == 0 ? streamFilename : blockFilename);
+        csvFile.setNumChannels(numChannels);
+        csvFile.setNumericBase(format.numericBase);
+        csvFile.setNumericFormat(format.numericFormat);
+        csvFile.setNumBits(format.numBits);
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (int64_t i = 0; i < numSamples; i += blockSize) {
+          if (method == 0) {
+            csvFile.writeStream(samples.data() + i, std::min(blockSize, numSamples - i));
+            }
+          else {
+            csvFile.write(samples.data() + i, std::min(blockSize, numSamples - i));
+            }
+          }
+        auto end = std::chrono::high_resolution_clock::now();
+        seconds[method] = std::chrono::duration<double>(end - begin).count();
+        }
+
+      bool identical = (fileContents(streamFilename) == fileContents(blockFilename));
+      std::cout << "csv, " << format.name << ":\n";
+      report("operator<<: ", seconds[0], fileSize(streamFilename));
+      report("block:      ", seconds[1], fileSize(blockFilename));
+      std::cout << "  [" << seconds[0] / seconds[1] << "x] " << (identical ? "(identical)" : "MISMATCH") << std::endl;
+      }
+
+    for (bool doublePrecision : {false, true}) {
+      std::chrono::high_resolution_clock::time_point begin, end;
+      {
+        NpyFile npyFile(npyFilename, numChannels, doublePrecision);
+        begin = std::chrono::high_resolution_clock::now();
+        for (int64_t i = 0; i < numSamples; i += blockSize) {
+          npyFile.write(samples.data() + i, std::min(blockSize, numSamples - i));
+          }
+      } // (includes closing the file, which completes the header)
+      end = std::chrono::high_resolution_clock::now();
+      std::cout << "npy, " << (doublePrecision ? "float64" : "float32") << ":\n";
+      report("", std::chrono::duration<double>(end - begin).count(), fileSize(npyFilename));
+      }
+    std::cout << std::endl;
+
+    std::remove(streamFilename.c_str());
+    std::remove(blockFilename.c_str());
+    std::remove(npyFilename.c_str());
+    }
+  //}}}
+
+} // namespace ReSampler
@@ -0,0 +1,580 @@
+// pcmstream.h : sequential (non-seeking) reading and writing of wav files and raw PCM, for pipes (stdin / stdout)
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+  #include <fcntl.h>
+  #include <io.h>
+#endif
+//}}}
+
+// libsndfile needs to seek (to read the length of a wav file before the data, and to write it afterwards), so it can't be
+// used on pipes. These classes read and write the samples strictly in order, one block at a time:
+// - PcmStreamReader reads wav (RIFF or RF64; PCM or floating-point, including WAVE_FORMAT_EXTENSIBLE) or raw PCM.
+//   A data chunk of unknown length (size 0 or 0xFFFFFFFF, as written by streaming producers) is read until the end of the input.
+// - PcmStreamWriter writes wav or raw PCM. The wav header is written up front with "unknown" (0xFFFFFFFF) sizes;
+//   if the output turns out to be seekable (a regular file), the sizes are filled in when it is closed.
+// The filename "-" means stdin (reader) or stdout (writer).
+// Sample values are scaled the same way as libsndfile (read: 1 / 2^(bits - 1), write: 2^(bits - 1) - 1, rounded to nearest).
+
+namespace ReSampler {
+  //{{{
+  enum PcmSampleFormat {
+    pcmU8,
+    pcmS8,
+    pcm16,
+    pcm24,
+    pcm32,
+    pcmFloat32,
+    pcmFloat64
+    };
+  //}}}
+  //{{{
+  struct PcmFormat {
+    PcmSampleFormat sampleFormat;
+    int numChannels;
+    int sampleRate;
+    };
+  //}}}
+  //{{{
+  inline int getPcmBytesPerSample (PcmSampleFormat sampleFormat) {
+
+    switch (sampleFormat) {
+    case pcmU8:
+    case pcmS8:
+      return 1;
+    case pcm16:
+      return 2;
+    case pcm24:
+      return 3;
+    case pcmFloat64:
+      return 8;
+    default:
+      return 4;
+      }
+    }
+  //}}}
+  //{{{
+  // getPcmSampleFormat() : sample format from a bit format (as used by -b and --raw-input: 8, u8, s8, 16, 24, 32, 32f, 64f)
+  inline bool getPcmSampleFormat (const std::string& bitFormat, PcmSampleFormat& sampleFormat) {
+
+    const struct {
+      const char* name;
+      PcmSampleFormat sampleFormat;
+      } formats[] = {
+      {"8", pcmU8}, {"u8", pcmU8}, {"s8", pcmS8}, {"16", pcm16}, {"24", pcm24}, {"32", pcm32}, {"32f", pcmFloat32}, {"64f", pcmFloat64}
+      };
+
+    for (auto& format : formats) {
+      if (bitFormat == format.name) {
+        sampleFormat = format.sampleFormat;
+        return true;
+        }
+      }
+    return false;
+    }
+  //}}}
+  //{{{
+  inline const char* getPcmSampleFormatName (PcmSampleFormat sampleFormat) {
+
+    const char* names[] = {"8-bit unsigned", "8-bit signed", "16-bit", "24-bit", "32-bit", "32-bit float", "64-bit float"};
+    return names[sampleFormat];
+    }
+  //}}}
+
+  //{{{
+  class PcmStreamReader {
+  public:
+    //{{{
+    // path : file to read ("-" = stdin)
+    // raw : if true, the input is headerless PCM in rawFormat (little-endian); otherwise, the wav header is read
+    PcmStreamReader (const std::string& path, bool raw, const PcmFormat& rawFormat)
+        : format(rawFormat), bytesRemaining(unknownLength) {
+
+      if (path == "-") {
+        #ifdef _WIN32
+          _setmode(_fileno(stdin), _O_BINARY);
+        #endif
+        file = stdin;
+        ownsFile = false;
+        }
+      else {
+        file = fopen(path.c_str(), "rb");
+        ownsFile = true;
+        }
+
+      if (file == nullptr) {
+        errorMessage = "couldn't open " + path;
+        return;
+        }
+
+      if (!raw) {
+        readWavHeader();
+        }
+      else if (format.numChannels < 1 || format.sampleRate < 1) {
+        errorMessage = "invalid raw input format";
+        }
+      }
+    //}}}
+    //{{{
+    ~PcmStreamReader() {
+      if (ownsFile && file != nullptr) {
+        fclose(file);
+        }
+      }
+    //}}}
+
+    PcmStreamReader (const PcmStreamReader&) = delete;
+    PcmStreamReader& operator = (const PcmStreamReader&) = delete;
+
+    //{{{
+    bool isErr() const {
+      return !errorMessage.empty();
+      }
+    //}}}
+    //{{{
+    const std::string& getErrorMessage() const {
+      return errorMessage;
+      }
+    //}}}
+    //{{{
+    const PcmFormat& getFormat() const {
+      return format;
+      }
+    //}}}
+    //{{{
+    // read() : read up to 'frames' frames (interleaved), blocking until they have all arrived or the input ends.
+    // Returns the number of frames read (0 at the end of the input)
+    template <typename FloatType> size_t read (FloatType* buffer, size_t frames) {
+
+      if (isErr()) {
+        return 0;
+        }
+
+      const size_t bytesPerFrame = static_cast<size_t>(getPcmBytesPerSample(format.sampleFormat)) * format.numChannels;
+      size_t bytesWanted = frames * bytesPerFrame;
+      if (bytesRemaining != unknownLength) {
+        bytesWanted = static_cast<size_t>(std::min<uint64_t>(bytesWanted, bytesRemaining));
+        }
+      byteBuffer.resize(bytesWanted);
+      size_t bytesRead = fread(byteBuffer.data(), 1, bytesWanted, file);
+      if (bytesRemaining != unknownLength) {
+        bytesRemaining -= bytesRead;
+        }
+
+      size_t framesRead = bytesRead / bytesPerFrame; // (a partial frame at the very end is dropped)
+      decode(buffer, byteBuffer.data(), framesRead * format.numChannels);
+      return framesRead;
+      }
+    //}}}
+
+  private:
+    static const uint64_t unknownLength = std::numeric_limits<uint64_t>::max();
+
+    //{{{
+    static uint32_t getLE (const uint8_t* p, int numBytes) {
+      uint32_t x = 0;
+      for (int i = numBytes - 1; i >= 0; --i) {
+        x = (x << 8) | p[i];
+        }
+      return x;
+      }
+    //}}}
+    //{{{
+    bool readBytes (void* dst, size_t n) {
+      return fread(dst, 1, n, file) == n;
+      }
+    //}}}
+    //{{{
+    bool skipBytes (uint64_t n) { // (read and discard: the input may not be seekable)
+      uint8_t scratch[4096];
+      while (n != 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(n, sizeof(scratch)));
+        if (!readBytes(scratch, chunk)) {
+          return false;
+          }
+        n -= chunk;
+        }
+      return true;
+      }
+    //}}}
+    //{{{
+    // readWavHeader() : read chunks up to the start of the sample data
+    void readWavHeader() {
+
+      uint8_t riff[12];
+      if (!readBytes(riff, sizeof(riff)) || (memcmp(riff, "RIFF", 4) != 0 && memcmp(riff, "RF64", 4) != 0) || memcmp(riff + 8, "WAVE", 4) != 0) {
+        errorMessage = "input is not a wav file (for raw PCM input, use --raw-input)";
+        return;
+        }
+
+      bool haveFormat = false;
+      uint64_t ds64DataSize = unknownLength;
+      for (;;) {
+        uint8_t chunkHeader[8];
+        if (!readBytes(chunkHeader, sizeof(chunkHeader))) {
+          errorMessage = "no data chunk in wav input";
+          return;
+          }
+        uint32_t chunkSize = getLE(chunkHeader + 4, 4);
+
+        if (memcmp(chunkHeader, "fmt ", 4) == 0) {
+          uint8_t fmt[40] = {};
+          size_t n = std::min<size_t>(chunkSize, sizeof(fmt));
+          if (chunkSize < 16 || !readBytes(fmt, n) || !skipBytes(chunkSize - n + (chunkSize & 1))) {
+            errorMessage = "bad fmt chunk in wav input";
+            return;
+            }
+          uint32_t formatTag = getLE(fmt, 2);
+          if (formatTag == 0xfffe && chunkSize >= 26) { // WAVE_FORMAT_EXTENSIBLE: format tag is at the start of the subformat GUID
+            formatTag = getLE(fmt + 24, 2);
+            }
+          format.numChannels = static_cast<int>(getLE(fmt + 2, 2));
+          format.sampleRate = static_cast<int>(getLE(fmt + 4, 4));
+          uint32_t bitsPerSample = getLE(fmt + 14, 2);
+
+          if (formatTag == 1 && bitsPerSample == 8) {
+            format.sampleFormat = pcmU8;
+            }
+          else if (formatTag == 1 && bitsPerSample == 16) {
+            format.sampleFormat = pcm16;
+            }
+          else if (formatTag == 1 && bitsPerSample == 24) {
+            format.sampleFormat = pcm24;
+            }
+          else if (formatTag == 1 && bitsPerSample == 32) {
+            format.sampleFormat = pcm32;
+            }
+          else if (formatTag == 3 && bitsPerSample == 32) {
+            format.sampleFormat = pcmFloat32;
+            }
+          else if (formatTag == 3 && bitsPerSample == 64) {
+            format.sampleFormat = pcmFloat64;
+            }
+          else {
+            errorMessage = "unsupported sample format in wav input (format " + std::to_string(formatTag) + ", " + std::to_string(bitsPerSample) + " bits)";
+            return;
+            }
+          if (format.numChannels < 1 || format.sampleRate < 1) {
+            errorMessage = "bad fmt chunk in wav input";
+            return;
+            }
+          haveFormat = true;
+          }
+
+        else if (memcmp(chunkHeader, "ds64", 4) == 0) { // (RF64: 64-bit sizes)
+          uint8_t ds64[16];
+          if (chunkSize < 16 || !readBytes(ds64, sizeof(ds64)) || !skipBytes(chunkSize - 16 + (chunkSize & 1))) {
+            errorMessage = "bad ds64 chunk in wav input";
+            return;
+            }
+          ds64DataSize = getLE(ds64 + 8, 4) | (static_cast<uint64_t>(getLE(ds64 + 12, 4)) << 32);
+          }
+
+        else if (memcmp(chunkHeader, "data", 4) == 0) {
+          if (!haveFormat) {
+            errorMessage = "no fmt chunk before data chunk in wav input";
+            return;
+            }
+          if (chunkSize == 0xffffffff) { // (RF64, or a streaming producer which didn't know the length)
+            bytesRemaining = (ds64DataSize == 0 || ds64DataSize == 0xffffffff) ? unknownLength : ds64DataSize;
+            }
+          else {
+            bytesRemaining = (chunkSize == 0) ? unknownLength : chunkSize;
+            }
+          return;
+          }
+
+        else if (!skipBytes(static_cast<uint64_t>(chunkSize) + (chunkSize & 1))) { // (any other chunk)
+          errorMessage = "truncated wav input";
+          return;
+          }
+        }
+      }
+    //}}}
+    //{{{
+    template <typename FloatType> void decode (FloatType* dst, const uint8_t* src, size_t numSamples) const {
+
+      switch (format.sampleFormat) {
+      case pcmU8:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<FloatType>((static_cast<int>(src[i]) - 128) * (1.0 / 0x80));
+          }
+        break;
+      case pcmS8:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<FloatType>(static_cast<int8_t>(src[i]) * (1.0 / 0x80));
+          }
+        break;
+      case pcm16:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<FloatType>(static_cast<int16_t>(getLE(src + 2 * i, 2)) * (1.0 / 0x8000));
+          }
+        break;
+      case pcm24:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<FloatType>(static_cast<int32_t>(getLE(src + 3 * i, 3) << 8) * (1.0 / 0x80000000));
+          }
+        break;
+      case pcm32:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<FloatType>(static_cast<int32_t>(getLE(src + 4 * i, 4)) * (1.0 / 0x80000000));
+          }
+        break;
+      case pcmFloat32:
+        for (size_t i = 0; i < numSamples; ++i) {
+          uint32_t bits = getLE(src + 4 * i, 4);
+          float x;
+          memcpy(&x, &bits, sizeof(x));
+          dst[i] = static_cast<FloatType>(x);
+          }
+        break;
+      case pcmFloat64:
+        for (size_t i = 0; i < numSamples; ++i) {
+          uint64_t bits = getLE(src + 8 * i, 4) | (static_cast<uint64_t>(getLE(src + 8 * i + 4, 4)) << 32);
+          double x;
+          memcpy(&x, &bits, sizeof(x));
+          dst[i] = static_cast<FloatType>(x);
+          }
+        break;
+        }
+      }
+    //}}}
+
+    FILE* file{nullptr};
+    bool ownsFile{false};
+    PcmFormat format;
+    uint64_t bytesRemaining; // in the data chunk (or unknownLength)
+    std::string errorMessage;
+    std::vector<uint8_t> byteBuffer;
+    };
+  //}}}
+
+  //{{{
+  class PcmStreamWriter {
+  public:
+    //{{{
+    // path : file to write ("-" = stdout)
+    // raw : if true, write headerless PCM (little-endian); otherwise, write a wav file
+    PcmStreamWriter (const std::string& path, bool raw, const PcmFormat& format) : raw(raw), format(format) {
+
+      if (path == "-") {
+        #ifdef _WIN32
+          _setmode(_fileno(stdout), _O_BINARY);
+        #endif
+        file = stdout;
+        ownsFile = false;
+        }
+      else {
+        file = fopen(path.c_str(), "wb");
+        ownsFile = true;
+        }
+
+      if (file == nullptr) {
+        errorMessage = "couldn't open " + path;
+        return;
+        }
+
+      if (!raw) {
+        writeWavHeader(0xffffffff, 0xffffffff);
+        }
+      }
+    //}}}
+    //{{{
+    ~PcmStreamWriter() {
+      close();
+      }
+    //}}}
+
+    PcmStreamWriter (const PcmStreamWriter&) = delete;
+    PcmStreamWriter& operator = (const PcmStreamWriter&) = delete;
+
+    //{{{
+    bool isErr() const {
+      return !errorMessage.empty();
+      }
+    //}}}
+    //{{{
+    const std::string& getErrorMessage() const {
+      return errorMessage;
+      }
+    //}}}
+    //{{{
+    // write() : encode 'frames' frames (interleaved; values beyond full scale are clipped), and send them on immediately
+    template <typename FloatType> bool write (const FloatType* buffer, size_t frames) {
+
+      if (isErr()) {
+        return false;
+        }
+
+      size_t numSamples = frames * format.numChannels;
+      byteBuffer.resize(numSamples * getPcmBytesPerSample(format.sampleFormat));
+      encode(byteBuffer.data(), buffer, numSamples);
+      if (fwrite(byteBuffer.data(), 1, byteBuffer.size(), file) != byteBuffer.size() || fflush(file) != 0) {
+        errorMessage = "write failed (output closed ?)";
+        return false;
+        }
+      dataBytes += byteBuffer.size();
+      return true;
+      }
+    //}}}
+    //{{{
+    // close() : finish the output. If it is seekable, the wav header is completed with the actual sizes.
+    bool close() {
+
+      if (file == nullptr) {
+        return !isErr();
+        }
+
+      if (!raw && !isErr() && dataBytes < 0xffffffff - 36 && fseek(file, 0, SEEK_SET) == 0) {
+        writeWavHeader(static_cast<uint32_t>(36 + dataBytes + (dataBytes & 1) + (isFloat() ? 2 : 0)), static_cast<uint32_t>(dataBytes));
+        }
+      else {
+        fflush(file);
+        }
+      if (ownsFile) {
+        fclose(file);
+        }
+      file = nullptr;
+      return !isErr();
+      }
+    //}}}
+    //{{{
+    uint64_t getClippedSamples() const {
+      return clippedSamples;
+      }
+    //}}}
+
+  private:
+    //{{{
+    bool isFloat() const {
+      return format.sampleFormat == pcmFloat32 || format.sampleFormat == pcmFloat64;
+      }
+    //}}}
+    //{{{
+    static void putLE (uint8_t* p, uint64_t x, int numBytes) {
+      for (int i = 0; i < numBytes; ++i) {
+        p[i] = static_cast<uint8_t>(x >> (8 * i));
+        }
+      }
+    //}}}
+    //{{{
+    void writeWavHeader (uint32_t riffSize, uint32_t dataSize) {
+
+      const uint32_t fmtSize = isFloat() ? 18 : 16; // (floating-point: includes cbSize)
+      const uint32_t bytesPerSample = static_cast<uint32_t>(getPcmBytesPerSample(format.sampleFormat));
+      uint8_t header[46] = {};
+      uint8_t* p = header;
+      memcpy(p, "RIFF", 4);
+      putLE(p + 4, riffSize, 4);
+      memcpy(p + 8, "WAVEfmt ", 8);
+      putLE(p + 16, fmtSize, 4);
+      putLE(p + 20, isFloat() ? 3 : 1, 2);
+      putLE(p + 22, static_cast<uint32_t>(format.numChannels), 2);
+      putLE(p + 24, static_cast<uint32_t>(format.sampleRate), 4);
+      putLE(p + 28, static_cast<uint64_t>(format.sampleRate) * format.numChannels * bytesPerSample, 4);
+      putLE(p + 32, bytesPerSample * format.numChannels, 2);
+      putLE(p + 34, 8 * bytesPerSample, 2);
+      p += 20 + fmtSize; // (cbSize, if present, is zero)
+      memcpy(p, "data", 4);
+      putLE(p + 4, dataSize, 4);
+      p += 8;
+
+      if (fwrite(header, 1, static_cast<size_t>(p - header), file) != static_cast<size_t>(p - header)) {
+        errorMessage = "write failed (output closed ?)";
+        }
+      }
+    //}}}
+    //{{{
+    template <typename FloatType> void encode (uint8_t* dst, const FloatType* src, size_t numSamples) {
+
+      switch (format.sampleFormat) {
+      case pcmU8:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<uint8_t>(toInt(src[i], 0x7f) + 128);
+          }
+        break;
+      case pcmS8:
+        for (size_t i = 0; i < numSamples; ++i) {
+          dst[i] = static_cast<uint8_t>(toInt(src[i], 0x7f));
+          }
+        break;
+      case pcm16:
+        for (size_t i = 0; i < numSamples; ++i) {
+          putLE(dst + 2 * i, static_cast<uint32_t>(toInt(src[i], 0x7fff)), 2);
+          }
+        break;
+      case pcm24:
+        for (size_t i = 0; i < numSamples; ++i) {
+          putLE(dst + 3 * i, static_cast<uint32_t>(toInt(src[i], 0x7fffff)), 3);
+          }
+        break;
+      case pcm32:
+        for (size_t i = 0; i < numSamples; ++i) {
+          putLE(dst + 4 * i, static_cast<uint32_t>(toInt(src[i], 0x7fffffff)), 4);
+          }
+        break;
+      case pcmFloat32:
+        for (size_t i = 0; i < numSamples; ++i) {
+          auto x = static_cast<float>(src[i]);
+          uint32_t bits;
+          memcpy(&bits, &x, sizeof(bits));
+          putLE(dst + 4 * i, bits, 4);
+          }
+        break;
+      case pcmFloat64:
+        for (size_t i = 0; i < numSamples; ++i) {
+          auto x = static_cast<double>(src[i]);
+          uint64_t bits;
+          memcpy(&bits, &x, sizeof(bits));
+          putLE(dst + 8 * i, bits, 8);
+          }
+        break;
+        }
+      }
+    //}}}
+    //{{{
+    // toInt() : scale to integer full scale, and clip
+    template <typename FloatType> int32_t toInt (FloatType x, int32_t fullScale) {
+      double y = std::nearbyint(static_cast<double>(x) * fullScale);
+      if (y > fullScale) {
+        ++clippedSamples;
+        return fullScale;
+        }
+      if (y < -1.0 - fullScale) {
+        ++clippedSamples;
+        return -1 - fullScale;
+        }
+      return static_cast<int32_t>(y);
+      }
+    //}}}
+
+    FILE* file{nullptr};
+    bool ownsFile{false};
+    bool raw;
+    PcmFormat format;
+    uint64_t dataBytes{0};
+    uint64_t clippedSamples{0};
+    std::string errorMessage;
+    std::vector<uint8_t> byteBuffer;
+    };
+  //}}}
+  }
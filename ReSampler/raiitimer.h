@@ -14,7 +14,7 @@
 #include <iomanip>
 #include <chrono>
 
-// class RaiiTimer : starts a high-resolution timer upon construction and prints elapsed time to stdout upon destruction
+// class RaiiTimer : starts a high-resolution timer upon construction and prints elapsed time to stdout (or to out) upon destruction
 // For convenience, a reference time value (in ms) for comparison may be provided using the parameter msComparison.
 
 namespace ReSampler {
@@ -22,7 +22,7 @@ namespace ReSampler {
   class RaiiTimer {
   public:
     //{{{
-    explicit RaiiTimer(double msComparison = 0.0) : msComparison(msComparison) {
+    explicit RaiiTimer(double msComparison = 0.0, std::ostream& out = std::cout) : msComparison(msComparison), out(out) {
       beginTimer = std::chrono::high_resolution_clock::now();
       }
     //}}}
@@ -30,14 +30,14 @@ namespace ReSampler {
     ~RaiiTimer() {
       endTimer = std::chrono::high_resolution_clock::now();
       auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTimer - beginTimer).count();
-      std::cout << "Time=" << duration << " ms";
+      out << "Time=" << duration << " ms";
       if(msComparison != 0.0) {
         double relativeSpeed = msComparison / duration;
-        auto ss = std::cout.precision();
-        std::cout << " [" << std::setprecision(1) << relativeSpeed << "x]" << std::setprecision(
+        auto ss = out.precision();
+        out << " [" << std::setprecision(1) << relativeSpeed << "x]" << std::setprecision(
             static_cast<int>(ss));
       }
-      std::cout << "\n" << std::endl;
+      out << "\n" << std::endl;
     }
     //}}}
 
@@ -45,5 +45,6 @@ namespace ReSampler {
     std::chrono::time_point<std::chrono::high_resolution_clock> beginTimer;
     std::chrono::time_point<std::chrono::high_resolution_clock> endTimer;
     double msComparison;
+    std::ostream& out;
     };
 }
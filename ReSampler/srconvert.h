@@ -14,10 +14,21 @@
 #define USE_LAZYGET_ON_INTERPOLATE_DECIMATE
 
 #include "FIRFilter.h"
+#include "FFTConvolver.h"
+#include "filtercache.h"
+#include "stageplanner.h"
 #include "conversioninfo.h"
 #include "fraction.h"
 #include "ReSampler.h"
 
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
 namespace ReSampler {
   static_assert (std::is_copy_constructible<ConversionInfo>::value, "ConversionInfo needs to be copy Constructible");
   static_assert (std::is_copy_assignable<ConversionInfo>::value, "ConversionInfo needs to be copy Assignable");
@@ -28,13 +39,9 @@ namespace ReSampler {
     // determine cutoff frequency and steepness
     double targetNyquist = std::min(ci.inputSampleRate, ci.outputSampleRate) / 2.0;
     double ft = (ci.lpfCutoff / 100.0) * targetNyquist;
-    double steepness = 0.090909091 / (ci.lpfTransitionWidth / 100.0);
 
     // determine filtersize
-    int filterSize = static_cast<int>(
-      std::min<int>(FILTERSIZE_BASE * ci.overSamplingFactor * std::max(fraction.denominator, fraction.numerator) * steepness, FILTERSIZE_LIMIT)
-      | 1 // ensure that filter length is always odd
-      );
+    int filterSize = getFilterSize(ci.lpfTransitionWidth, ci.overSamplingFactor, fraction);
 
     // determine sidelobe attenuation
     int sidelobeAtten = ((fraction.numerator == 1) || (fraction.denominator == 1)) ? 195 : 160;
@@ -57,12 +64,106 @@ namespace ReSampler {
     }
   //}}}
   //{{{
+  template <typename FloatType> class FilterCoefficientCache {
+  // FilterCoefficientCache : process-wide cache of designed filters, keyed by every parameter which affects the design.
+  // Identical conversions (eg files in batch mode) share one design (including the minimum-phase transformation).
+  // If several threads request the same design at once, the first one designs it and the others wait for the result.
+  public:
+    typedef std::shared_ptr<const std::vector<FloatType>> Coefficients;
+
+    //{{{
+    static Coefficients get (const ConversionInfo& ci, Fraction fraction) {
+
+      FilterCoefficientCache& cache = getInstance();
+      Key key(ci.inputSampleRate, ci.outputSampleRate, fraction.numerator, fraction.denominator,
+              ci.overSamplingFactor, ci.lpfCutoff, ci.lpfTransitionWidth, ci.bMinPhase);
+
+      std::promise<Coefficients> promise;
+      std::shared_future<Coefficients> future;
+      bool mustDesign = false;
+      {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.designs.find(key);
+        if (it == cache.designs.end()) {
+          future = promise.get_future().share();
+          cache.designs.emplace(key, future);
+          mustDesign = true;
+          ++cache.misses;
+          }
+        else {
+          future = it->second;
+          ++cache.hits;
+          }
+      }
+
+      if (mustDesign) {
+        try {
+          promise.set_value(std::make_shared<const std::vector<FloatType>>(loadOrDesign(ci, fraction)));
+          }
+        catch (...) {
+          promise.set_exception(std::current_exception());
+          }
+        }
+
+      return future.get();
+      }
+    //}}}
+    //{{{
+    // getStats() : number of filters designed, and number of requests served from the cache
+    static void getStats (int& designed, int& reused) {
+
+      FilterCoefficientCache& cache = getInstance();
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      designed = cache.misses;
+      reused = cache.hits;
+      }
+    //}}}
+
+  private:
+    // input rate, output rate, numerator, denominator, oversampling factor, cutoff, transition width, minimum phase
+    typedef std::tuple<int, int, int, int, int, double, double, bool> Key;
+
+    FilterCoefficientCache() : misses(0), hits(0) {}
+
+    //{{{
+    // loadOrDesign() : fetch the design from the on-disk cache (--filter-cache) if possible, otherwise design it (and save it)
+    static std::vector<FloatType> loadOrDesign (const ConversionInfo& ci, Fraction fraction) {
+
+      std::vector<FloatType> taps;
+      if (ci.filterCacheDir.empty()) {
+        return makeFilterCoefficients<FloatType>(ci, fraction);
+        }
+
+      FilterDesignKey diskKey {ci.inputSampleRate, ci.outputSampleRate, fraction.numerator, fraction.denominator,
+                               ci.overSamplingFactor, ci.bMinPhase, ci.lpfCutoff, ci.lpfTransitionWidth};
+      if (!loadFilterFromCache(ci.filterCacheDir, diskKey, taps)) {
+        taps = makeFilterCoefficients<FloatType>(ci, fraction);
+        saveFilterToCache(ci.filterCacheDir, diskKey, taps);
+        }
+      return taps;
+      }
+    //}}}
+
+    //{{{
+    static FilterCoefficientCache& getInstance() {
+      static FilterCoefficientCache instance;
+      return instance;
+      }
+    //}}}
+
+    std::mutex mutex;
+    std::map<Key, std::shared_future<Coefficients>> designs;
+    int misses;
+    int hits;
+    };
+  //}}}
+  //{{{
   template <typename FloatType> class ResamplingStage {
   public:
     //{{{
-    ResamplingStage (int L, int M, const FIRFilter<FloatType>& filter, bool bypassMode = false)
-        : L(L), M(M),  m(0), filter(filter), bypassMode(bypassMode) {
-      SetConvertFunction();
+    ResamplingStage (int L, int M, const FIRFilter<FloatType>& filter, bool bypassMode = false, bool polyphaseMode = false)
+        : L(L), M(M),  m(0), filter(filter), bypassMode(bypassMode), polyphaseMode(false), historyLength(0), historyIndex(0) {
+      setPolyphaseMode(polyphaseMode);
       }
     //}}}
 
@@ -79,9 +180,53 @@ namespace ReSampler {
       }
     //}}}
     //{{{
+    void setPolyphaseMode (bool polyphaseMode) {
+    // polyphase mode only applies to stages which interpolate (L > 1), and where it is faster (see usePolyphase())
+
+      ResamplingStage::polyphaseMode = polyphaseMode && usePolyphase(L, M);
+      if (ResamplingStage::polyphaseMode && phaseKernels.empty()) {
+        makePhaseKernels();
+        }
+      SetConvertFunction();
+      }
+    //}}}
+    //{{{
+    bool isPolyphaseMode() const {
+      return polyphaseMode;
+      }
+    //}}}
+    //{{{
+    void setFFTMode (bool fftMode) {
+    // fftMode : convolve using FFTConvolver (overlap-save) instead of the direct-form FIR
+
+      if (fftMode && !fftConvolver) {
+        // rotate kernel by one tap, to match the alignment of FIRFilter::get()
+        const FloatType* taps = filter.getKernel();
+        const int length = filter.getLength();
+        std::vector<FloatType> kernel(taps + 1, taps + length);
+        kernel.push_back(taps[0]);
+        fftConvolver.reset(new FFTConvolver<FloatType>(kernel.data(), length));
+        }
+      else if (!fftMode) {
+        fftConvolver.reset();
+        }
+      SetConvertFunction();
+      }
+    //}}}
+    //{{{
+    bool isFFTMode() const {
+      return static_cast<bool>(fftConvolver);
+      }
+    //}}}
+    //{{{
     void reset() {
 
       filter.reset();
+      if (fftConvolver) {
+        fftConvolver->reset();
+        }
+      std::fill(history.begin(), history.end(), 0.0);
+      historyIndex = 0;
       m = 0;
       }
     //}}}
@@ -99,11 +244,7 @@ namespace ReSampler {
     // filterOnly() - keeps 1:1 conversion ratio, but applies filter
     void filterOnly (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
 
-      size_t o = 0;
-      for(size_t i = 0; i < inBufferSize; ++i) {
-        filter.put(inBuffer[i]);
-        outBuffer[o++] = filter.get();
-        }
+      filter.process(inBuffer, outBuffer, inBufferSize);
       outBufferSize = inBufferSize;
       }
     //}}}
@@ -178,14 +319,112 @@ namespace ReSampler {
     }
     //}}}
     //{{{
+    // polyphaseInterpolateAndDecimate() - polyphase equivalent of interpolateAndDecimate()
+    // Only the outputs which survive decimation are calculated, and each one only uses the taps
+    // which line up with real (ie not stuffed-zero) input samples.
+    // Taps and accumulation order are the same as lazyGet(), so the output is bit-identical to interpolateAndDecimate().
+    // For M == 1 the direct path is interpolate(), which uses the vectorized get() over every tap (stuffed zeros included),
+    // so the two differ by rounding (the order of summation), not bit for bit.
+    void polyphaseInterpolateAndDecimate (FloatType* outBuffer, size_t& outBufferSize,
+                                          const FloatType* inBuffer, const size_t& inBufferSize) {
+      size_t o = 0;
+      int localm = m;
+      for (size_t i = 0; i < inBufferSize; ++i) {
+
+        // push input sample into history (in reverse order; mirrored to avoid wrapping)
+        historyIndex = (historyIndex == 0) ? historyLength - 1 : historyIndex - 1;
+        history[historyIndex] = history[historyIndex + historyLength] = inBuffer[i];
+        const FloatType* h = history.data() + historyIndex;
+
+        // visit only the sub-sample phases which produce an output
+        for (int l = (localm == 0) ? 0 : M - localm; l < L; l += M) {
+          const std::vector<FloatType>& kernel = phaseKernels[l];
+          FloatType output = 0.0;
+          for (size_t j = 0; j < kernel.size(); ++j) {
+            output += h[j] * kernel[j];
+            }
+          outBuffer[o++] = output;
+          }
+
+        localm = (localm + L) % M;
+        }
+
+      outBufferSize = o;
+      m = localm;
+      }
+    //}}}
+    //{{{
+    // fftConvolve() - FFT equivalent of filterOnly(), interpolate(), decimate() and interpolateAndDecimate()
+    // The (zero-stuffed) input is convolved at the full intermediate rate, and every M-th result is kept.
+    void fftConvolve (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
+
+      if (L == 1 && M == 1) {
+        fftConvolver->process(inBuffer, outBuffer, inBufferSize);
+        outBufferSize = inBufferSize;
+        return;
+        }
+
+      size_t n = inBufferSize * L;
+      if (fftBuffer.size() < n) {
+        fftBuffer.resize(n);
+        }
+
+      if (L == 1) {
+        memcpy(fftBuffer.data(), inBuffer, inBufferSize * sizeof(FloatType));
+        }
+      else {
+        std::fill_n(fftBuffer.begin(), n, 0.0);
+        for (size_t i = 0; i < inBufferSize; ++i) {
+          fftBuffer[i * L] = inBuffer[i];
+          }
+        }
+
+      fftConvolver->process(fftBuffer.data(), fftBuffer.data(), n);
+
+      size_t o = 0;
+      size_t i = (m == 0) ? 0 : M - m;
+      for (; i < n; i += M) {
+        outBuffer[o++] = fftBuffer[i];
+        }
+      m = static_cast<int>((m + n) % M);
+      outBufferSize = o;
+      }
+    //}}}
+    //{{{
+    void makePhaseKernels() {
+    // makePhaseKernels() : split the filter into L sub-filters.
+    // Phase l is used at the l-th sub-sample after a real input sample, where lazyGet() would have
+    // started at tap (l + 1) and stepped through the kernel in increments of L
+
+      const FloatType* taps = filter.getKernel();
+      const int length = filter.getLength();
+      phaseKernels.assign(L, std::vector<FloatType>());
+      for (int l = 0; l < L; ++l) {
+        for (int t = l + 1; t < length; t += L) {
+          phaseKernels[l].push_back(taps[t]);
+          }
+        }
+
+      historyLength = std::max(1, static_cast<int>(phaseKernels[0].size()));
+      history.assign(2 * historyLength, 0.0);
+      historyIndex = 0;
+      }
+    //}}}
+    //{{{
     void SetConvertFunction() {
 
       if (bypassMode) {
         convertFn = &ResamplingStage::passThrough;
       }
+      else if (fftConvolver) {
+        convertFn = &ResamplingStage::fftConvolve;
+      }
       else if (L == 1 && M == 1) {
         convertFn = &ResamplingStage::filterOnly;
       }
+      else if (L != 1 && polyphaseMode) {
+        convertFn = &ResamplingStage::polyphaseInterpolateAndDecimate; // (M == 1 is just the special case of keeping every output)
+      }
       else if (L != 1 && M == 1) {
         convertFn = &ResamplingStage::interpolate;
       }
@@ -205,6 +444,17 @@ namespace ReSampler {
     FIRFilter<FloatType> filter;
     bool bypassMode;
 
+    // polyphase engine:
+    bool polyphaseMode;
+    std::vector<std::vector<FloatType>> phaseKernels; // L sub-filters
+    std::vector<FloatType> history; // double-length history of real input samples (most recent first)
+    int historyLength;
+    int historyIndex;
+
+    // FFT (overlap-save) engine:
+    std::unique_ptr<FFTConvolver<FloatType>> fftConvolver;
+    std::vector<FloatType> fftBuffer; // full-rate (zero-stuffed) working buffer
+
     // The following typedef defines the type 'ConvertFunction' which is a pointer to any of the member functions which
     // take the arguments (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) ...
     typedef void (ResamplingStage::*ConvertFunction) (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize); // see https://isocpp.org/wiki/faq/pointers-to-members
@@ -216,7 +466,14 @@ namespace ReSampler {
   template <typename FloatType> class Converter {
   public:
     //{{{
-    explicit Converter (const ConversionInfo& ci) : ci(ci), groupDelay(0.0), isBypassMode(false), gain(1.0) {
+    explicit Converter (const ConversionInfo& ci) : Converter(ci, choosePlan(ci)) {
+    }
+    //}}}
+    //{{{
+    // Converter() : with the configuration of stages already chosen (see choosePlan(), getConversionPlans()), so that
+    // the (costly) search for the best plan is done once per conversion, rather than once per channel.
+    // The plan is ignored by single-stage and bypass (same-rate) converters.
+    Converter (const ConversionInfo& ci, const ConversionPlan& plan) : ci(ci), groupDelay(0.0), isBypassMode(false), gain(1.0) {
       if (ci.outputSampleRate == ci.inputSampleRate) {
         isBypassMode = true;
         Converter::ci.bSingleStage = true;
@@ -227,10 +484,19 @@ namespace ReSampler {
         initSinglestage();
       } else {
         isMultistage = true;
-        initMultistage();
+        initMultistage(plan);
       }
     }
     //}}}
+    //{{{
+    // choosePlan() : the configuration of stages a Converter made from ci will use (empty if it is single-stage or bypass)
+    static ConversionPlan choosePlan (const ConversionInfo& ci) {
+      if (ci.bSingleStage || ci.outputSampleRate == ci.inputSampleRate) {
+        return ConversionPlan();
+      }
+      return getBestConversionPlan(ci);
+    }
+    //}}}
 
     //{{{
     void convert (FloatType* outBuffer, size_t& outBufferSize, const FloatType* inBuffer, const size_t& inBufferSize) {
@@ -274,6 +540,15 @@ namespace ReSampler {
     //}}}
 
   private:
+    //{{{
+    bool useFFT (size_t numTaps, int L, int M) const {
+    // useFFT() : decide whether a stage should use FFT convolution, by comparing the predicted cost of the FFT engine
+    // (proportional to M, as it computes every full-rate result) with that of the direct engine (see getStageCost()).
+    // ci.fftThreshold is the crossover for a 1:1 filter.
+
+      return getStageCost(static_cast<int>(numTaps), L, M, ci.fftThreshold, ci.bPolyphase).fft;
+    }
+    //}}}
     //{{{
     void initSinglestage() {
       numStages = 1;
@@ -283,68 +558,66 @@ namespace ReSampler {
       if (ci.overSamplingFactor != 1)
         gain *= ci.overSamplingFactor;
 
-      std::vector<FloatType> filterTaps = makeFilterCoefficients<FloatType>(ci, f);
+      auto coefficients = FilterCoefficientCache<FloatType>::get(ci, f);
+      const std::vector<FloatType>& filterTaps = *coefficients;
       f.numerator *= ci.overSamplingFactor;
       f.denominator *= ci.overSamplingFactor;
 
       FIRFilter<FloatType> firFilter(filterTaps.data(), static_cast<int>(filterTaps.size()));
-      convertStages.emplace_back(f.numerator, f.denominator, firFilter, isBypassMode);
+      convertStages.emplace_back(f.numerator, f.denominator, firFilter, isBypassMode, ci.bPolyphase);
+      if (!isBypassMode && useFFT(filterTaps.size(), f.numerator, f.denominator)) {
+        convertStages.back().setFFTMode(true);
+      }
       groupDelay = (ci.bMinPhase || !ci.bDelayTrim) ? 0 : (filterTaps.size() - 1) / 2 / f.denominator;
       if (isBypassMode)
         groupDelay = 0;
     }
     //}}}
     //{{{
-    void initMultistage() {
-      Fraction masterConversionRatio = getFractionFromSamplerates(ci.inputSampleRate, ci.outputSampleRate);
-      auto fractions = getConversionStages(masterConversionRatio, ci.maxStages);
+    void initMultistage (const ConversionPlan& plan) {
+    // initMultistage() : build the stages of a plan (see stageplanner.h)
+
+      std::vector<Fraction> fractions;
+      for (auto& stage : plan.stages) {
+        fractions.push_back(stage.fraction);
+      }
       numStages = static_cast<int>(fractions.size());
       indexOfLastStage = numStages - 1;
-      unsigned int inputRate = ci.inputSampleRate;
-      double stretch = (ci.lpfCutoff + ci.lpfTransitionWidth) / 100.0;
-      double lastStopFreq = stretch * inputRate / 2.0;
       std::string stageInputName(ci.inputFilename);
-      double ft = ci.lpfCutoff / 100 * std::min(ci.inputSampleRate, ci.outputSampleRate) / 2.0;
+      double ft = plan.ft;
+
+      if (ci.bShowStages) {
+        std::cout << "Conversion plan: ";
+        dumpConversionPlan(plan);
+        std::cout << " (" << plan.macs << " multiply-adds per output sample, predicted cost " << plan.cost << ")\n";
+      }
 
       for (int i = 0; i < numStages; i++) {
+        const StagePlan& stagePlan = plan.stages[i];
 
         // copy ConversionInfo for this stage from master:
         ConversionInfo stageCi = ci;
 
         // set input & output rates of this stage:
-        stageCi.inputSampleRate = inputRate;
-        stageCi.outputSampleRate = inputRate * fractions[i].numerator / fractions[i].denominator;
+        stageCi.inputSampleRate = stagePlan.inputSampleRate;
+        stageCi.outputSampleRate = stagePlan.outputSampleRate;
 
-        // decide whether to oversample this stage:
-        stageCi.overSamplingFactor = stageCi.bMinPhase ? 2 : 1;
+        // oversampling of this stage:
+        stageCi.overSamplingFactor = stagePlan.overSamplingFactor;
         if (stageCi.overSamplingFactor != 1) {
           gain *= stageCi.overSamplingFactor;
         }
 
-        // set minSampleRate and minNyquist for this stage:
-        decltype(stageCi.inputSampleRate) minSampleRate = std::min(stageCi.inputSampleRate, stageCi.outputSampleRate);
-        decltype(stageCi.inputSampleRate) minNyquist = static_cast<unsigned int>(minSampleRate / 2.0);
-
-        // determine transition frequency (cutoff) and stop frequency for this stage:
-        double stopFreq = std::max(stretch * minNyquist, minSampleRate - lastStopFreq);
+        // transition frequency (cutoff) and stop frequency for this stage (transition frequency and width are stored as percentage values):
+        double stopFreq = stagePlan.stopFreq;
         assert(stopFreq > ft); // should always be the case for a LPF
-
-        // set transition frequency (cutoff) and transition width for this stage (they are stored as percentage values)
-        if (i == indexOfLastStage) { // last stage must have the characteristics of the requested parameters:
-          stageCi.lpfTransitionWidth = ci.lpfTransitionWidth;
-          stageCi.lpfCutoff = ci.lpfCutoff;
-        }
-        else {
-          const double widthReduction = 2.0;
-          stageCi.lpfTransitionWidth = 100.0 * (stopFreq - ft) / (stageCi.outputSampleRate * 0.5) / widthReduction;
-          stageCi.lpfCutoff = 100 - stageCi.lpfTransitionWidth;
-        }
-
+        stageCi.lpfTransitionWidth = stagePlan.lpfTransitionWidth;
+        stageCi.lpfCutoff = stagePlan.lpfCutoff;
         assert(stageCi.lpfTransitionWidth > 0.0);
-        lastStopFreq = stopFreq; // keep this value for calculation of next stage's stopFreq
 
         // make the filter coefficients
-        std::vector<FloatType> filterTaps = makeFilterCoefficients<FloatType>(stageCi, fractions[i]);
+        auto coefficients = FilterCoefficientCache<FloatType>::get(stageCi, fractions[i]);
+        const std::vector<FloatType>& filterTaps = *coefficients;
 
         // make the filter
         FIRFilter<FloatType> firFilter(filterTaps.data(), static_cast<int>(filterTaps.size()));
@@ -356,8 +629,9 @@ namespace ReSampler {
           std::cout << "ft: " << ft << "\n";
           std::cout << "stopFreq: " << stopFreq << "\n";
           std::cout << "transition width: " << stageCi.lpfTransitionWidth << " %\n";
-          std::cout << "guarantee: " << lastStopFreq << "\n";
+          std::cout << "guarantee: " << stopFreq << "\n";
           std::cout << "Generated Filter Size: " << filterTaps.size() << "\n";
+          std::cout << "Multiply-adds per output sample: " << stagePlan.cost.macs << " (predicted cost " << stagePlan.cost.cost << ")\n";
 
           stageCi.maxStages = 1;
           // stageCi.bSingleStage = true; // to-do: use single-stage engine vs. multi w/ maxStages= 1 ??
@@ -383,7 +657,13 @@ namespace ReSampler {
         Fraction f = fractions[i];
         f.numerator *= stageCi.overSamplingFactor;
         f.denominator *= stageCi.overSamplingFactor;
-        convertStages.emplace_back(f.numerator, f.denominator, firFilter, false);
+        convertStages.emplace_back(f.numerator, f.denominator, firFilter, false, ci.bPolyphase);
+        if (useFFT(filterTaps.size(), f.numerator, f.denominator)) {
+          convertStages.back().setFFTMode(true);
+        }
+        if (ci.bShowStages) {
+          std::cout << "Engine: " << (convertStages.back().isFFTMode() ? "FFT (overlap-save)" : convertStages.back().isPolyphaseMode() ? "polyphase" : "direct") << "\n";
+        }
 
         // add Group Delay:
         groupDelay *= (static_cast<double>(f.numerator) / f.denominator); // scale previous delay according to conversion ratio
@@ -409,9 +689,6 @@ namespace ReSampler {
           intermediateOutputBuffers.emplace_back(std::vector<FloatType>(outBufferSize, 0.0));
         }
 
-        // set input rate of next stage
-        inputRate = stageCi.outputSampleRate;
-
       } // ends loop over i
 
       if (ci.bShowStages) {
@@ -441,4 +718,133 @@ namespace ReSampler {
     };
   //}}}
 
+  //{{{
+  // showConversionPlans() : list the candidate configurations of stages for a multi-stage conversion,
+  // with the predicted cost of each, and the cost measured by converting a few blocks of noise (for the cheapest few)
+  template <typename FloatType> void showConversionPlans (const ConversionInfo& ci) {
+
+    const size_t maxMeasured = 8;
+    const int numBlocks = 4;
+
+    std::vector<ConversionPlan> plans = getConversionPlans(ci);
+    ConversionPlan best = getBestConversionPlan(ci);
+    std::stable_sort(plans.begin(), plans.end(), [] (const ConversionPlan& a, const ConversionPlan& b) {
+      return (a.meetsSpec != b.meetsSpec) ? a.meetsSpec : a.cost < b.cost;
+      });
+
+    std::vector<FloatType> input(BUFFERSIZE);
+    srand(1);
+    for (auto& x : input) {
+      x = static_cast<FloatType>(rand()) / RAND_MAX - 0.5;
+      }
+    std::vector<FloatType> output(static_cast<size_t>(std::ceil(BUFFERSIZE * static_cast<double>(ci.outputSampleRate) / ci.inputSampleRate)) + 16);
+
+    ConversionInfo measureCi = ci;
+    measureCi.bShowStages = false;
+
+    std::cout << "Candidate conversion plans (" << plans.size() << "):\n"
+              << std::setw(28) << std::left << "stages" << std::right << std::setw(20) << "taps"
+              << std::setw(12) << "MACs" << std::setw(16) << "predicted cost" << std::setw(14) << "measured ns" << "  (per output sample)\n";
+
+    size_t measured = 0;
+    for (auto& plan : plans) {
+      std::ostringstream stages;
+      std::ostringstream taps;
+      for (size_t i = 0; i < plan.stages.size(); ++i) {
+        stages << (i == 0 ? "" : ", ") << plan.stages[i].fraction.numerator << "/" << plan.stages[i].fraction.denominator;
+        taps << (i == 0 ? "" : "+") << plan.stages[i].numTaps;
+        }
+
+      bool isBest = (plan.stages.size() == best.stages.size()) && std::equal(plan.stages.begin(), plan.stages.end(), best.stages.begin(),
+        [] (const StagePlan& a, const StagePlan& b) { return a.fraction.numerator == b.fraction.numerator && a.fraction.denominator == b.fraction.denominator; });
+
+      std::cout << std::setw(28) << std::left << stages.str() << std::right << std::setw(20) << taps.str()
+                << std::setw(12) << plan.macs << std::setw(16) << plan.cost;
+
+      if (plan.meetsSpec && (measured < maxMeasured || isBest || plan.isPreset)) {
+        ++measured;
+        Converter<FloatType> converter(measureCi, plan);
+        size_t outputCount = 0;
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (int b = 0; b < numBlocks; ++b) {
+          size_t o = 0;
+          converter.convert(output.data(), o, input.data(), input.size());
+          outputCount += o;
+          }
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+        std::cout << std::setw(14) << 1.0e9 * seconds / outputCount;
+        }
+      else {
+        std::cout << std::setw(14) << "-";
+        }
+
+      std::cout << (isBest ? "  <- chosen" : "") << (plan.isPreset ? "  (preset)" : "") << (plan.meetsSpec ? "" : "  (doesn't meet spec)") << "\n";
+      }
+    std::cout << std::endl;
+    }
+  //}}}
+  //{{{
+  // benchmarkPolyphase() : compare throughput of the direct (zero-stuffing) and polyphase engines
+  // on single-stage conversions, and report the largest difference between their outputs
+  template <typename FloatType> void benchmarkPolyphase() {
+
+    struct Ratio {
+      int inputRate;
+      int outputRate;
+      };
+    const std::vector<Ratio> ratios { {44100, 48000}, {44100, 96000}, {48000, 96000}, {48000, 384000}, {192000, 44100} };
+    const int numBlocks = 8;
+
+    for (auto& ratio : ratios) {
+      ConversionInfo ci{};
+      ci.inputSampleRate = ratio.inputRate;
+      ci.outputSampleRate = ratio.outputRate;
+      ci.lpfCutoff = 100.0 * (10.0 / 11.0);
+      ci.lpfTransitionWidth = 100.0 - ci.lpfCutoff;
+      ci.overSamplingFactor = 1;
+
+      Fraction f = getFractionFromSamplerates(ratio.inputRate, ratio.outputRate);
+      std::vector<FloatType> taps = makeFilterCoefficients<FloatType>(ci, f);
+      FIRFilter<FloatType> filter(taps.data(), static_cast<int>(taps.size()));
+
+      std::vector<FloatType> input(BUFFERSIZE);
+      srand(1);
+      for (auto& x : input) {
+        x = static_cast<FloatType>(rand()) / RAND_MAX - 0.5;
+        }
+
+      size_t outputBufferSize = 1 + static_cast<size_t>(std::ceil(BUFFERSIZE * static_cast<double>(f.numerator) / f.denominator));
+      std::vector<std::vector<FloatType>> outputs(2, std::vector<FloatType>(outputBufferSize * numBlocks));
+      double seconds[2];
+      size_t outputCount[2];
+      bool polyphaseUsed = false;
+
+      for (int mode = 0; mode < 2; ++mode) {
+        ResamplingStage<FloatType> stage(f.numerator, f.denominator, filter, false, mode == 1);
+        polyphaseUsed = stage.isPolyphaseMode();
+        outputCount[mode] = 0;
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (int b = 0; b < numBlocks; ++b) {
+          size_t o = 0;
+          stage.convert(outputs[mode].data() + outputCount[mode], o, input.data(), input.size());
+          outputCount[mode] += o;
+          }
+        auto end = std::chrono::high_resolution_clock::now();
+        seconds[mode] = std::chrono::duration<double>(end - begin).count();
+        }
+
+      FloatType maxDiff = 0.0;
+      for (size_t n = 0; n < std::min(outputCount[0], outputCount[1]); ++n) {
+        maxDiff = std::max(maxDiff, std::abs(outputs[0][n] - outputs[1][n]));
+        }
+
+      std::cout << ratio.inputRate << " -> " << ratio.outputRate
+                << " (" << f.numerator << ":" << f.denominator << ", " << taps.size() << " taps)\n";
+      std::cout << "  direct:    " << outputCount[0] / seconds[0] / 1.0e6 << " Msamples/sec\n";
+      std::cout << "  polyphase: " << outputCount[1] / seconds[1] / 1.0e6 << " Msamples/sec"
+                << " [" << seconds[0] / seconds[1] << "x]" << (polyphaseUsed ? "" : " (not used: the direct engine is faster)") << "\n";
+      std::cout << "  max difference: " << maxDiff << (maxDiff == 0.0 ? " (bit-identical)" : "") << "\n" << std::endl;
+      }
+    }
+  //}}}
 }
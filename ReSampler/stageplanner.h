@@ -0,0 +1,281 @@
+// stageplanner.h : cost model for multi-stage conversion, and selection of the cheapest configuration of stages
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "FIRFilter.h"
+#include "conversioninfo.h"
+#include "fraction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <utility>
+#include <vector>
+//}}}
+
+namespace ReSampler {
+  //{{{
+  // getFilterSize() : number of taps in the filter for a stage with the given transition width (%), oversampling and ratio
+  inline int getFilterSize (double lpfTransitionWidth, int overSamplingFactor, Fraction fraction) {
+
+    double steepness = 0.090909091 / (lpfTransitionWidth / 100.0);
+    return static_cast<int>(
+      std::min<int>(FILTERSIZE_BASE * overSamplingFactor * std::max(fraction.denominator, fraction.numerator) * steepness, FILTERSIZE_LIMIT)
+      | 1 // ensure that filter length is always odd
+      );
+    }
+  //}}}
+
+  // Relative cost of the basic operations of each engine, in units of one multiply-add of the (vectorized) direct FIR kernel.
+  // (measured on x86-64; they only need to be accurate enough to rank the candidate plans - see showConversionPlans())
+  const double scalarMacCost = 7.0;   // multiply-add in lazyGet() and in the polyphase engine (scalar)
+  const double subSampleCost = 32.0;  // each zero-stuffed sub-sample pushed through the zero-skipping engine
+  const double inputSampleCost = 6.0; // each input sample pushed into a filter's history
+
+  //{{{
+  // usePolyphase() : whether a stage with the polyphase option set actually uses the polyphase engine.
+  // Plain interpolation (M == 1) has no zero-skipping alternative, and the vectorized interpolate() costs numTaps per output,
+  // against scalarMacCost * numTaps / L for the scalar polyphase engine, so it stays faster until L exceeds scalarMacCost.
+  inline bool usePolyphase (int L, int M) {
+    return (L != 1) && ((M != 1) || (L > scalarMacCost));
+    }
+  //}}}
+  //{{{
+  struct StageCost {
+    double macs;  // multiply-adds per output sample
+    double cost;  // predicted cost per output sample (in units of one vectorized multiply-add)
+    bool fft;     // true if the FFT engine is cheaper
+    };
+  //}}}
+  //{{{
+  // getStageCost() : predicted cost of one stage (L and M include any oversampling), for the engine which ResamplingStage will use.
+  // The decimating and 1:1 engines (and plain interpolation) use every tap; the zero-skipping (lazyGet) and polyphase engines only use
+  // the taps which line up with real input samples (numTaps / L). The FFT engine's cost is modelled by its crossover (--fftThreshold),
+  // which is the filter length at which FFT convolution costs the same as the vectorized direct FIR.
+  inline StageCost getStageCost (int numTaps, int L, int M, int fftThreshold, bool polyphase) {
+
+    StageCost c;
+    if (L == 1) { // filterOnly(), decimate()
+      c.macs = numTaps;
+      c.cost = numTaps + inputSampleCost * M;
+      }
+    else if (polyphase && usePolyphase(L, M)) { // polyphaseInterpolateAndDecimate()
+      c.macs = static_cast<double>(numTaps) / L;
+      c.cost = scalarMacCost * numTaps / L + inputSampleCost * M / L;
+      }
+    else if (M == 1) { // interpolate()
+      c.macs = numTaps;
+      c.cost = numTaps + inputSampleCost;
+      }
+    else { // interpolateAndDecimate()
+      c.macs = static_cast<double>(numTaps) / L;
+      c.cost = scalarMacCost * numTaps / L + subSampleCost * M;
+      }
+
+    double fftCost = static_cast<double>(fftThreshold) * M;
+    c.fft = (fftThreshold != 0) && (fftCost <= c.cost);
+    if (c.fft) {
+      c.macs = fftCost;
+      c.cost = fftCost;
+      }
+    return c;
+    }
+  //}}}
+  //{{{
+  struct StagePlan {
+    Fraction fraction;        // conversion ratio (before oversampling)
+    int overSamplingFactor;
+    unsigned int inputSampleRate;
+    unsigned int outputSampleRate;
+    double lpfCutoff;         // %
+    double lpfTransitionWidth; // %
+    double stopFreq;          // Hz
+    int numTaps;
+    StageCost cost;           // per output sample of this stage
+    };
+  //}}}
+  //{{{
+  struct ConversionPlan {
+    std::vector<StagePlan> stages;
+    double ft;                // transition frequency (Hz) of the overall conversion
+    double macs;              // multiply-adds per output sample of the whole conversion
+    double cost;              // predicted cost per output sample of the whole conversion (see getStageCost())
+    bool meetsSpec;           // false if any stage fails to protect the passband, or needs a filter longer than FILTERSIZE_LIMIT
+    bool isPreset;            // true for the configuration chosen by getConversionStages()
+    };
+  //}}}
+
+  //{{{
+  inline ConversionPlan makeConversionPlan (const ConversionInfo& ci, const std::vector<Fraction>& fractions) {
+  // makeConversionPlan() : derive the filter specification of each stage (as Converter::initMultistage() will build it),
+  // and predict the cost of the conversion
+
+    ConversionPlan plan;
+    plan.meetsSpec = true;
+    plan.isPreset = false;
+    plan.macs = 0.0;
+    plan.cost = 0.0;
+
+    unsigned int inputRate = ci.inputSampleRate;
+    double stretch = (ci.lpfCutoff + ci.lpfTransitionWidth) / 100.0;
+    double lastStopFreq = stretch * inputRate / 2.0;
+    plan.ft = ci.lpfCutoff / 100 * std::min(ci.inputSampleRate, ci.outputSampleRate) / 2.0;
+
+    for (size_t i = 0; i < fractions.size(); i++) {
+      StagePlan stage;
+      stage.fraction = fractions[i];
+      stage.inputSampleRate = inputRate;
+      stage.outputSampleRate = inputRate * fractions[i].numerator / fractions[i].denominator;
+      stage.overSamplingFactor = ci.bMinPhase ? 2 : 1;
+
+      unsigned int minSampleRate = std::min(stage.inputSampleRate, stage.outputSampleRate);
+      unsigned int minNyquist = static_cast<unsigned int>(minSampleRate / 2.0);
+
+      // stop frequency must be above the passband, and low enough that nothing aliases into the passband:
+      stage.stopFreq = std::max(stretch * minNyquist, minSampleRate - lastStopFreq);
+      if (stage.stopFreq <= plan.ft) {
+        plan.meetsSpec = false;
+        }
+
+      if (i == fractions.size() - 1) { // last stage must have the characteristics of the requested parameters:
+        stage.lpfTransitionWidth = ci.lpfTransitionWidth;
+        stage.lpfCutoff = ci.lpfCutoff;
+        }
+      else {
+        const double widthReduction = 2.0;
+        stage.lpfTransitionWidth = 100.0 * (stage.stopFreq - plan.ft) / (stage.outputSampleRate * 0.5) / widthReduction;
+        stage.lpfCutoff = 100 - stage.lpfTransitionWidth;
+        }
+      if (stage.lpfTransitionWidth <= 0.0 || stage.lpfCutoff <= 0.0) {
+        plan.meetsSpec = false;
+        stage.lpfTransitionWidth = std::max(stage.lpfTransitionWidth, 0.1); // (keep filter size finite)
+        }
+      lastStopFreq = stage.stopFreq;
+
+      stage.numTaps = getFilterSize(stage.lpfTransitionWidth, stage.overSamplingFactor, stage.fraction);
+      if (stage.numTaps >= FILTERSIZE_LIMIT) {
+        plan.meetsSpec = false; // (filter would be truncated)
+        }
+
+      stage.cost = getStageCost(stage.numTaps, stage.fraction.numerator * stage.overSamplingFactor,
+                                stage.fraction.denominator * stage.overSamplingFactor, ci.fftThreshold, ci.bPolyphase);
+      double outputsPerOutput = static_cast<double>(stage.outputSampleRate) / ci.outputSampleRate;
+      plan.macs += stage.cost.macs * outputsPerOutput;
+      plan.cost += stage.cost.cost * outputsPerOutput;
+
+      plan.stages.push_back(stage);
+      inputRate = stage.outputSampleRate;
+      }
+
+    return plan;
+    }
+  //}}}
+  //{{{
+  inline std::vector<ConversionPlan> getConversionPlans (const ConversionInfo& ci) {
+  // getConversionPlans() : enumerate every viable configuration of up to ci.maxStages stages (every distribution of the prime factors
+  // of the conversion ratio between the stages, which keeps the intermediate sample rates high enough), and plan each one.
+  // The configuration chosen by getConversionStages() comes first.
+
+    Fraction f = getFractionFromSamplerates(ci.inputSampleRate, ci.outputSampleRate);
+    double minRatio = std::min(1.0, static_cast<double>(f.numerator) / f.denominator);
+    std::set<std::vector<std::pair<int, int>>> seen;
+    std::vector<ConversionPlan> plans;
+
+    auto addCandidate = [&] (const std::vector<Fraction>& fractions, bool isPreset) {
+      std::vector<std::pair<int, int>> signature;
+      for (auto& fraction : fractions) {
+        signature.emplace_back(fraction.numerator, fraction.denominator);
+        }
+      if (seen.insert(signature).second) {
+        plans.push_back(makeConversionPlan(ci, fractions));
+        plans.back().isPreset = isPreset;
+        }
+      };
+
+    addCandidate(getConversionStages(f, ci.maxStages), true);
+    addCandidate(std::vector<Fraction> {f}, false);
+
+    // distribute the prime factors of L and M between the stages, in every possible way:
+    std::vector<int> numeratorPrimes = (f.numerator == 1) ? std::vector<int>() : factorize(f.numerator);
+    std::vector<int> denominatorPrimes = (f.denominator == 1) ? std::vector<int>() : factorize(f.denominator);
+    size_t numPrimes = numeratorPrimes.size() + denominatorPrimes.size();
+
+    for (int numStages = 2; numStages <= ci.maxStages; ++numStages) {
+      if (std::pow(static_cast<double>(numStages), static_cast<double>(numPrimes)) > 1.0e6) {
+        break; // (too many to search)
+        }
+
+      std::vector<int> assignment(numPrimes, 0); // stage to which each prime is assigned
+      do {
+        std::vector<Fraction> fractions(numStages, Fraction{1, 1});
+        for (size_t p = 0; p < numPrimes; ++p) {
+          if (p < numeratorPrimes.size()) {
+            fractions[assignment[p]].numerator *= numeratorPrimes[p];
+            }
+          else {
+            fractions[assignment[p]].denominator *= denominatorPrimes[p - numeratorPrimes.size()];
+            }
+          }
+
+        // reject 1:1 stages (same as fewer stages, at extra cost), and intermediate rates below min(input rate, output rate):
+        bool viable = true;
+        double ratio = 1.0;
+        for (int i = 0; i < numStages && viable; ++i) {
+          ratio *= static_cast<double>(fractions[i].numerator) / fractions[i].denominator;
+          viable = (fractions[i].numerator != fractions[i].denominator) && (ratio >= minRatio || i == numStages - 1);
+          }
+        if (viable) {
+          addCandidate(fractions, false);
+          }
+
+        // next assignment (odometer):
+        size_t p = 0;
+        while (p < numPrimes && ++assignment[p] == numStages) {
+          assignment[p++] = 0;
+          }
+        if (p == numPrimes) {
+          break;
+          }
+        } while (numPrimes != 0);
+      }
+
+    return plans;
+    }
+  //}}}
+  //{{{
+  inline ConversionPlan getBestConversionPlan (const ConversionInfo& ci) {
+  // getBestConversionPlan() : the cheapest plan which meets the specification
+  // (in the event of a tie, the preset configuration, then the one with the fewest stages)
+
+    std::vector<ConversionPlan> plans = getConversionPlans(ci);
+    const ConversionPlan* best = &plans.front();
+    for (auto& plan : plans) {
+      if ((plan.meetsSpec && !best->meetsSpec) ||
+          (plan.meetsSpec == best->meetsSpec && plan.cost < best->cost * (1.0 - 1.0e-9))) {
+        best = &plan;
+        }
+      }
+    return *best;
+    }
+  //}}}
+
+  //{{{
+  inline void dumpConversionPlan (const ConversionPlan& plan) {
+
+    std::vector<Fraction> fractions;
+    for (auto& stage : plan.stages) {
+      fractions.push_back(stage.fraction);
+      }
+    dumpFractionList(fractions);
+    }
+  //}}}
+}
@@ -0,0 +1,353 @@
+// streamconverter.h : streaming (push / pull) interface to the sample rate converter, for embedding in other applications
+//{{{
+/*
+* Copyright (C) 2016 - 2020 Judd Niemann - All Rights Reserved.
+* You may use, distribute and modify this code under the
+* terms of the GNU Lesser General Public License, version 2.1
+*
+* You should have received a copy of GNU Lesser General Public License v2.1
+* with this file. If not, please refer to: https://github.com/jniemann66/ReSampler
+*/
+//}}}
+#pragma once
+//{{{  includes
+#include "srconvert.h"
+#include "conversioninfo.h"
+#include "fraction.h"
+#include "interleave.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+//}}}
+
+namespace ReSampler {
+  //{{{
+  // getDefaultStreamOptions() : the filter settings used by ReSampler when no options are given on the command line
+  inline ConversionInfo getDefaultStreamOptions() {
+
+    ConversionInfo ci{};
+    ci.gain = 1.0;
+    ci.limit = 1.0;
+    ci.lpfMode = normal;
+    ci.lpfCutoff = 100.0 * (10.0 / 11.0);
+    ci.lpfTransitionWidth = 100.0 - ci.lpfCutoff;
+    ci.bDelayTrim = true;
+    ci.maxStages = 3;
+    ci.bMultiStage = true;
+    ci.fftThreshold = 1024;
+    ci.overSamplingFactor = 1;
+    return ci;
+    }
+  //}}}
+
+  //{{{
+  template <typename FloatType> class StreamConverter {
+  // StreamConverter : converts a continuous stream of (multi-channel) audio, in arbitrary-sized blocks.
+  // Input is pushed in (planar or interleaved), and converted immediately into an output FIFO,
+  // from which any number of frames can be pulled (planar or interleaved) - eg exactly one encoder frame at a time.
+  // The output is identical to that of the file converter, except that the filter delay is not trimmed (see getLatency()).
+  // All memory is allocated by the constructor (and by prepareRates()); push(), pull(), setRates() (of prepared rates)
+  // and reset() never allocate, so they are safe to call from a real-time thread. Not thread-safe: use from one thread at a time.
+  public:
+    //{{{
+    // maxInputFrames : largest number of frames which will be passed to a single push()
+    // fifoFrames : capacity of the output FIFO (0 = room for the output of two maximum-sized pushes, plus BUFFERSIZE frames)
+    // options : filter options (cutoff, transition width, minimum phase, polyphase, maxStages etc); sample rates are ignored
+    StreamConverter (int numChannels, int inputSampleRate, int outputSampleRate, size_t maxInputFrames,
+                     size_t fifoFrames = 0, const ConversionInfo& options = getDefaultStreamOptions())
+        : numChannels(numChannels), maxInputFrames(std::max<size_t>(1, maxInputFrames)), options(options),
+          requestedFifoFrames(fifoFrames), fifoCapacity(0), fifoRead(0), fifoCount(0), current(nullptr) {
+
+      inputScratch.assign(numChannels, std::vector<FloatType>(StreamConverter::maxInputFrames));
+      inputPointers.assign(numChannels, nullptr);
+      scratchPointers.assign(numChannels, nullptr);
+      for (int ch = 0; ch < numChannels; ++ch) {
+        scratchPointers[ch] = inputScratch[ch].data();
+        }
+      fifoPointers.assign(numChannels, nullptr);
+
+      prepareRates(inputSampleRate, outputSampleRate);
+      current = engines.front().get();
+      }
+    //}}}
+
+    StreamConverter (const StreamConverter&) = delete;
+    StreamConverter& operator = (const StreamConverter&) = delete;
+
+    //{{{
+    // push() : convert planar input (one pointer per channel). Returns false (and consumes nothing)
+    // if frames > maxInputFrames, or if the output FIFO doesn't have room for the result (pull some output first).
+    bool push (const FloatType* const* input, size_t frames) {
+
+      if (frames > maxInputFrames || fifoCount + current->getOutputBound(frames) > fifoCapacity) {
+        return false;
+        }
+
+      for (size_t offset = 0; offset < frames; ) {
+        size_t n = std::min(frames - offset, static_cast<size_t>(BUFFERSIZE));
+        size_t o = 0;
+        for (int ch = 0; ch < numChannels; ++ch) {
+          current->converters[ch].convert(current->outputScratch[ch].data(), o, input[ch] + offset, n);
+          }
+        writeFifo(o);
+        offset += n;
+        }
+      return true;
+      }
+    //}}}
+    //{{{
+    // pushInterleaved() : as push(), but for interleaved input
+    bool pushInterleaved (const FloatType* input, size_t frames) {
+
+      if (frames > maxInputFrames) {
+        return false;
+        }
+      deinterleave(input, scratchPointers.data(), frames, numChannels);
+      for (int ch = 0; ch < numChannels; ++ch) {
+        inputPointers[ch] = inputScratch[ch].data();
+        }
+      return push(inputPointers.data(), frames);
+      }
+    //}}}
+    //{{{
+    // pull() : fetch up to 'frames' frames of planar output. Returns the number of frames fetched
+    size_t pull (FloatType* const* output, size_t frames) {
+
+      size_t count = std::min(frames, fifoCount);
+      size_t first = std::min(count, fifoCapacity - fifoRead); // (before wrap-around)
+      for (int ch = 0; ch < numChannels; ++ch) {
+        const FloatType* src = fifo[ch].data();
+        std::copy(src + fifoRead, src + fifoRead + first, output[ch]);
+        std::copy(src, src + (count - first), output[ch] + first);
+        }
+      fifoRead = (fifoRead + count) % fifoCapacity;
+      fifoCount -= count;
+      return count;
+      }
+    //}}}
+    //{{{
+    // pullInterleaved() : as pull(), but for interleaved output
+    size_t pullInterleaved (FloatType* output, size_t frames) {
+
+      size_t count = std::min(frames, fifoCount);
+      size_t first = std::min(count, fifoCapacity - fifoRead); // (before wrap-around)
+      for (int ch = 0; ch < numChannels; ++ch) {
+        fifoPointers[ch] = fifo[ch].data() + fifoRead;
+        }
+      interleave(fifoPointers.data(), output, first, numChannels);
+      for (int ch = 0; ch < numChannels; ++ch) {
+        fifoPointers[ch] = fifo[ch].data();
+        }
+      interleave(fifoPointers.data(), output + first * numChannels, count - first, numChannels);
+      fifoRead = (fifoRead + count) % fifoCapacity;
+      fifoCount -= count;
+      return count;
+      }
+    //}}}
+
+    //{{{
+    // getAvailableFrames() : number of frames which can be pulled
+    size_t getAvailableFrames() const {
+      return fifoCount;
+      }
+    //}}}
+    //{{{
+    // getLatency() : delay (in output frames) introduced by the filters, ie the number of output frames
+    // which the file converter trims from the start of its output. (0 for minimum-phase filters)
+    size_t getLatency() const {
+      return current->latency;
+      }
+    //}}}
+    //{{{
+    int getInputSampleRate() const {
+      return current->inputSampleRate;
+      }
+    //}}}
+    //{{{
+    int getOutputSampleRate() const {
+      return current->outputSampleRate;
+      }
+    //}}}
+    //{{{
+    size_t getMaxInputFrames() const {
+      return maxInputFrames;
+      }
+    //}}}
+
+    //{{{
+    // reset() : discard all state (filter histories and the output FIFO), as if newly constructed
+    void reset() {
+
+      current->reset();
+      fifoRead = fifoCount = 0;
+      }
+    //}}}
+    //{{{
+    // prepareRates() : build the filters for another pair of sample rates, so that setRates() can switch to them without allocating.
+    // Allocates (and may take some time to design the filters): don't call from a real-time thread.
+    void prepareRates (int inputSampleRate, int outputSampleRate) {
+
+      if (findEngine(inputSampleRate, outputSampleRate) != nullptr) {
+        return;
+        }
+
+      std::unique_ptr<Engine> engine(new Engine(numChannels, inputSampleRate, outputSampleRate, maxInputFrames, options));
+      engines.push_back(std::move(engine));
+
+      // grow the FIFO if necessary (it must at least be able to hold the output of one maximum-sized push):
+      size_t bound = engines.back()->getOutputBound(maxInputFrames);
+      size_t capacity = (requestedFifoFrames != 0) ? std::max(requestedFifoFrames, bound) : 2 * bound + BUFFERSIZE;
+      if (capacity > fifoCapacity) {
+        resizeFifo(capacity);
+        }
+      }
+    //}}}
+    //{{{
+    // setRates() : change the conversion ratio between blocks. The filters of the new rates start from silence
+    // (frames already in the output FIFO are kept). Rates which haven't been prepared are prepared first (which allocates).
+    void setRates (int inputSampleRate, int outputSampleRate) {
+
+      Engine* engine = findEngine(inputSampleRate, outputSampleRate);
+      if (engine == nullptr) {
+        prepareRates(inputSampleRate, outputSampleRate);
+        engine = engines.back().get();
+        }
+      if (engine != current) {
+        engine->reset();
+        current = engine;
+        }
+      }
+    //}}}
+
+  private:
+    //{{{
+    struct Engine {
+    // Engine : one converter per channel for a particular pair of sample rates, with output scratch buffers
+      //{{{
+      Engine (int numChannels, int inputSampleRate, int outputSampleRate, size_t maxInputFrames, const ConversionInfo& options)
+          : inputSampleRate(inputSampleRate), outputSampleRate(outputSampleRate) {
+
+        ConversionInfo ci = options;
+        ci.inputSampleRate = inputSampleRate;
+        ci.outputSampleRate = outputSampleRate;
+        ci.bDelayTrim = true; // (so that the converter reports its group delay)
+        ci.bShowStages = false;
+
+        converters.reserve(numChannels);
+        ConversionPlan plan = Converter<FloatType>::choosePlan(ci); // (once, for every channel)
+        for (int ch = 0; ch < numChannels; ++ch) {
+          converters.emplace_back(ci, plan);
+          }
+
+        // same gain as the file converter (compensates for zero-stuffing, and oversampling):
+        Fraction fraction = getFractionFromSamplerates(inputSampleRate, outputSampleRate);
+        gain = static_cast<FloatType>(converters[0].getGain()) * static_cast<FloatType>(fraction.numerator * 1.0);
+        latency = static_cast<size_t>(converters[0].getGroupDelay());
+
+        // run a maximum-sized block through each converter, so that any lazily-sized working buffers are allocated now:
+        size_t chunk = std::min(maxInputFrames, static_cast<size_t>(BUFFERSIZE));
+        std::vector<FloatType> silence(chunk, 0.0);
+        outputScratch.assign(numChannels, std::vector<FloatType>(getOutputBound(chunk)));
+        for (int ch = 0; ch < numChannels; ++ch) {
+          size_t o = 0;
+          converters[ch].convert(outputScratch[ch].data(), o, silence.data(), chunk);
+          }
+        reset();
+        }
+      //}}}
+      //{{{
+      void reset() {
+        for (auto& converter : converters) {
+          converter.reset();
+          }
+        }
+      //}}}
+      //{{{
+      // getOutputBound() : upper bound of the number of output frames produced by 'frames' input frames
+      // (each stage may round its output count up by one, which later stages may multiply; allow for that in every chunk)
+      size_t getOutputBound (size_t frames) const {
+
+        double ratio = static_cast<double>(outputSampleRate) / inputSampleRate;
+        size_t numChunks = std::max<size_t>(1, (frames + BUFFERSIZE - 1) / BUFFERSIZE);
+        return static_cast<size_t>(std::ceil(frames * ratio)) + numChunks * 16 * (1 + static_cast<size_t>(std::ceil(ratio)));
+        }
+      //}}}
+
+      int inputSampleRate;
+      int outputSampleRate;
+      std::vector<Converter<FloatType>> converters;
+      std::vector<std::vector<FloatType>> outputScratch;
+      FloatType gain;
+      size_t latency;
+      };
+    //}}}
+
+    //{{{
+    Engine* findEngine (int inputSampleRate, int outputSampleRate) const {
+
+      for (auto& engine : engines) {
+        if (engine->inputSampleRate == inputSampleRate && engine->outputSampleRate == outputSampleRate) {
+          return engine.get();
+          }
+        }
+      return nullptr;
+      }
+    //}}}
+    //{{{
+    // writeFifo() : append n frames (with gain applied) from the current engine's output scratch buffers
+    void writeFifo (size_t n) {
+
+      size_t write = (fifoRead + fifoCount) % fifoCapacity;
+      for (int ch = 0; ch < numChannels; ++ch) {
+        const FloatType* src = current->outputScratch[ch].data();
+        FloatType* dst = fifo[ch].data();
+        size_t w = write;
+        for (size_t i = 0; i < n; ++i) {
+          dst[w] = current->gain * src[i];
+          if (++w == fifoCapacity) {
+            w = 0;
+            }
+          }
+        }
+      fifoCount += n;
+      }
+    //}}}
+    //{{{
+    void resizeFifo (size_t capacity) {
+    // resizeFifo() : change capacity, preserving contents
+
+      std::vector<std::vector<FloatType>> newFifo(numChannels, std::vector<FloatType>(capacity));
+      for (int ch = 0; ch < numChannels && fifoCount != 0; ++ch) {
+        for (size_t i = 0; i < fifoCount; ++i) {
+          newFifo[ch][i] = fifo[ch][(fifoRead + i) % fifoCapacity];
+          }
+        }
+      fifo.swap(newFifo);
+      fifoCapacity = capacity;
+      fifoRead = 0;
+      }
+    //}}}
+
+    int numChannels;
+    size_t maxInputFrames;
+    ConversionInfo options;
+
+    std::vector<std::unique_ptr<Engine>> engines; // one for each prepared pair of sample rates
+    std::vector<std::vector<FloatType>> inputScratch; // (de-interleaved input)
+    std::vector<const FloatType*> inputPointers;
+    std::vector<FloatType*> scratchPointers; // (to inputScratch)
+    std::vector<const FloatType*> fifoPointers; // (for interleaving the output)
+
+    // output FIFO (one ring buffer per channel):
+    std::vector<std::vector<FloatType>> fifo;
+    size_t requestedFifoFrames;
+    size_t fifoCapacity;
+    size_t fifoRead;
+    size_t fifoCount;
+
+    Engine* current;
+    };
+  //}}}
+}
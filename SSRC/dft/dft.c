@@ -455,6 +455,22 @@ static uint64_t estimate(int level, int N) {
 }
 //}}}
 //{{{
+// measureButterfly : time niter runs of a butterfly, with plain and with streaming stores. (Each run used to be preceded
+// by a width 1 butterfly at the level above, which isn't a valid butterfly for every vector width and level, and
+// crashed SLEEF_MODE_MEASURE plans)
+static void measureButterfly(SleefDFT *p, int N, SleefDFT_real *d, const SleefDFT_real *s, int level, int niter) {
+	dispatch(p, N, d, s, level, 0);
+	uint64_t tm = gettime();
+	for(int i=0;i<niter;i++) dispatch(p, N, d, s, level, 0);
+	p->tm[level*(MAXBUTWIDTH+1)+N] = gettime() - tm;
+
+	dispatch(p, N, d, s, level, 1);
+	tm = gettime();
+	for(int i=0;i<niter;i++) dispatch(p, N, d, s, level, 1);
+	p->tm2[level*(MAXBUTWIDTH+1)+N] = gettime() - tm;
+}
+//}}}
+//{{{
 static int measure(SleefDFT *p, int randomize) {
 	SleefDFT_real *s = (SleefDFT_real *)memset(p->x0, 0, sizeof(SleefDFT_real) * (2 << p->log2len));
 	SleefDFT_real *d = (SleefDFT_real *)memset(p->x1, 0, sizeof(SleefDFT_real) * (2 << p->log2len));
@@ -479,23 +495,7 @@ static int measure(SleefDFT *p, int randomize) {
 			if (level == N) {
 	if ((int)p->log2len - (int)level < p->log2vecwidth) continue;
 	if (!randomize && p->planMode != 0) {
-		const int pl = level >= p->log2len-2 ? 1 : 1;
-
-		p->tm[level*(MAXBUTWIDTH+1)+N] = 0;
-		for(int i=0;i<niter;i++) {
-			dispatch(p, pl, d, s, level+pl, 0);
-			uint64_t tm = gettime();
-			dispatch(p, N, d, s, level, 0);
-			p->tm[level*(MAXBUTWIDTH+1)+N] += gettime() - tm;
-		}
-
-		p->tm2[level*(MAXBUTWIDTH+1)+N] = 0;
-		for(int i=0;i<niter;i++) {
-			dispatch(p, pl, d, s, level+pl, 0);
-			uint64_t tm = gettime();
-			dispatch(p, N, d, s, level, 1);
-			p->tm2[level*(MAXBUTWIDTH+1)+N] += gettime() - tm;
-		}
+		measureButterfly(p, N, d, s, level, niter);
 	} else {
 		p->tm[level*(MAXBUTWIDTH+1)+N] = estimate(level, N);
 	}
@@ -523,23 +523,8 @@ static int measure(SleefDFT *p, int randomize) {
 		for(int i0=0, i1=0;i0 < (1 << (p->log2len-N));i0+=p->vecwidth, i1++) {
 			p->perm[level][i1] = 2*perm(p->log2len, i0, p->log2len-level, p->log2len-(level-N));
 		}
-		const int pl = level >= p->log2len-2 ? 1 : 1;
 
-		p->tm[level*(MAXBUTWIDTH+1)+N] = 0;
-		for(int i=0;i<niter;i++) {
-			dispatch(p, pl, d, s, level+pl, 0);
-			uint64_t tm = gettime();
-			dispatch(p, N, d, s, level, 0);
-			p->tm[level*(MAXBUTWIDTH+1)+N] += gettime() - tm;
-		}
-
-		p->tm2[level*(MAXBUTWIDTH+1)+N] = 0;
-		for(int i=0;i<niter;i++) {
-			dispatch(p, pl, d, s, level+pl, 0);
-			uint64_t tm = gettime();
-			dispatch(p, N, d, s, level, 1);
-			p->tm2[level*(MAXBUTWIDTH+1)+N] += gettime() - tm;
-		}
+		measureButterfly(p, N, d, s, level, niter);
 	} else {
 		p->tm[level*(MAXBUTWIDTH+1)+N] = estimate(level, N);
 	}
@@ -576,6 +561,194 @@ static int measure(SleefDFT *p, int randomize) {
 }
 //}}}
 
+//{{{  plan cache
+// Measured plans (the path through the butterflies), keyed by (mode, log2len, ISA name). The ISA is recorded by name
+// rather than by index, as the indices depend on the ISAs a library was built with. Each line of a plan file is
+//   <ISA name> : <mode> <log2len> : <path, as for SleefDFT_setPath>
+#define PLAN_KEY_MASK (SLEEF_MODE_BACKWARD | SLEEF_MODE_REAL | SLEEF_MODE_ALT | (15 << 5) | (3 << 9))
+#define PLAN_ISANAME_MAX 64
+
+typedef struct PlanEntry {
+	char isaName[PLAN_ISANAME_MAX];
+	uint64_t key;
+	uint32_t log2len;
+	int path[32];
+} PlanEntry;
+
+static PlanEntry *plans = NULL;
+static int nPlans = 0, plansCapacity = 0;
+static char *planFilePath = NULL;
+static int planFileReadOnly = 0;
+
+// the plans are shared by the threads creating plans (eg SSRC converting segments concurrently)
+static volatile int planLock = 0;
+static void lockPlans() { while(__sync_lock_test_and_set(&planLock, 1)) ; }
+static void unlockPlans() { __sync_lock_release(&planLock); }
+
+//{{{
+static PlanEntry *findPlan(const char *isaName, uint64_t key, uint32_t log2len) {
+	for(int i=nPlans-1;i>=0;i--) {
+		if (plans[i].key == key && plans[i].log2len == log2len && strcmp(plans[i].isaName, isaName) == 0) return &plans[i];
+	}
+	return NULL;
+}
+//}}}
+//{{{
+static void appendPlan(const PlanEntry *e) {
+	if (nPlans == plansCapacity) {
+		plansCapacity = plansCapacity == 0 ? 16 : plansCapacity * 2;
+		plans = (PlanEntry *)realloc(plans, sizeof(PlanEntry) * plansCapacity);
+	}
+	plans[nPlans++] = *e;
+}
+//}}}
+//{{{
+// parsePlan : one line of a plan file; the path must cover the length with butterflies this library has
+static int parsePlan(const char *line, PlanEntry *e) {
+	char isaName[PLAN_ISANAME_MAX];
+	unsigned long long key;
+	unsigned log2len;
+	int pos = 0;
+
+	if (sscanf(line, "%63[^:]: %llx %u :%n", isaName, &key, &log2len, &pos) < 3 || pos == 0) return 0;
+	if (log2len < 1 || log2len > 30) return 0;
+
+	int len = strlen(isaName);
+	while(len > 0 && isaName[len-1] == ' ') isaName[--len] = '\0';
+	strcpy(e->isaName, isaName);
+	e->key = key;
+	e->log2len = log2len;
+
+	const char *q = line + pos;
+	int level = log2len;
+	for(int j=0;j<32;j++) e->path[j] = 0;
+	for(int j=0;j<32 && level > 0;j++) {
+		char *end;
+		long N = strtol(q, &end, 10);
+		if (end == q || N == 0 || abs(N) > MAXBUTWIDTH || abs(N) > level) return 0;
+		e->path[j] = N;
+		level -= abs(N);
+		q = end;
+	}
+
+	return level == 0;
+}
+//}}}
+//{{{
+static void loadPlans(const char *path) {
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) return;
+
+	char line[256];
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		PlanEntry e;
+		if (parsePlan(line, &e)) appendPlan(&e);
+	}
+
+	fclose(fp);
+}
+//}}}
+//{{{
+// lookupPlan : take the path of a known plan, if the tables it needs exist for the ISA chosen
+static int lookupPlan(SleefDFT *p, uint64_t key) {
+	const char *isaName = (const char *)(*getPtr[p->isa])(0);
+
+	lockPlans();
+	PlanEntry *e = findPlan(isaName, key, p->log2len);
+	PlanEntry plan;
+	if (e != NULL) plan = *e;
+	unlockPlans();
+	if (e == NULL) return 0;
+
+	for(int level = p->log2len, j = 0;level > 0;level -= abs(plan.path[j]), j++) {
+		int N = abs(plan.path[j]);
+		// (the butterflies measure() would have considered)
+		if (p->tbl[N] == NULL && level != N) return 0;
+		if (level == N) {
+			if ((int)p->log2len - level < p->log2vecwidth) return 0;
+		} else if (level == (int)p->log2len) {
+			if (p->tbl[N][level] == NULL || p->vecwidth > (1 << N)) return 0;
+		} else {
+			if (p->tbl[N][level] == NULL) return 0;
+			if (p->vecwidth > 2 && (int)p->log2len <= N+2) return 0;
+			if ((int)p->log2len - level < p->log2vecwidth) return 0;
+		}
+	}
+
+	p->bestPath = (int *)malloc(sizeof(int) * (p->log2len+1));
+	for(uint32_t j = 0;j <= p->log2len;j++) p->bestPath[j] = 0;
+	for(int level = p->log2len, j = 0;level > 0;level -= abs(plan.path[j]), j++) p->bestPath[level] = plan.path[j];
+
+	p->pathLen = 0;
+	for(int j = p->log2len;j >= 0;j--) if (p->bestPath[j] != 0) p->pathLen++;
+
+	if ((p->mode & SLEEF_MODE_VERBOSE) != 0) printf("plan from cache\n");
+
+	return 1;
+}
+//}}}
+//{{{
+// addPlan : remember a measured plan (and append it to the plan file).
+// Returns 0 if another thread added a plan for the key while this one was measuring
+static int addPlan(SleefDFT *p, uint64_t key) {
+	PlanEntry e;
+
+	strncpy(e.isaName, (const char *)(*getPtr[p->isa])(0), PLAN_ISANAME_MAX-1);
+	e.isaName[PLAN_ISANAME_MAX-1] = '\0';
+	e.key = key;
+	e.log2len = p->log2len;
+	for(int j=0;j<32;j++) e.path[j] = 0;
+	for(int level = p->log2len, j = 0;level > 0 && j < 32;j++) {
+		e.path[j] = p->bestPath[level];
+		level -= abs(p->bestPath[level]);
+	}
+
+	lockPlans();
+	int added = findPlan(e.isaName, key, e.log2len) == NULL;
+	if (added) {
+		appendPlan(&e);
+		if (planFilePath != NULL && !planFileReadOnly) {
+			FILE *fp = fopen(planFilePath, "a");
+			if (fp != NULL) {
+	fprintf(fp, "%s : %llx %u :", e.isaName, (unsigned long long)e.key, e.log2len);
+	for(int j=0;j<32 && e.path[j] != 0;j++) fprintf(fp, " %d", e.path[j]);
+	fprintf(fp, "\n");
+	fclose(fp);
+			}
+		}
+	}
+	unlockPlans();
+
+	return added;
+}
+//}}}
+//{{{
+void SleefDFT_setPlanFilePath(const char *path, uint64_t mode) {
+	lockPlans();
+
+	free(plans);
+	plans = NULL;
+	nPlans = plansCapacity = 0;
+	free(planFilePath);
+	planFilePath = NULL;
+
+	if (path != NULL) {
+		planFilePath = (char *)malloc(strlen(path)+1);
+		strcpy(planFilePath, path);
+		planFileReadOnly = (mode & SLEEF_PLAN_READONLY) != 0;
+
+		if ((mode & SLEEF_PLAN_RESET) != 0 && !planFileReadOnly) {
+			FILE *fp = fopen(path, "w");
+			if (fp != NULL) fclose(fp);
+		}
+		loadPlans(path);
+	}
+
+	unlockPlans();
+}
+//}}}
+//}}}
+
 static jmp_buf sigjmp;
 static void sighandler(int signum) { longjmp(sigjmp, 1); }
 //{{{
@@ -593,6 +766,26 @@ static int checkISAAvailability(int isa) {
 }
 //}}}
 //{{{
+// selectISA : the available ISA with the highest priority, checked once per process
+static int selectISA() {
+	static int bestISA = -1;
+
+	lockPlans();
+	if (bestISA < 0) {
+		int bestPriority = -1;
+		for(int i=0;i<ISAMAX;i++) {
+			if (checkISAAvailability(i) && bestPriority < (*getInt[i])(2)) {
+	bestPriority = (*getInt[i])(2);
+	bestISA = i;
+			}
+		}
+	}
+	unlockPlans();
+
+	return bestISA;
+}
+//}}}
+//{{{
 SleefDFT *SleefDFT_init(uint64_t mode, uint32_t n) {
 	SleefDFT *p = (SleefDFT *)calloc(1, sizeof(SleefDFT));
 	p->magic = MAGIC;
@@ -604,16 +797,10 @@ SleefDFT *SleefDFT_init(uint64_t mode, uint32_t n) {
 	p->planMode  = (mode >> 15) &  7;
 
 	if (p->isa == 0) {
-		int bestPriority = -1;
-		for(int i=0;i<ISAMAX;i++) {
-			if (checkISAAvailability(i) && bestPriority < (*getInt[i])(2)) {
-	bestPriority = (*getInt[i])(2);
-	p->isa = i;
-			}
-		}
+		p->isa = selectISA();
 	} else {
 		p->isa--;
-		if (checkISAAvailability(p->isa)) {
+		if (p->isa >= ISAMAX || !checkISAAvailability(p->isa)) {
 			if ((p->mode & SLEEF_MODE_VERBOSE) != 0) printf("Specified ISA not available\n");
 			p->magic = 0;
 			free(p);
@@ -625,6 +812,10 @@ SleefDFT *SleefDFT_init(uint64_t mode, uint32_t n) {
 
 	assert(n >= 4);
 
+	// (keyed by the mode as given, before SLEEF_MODE_ALT is folded into the direction)
+	const uint64_t planKey = mode & PLAN_KEY_MASK;
+	const int usePlans = p->planMode != 0 && (mode & SLEEF_MODE_DEBUG) == 0;
+
 	if ((mode & SLEEF_MODE_ALT) != 0) p->mode = mode = mode ^ SLEEF_MODE_BACKWARD;
 	int sign = (mode & SLEEF_MODE_BACKWARD) != 0 ? -1 : 1;
 	p->log2len = ilog2(n);
@@ -657,7 +848,21 @@ SleefDFT *SleefDFT_init(uint64_t mode, uint32_t n) {
 			p->tbl[i] = makeTable(sign, p->vecwidth, p->log2len, i, constK[i]);
 		}
 
-		if (measure(p, (mode & SLEEF_MODE_DEBUG))) break;
+		if (usePlans && lookupPlan(p, planKey)) break;
+
+		if (measure(p, (mode & SLEEF_MODE_DEBUG))) {
+			// (measured concurrently with another thread, take the cached plan, so that every plan for a key has the same path)
+			if (usePlans && !addPlan(p, planKey)) {
+				int *measuredPath = p->bestPath, measuredLen = p->pathLen;
+				if (lookupPlan(p, planKey)) {
+					free(measuredPath);
+				} else {
+					p->bestPath = measuredPath;
+					p->pathLen = measuredLen;
+				}
+			}
+			break;
+		}
 
 		if (p->isa == 0) { fprintf(stderr, "SleefDFT : Initialization failed.\n"); exit(-1); }
 
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <math.h>
 #include <complex.h>
+#include <string.h>
 #include <time.h>
 
 #include "sleefdft.h"
@@ -390,9 +391,97 @@ int check_arb(int n) {
   return success;
 }
 
+// plan benchmark : the time to make a measured plan (from scratch, from the plans kept in the process and from a plan
+// file), and the time of one transform with an estimated plan, with a measured plan and by the naive DFT
+double seconds() {
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+struct SleefDFT *timed_init(uint64_t mode, int n, double *secs) {
+  double t0 = seconds();
+  struct SleefDFT *p = SleefDFT_init(mode, n);
+  *secs = seconds() - t0;
+  return p;
+}
+
+double time_execute(struct SleefDFT *p, SleefDFT_real *sy, const SleefDFT_real *sx, int niter) {
+  int i;
+  double t0 = seconds();
+  for(i=0;i<niter;i++) SleefDFT_execute(p, sy, sx);
+  return (seconds() - t0) / niter;
+}
+
+int benchmark_plan(int n, const char *planfile) {
+  int i;
+
+  SleefDFT_real *sx = (SleefDFT_real *)SleefDFT_malloc(n*2 * sizeof(SleefDFT_real));
+  SleefDFT_real *sy = (SleefDFT_real *)SleefDFT_malloc(n*2 * sizeof(SleefDFT_real));
+
+  cmpl *ts = (cmpl *)malloc(sizeof(cmpl)*n);
+  cmpl *fs = (cmpl *)malloc(sizeof(cmpl)*n);
+
+  for(i=0;i<n;i++) {
+    ts[i] = (2.0 * (rand() / (double)RAND_MAX) - 1) + (2.0 * (rand() / (double)RAND_MAX) - 1) * _Complex_I;
+    sx[(i*2+0)] = creal(ts[i]);
+    sx[(i*2+1)] = cimag(ts[i]);
+  }
+
+  //
+
+  double tEstimate, tMeasure, tCached, tFile;
+
+  SleefDFT_setPlanFilePath(NULL, SLEEF_PLAN_AUTOMATIC);
+  struct SleefDFT *pe = timed_init(SLEEF_MODE_FORWARD | SLEEF_MODE_ESTIMATE, n, &tEstimate);
+  struct SleefDFT *pm = timed_init(SLEEF_MODE_FORWARD | SLEEF_MODE_MEASURE , n, &tMeasure);
+  struct SleefDFT *pc = timed_init(SLEEF_MODE_FORWARD | SLEEF_MODE_MEASURE , n, &tCached);
+
+  // measure into an empty plan file, then start again from the file (as a later run would)
+  SleefDFT_setPlanFilePath(planfile, SLEEF_PLAN_RESET);
+  SleefDFT_dispose(SleefDFT_init(SLEEF_MODE_FORWARD | SLEEF_MODE_MEASURE, n));
+  SleefDFT_setPlanFilePath(planfile, SLEEF_PLAN_AUTOMATIC);
+  struct SleefDFT *pf = timed_init(SLEEF_MODE_FORWARD | SLEEF_MODE_MEASURE , n, &tFile);
+
+  const int niter = 1 + (1 << 24) / n;
+  double xEstimate = time_execute(pe, sy, sx, niter);
+  double xMeasure  = time_execute(pm, sy, sx, niter);
+
+  double t0 = seconds();
+  forward(ts, fs, n);
+  double xNaive = seconds() - t0;
+
+  double maxError = 0;
+  for(i=0;i<n;i++) {
+    maxError = max(maxError, fabs((sy[(i*2+0)] - creal(fs[i]))));
+    maxError = max(maxError, fabs((sy[(i*2+1)] - cimag(fs[i]))));
+  }
+
+  printf("plan     : estimate %.6f secs, measure %.6f secs, cached %.6f secs, from plan file %.6f secs\n",
+	 tEstimate, tMeasure, tCached, tFile);
+  printf("execute  : estimated plan %.3f usecs, measured plan %.3f usecs, naive DFT %.3f usecs\n",
+	 xEstimate * 1e6, xMeasure * 1e6, xNaive * 1e6);
+  printf("maxError = %g\n", maxError);
+
+  //
+
+  free(fs);
+  free(ts);
+
+  SleefDFT_free(sx);
+  SleefDFT_free(sy);
+  SleefDFT_dispose(pe);
+  SleefDFT_dispose(pm);
+  SleefDFT_dispose(pc);
+  SleefDFT_dispose(pf);
+  SleefDFT_setPlanFilePath(NULL, SLEEF_PLAN_AUTOMATIC);
+
+  //
+
+  return maxError < THRES * sqrt(n);
+}
+
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    fprintf(stderr, "%s <log2n>\n", argv[0]);
+  if (argc != 2 && !(argc == 4 && strcmp(argv[2], "--plan") == 0)) {
+    fprintf(stderr, "%s <log2n> [--plan <plan file>]\n", argv[0]);
     exit(-1);
   }
 
@@ -400,6 +489,11 @@ int main(int argc, char **argv) {
 
   srand(time(NULL));
 
+  if (argc == 4) {
+    printf("complex  forward plans : %s\n", benchmark_plan(n, argv[3]) ? "OK" : "NG");
+    exit(0);
+  }
+
   //
 
   printf("complex  forward   : %s\n", check_cf(n)  ? "OK" : "NG");
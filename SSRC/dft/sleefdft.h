@@ -33,6 +33,10 @@
 #define SLEEF_MODE_PATIENT     (2 << 15)
 #define SLEEF_MODE_EXHAUSTIVE  (3 << 15)
 
+#define SLEEF_PLAN_AUTOMATIC   0
+#define SLEEF_PLAN_READONLY    (1 << 0)
+#define SLEEF_PLAN_RESET       (1 << 1)
+
 #ifdef SLEEFDFT_REAL_IS_FLOAT
 typedef float SleefDFT_real;
 #else
@@ -45,6 +49,12 @@ void SleefDFT_executePremult(struct SleefDFT *ptr, SleefDFT_real *out, const Sle
 
 void SleefDFT_setPath(struct SleefDFT *ptr, char *pathStr);
 
+// Plans made with SLEEF_MODE_MEASURE (or PATIENT, EXHAUSTIVE) are kept for the life of the process, keyed by
+// (length, mode, ISA), so that further plans of the same kind don't measure again. With a plan file, they are also
+// read from and appended to that file, so that later runs don't measure either. SLEEF_PLAN_READONLY : don't write the
+// file, SLEEF_PLAN_RESET : discard the plans in the file. A NULL path forgets the plans
+void SleefDFT_setPlanFilePath(const char *path, uint64_t mode);
+
 void SleefDFT_dispose(struct SleefDFT *ptr);
 void *SleefDFT_malloc(size_t z);
 void SleefDFT_free(void *ptr);
@@ -12,6 +12,11 @@
 #include "dither.h"
 
 #include "dft/sleefdft.h"
+#include "ssrcengine.h"
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
 //}}}
 //{{{
 #define VERSION "1.33"
@@ -20,12 +25,10 @@
   typedef float REAL;
   double AA = 140;
   double DF = 2000;
-  #define M 30
 #else
   typedef double REAL;
   double AA = 150;
   double DF = 200;
-  #define M 30
 #endif
 
 #define MAXNCH 10
@@ -39,11 +42,12 @@
 #define RINT(x) ((x) >= 0 ? ((int)((x) + 0.5)) : ((int)((x) - 0.5)))
 //}}}
 
-double fact[M+1];
-
 static inline void ignoreReturnValue (int x) {}
 
 int quiet = 0;
+int nthreads = 1; // number of worker threads (--threads)
+int segments = 0; // split long inputs into segments, even with one thread (--segments)
+int shapedelay = 1; // with dither, the noise shapers also quantize the delay of the filters (see resample())
 int lastshowed2;
 time_t starttime, lastshowed;
 
@@ -57,53 +61,6 @@ int do_shaping (double s, double *peak, int dtype, int ch) {
 }
 //}}}
 
-//{{{
-double alpha (double a) {
-
-  if (a <= 21)
-    return 0;
-  if (a <= 50)
-    return 0.5842 * pow (a-21,0.4) + 0.07886 * (a-21);
-
-  return 0.1102*(a-8.7);
-  }
-//}}}
-//{{{
-double izero (double x) {
-
-  double ret = 1;
-  int m;
-
-  for(m = M; m >= 1; m--) {
-    double t = pow (x / 2, m) / fact[m];
-    ret += t*t;
-    }
-
-  return ret;
-  }
-//}}}
-//{{{
-double win (double n, int len, double alp, double iza) {
-
-  return izero (alp * sqrt (1 - 4 * n * n / ((len - 1.0) * (len - 1.0)))) / iza;
-  }
-//}}}
-//{{{
-double sinc (double x) {
-
-  return x == 0 ? 1 : sin(x)/x;
-  }
-//}}}
-
-//{{{
-double hn_lpf (int n, double lpf,double fs)
-{
-  double t = 1/fs;
-  double omega = 2*M_PI*lpf;
-  return 2*lpf*t*sinc(n*omega*t);
-}
-//}}}
-
 //{{{
 void usage(void)
 {
@@ -113,9 +70,15 @@ void usage(void)
   printf("          --att <attenuation(dB)>    attenuate signal\n");
   printf("          --bits <number of bits>    output quantization bit length\n");
   printf("          --tmpfile <file name>      specify temporal file\n");
+  printf("          --planfile <file name>     measure FFT plans once, and keep them in this file\n");
   printf("          --twopass                  two pass processing to avoid clipping\n");
   printf("          --normalize                normalize the wave file\n");
+  printf("          --prescan                  two pass processing without a temporary file (converting twice)\n");
   printf("          --quiet                    nothing displayed except error\n");
+  printf("          --threads <number>         number of threads (0 : one per processor)\n");
+  printf("          --segments                 convert long inputs in segments, as with more than one thread\n");
+  printf("          --benchmark                time the conversion with 1 to --threads threads\n");
+  printf("          --verify                   check the in-memory converter against ssrc 1.33, and the conversion of the file\n");
   printf("          --dither [<type>]          dither options\n");
   printf("                                       0    : ATH-based noise shaping, low intensity\n");
   printf("                                       2    : ATH-based noise shaping, mid intensity\n");
@@ -188,1125 +151,286 @@ int64_t gcd (int64_t x, int64_t y) {
 //}}}
 
 //{{{
-double upsample (FILE *fpi,FILE *fpo,int nch,int bps,int dbps,int64_t sfrq,int64_t dfrq,double gain,unsigned int chunklen,int twopass,int dither)
+// quantize : convert n interleaved samples of outbuf (starting at channel *ch) to dbps-byte integers, with dither or clipping
+void quantize (const REAL *outbuf, uint8_t *rawoutbuf, int n, int nch, int dbps, double gain, int dither, double *peak, int *pch)
 {
-  int64_t frqgcd,osf;
-  int64_t fs1, fs2, n2;
-  int64_t n1,n1x,n1y,n2b;
-
-  REAL **stage1,*stage2;
-  int filter2len;
-  int *f1order,*f1inc;
-  struct SleefDFT *dftf = NULL, *dftb = NULL;
-  uint8_t *rawinbuf,*rawoutbuf;
-  REAL *inbuf,*outbuf;
-  REAL **buf1,**buf2;
-  double peak=0;
-  int spcount = 0;
-  int i,j;
-
-  filter2len = 1; /* stage 2 filter length */
-
-  /* Make stage 1 filter */
-
-  {
-    double aa = AA; /* stop band attenuation(dB) */
-    double lpf,delta,d,df,alp,iza;
-    double guard = 2;
-
-    frqgcd = gcd(sfrq,dfrq);
+  int i, ch = *pch;
 
-    fs1 = (int64_t)sfrq / frqgcd * dfrq;
-
-    if (fs1/dfrq == 1) osf = 1;
-    else if (fs1/dfrq % 2 == 0) osf = 2;
-    else if (fs1/dfrq % 3 == 0) osf = 3;
-    else {
-      fprintf(stderr,"Resampling from %dHz to %dHz is not supported.\n",(int)sfrq, (int)dfrq);
-      fprintf(stderr,"%d/gcd(%d,%d)=%d must be divided by 2 or 3.\n",(int)sfrq,(int)sfrq,(int)dfrq,(int)(fs1/dfrq));
-      exit(-1);
-    }
-
-    df = (dfrq*osf/2 - sfrq/2) * 2 / guard;
-    lpf = sfrq/2 + (dfrq*osf/2 - sfrq/2)/guard;
-
-    delta = pow(10,-aa/20);
-    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
-
-    n1 = fs1/df*d+1;
-    if (n1 % 2 == 0) n1++;
-
-    alp = alpha (aa);
-    iza = izero (alp);
-
-    n1y = fs1/sfrq;
-    n1x = n1/n1y+1;
-
-    f1order = calloc(n1y*osf,sizeof(int));
-    for(i=0;i<n1y*osf;i++) {
-      f1order[i] = fs1/sfrq-(i*(fs1/(dfrq*osf)))%(fs1/sfrq);
-      if (f1order[i] == fs1/sfrq) f1order[i] = 0;
-    }
-
-    f1inc = calloc(n1y*osf,sizeof(int));
-    for(i=0;i<n1y*osf;i++) {
-      f1inc[i] = f1order[i] < fs1/(dfrq*osf) ? nch : 0;
-    }
-
-    stage1 = malloc(n1y*sizeof(REAL *));
-    stage1[0] = calloc(n1x*n1y,sizeof(REAL));
-
-    for(i=1;i<n1y;i++) {
-      stage1[i] = &(stage1[0][n1x*i]);
-      for(j=0;j<n1x;j++) stage1[i][j] = 0;
-    }
-
-    for(i=-(n1/2);i<=n1/2;i++)
-      {
-  stage1[(i+n1/2)%n1y][(i+n1/2)/n1y] = win(i,n1,alp,iza)*hn_lpf(i,lpf,fs1)*fs1/sfrq;
-      }
-  }
-
-  /* Make stage 2 filter */
-
-  {
-    double aa = AA; /* stop band attenuation(dB) */
-    double lpf,delta,d,df,alp,iza;
-    int ipsize,wsize;
-
-    delta = pow(10,-aa/20);
-    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
-
-    fs2 = (int64_t)dfrq*osf;
-
-    for(i=1;;i = i * 2)
-      {
-  n2 = filter2len * i;
-  if (n2 % 2 == 0) n2--;
-  df = (fs2*d)/(n2-1);
-  lpf = sfrq/2;
-  if (df < DF) break;
-      }
-
-    alp = alpha (aa);
-    iza = izero (alp);
-
-    for(n2b=1;n2b<n2;n2b*=2);
-    n2b *= 2;
-
-    stage2 = SleefDFT_malloc(n2b * sizeof(REAL));
-
-    for(i=-(n2/2);i<=n2/2;i++) {
-      stage2[i+n2/2] = win(i,n2,alp,iza)*hn_lpf(i,lpf,fs2)/n2b*2;
-    }
-
-    dftf = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_FORWARD , n2b);
-    dftb = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_BACKWARD, n2b);
-
-    SleefDFT_execute(dftf, stage2, stage2);
-  }
-
-  /* Apply filters */
-
-  setstarttime();
-
-  {
-    int n2b2 = n2b/2;
-    int rp;            // Position of the next sample read from inbuf at fs1
-    int ds;            // Number of samples disposed next at sfrq
-    int nsmplwrt1 = 0; // Number of samples that will be sent to the stage2 filter, that is
-                       // calculated from the actual number of samples read from the file
-    int nsmplwrt2 = 0; // Number of samples that will be sent to the stage2 filter, that is
-                       // calculated from the actual number of samples read from the file
-    int s1p;           // Residual of the number of samples output from the stage1 filter divided by (n1y * osf)
-    int init,ending;
-    int64_t sumread,sumwrite;
-    int osc;
-    REAL *ip,*ip_backup;
-    int s1p_backup,osc_backup;
-    int k,ch,p;
-    int inbuflen;
-    int delay = 0;
-
-    buf1 = malloc(nch*sizeof(REAL *));
-    for(i=0;i<nch;i++)
-      {
-  buf1[i] = calloc((n2b2/osf+1),sizeof(REAL));
-  for(j=0;j<(n2b2/osf+1);j++) buf1[i][j] = 0;
-      }
-
-    buf2 = malloc(sizeof(REAL *)*nch);
-    for(i=0;i<nch;i++) buf2[i] = SleefDFT_malloc(n2b * sizeof(REAL));
-
-    rawinbuf  = calloc(nch*(n2b2+n1x+2), bps);
-    rawoutbuf = calloc(nch*(n2b2/osf+1), dbps);
-
-    inbuf  = calloc(nch*(n2b2+n1x+2),sizeof(REAL));
-    outbuf = calloc(nch*(n2b2/osf+1),sizeof(REAL));
-
-    s1p = 0;
-    rp  = 0;
-    ds  = 0;
-    osc = 0;
-
-    init = 1;
-    ending = 0;
-    inbuflen = n1/2/(fs1/sfrq)+1;
-    delay = (double)n2/2/(fs2/dfrq);
-
-    sumread = sumwrite = 0;
-
-    for(;;)
-      {
-  int nsmplread,toberead,toberead2;
-
-  toberead2 = toberead = ceil((double)n2b2*sfrq/(dfrq*osf))+1+n1x-inbuflen;
-  if (toberead+sumread > chunklen) {
-    toberead = chunklen-sumread;
-  }
-
-  nsmplread = fread(rawinbuf,1,bps*nch*toberead,fpi);
-  nsmplread /= bps*nch;
-
-  switch(bps)
+  switch(dbps)
     {
     case 1:
-      for(i = 0; i < nsmplread * nch; i++)
-        inbuf[nch * inbuflen + i] =
-    (1 / (REAL)0x7f) * ((REAL)((uint8_t *)rawinbuf)[i]-128);
-      break;
-
-    case 2:
-#ifndef BIGENDIAN
-      for(i=0;i<nsmplread*nch;i++)
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fff)*(REAL)((int16_t *)rawinbuf)[i];
-#else
-      for(i=0;i<nsmplread*nch;i++) {
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fff)*
-    (((int)rawinbuf[i*2]) |
-     (((int)((int8_t *)rawinbuf)[i*2+1]) << 8));
-      }
-#endif
-      break;
-
-    case 3:
-      for(i=0;i<nsmplread*nch;i++) {
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fffff)*
-    ((((int)rawinbuf[i*3  ]) << 0 ) |
-     (((int)rawinbuf[i*3+1]) << 8 ) |
-     (((int)((int8_t *)rawinbuf)[i*3+2]) << 16));
-      }
-      break;
-
-    case 4:
-      for(i=0;i<nsmplread*nch;i++) {
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fffffff)*
-    ((((int)rawinbuf[i*4  ]) << 0 ) |
-     (((int)rawinbuf[i*4+1]) << 8 ) |
-     (((int)rawinbuf[i*4+2]) << 16) |
-     (((int)((int8_t *)rawinbuf)[i*4+3]) << 24));
-      }
-      break;
-    }
-
-  assert(i <= nch*(n2b2+n1x+2));
-  for(;i<nch*toberead2;i++) inbuf[nch*inbuflen+i] = 0;
-
-  inbuflen += toberead2;
-
-  sumread += nsmplread;
-
-  ending = feof(fpi) || sumread >= chunklen;
-
-  nsmplwrt1 = n2b2;
-
-  // apply stage 1 filter
-
-  ip = &inbuf[((sfrq*(rp-1)+fs1)/fs1)*nch];
-
-  s1p_backup = s1p;
-  ip_backup  = ip;
-  osc_backup = osc;
-
-  for(ch=0;ch<nch;ch++)
-    {
-      REAL *op = &outbuf[ch];
-      int fdo = fs1/(dfrq*osf),no = n1y*osf;
-
-      s1p = s1p_backup; ip = ip_backup+ch;
-
-      switch(n1x)
-        {
-        case 7:
-    for(p=0;p<nsmplwrt1;p++)
-      {
-        int s1o = f1order[s1p];
-
-        buf2[ch][p] =
-          stage1[s1o][0] * *(ip+0*nch)+
-          stage1[s1o][1] * *(ip+1*nch)+
-          stage1[s1o][2] * *(ip+2*nch)+
-          stage1[s1o][3] * *(ip+3*nch)+
-          stage1[s1o][4] * *(ip+4*nch)+
-          stage1[s1o][5] * *(ip+5*nch)+
-          stage1[s1o][6] * *(ip+6*nch);
-
-        ip += f1inc[s1p];
-
-        s1p++;
-        if (s1p == no) s1p = 0;
-      }
-    break;
-
-        case 9:
-    for(p=0;p<nsmplwrt1;p++)
       {
-        int s1o = f1order[s1p];
-
-        buf2[ch][p] =
-          stage1[s1o][0] * *(ip+0*nch)+
-          stage1[s1o][1] * *(ip+1*nch)+
-          stage1[s1o][2] * *(ip+2*nch)+
-          stage1[s1o][3] * *(ip+3*nch)+
-          stage1[s1o][4] * *(ip+4*nch)+
-          stage1[s1o][5] * *(ip+5*nch)+
-          stage1[s1o][6] * *(ip+6*nch)+
-          stage1[s1o][7] * *(ip+7*nch)+
-          stage1[s1o][8] * *(ip+8*nch);
-
-        ip += f1inc[s1p];
-
-        s1p++;
-        if (s1p == no) s1p = 0;
-      }
-    break;
-
-        default:
-    for(p=0;p<nsmplwrt1;p++)
-      {
-        REAL tmp = 0;
-        REAL *ip2=ip;
-
-        int s1o = f1order[s1p];
-
-        for(i=0;i<n1x;i++)
-          {
-      tmp += stage1[s1o][i] * *ip2;
-      ip2 += nch;
-          }
-        buf2[ch][p] = tmp;
-
-        ip += f1inc[s1p];
-
-        s1p++;
-        if (s1p == no) s1p = 0;
-      }
-    break;
-        }
-
-      osc = osc_backup;
-
-      // apply stage 2 filter
-
-      for(p=nsmplwrt1;p<n2b;p++) buf2[ch][p] = 0;
-
-      SleefDFT_execute(dftf, buf2[ch], buf2[ch]);
+  REAL gain2 = gain * (REAL)0x7f;
 
-      buf2[ch][0] = stage2[0]*buf2[ch][0];
-      buf2[ch][1] = stage2[1]*buf2[ch][1];
-
-      for(i=1;i<n2b/2;i++)
-        {
-    REAL re,im;
+  for(i=0;i<n;i++)
+    {
+      int s;
 
-    re = stage2[i*2  ]*buf2[ch][i*2] - stage2[i*2+1]*buf2[ch][i*2+1];
-    im = stage2[i*2+1]*buf2[ch][i*2] + stage2[i*2  ]*buf2[ch][i*2+1];
+      if (dither != -1) {
+        s = do_shaping(outbuf[i]*gain2,peak,dither,ch);
+      } else {
+        s = RINT(outbuf[i]*gain2);
 
-    buf2[ch][i*2  ] = re;
-    buf2[ch][i*2+1] = im;
+        if (s < -0x80) {
+    double d = (double)s/-0x80;
+    *peak = *peak < d ? d : *peak;
+    s = -0x80;
         }
-
-      SleefDFT_execute(dftb, buf2[ch], buf2[ch]);
-
-      for(i=osc,j=0;i<n2b2;i+=osf,j++)
-        {
-    REAL f = (buf1[ch][j] + buf2[ch][i]);
-    op[j*nch] = f;
+        if (0x7f <  s) {
+    double d = (double)s/ 0x7f;
+    *peak = *peak < d ? d : *peak;
+    s =  0x7f;
         }
+      }
 
-      nsmplwrt2 = j;
-
-      osc = i - n2b2;
+      ((uint8_t *)rawoutbuf)[i] = s + 0x80;
 
-      for(j=0;i<n2b;i+=osf,j++)
-        buf1[ch][j] = buf2[ch][i];
+      ch++;
+      if (ch == nch) ch = 0;
     }
-
-  rp += nsmplwrt1 * (sfrq / frqgcd) / osf;
-
-  if (twopass) {
-    for(i=0;i<nsmplwrt2*nch;i++)
-      {
-        REAL f = outbuf[i] > 0 ? outbuf[i] : -outbuf[i];
-        peak = peak < f ? f : peak;
-        ((REAL *)rawoutbuf)[i] = outbuf[i];
       }
-  } else {
-    switch(dbps)
-      {
-      case 1:
-        {
-    REAL gain2 = gain * (REAL)0x7f;
-    ch = 0;
+    break;
 
-    for(i=0;i<nsmplwrt2*nch;i++)
+    case 2:
       {
-        int s;
-
-        if (dither != -1) {
-          s = do_shaping(outbuf[i]*gain2,&peak,dither,ch);
-        } else {
-          s = RINT(outbuf[i]*gain2);
+  REAL gain2 = gain * (REAL)0x7fff;
 
-          if (s < -0x80) {
-      double d = (double)s/-0x80;
-      peak = peak < d ? d : peak;
-      s = -0x80;
-          }
-          if (0x7f <  s) {
-      double d = (double)s/ 0x7f;
-      peak = peak < d ? d : peak;
-      s =  0x7f;
-          }
-        }
+  for(i=0;i<n;i++)
+    {
+      int s;
 
-        ((uint8_t *)rawoutbuf)[i] = s + 0x80;
+      if (dither != -1) {
+        s = do_shaping(outbuf[i]*gain2,peak,dither,ch);
+      } else {
+        s = RINT(outbuf[i]*gain2);
 
-        ch++;
-        if (ch == nch) ch = 0;
-      }
+        if (s < -0x8000) {
+    double d = (double)s/-0x8000;
+    *peak = *peak < d ? d : *peak;
+    s = -0x8000;
         }
-      break;
-
-      case 2:
-        {
-    REAL gain2 = gain * (REAL)0x7fff;
-    ch = 0;
-
-    for(i=0;i<nsmplwrt2*nch;i++)
-      {
-        int s;
-
-        if (dither != -1) {
-          s = do_shaping(outbuf[i]*gain2,&peak,dither,ch);
-        } else {
-          s = RINT(outbuf[i]*gain2);
-
-          if (s < -0x8000) {
-      double d = (double)s/-0x8000;
-      peak = peak < d ? d : peak;
-      s = -0x8000;
-          }
-          if (0x7fff <  s) {
-      double d = (double)s/ 0x7fff;
-      peak = peak < d ? d : peak;
-      s =  0x7fff;
-          }
+        if (0x7fff <  s) {
+    double d = (double)s/ 0x7fff;
+    *peak = *peak < d ? d : *peak;
+    s =  0x7fff;
         }
+      }
 
 #ifndef BIGENDIAN
-        ((int16_t *)rawoutbuf)[i] = s;
+      ((int16_t *)rawoutbuf)[i] = s;
 #else
-        ((int8_t *)rawoutbuf)[i*2  ] = s & 255; s >>= 8;
-        ((int8_t *)rawoutbuf)[i*2+1] = s & 255;
+      ((int8_t *)rawoutbuf)[i*2  ] = s & 255; s >>= 8;
+      ((int8_t *)rawoutbuf)[i*2+1] = s & 255;
 #endif
-        ch++;
-        if (ch == nch) ch = 0;
+      ch++;
+      if (ch == nch) ch = 0;
+    }
       }
-        }
-      break;
-
-      case 3:
-        {
-    REAL gain2 = gain * (REAL)0x7fffff;
-    ch = 0;
+    break;
 
-    for(i=0;i<nsmplwrt2*nch;i++)
+    case 3:
       {
-        int s;
-
-        if (dither != -1) {
-          s = do_shaping(outbuf[i]*gain2,&peak,dither,ch);
-        } else {
-          s = RINT(outbuf[i]*gain2);
+  REAL gain2 = gain * (REAL)0x7fffff;
 
-          if (s < -0x800000) {
-      double d = (double)s/-0x800000;
-      peak = peak < d ? d : peak;
-      s = -0x800000;
-          }
-          if (0x7fffff <  s) {
-      double d = (double)s/ 0x7fffff;
-      peak = peak < d ? d : peak;
-      s =  0x7fffff;
-          }
-        }
-
-        ((int8_t *)rawoutbuf)[i*3  ] = s & 255; s >>= 8;
-        ((int8_t *)rawoutbuf)[i*3+1] = s & 255; s >>= 8;
-        ((int8_t *)rawoutbuf)[i*3+2] = s & 255;
-
-        ch++;
-        if (ch == nch) ch = 0;
-      }
-        }
-      break;
-
-      }
-  }
+  for(i=0;i<n;i++)
+    {
+      int s;
 
-  if (!init) {
-    if (ending) {
-      if ((double)sumread*dfrq/sfrq+2 > sumwrite+nsmplwrt2) {
-        if (dbps*nch*nsmplwrt2 != fwrite(rawoutbuf,1,dbps*nch*nsmplwrt2,fpo)) {
-    fprintf(stderr,"ERROR: -41\n");
-    abort();
-        }
-        sumwrite += nsmplwrt2;
+      if (dither != -1) {
+        s = do_shaping(outbuf[i]*gain2,peak,dither,ch);
       } else {
-        if (dbps*nch*(floor((double)sumread*dfrq/sfrq)+2-sumwrite) !=
-      fwrite(rawoutbuf,1,dbps*nch*(floor((double)sumread*dfrq/sfrq)+2-sumwrite),fpo)) {
-    fprintf(stderr,"fwrite error(2).\n");
-    abort();
-        }
-        break;
-      }
-    } else {
-      if (dbps*nch*nsmplwrt2 != fwrite(rawoutbuf,1,dbps*nch*nsmplwrt2,fpo)) {
-        fprintf(stderr,"fwrite error(3).\n");
-        abort();
-      }
-      sumwrite += nsmplwrt2;
-    }
-  } else {
-    int pos,len;
-    if (nsmplwrt2 < delay) {
-      delay -= nsmplwrt2;
-    } else {
-      if (ending) {
-        if ((double)sumread*dfrq/sfrq+2 > sumwrite+nsmplwrt2-delay) {
-    if (dbps*nch*(nsmplwrt2-delay) != fwrite(rawoutbuf+dbps*nch*delay,1,dbps*nch*(nsmplwrt2-delay),fpo)) {
-      fprintf(stderr,"fwrite error(4).\n");
-      abort();
-    }
-    sumwrite += nsmplwrt2-delay;
-        } else {
-    if (dbps*nch*(floor((double)sumread*dfrq/sfrq)+2-sumwrite-delay) !=
-        fwrite(rawoutbuf+dbps*nch*delay,1,dbps*nch*(floor((double)sumread*dfrq/sfrq)+2-sumwrite-delay),fpo)) {
-      fprintf(stderr,"fwrite error(5).\n");
-      abort();
-    }
-    break;
+        s = RINT(outbuf[i]*gain2);
+
+        if (s < -0x800000) {
+    double d = (double)s/-0x800000;
+    *peak = *peak < d ? d : *peak;
+    s = -0x800000;
         }
-      } else {
-        if (dbps*nch*(nsmplwrt2-delay) != fwrite(rawoutbuf+dbps*nch*delay,1,dbps*nch*(nsmplwrt2-delay),fpo)) {
-    fprintf(stderr,"fwrite error(6).\n");
-    abort();
+        if (0x7fffff <  s) {
+    double d = (double)s/ 0x7fffff;
+    *peak = *peak < d ? d : *peak;
+    s =  0x7fffff;
         }
-        sumwrite += nsmplwrt2-delay;
-        init = 0;
       }
-    }
-  }
-
-  {
-    int ds = (rp-1)/(fs1/sfrq);
 
-    assert(inbuflen >= ds);
+      ((int8_t *)rawoutbuf)[i*3  ] = s & 255; s >>= 8;
+      ((int8_t *)rawoutbuf)[i*3+1] = s & 255; s >>= 8;
+      ((int8_t *)rawoutbuf)[i*3+2] = s & 255;
 
-    memmove(inbuf,inbuf+nch*ds,sizeof(REAL)*nch*(inbuflen-ds));
-    inbuflen -= ds;
-    rp -= ds*(fs1/sfrq);
-  }
-
-  if ((spcount++ & 7) == 7) showprogress((double)sumread / chunklen);
+      ch++;
+      if (ch == nch) ch = 0;
+    }
       }
-  }
-
-  showprogress(1);
-
-  free(f1order);
-  free(f1inc);
-  free(stage1[0]);
-  free(stage1);
-  SleefDFT_free(stage2);
-  SleefDFT_dispose(dftf);
-  SleefDFT_dispose(dftb);
-  for(i=0;i<nch;i++) free(buf1[i]);
-  free(buf1);
-  for(i=0;i<nch;i++) SleefDFT_free(buf2[i]);
-  free(buf2);
-  free(inbuf);
-  free(outbuf);
-  free(rawinbuf);
-  free(rawoutbuf);
-
-  if (dither != -1) {
-    static int64_t dlmin[] = { 0, -0x80, -0x8000, -0x800000, -(0x7fffffff) };
-    static int64_t dlmax[] = { 0,  0x7f,  0x7fff,  0x7fffff,  0x7fffffffULL };
-    double min = 0, max = 0;
-    for(i=0;i<nch;i++) {
-      double p[2];
-      SSRCDither_getPeaks(shaper[i], p);
-      if (p[1] < min) min = p[1];
-      if (p[0] > max) max = p[0];
+    break;
     }
-    if (min < dlmin[dbps]) peak = min / dlmin[dbps];
-    if (max > dlmax[dbps]) peak = max / dlmax[dbps];
-  }
 
-  return peak;
+  *pch = ch;
 }
 //}}}
 //{{{
-double downsample (FILE *fpi,FILE *fpo,int nch,int bps,int dbps,int64_t sfrq,int64_t dfrq,double gain,unsigned int chunklen,int twopass,int dither)
+// toreal : convert n samples of bps bytes to REALs
+void toreal (const uint8_t *rawinbuf,REAL *inbuf,int n,int bps)
 {
-  int64_t frqgcd,osf;
-  int64_t fs1, fs2;
-  int64_t n2,n2x,n2y,n1,n1b;
-
-  REAL *stage1,**stage2;
-  int filter1len;
-  int *f2order,*f2inc;
-  struct SleefDFT *dftf = NULL, *dftb = NULL;
-  uint8_t *rawinbuf,*rawoutbuf;
-  REAL *inbuf,*outbuf;
-  REAL **buf1,**buf2;
-  int i,j;
-  int spcount = 0;
-  double peak=0;
-
-  filter1len = 1; /* stage 1 filter length */
-
-  /* Make stage 1 filter */
-
-  {
-    double aa = AA; /* stop band attenuation(dB) */
-    double lpf,delta,d,df,alp,iza;
-    int ipsize,wsize;
-
-    frqgcd = gcd(sfrq,dfrq);
-
-    if (dfrq/frqgcd == 1) osf = 1;
-    else if (dfrq/frqgcd % 2 == 0) osf = 2;
-    else if (dfrq/frqgcd % 3 == 0) osf = 3;
-    else {
-      fprintf(stderr,"Resampling from %dHz to %dHz is not supported.\n",(int)sfrq,(int)dfrq);
-      fprintf(stderr,"%d/gcd(%d,%d)=%d must be divided by 2 or 3.\n",(int)dfrq,(int)sfrq,(int)dfrq,(int)(dfrq/frqgcd));
-      exit(-1);
-    }
-
-    fs1 = (int64_t)sfrq*osf;
-
-    delta = pow(10,-aa/20);
-    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
-
-    n1 = filter1len;
-    for(i=1;;i = i * 2)
-      {
-  n1 = filter1len * i;
-  if (n1 % 2 == 0) n1--;
-  df = (fs1*d)/(n1-1);
-  lpf = (dfrq-df)/2;
-  if (df < DF) break;
-      }
-
-    alp = alpha(aa);
-    iza = izero(alp);
-
-    for(n1b=1;n1b<n1;n1b*=2);
-    n1b *= 2;
-
-    stage1 = SleefDFT_malloc(n1b * sizeof(REAL));
-
-    for(i=0;i<n1b;i++) stage1[i] = 0;
-
-    for(i=-(n1/2);i<=n1/2;i++) {
-      stage1[i+n1/2] = win(i,n1,alp,iza)*hn_lpf(i,lpf,fs1)*fs1/sfrq/n1b*2;
-    }
-
-    dftf = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_FORWARD , n1b);
-    dftb = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_BACKWARD, n1b);
-
-    SleefDFT_execute(dftf, stage1, stage1);
-  }
-
-  /* Make stage 2 filter */
-
-  if (osf == 1) {
-    fs2 = (int64_t)sfrq/frqgcd*dfrq;
-    n2 = 1;
-    n2y = n2x = 1;
-    f2order = calloc(n2y,sizeof(int));
-    f2order[0] = 0;
-    f2inc = calloc(n2y,sizeof(int));
-    f2inc[0] = sfrq/dfrq;
-    stage2 = malloc(sizeof(REAL *)*n2y);
-    stage2[0] = calloc(n2x*n2y,sizeof(REAL));
-    stage2[0][0] = 1;
-  } else {
-    double aa = AA; /* stop band attenuation(dB) */
-    double lpf,delta,d,df,alp,iza;
-    double guard = 2;
-
-    fs2 = (int64_t)sfrq / frqgcd * dfrq;
-
-    df = (fs1/2 - sfrq/2) * 2 / guard;
-    lpf = sfrq/2 + (fs1/2 - sfrq/2)/guard;
-
-    delta = pow(10,-aa/20);
-    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
-
-    n2 = (int64_t)fs2/df*d+1;
-    if (n2 % 2 == 0) n2++;
-
-    alp = alpha(aa);
-    iza = izero(alp);
-
-    n2y = fs2/fs1; // non-zero samples are at intervals of n2y at fs2
-    n2x = n2/n2y+1;
-
-    f2order = calloc(n2y,sizeof(int));
-    for(i=0;i<n2y;i++) {
-      f2order[i] = fs2/fs1-(i*(fs2/dfrq))%(fs2/fs1);
-      if (f2order[i] == fs2/fs1) f2order[i] = 0;
-    }
-
-    f2inc = calloc(n2y,sizeof(int));
-    for(i=0;i<n2y;i++) {
-      f2inc[i] = (fs2/dfrq-f2order[i])/(fs2/fs1)+1;
-      if (f2order[i+1==n2y ? 0 : i+1] == 0) f2inc[i]--;
-    }
-
-    stage2 = malloc(sizeof(REAL *)*n2y);
-    stage2[0] = calloc(n2x*n2y,sizeof(REAL));
-
-    for(i=1;i<n2y;i++) {
-      stage2[i] = &(stage2[0][n2x*i]);
-      for(j=0;j<n2x;j++) stage2[i][j] = 0;
-    }
-
-    for(i=-(n2/2);i<=n2/2;i++)
-      {
-  stage2[(i+n2/2)%n2y][(i+n2/2)/n2y] = win(i,n2,alp,iza)*hn_lpf(i,lpf,fs2)*fs2/fs1;
-      }
-  }
-
-  /* Apply filters */
-
-  setstarttime();
-
-  {
-    int n1b2 = n1b/2;
-    int rp;        // inbuffs1
-    int rps;       // rp(fs1/sfrq=osf)
-    int rp2;       // buf2fs2
-    int ds;        // disposesfrq
-    int nsmplwrt1 = 0; // ºݤ˥ե뤫inbuf
-                   // stage2 filter
-    int nsmplwrt2 = 0; // ºݤ˥ե뤫inbuf
-                   // stage2 filter
-    int s2p;       // stage1 filterϤ줿ץοn1y*osf
-    int init,ending;
-    int osc;
-    REAL *bp,*bp_backup; // rp2׻롥buf2
-    int rps_backup,s2p_backup,osc_backup;
-    int k,ch,p;
-    int inbuflen=0;
-    int64_t sumread,sumwrite;
-    int delay = 0;
-    REAL *op;
-
-    //    |....B....|....C....|   buf1      n1b2+n1b2
-    //|.A.|....D....|             buf2  n2x+n1b2
-    //
-    // ޤinbufBosf
-    // C
-    // BCstage 1 filter
-    // DB
-    // ADstage 2 filter
-    // DθA
-    // CD
-
-    buf1 = malloc(sizeof(REAL *)*nch);
-    for(i=0;i<nch;i++)
-      buf1[i] = SleefDFT_malloc(sizeof(REAL) * n1b);
-
-    buf2 = malloc(sizeof(REAL *)*nch);
-    for(i=0;i<nch;i++) {
-      buf2[i] = calloc(n2x+1+n1b2,sizeof(REAL));
-      for(j=0;j<n2x+1+n1b2;j++) buf2[i][j] = 0;
-    }
-
-    rawinbuf  = calloc(nch*(n1b2/osf+osf+1),bps);
-    rawoutbuf = calloc(((double)n1b2*sfrq/dfrq+1),dbps*nch);
-    inbuf = calloc(nch*(n1b2/osf+osf+1),sizeof(REAL));
-    outbuf = calloc(nch*((double)n1b2*sfrq/dfrq+1),sizeof(REAL));
-
-    op = outbuf;
-
-    s2p = 0;
-    rp  = 0;
-    rps = 0;
-    ds  = 0;
-    osc = 0;
-    rp2 = 0;
-
-    init = 1;
-    ending = 0;
-    delay = (double)n1/2/((double)fs1/dfrq)+(double)n2/2/((double)fs2/dfrq);
-
-    sumread = sumwrite = 0;
-
-    for(;;)
-      {
-  int nsmplread;
-  int toberead;
-
-  toberead = (n1b2-rps-1)/osf+1;
-  if (toberead+sumread > chunklen) {
-    toberead = chunklen-sumread;
-  }
-
-  nsmplread = fread(rawinbuf,1,bps*nch*toberead,fpi);
-  nsmplread /= bps*nch;
+  int i;
 
   switch(bps)
     {
     case 1:
-      for(i = 0; i < nsmplread * nch; i++)
-        inbuf[nch * inbuflen + i] =
+      for(i = 0; i < n; i++)
+        inbuf[i] =
     (1 / (REAL)0x7f) * ((REAL)((uint8_t *)rawinbuf)[i]-128);
       break;
 
     case 2:
 #ifndef BIGENDIAN
-      for(i=0;i<nsmplread*nch;i++)
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fff)*(REAL)((int16_t *)rawinbuf)[i];
+      for(i=0;i<n;i++)
+        inbuf[i] = (1/(REAL)0x7fff)*(REAL)((int16_t *)rawinbuf)[i];
 #else
-      for(i=0;i<nsmplread*nch;i++) {
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fff)*
+      for(i=0;i<n;i++) {
+        inbuf[i] = (1/(REAL)0x7fff)*
     (((int)rawinbuf[i*2]) |
      (((int)((int8_t *)rawinbuf)[i*2+1]) << 8));
       }
 #endif
-      break;
-
-    case 3:
-      for(i=0;i<nsmplread*nch;i++) {
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fffff)*
-    ((((int)rawinbuf[i*3  ]) << 0 ) |
-     (((int)rawinbuf[i*3+1]) << 8 ) |
-     (((int)((int8_t *)rawinbuf)[i*3+2]) << 16));
-      }
-      break;
-
-    case 4:
-      for(i=0;i<nsmplread*nch;i++) {
-        inbuf[nch*inbuflen+i] = (1/(REAL)0x7fffffff)*
-    ((((int)rawinbuf[i*4  ]) << 0 ) |
-     (((int)rawinbuf[i*4+1]) << 8 ) |
-     (((int)rawinbuf[i*4+2]) << 16) |
-     (((int)((int8_t *)rawinbuf)[i*4+3]) << 24));
-      }
-      break;
-    }
-  assert(i <= nch*(n1b2/osf+osf+1));
-
-  for(;i<nch*toberead;i++) inbuf[i] = 0;
-
-  sumread += nsmplread;
-
-  ending = feof(fpi) || sumread >= chunklen;
-
-  rps_backup = rps;
-  s2p_backup = s2p;
-
-  for(ch=0;ch<nch;ch++)
-    {
-      rps = rps_backup;
-
-      for(k=0;k<rps;k++) buf1[ch][k] = 0;
-
-      for(i=rps,j=0;i<n1b2;i+=osf,j++)
-        {
-    assert(j < ((n1b2-rps-1)/osf+1));
-
-    buf1[ch][i] = inbuf[j*nch+ch];
-
-    for(k=i+1;k<i+osf;k++) buf1[ch][k] = 0;
-        }
-
-      assert(j == ((n1b2-rps-1)/osf+1));
-
-      for(k=n1b2;k<n1b;k++) buf1[ch][k] = 0;
-
-      rps = i - n1b2;
-      rp += j;
-
-      SleefDFT_execute(dftf, buf1[ch], buf1[ch]);
-
-      buf1[ch][0] = stage1[0]*buf1[ch][0];
-      buf1[ch][1] = stage1[1]*buf1[ch][1];
-
-      for(i=1;i<n1b2;i++)
-        {
-    REAL re,im;
-
-    re = stage1[i*2  ]*buf1[ch][i*2] - stage1[i*2+1]*buf1[ch][i*2+1];
-    im = stage1[i*2+1]*buf1[ch][i*2] + stage1[i*2  ]*buf1[ch][i*2+1];
-
-    buf1[ch][i*2  ] = re;
-    buf1[ch][i*2+1] = im;
-        }
-
-      SleefDFT_execute(dftb, buf1[ch], buf1[ch]);
-
-      for(i=0;i<n1b2;i++) {
-        buf2[ch][n2x+1+i] += buf1[ch][i];
-      }
-
-      {
-        int t1 = rp2/(fs2/fs1);
-        if (rp2%(fs2/fs1) != 0) t1++;
-
-        bp = &(buf2[ch][t1]);
-      }
-
-      s2p = s2p_backup;
-
-      for(p=0;bp-buf2[ch]<n1b2+1;p++)
-        {
-    REAL tmp = 0;
-    REAL *bp2;
-    int s;
-    int s2o;
-
-    bp2 = bp;
-    s2o = f2order[s2p];
-    bp += f2inc[s2p];
-    s2p++;
-
-    if (s2p == n2y) s2p = 0;
-
-    assert((bp2-&(buf2[ch][0]))*(fs2/fs1)-(rp2+p*(fs2/dfrq)) == s2o);
-
-    for(i=0;i<n2x;i++)
-      tmp += stage2[s2o][i] * *bp2++;
-
-    op[p*nch+ch] = tmp;
-        }
-
-      nsmplwrt2 = p;
-    }
-
-  rp2 += nsmplwrt2 * (fs2 / dfrq);
-
-  if (twopass) {
-    for(i=0;i<nsmplwrt2*nch;i++)
-      {
-        REAL f = outbuf[i] > 0 ? outbuf[i] : -outbuf[i];
-        peak = peak < f ? f : peak;
-        ((REAL *)rawoutbuf)[i] = outbuf[i];
-      }
-  } else {
-    switch(dbps)
-      {
-      case 1:
-        {
-    REAL gain2 = gain * (REAL)0x7f;
-    ch = 0;
-
-    for(i=0;i<nsmplwrt2*nch;i++)
-      {
-        int s;
-
-        if (dither != -1) {
-          s = do_shaping(outbuf[i]*gain2,&peak,dither,ch);
-        } else {
-          s = RINT(outbuf[i]*gain2);
-
-          if (s < -0x80) {
-      double d = (double)s/-0x80;
-      peak = peak < d ? d : peak;
-      s = -0x80;
-          }
-          if (0x7f <  s) {
-      double d = (double)s/ 0x7f;
-      peak = peak < d ? d : peak;
-      s =  0x7f;
-          }
-        }
+      break;
 
-        ((uint8_t *)rawoutbuf)[i] = s + 0x80;
+    case 3:
+      for(i=0;i<n;i++) {
+        inbuf[i] = (1/(REAL)0x7fffff)*
+    ((((int)rawinbuf[i*3  ]) << 0 ) |
+     (((int)rawinbuf[i*3+1]) << 8 ) |
+     (((int)((int8_t *)rawinbuf)[i*3+2]) << 16));
+      }
+      break;
 
-        ch++;
-        if (ch == nch) ch = 0;
+    case 4:
+      for(i=0;i<n;i++) {
+        inbuf[i] = (1/(REAL)0x7fffffff)*
+    ((((int)rawinbuf[i*4  ]) << 0 ) |
+     (((int)rawinbuf[i*4+1]) << 8 ) |
+     (((int)rawinbuf[i*4+2]) << 16) |
+     (((int)((int8_t *)rawinbuf)[i*4+3]) << 24));
       }
-        }
       break;
+    }
+}
+//}}}
+//{{{
+// resample : convert the sampling rate of chunklen frames from fpi to fpo (with an SSRCEngine), quantizing the output
+// to dbps bytes, or with twopass, writing it as REALs (or with fpo NULL, only measuring the peak). Only output frames
+// skip to skip+keep are kept (keep -1 : to the end). With dither, the noise shapers also quantize the delay of the
+// filters, which is then dropped, as ssrc always has, so that the output stays the same. Returns the peak
+double resample (FILE *fpi,FILE *fpo,int nch,int bps,int dbps,int64_t sfrq,int64_t dfrq,double gain,unsigned int chunklen,int twopass,int dither,int64_t skip,int64_t keep)
+{
+  struct SSRCEngine *engine;
+  uint8_t *rawinbuf,*rawoutbuf;
+  REAL *inbuf,*outbuf;
+  int blocklen,outlen;
+  int64_t sumread = 0, sumwrite = 0, lead = 0;
+  int spcount = 0;
+  int ending = 0;
+  int ch = 0;
+  double peak=0;
+  int i;
 
-      case 2:
-        {
-    REAL gain2 = gain*(REAL)0x7fff;
-    ch = 0;
+  engine = SSRCEngine_init(nch,sfrq,dfrq,AA,DF,nthreads);
+  if (!engine) {
+    int64_t r = sfrq < dfrq ? sfrq : dfrq;
+    fprintf(stderr,"Resampling from %dHz to %dHz is not supported.\n",(int)sfrq,(int)dfrq);
+    fprintf(stderr,"%d/gcd(%d,%d)=%d must be divided by 2 or 3.\n",(int)r,(int)sfrq,(int)dfrq,(int)(r/gcd(sfrq,dfrq)));
+    exit(-1);
+  }
 
-    for(i=0;i<nsmplwrt2*nch;i++)
-      {
-        int s;
+  if (dither != -1 && !twopass && shapedelay) {
+    SSRCEngine_keepDelay(engine);
+    lead = SSRCEngine_getLatency(engine);
+  }
 
-        if (dither != -1) {
-          s = do_shaping(outbuf[i]*gain2,&peak,dither,ch);
-        } else {
-          s = RINT(outbuf[i]*gain2);
+  blocklen = SSRCEngine_getBlockSize(engine);
+  outlen = (double)blocklen*dfrq/sfrq+1;
 
-          if (s < -0x8000) {
-      double d = (double)s/-0x8000;
-      peak = peak < d ? d : peak;
-      s = -0x8000;
-          }
-          if (0x7fff <  s) {
-      double d = (double)s/ 0x7fff;
-      peak = peak < d ? d : peak;
-      s =  0x7fff;
-          }
-        }
+  rawinbuf  = calloc(nch*blocklen,bps);
+  rawoutbuf = calloc(nch*outlen,dbps);
+  inbuf  = calloc(nch*blocklen,sizeof(REAL));
+  outbuf = calloc(nch*outlen,sizeof(REAL));
 
-#ifndef BIGENDIAN
-        ((int16_t *)rawoutbuf)[i] = s;
-#else
-        ((int8_t *)rawoutbuf)[i*2  ] = s & 255; s >>= 8;
-        ((int8_t *)rawoutbuf)[i*2+1] = s & 255;
-#endif
+  setstarttime();
 
-        ch++;
-        if (ch == nch) ch = 0;
-      }
-        }
-      break;
+  while (!ending)
+    {
+  int nsmplread,toberead;
+  int64_t nsmplwrt;
 
-      case 3:
-        {
-    REAL gain2 = gain * (REAL)0x7fffff;
-    ch = 0;
+  toberead = blocklen;
+  if (toberead+sumread > chunklen) {
+    toberead = chunklen-sumread;
+  }
 
-    for(i=0;i<nsmplwrt2*nch;i++)
-      {
-        int s;
+  nsmplread = fread(rawinbuf,1,bps*nch*toberead,fpi);
+  nsmplread /= bps*nch;
 
-        if (dither != -1) {
-          s = do_shaping(outbuf[i]*gain2,&peak,dither,ch);
-        } else {
-          s = RINT(outbuf[i]*gain2);
+  toreal(rawinbuf,inbuf,nsmplread*nch,bps);
 
-          if (s < -0x800000) {
-      double d = (double)s/-0x800000;
-      peak = peak < d ? d : peak;
-      s = -0x800000;
-          }
-          if (0x7fffff <  s) {
-      double d = (double)s/ 0x7fffff;
-      peak = peak < d ? d : peak;
-      s =  0x7fffff;
-          }
-        }
+  SSRCEngine_push(engine,inbuf,nsmplread);
+  sumread += nsmplread;
 
-        ((int8_t *)rawoutbuf)[i*3  ] = s & 255; s >>= 8;
-        ((int8_t *)rawoutbuf)[i*3+1] = s & 255; s >>= 8;
-        ((int8_t *)rawoutbuf)[i*3+2] = s & 255;
+  ending = feof(fpi) || nsmplread < toberead || sumread >= chunklen;
+  if (ending) SSRCEngine_flush(engine);
 
-        ch++;
-        if (ch == nch) ch = 0;
+  while ((nsmplwrt = SSRCEngine_pull(engine,outbuf,outlen)) > 0)
+    {
+      REAL *o = outbuf;
+
+      if (lead > 0) {
+        int64_t n = lead < nsmplwrt ? lead : nsmplwrt;
+        quantize(o,rawoutbuf,n*nch,nch,dbps,gain,dither,&peak,&ch);
+        o += n*nch;
+        nsmplwrt -= n;
+        lead -= n;
       }
-        }
-      break;
+      if (sumwrite < skip) {
+        int64_t n = skip-sumwrite < nsmplwrt ? skip-sumwrite : nsmplwrt;
+        o += n*nch;
+        nsmplwrt -= n;
+        sumwrite += n;
       }
-  }
+      if (keep >= 0 && sumwrite+nsmplwrt > skip+keep) nsmplwrt = skip+keep-sumwrite;
+      if (nsmplwrt <= 0) continue;
+      sumwrite += nsmplwrt;
 
-  if (!init) {
-    if (ending) {
-      if ((double)sumread*dfrq/sfrq+2 > sumwrite+nsmplwrt2) {
-        if (dbps*nch*nsmplwrt2 != fwrite(rawoutbuf,1,dbps*nch*nsmplwrt2,fpo)) {
-        }
-        sumwrite += nsmplwrt2;
-      } else {
-        fwrite(rawoutbuf,1,dbps*nch*(floor((double)sumread*dfrq/sfrq)+2-sumwrite),fpo);
-        break;
-      }
-    } else {
-      fwrite(rawoutbuf,1,dbps*nch*nsmplwrt2,fpo);
-      sumwrite += nsmplwrt2;
+      if (twopass) {
+        for(i=0;i<nsmplwrt*nch;i++)
+    {
+      REAL f = o[i] > 0 ? o[i] : -o[i];
+      peak = peak < f ? f : peak;
     }
-  } else {
-    int pos,len;
-    if (nsmplwrt2 < delay) {
-      delay -= nsmplwrt2;
-    } else {
-      if (ending) {
-        if ((double)sumread*dfrq/sfrq+2 > sumwrite+nsmplwrt2-delay) {
-    fwrite(rawoutbuf+dbps*nch*delay,1,dbps*nch*(nsmplwrt2-delay),fpo);
-    sumwrite += nsmplwrt2-delay;
-        } else {
-    fwrite(rawoutbuf+dbps*nch*delay,1,dbps*nch*(floor((double)sumread*dfrq/sfrq)+2-sumwrite-delay),fpo);
-    break;
+        if (fpo && (size_t)(nsmplwrt*nch) != fwrite(o,sizeof(REAL),nsmplwrt*nch,fpo)) {
+    fprintf(stderr,"fwrite error(1).\n");
+    abort();
         }
       } else {
-        fwrite(rawoutbuf+dbps*nch*delay,1,dbps*nch*(nsmplwrt2-delay),fpo);
-        sumwrite += nsmplwrt2-delay;
-        init = 0;
+        quantize(o,rawoutbuf,nsmplwrt*nch,nch,dbps,gain,dither,&peak,&ch);
+        if ((size_t)(nsmplwrt*nch) != fwrite(rawoutbuf,dbps,nsmplwrt*nch,fpo)) {
+    fprintf(stderr,"fwrite error(2).\n");
+    abort();
+        }
       }
     }
-  }
-
-  {
-    int ds = (rp2-1)/(fs2/fs1);
-
-    if (ds > n1b2) ds = n1b2;
-
-    for(ch=0;ch<nch;ch++)
-      memmove(buf2[ch],buf2[ch]+ds,sizeof(REAL)*(n2x+1+n1b2-ds));
-
-    rp2 -= ds*(fs2/fs1);
-  }
-
-  for(ch=0;ch<nch;ch++)
-    memcpy(buf2[ch]+n2x+1,buf1[ch]+n1b2,sizeof(REAL)*n1b2);
 
   if ((spcount++ & 7) == 7) showprogress((double)sumread / chunklen);
-      }
-  }
+    }
 
   showprogress(1);
 
-  SleefDFT_free(stage1);
-  SleefDFT_dispose(dftf);
-  SleefDFT_dispose(dftb);
-  free(f2order);
-  free(f2inc);
-  free(stage2[0]);
-  free(stage2);
-  for(i=0;i<nch;i++) SleefDFT_free(buf1[i]);
-  free(buf1);
-  for(i=0;i<nch;i++) free(buf2[i]);
-  free(buf2);
+  SSRCEngine_dispose(engine);
   free(inbuf);
   free(outbuf);
   free(rawinbuf);
   free(rawoutbuf);
 
   if (dither != -1) {
-    static int64_t dlmin[] = { 0, -0x80, -0x8000, -0x800000, -(0x7FFFFFFF) };
-    static int64_t dlmax[] = { 0,  0x7f,  0x7fff,  0x7fffff,   0x7fffffffULL };
+    static int64_t dlmin[] = { 0, -0x80, -0x8000, -0x800000, -(0x7fffffff) };
+    static int64_t dlmax[] = { 0,  0x7f,  0x7fff,  0x7fffff,  0x7fffffffULL };
     double min = 0, max = 0;
     for(i=0;i<nch;i++) {
       double p[2];
@@ -1425,6 +549,418 @@ double no_src (FILE *fpi,FILE *fpo,int nch,int bps,int dbps,double gain,int chun
   return peak;
 }
 //}}}
+//{{{
+int get_num_processors (void) {
+
+#ifdef _OPENMP
+  return omp_get_num_procs();
+#else
+  return 1;
+#endif
+  }
+//}}}
+//{{{
+double get_time (void) {
+
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+  }
+//}}}
+//{{{
+// convert_segments : split the input into segments of a fixed length (120 margins, 30 secs), and resample them concurrently,
+// each into its own temporary file. The boundaries depend only on the input, not on the number of threads, so neither does
+// the output. Segment boundaries are multiples of the input period sfrq/gcd(sfrq,dfrq), where input and output samples line up, so the
+// output of a segment is the output of the whole file shifted by a whole number of samples. Each segment is extended by a
+// margin from its neighbours, which is resampled and then discarded, so that the joins match a single conversion (to within
+// rounding). Each segment is quantized (or with twopass, written as REALs) with its margins dropped, and the files are
+// joined; with fpo NULL, the segments only measure their peak. There is no dither, as the noise shapers have to see the
+// samples in order. The segments are converted and joined a group at a time, to bound the number of temporary files.
+// Returns the peak, or -1 if the input is shorter than two segments
+double convert_segments (const char *sfn, long datapos, FILE *fpo, int nch, int bps, int dbps, int64_t sfrq, int64_t dfrq, double gain, unsigned int chunklen, int twopass) {
+
+  int64_t frqgcd = gcd(sfrq,dfrq);
+  int64_t period = sfrq/frqgcd;  // input frames per period
+  int64_t operiod = dfrq/frqgcd; // output frames per period
+  int64_t margin = (sfrq/4+period-1)/period*period; // 250ms : several times the reach of the longest filter (--profile long)
+  int64_t seglen = 120*margin; // (the margins add 1/60 to the work)
+  int nseg, ngroup, first, k;
+  FILE **fpt;
+  double *peaks, peak = 0;
+  int savedquiet = quiet;
+
+  if ((int64_t)chunklen < 2*seglen) return -1;
+  nseg = (int)((int64_t)chunklen/seglen); // (the last segment takes the remainder)
+  ngroup = 4*nthreads;
+
+  fpt = calloc(ngroup,sizeof(FILE *));
+  peaks = calloc(nseg,sizeof(double));
+
+  setstarttime();
+  for(first=0;first<nseg;first+=ngroup) {
+    int last = first+ngroup < nseg ? first+ngroup : nseg;
+
+    quiet = 1; // (the progress display of the converters is per-file)
+
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1)
+    for(k=first;k<last;k++) {
+      int64_t a = k*seglen, b = k == nseg-1 ? chunklen : (k+1)*seglen;
+      int64_t start = a < margin ? 0 : a-margin;
+      int64_t end = b+margin > chunklen ? chunklen : b+margin;
+      int64_t skip = (a-start)/period*operiod;
+      int64_t keep = k == nseg-1 ? -1 : (b-a)/period*operiod; // (the last segment keeps everything up to its end)
+      FILE *fpi = fopen(sfn,"rb");
+
+      if (!fpi) {fprintf(stderr,"cannot open input file.\n"); exit(-1);}
+      if (fpo) {
+        fpt[k-first] = tmpfile();
+        if (!fpt[k-first]) {fprintf(stderr,"cannot open temporary file.\n"); exit(-1);}
+        }
+      fseek(fpi,datapos+(long)(start*nch*bps),SEEK_SET);
+
+      peaks[k] = resample(fpi,fpt[k-first],nch,bps,dbps,sfrq,dfrq,gain,end-start,twopass,-1,skip,keep);
+      fclose(fpi);
+      }
+
+    quiet = savedquiet;
+
+    // join
+    for(k=first;k<last;k++) {
+      peak = peak < peaks[k] ? peaks[k] : peak;
+      if (fpt[k-first]) {
+        uint8_t buf[65536];
+        size_t n;
+
+        fseek(fpt[k-first],0,SEEK_SET);
+        while ((n = fread(buf,1,sizeof(buf),fpt[k-first])) > 0) fwrite(buf,1,n,fpo);
+        fclose(fpt[k-first]);
+        fpt[k-first] = NULL;
+        }
+      }
+
+    showprogress((double)last/nseg);
+    }
+
+  free(fpt);
+  free(peaks);
+
+  return peak;
+  }
+//}}}
+//{{{
+// convert : resample (or requantize) chunklen frames from fpi, positioned at the start of the samples of sfn.
+// With more than one thread (or --segments), long inputs are resampled in segments when there is no dither to apply (or
+// with --twopass, where it is applied in pass 2); the joins can differ from a single conversion by rounding, so the
+// default, one thread, stays a single conversion. Otherwise, the channels of each block are filtered concurrently.
+// With twopass and fpo NULL, only the peak is measured (pass 1 of --prescan); as pass 2 converts again, both passes
+// have to split the input the same way
+double convert (const char *sfn, FILE *fpi, FILE *fpo, int nch, int bps, int dbps, int64_t sfrq, int64_t dfrq, double gain, unsigned int chunklen, int twopass, int dither) {
+
+  if (sfrq != dfrq && (segments || nthreads > 1) && ((twopass && fpo) || dither == -1)) {
+    double peak = convert_segments(sfn,ftell(fpi),fpo,nch,bps,dbps,sfrq,dfrq,gain,chunklen,twopass);
+    if (peak >= 0)
+      return peak;
+    }
+
+  if (sfrq != dfrq)
+    return resample(fpi,fpo,nch,bps,dbps,sfrq,dfrq,gain,chunklen,twopass,dither,0,-1);
+  else
+    return no_src(fpi,fpo,nch,bps,dbps,gain,chunklen,twopass,dither);
+  }
+//}}}
+//{{{
+// benchmark_threads : time the resampling of the input (to REALs, as pass 1 of --twopass) with 1 to N threads (N : --threads,
+// or one per processor), filtering the channels concurrently and converting segments concurrently, and compare the results
+// with the single-threaded conversion
+void benchmark_threads (const char *sfn, long datapos, int nch, int bps, int64_t sfrq, int64_t dfrq, unsigned int chunklen) {
+
+  int maxthreads = nthreads > 1 ? nthreads : get_num_processors();
+  int savedthreads = nthreads;
+  int savedquiet = quiet;
+  double t1 = 0;
+  FILE *ref = NULL;
+  int t, method;
+
+  if (sfrq == dfrq) {
+    printf("benchmark : input and output sampling rates are the same\n");
+    return;
+    }
+
+  printf("benchmark : %d channels, %g secs, %d processors\n\n",nch,(double)chunklen/sfrq,get_num_processors());
+
+  quiet = 1;
+  for(t=1;t<=maxthreads;t++) {
+    for(method=0;method<2;method++) {
+      static const char *methods[] = { "channels", "segments" };
+      FILE *fpi, *fpo;
+      double t0, secs, maxdiff = 0;
+      int64_t diffcount = 0;
+
+      if (t == 1 && method == 1) continue; // (the same as method 0)
+
+      fpi = fopen(sfn,"rb");
+      fpo = tmpfile();
+      if (!fpi || !fpo) {fprintf(stderr,"cannot open temporary file.\n"); exit(-1);}
+      fseek(fpi,datapos,SEEK_SET);
+      nthreads = t;
+
+      t0 = get_time();
+      if (method == 0)
+        resample(fpi,fpo,nch,bps,sizeof(REAL),sfrq,dfrq,1,chunklen,1,-1,0,-1);
+      else if (convert_segments(sfn,datapos,fpo,nch,bps,sizeof(REAL),sfrq,dfrq,1,chunklen,1) < 0) {
+        printf("%2d threads, by %s : input too short\n",t,methods[method]);
+        fclose(fpi);
+        fclose(fpo);
+        continue;
+        }
+      secs = get_time()-t0;
+      fclose(fpi);
+
+      if (ref == NULL) {
+        ref = fpo;
+        t1 = secs;
+        }
+      else {
+        // compare with the reference
+        REAL a[4096], b[4096];
+        size_t na, nb, i;
+        fseek(ref,0,SEEK_SET);
+        fseek(fpo,0,SEEK_SET);
+        do {
+          na = fread(a,sizeof(REAL),4096,ref);
+          nb = fread(b,sizeof(REAL),4096,fpo);
+          for(i=0;i<na && i<nb;i++) {
+            double d = fabs(a[i]-b[i]);
+            if (d != 0) diffcount++;
+            maxdiff = maxdiff < d ? d : maxdiff;
+            }
+          if (na != nb) {
+            printf("  output lengths differ\n");
+            break;
+            }
+          } while (na > 0);
+        fclose(fpo);
+        }
+
+      printf("%2d threads, by %s : %8.3f secs, %7.1fx realtime, speedup %5.2fx",
+             t,methods[method],secs,(double)chunklen/sfrq/secs,t1/secs);
+      if (fpo != ref) {
+        if (diffcount)
+          printf(", %lld samples differ (max %.3g, %.1fdB)",(long long)diffcount,maxdiff,20*log10(maxdiff));
+        else
+          printf(", identical");
+        }
+      printf("\n");
+      }
+    }
+
+  if (ref) fclose(ref);
+  nthreads = savedthreads;
+  quiet = savedquiet;
+  }
+//}}}
+//{{{
+// refsignal : the input of verify_reference(), 24 bit stereo : a triangle wave and a square wave, with noise
+static void refsignal (int32_t *buf, int nframes) {
+
+  uint32_t rnd = 12345;
+  int i;
+
+  for(i=0;i<nframes;i++) {
+    int t = i % 200;
+    rnd = rnd * 1664525 + 1013904223;
+    buf[i*2  ] = (t < 100 ? t : 200-t) * 40000 - 2000000 + ((int32_t)rnd >> 12);
+    buf[i*2+1] = (i % 441 < 220 ? 1500000 : -1500000) + ((int32_t)rnd >> 10);
+    }
+  }
+//}}}
+//{{{
+// the output of ssrc 1.33 (the last version before SSRCEngine) converting refsignal() of nframes frames to 24 bits, with
+// the normal profile and no dither : outframes frames, of which frames k*(outframes-9)/23 (k = 0 to 23) and the last 8
+static const struct {
+  int sfrq, dfrq, nframes, outframes;
+  int32_t frames[32][2];
+  } refoutputs[] = {
+  { 44100, 48000, 22173, 24135, {
+    {268145,-262873}, {-532684,1225003}, {1489650,3515645}, {1217600,-2885350}, {126271,-1459790}, {-1412067,-1806387}, {-1540946,201020}, {483174,2506121},
+    {2175938,3484158}, {581942,-2653701}, {-867580,-2651960}, {-1622996,2890970}, {-280713,2466209}, {690881,558880}, {2194790,779874}, {-344415,-3575016},
+    {-1464313,-2246906}, {-983047,2672848}, {349652,2207182}, {1618726,-1563565}, {1227325,-304443}, {-579868,-1735811}, {-2258462,371737}, {-759403,684905},
+    {-262960,3027374}, {-401371,2394729}, {-625171,1876602}, {-411382,2661571}, {-375361,3132295}, {-1276186,-425604}, {-1282616,-364552}, {-799342,2207519}
+    } },
+  { 48000, 44100, 24123, 22165, {
+    {173883,-42445}, {-66595,1730081}, {1833350,-1383358}, {606349,2844448}, {-1942727,-2450592}, {-775340,-3107991}, {1518588,1364147}, {586304,-1061592},
+    {-1301932,2148566}, {-772464,913218}, {1119837,-2405738}, {980542,2513407}, {-1474742,-2638491}, {-1205526,-2818469}, {1039427,1275582}, {1600827,990185},
+    {-734549,2351582}, {-1515943,-235059}, {454375,-3062775}, {1545025,2768539}, {-1042073,-2691847}, {-1397462,-1770867}, {566883,1389209}, {1489919,-1306225},
+    {1683237,-322777}, {1203299,-2068968}, {797725,-3566080}, {1179737,-1741913}, {1527155,-417346}, {1132548,-1362579}, {1864995,708758}, {-1237565,-3248567}
+    } },
+  { 96000, 44100, 48123, 22108, {
+    {60569,-291664}, {1200548,-2717515}, {-1094795,1783938}, {1066137,2299255}, {-539739,-1503798}, {127296,-1881833}, {105686,1150899}, {-664229,865491},
+    {1082024,-488059}, {-1280454,-2029284}, {1245403,622013}, {-2172013,-8501}, {1881877,-1179550}, {-1498512,-1575981}, {1260986,1921594}, {-1061331,616533},
+    {522052,-1481939}, {-441621,-2491202}, {-208367,1521635}, {582834,1709335}, {-729336,-999873}, {1061758,-1967713}, {-1306979,2252809}, {1854597,1670348},
+    {1745050,1523988}, {1661238,1608725}, {1476662,1127644}, {1517069,1754328}, {1703359,2693889}, {1213098,1297207}, {992603,410971}, {970129,1675041}
+    } },
+  { 44100, 96000, 22173, 48269, {
+    {-1364465,1119951}, {-177566,2938583}, {596223,235416}, {1137667,-3505587}, {-269977,-3411671}, {-1616708,-2999968}, {-1639386,175558}, {380058,2459737},
+    {1862074,2602739}, {992072,-1449724}, {-239441,-582060}, {-1493116,3205620}, {-428962,2386333}, {818996,1582320}, {1466334,-2641961}, {496903,-724670},
+    {-680786,267158}, {-1184324,2456973}, {419687,3074619}, {1846955,-26403}, {1285321,-733345}, {93438,299015}, {-1558320,2492560}, {-371084,3143914},
+    {-814633,1635277}, {-1271621,-402094}, {-1428870,-1320603}, {-1285680,-386817}, {-1046283,1352131}, {-802940,2206623}, {-494017,1605558}, {-138525,426600}
+    } },
+  };
+//}}}
+//{{{
+// verify_reference : check SSRCEngine against the output of ssrc 1.33 (see refoutputs). The FFTs can take another path on
+// another processor (or with --planfile), and HIGHPREC filters in doubles, so the samples may differ by an LSB or so;
+// a misplaced or misfiltered frame differs by thousands. Returns the number of conversions which don't match
+int verify_reference (void) {
+
+  static const int tolerance = 4;
+  int mismatches = 0;
+  int r, k, c;
+
+  for(r=0;r<(int)(sizeof(refoutputs)/sizeof(refoutputs[0]));r++) {
+    int nframes = refoutputs[r].nframes, outframes = refoutputs[r].outframes;
+    struct SSRCEngine *engine = SSRCEngine_init(2,refoutputs[r].sfrq,refoutputs[r].dfrq,140,2000,nthreads);
+    int32_t *raw = malloc(sizeof(int32_t)*2*nframes);
+    REAL *in = malloc(sizeof(REAL)*2*nframes);
+    REAL *out = malloc(sizeof(REAL)*2*(outframes+1));
+    REAL gain2 = (REAL)0x7fffff; // (as quantize())
+    int64_t outlen;
+    int maxdiff = 0;
+
+    refsignal(raw,nframes);
+    for(k=0;k<2*nframes;k++) in[k] = (1/(REAL)0x7fffff)*raw[k]; // (as toreal())
+
+    SSRCEngine_push(engine,in,nframes);
+    SSRCEngine_flush(engine);
+    outlen = SSRCEngine_getAvailable(engine);
+    SSRCEngine_pull(engine,out,outframes+1);
+    SSRCEngine_dispose(engine);
+
+    if (outlen == outframes) {
+      for(k=0;k<32;k++) {
+        int64_t i = k < 24 ? (int64_t)k*(outframes-9)/23 : outframes-32+k;
+        for(c=0;c<2;c++) {
+          int d = abs(RINT(out[i*2+c]*gain2) - refoutputs[r].frames[k][c]);
+          maxdiff = maxdiff < d ? d : maxdiff;
+          }
+        }
+      }
+
+    if (outlen != outframes) {
+      printf("verify : %d -> %d, MISMATCH with ssrc 1.33, %lld output frames, expected %d\n",
+             refoutputs[r].sfrq,refoutputs[r].dfrq,(long long)outlen,outframes);
+      mismatches++;
+      }
+    else if (maxdiff > tolerance) {
+      printf("verify : %d -> %d, MISMATCH with ssrc 1.33, samples differ by up to %d LSB (24 bits)\n",
+             refoutputs[r].sfrq,refoutputs[r].dfrq,maxdiff);
+      mismatches++;
+      }
+    else
+      printf("verify : %d -> %d, OK, within %d LSB (24 bits) of ssrc 1.33\n",refoutputs[r].sfrq,refoutputs[r].dfrq,maxdiff);
+
+    free(raw);
+    free(in);
+    free(out);
+    }
+
+  return mismatches;
+  }
+//}}}
+//{{{
+// verify_engine : regression check of SSRCEngine against the command line conversion. The input is resampled to REALs
+// as pass 1 of --twopass does, then again from memory, pushing and pulling blocks of pseudo-random sizes (from 1 frame to
+// a few engine blocks); the two results must be identical. Returns the number of samples that differ (-1 : lengths differ)
+int64_t verify_engine (const char *sfn, long datapos, int nch, int bps, int64_t sfrq, int64_t dfrq, unsigned int chunklen) {
+
+  struct SSRCEngine *engine;
+  uint8_t *rawinbuf;
+  REAL *in, *ref, *out;
+  int64_t reflen, outlen = 0, pushed = 0, diffcount = 0, i;
+  int savedquiet = quiet;
+  uint32_t rnd = 1;
+  int blocklen, maxstep;
+  FILE *fpi, *fpt;
+
+  if (sfrq == dfrq) {
+    printf("verify : input and output sampling rates are the same\n");
+    return 0;
+    }
+
+  fpi = fopen(sfn,"rb");
+  fpt = tmpfile();
+  if (!fpi || !fpt) {fprintf(stderr,"cannot open temporary file.\n"); exit(-1);}
+
+  // the command line conversion
+  quiet = 1;
+  fseek(fpi,datapos,SEEK_SET);
+  resample(fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,1,chunklen,1,-1,0,-1);
+  quiet = savedquiet;
+
+  reflen = ftell(fpt) / sizeof(REAL) / nch;
+  ref = malloc((reflen+1)*nch*sizeof(REAL));
+  fseek(fpt,0,SEEK_SET);
+  ignoreReturnValue(fread(ref,sizeof(REAL),reflen*nch,fpt));
+  fclose(fpt);
+
+  // the input, in memory
+  rawinbuf = malloc((int64_t)chunklen*nch*bps+1);
+  in = malloc(((int64_t)chunklen*nch+1)*sizeof(REAL));
+  fseek(fpi,datapos,SEEK_SET);
+  chunklen = fread(rawinbuf,bps*nch,chunklen,fpi);
+  toreal(rawinbuf,in,chunklen*nch,bps);
+  free(rawinbuf);
+  fclose(fpi);
+
+  engine = SSRCEngine_init(nch,sfrq,dfrq,AA,DF,nthreads);
+  blocklen = SSRCEngine_getBlockSize(engine);
+  maxstep = 3*blocklen;
+  out = malloc((reflen+(int64_t)maxstep*dfrq/sfrq+8)*nch*sizeof(REAL));
+
+  printf("verify : %d channels, %g secs, block %d frames, latency %d frames\n",
+         nch,(double)chunklen/sfrq,blocklen,SSRCEngine_getLatency(engine));
+
+  while (pushed < chunklen) {
+    int64_t n;
+
+    rnd = rnd * 1664525 + 1013904223;
+    n = 1 + (rnd >> 8) % maxstep;
+    if (n > chunklen-pushed) n = chunklen-pushed;
+    SSRCEngine_push(engine,in+pushed*nch,n);
+    pushed += n;
+
+    rnd = rnd * 1664525 + 1013904223;
+    n = (rnd >> 8) % maxstep;
+    if (outlen + n > reflen) n = reflen - outlen;
+    outlen += SSRCEngine_pull(engine,out+outlen*nch,n);
+    }
+
+  SSRCEngine_flush(engine);
+  while (SSRCEngine_getAvailable(engine) > 0 && outlen < reflen)
+    outlen += SSRCEngine_pull(engine,out+outlen*nch,reflen-outlen);
+  outlen += SSRCEngine_getAvailable(engine);
+  SSRCEngine_dispose(engine);
+
+  for(i=0;i<reflen*nch && i<outlen*nch;i++)
+    if (memcmp(&ref[i],&out[i],sizeof(REAL)) != 0) diffcount++;
+
+  if (outlen != reflen) {
+    printf("verify : MISMATCH, %lld output frames, expected %lld\n",(long long)outlen,(long long)reflen);
+    diffcount = -1;
+    }
+  else if (diffcount)
+    printf("verify : MISMATCH, %lld of %lld samples differ\n",(long long)diffcount,(long long)(reflen*nch));
+  else
+    printf("verify : OK, %lld frames identical\n",(long long)reflen);
+
+  free(in);
+  free(ref);
+  free(out);
+  return diffcount;
+  }
+//}}}
 
 //{{{
 int extract_int (uint8_t *buf) {
@@ -1582,7 +1118,7 @@ int main (int argc, char **argv)
 {
   char *sfn,*dfn,*tmpfn=NULL;
   FILE *fpi = NULL,*fpo = NULL,*fpt = NULL;
-  int twopass,normalize,dither,pdf,samp=0;
+  int twopass,normalize,dither,pdf,samp=0,benchmark=0,verify=0,prescan=0;
   int nch,bps;
   unsigned int length;
   int sfrq,dfrq,dbps;
@@ -1635,6 +1171,14 @@ int main (int argc, char **argv)
       }
       //}}}
 
+    if (strcmp(argv[i],"--prescan") == 0) {
+      //{{{
+      twopass = 1;
+      prescan = 1;
+      continue;
+      }
+      //}}}
+
     if (strcmp(argv[i],"--normalize") == 0) {
       //{{{
       twopass = 1;
@@ -1708,6 +1252,40 @@ int main (int argc, char **argv)
       }
       //}}}
 
+    if (strcmp(argv[i],"--threads") == 0) {
+      //{{{
+      nthreads = atoi(argv[++i]);
+#ifdef _OPENMP
+      if (nthreads <= 0) nthreads = get_num_processors();
+#else
+      if (nthreads != 1) fprintf(stderr,"Warning: built without OpenMP; --threads is ignored.\n");
+      nthreads = 1;
+#endif
+      continue;
+      }
+      //}}}
+
+    if (strcmp(argv[i],"--segments") == 0) {
+      //{{{
+      segments = 1;
+      continue;
+      }
+      //}}}
+
+    if (strcmp(argv[i],"--benchmark") == 0) {
+      //{{{
+      benchmark = 1;
+      continue;
+      }
+      //}}}
+
+    if (strcmp(argv[i],"--verify") == 0) {
+      //{{{
+      verify = 1;
+      continue;
+      }
+      //}}}
+
     if (strcmp(argv[i],"--tmpfile") == 0) {
       //{{{
       tmpfn = argv[++i];
@@ -1715,6 +1293,13 @@ int main (int argc, char **argv)
       }
       //}}}
 
+    if (strcmp(argv[i],"--planfile") == 0) {
+      //{{{
+      SSRCEngine_setPlanFile(argv[++i]);
+      continue;
+      }
+      //}}}
+
     if (strcmp(argv[i],"--profile") == 0) {
       //{{{  profile
       if (strcmp(argv[i+1],"short") == 0) {
@@ -1839,9 +1424,6 @@ int main (int argc, char **argv)
     }
     //}}}
 
-  if (sfrq < dfrq && DF < sfrq / 24.0) DF = sfrq/24.0;
-  if (dfrq < sfrq && DF < dfrq / 24.0) DF = dfrq/24.0;
-
   if (!quiet) {
     //{{{
     const char *ptype[] = { "rectangular", "triangular", "gaussian", "two-level" };
@@ -1850,6 +1432,7 @@ int main (int argc, char **argv)
     printf("bits per sample : %d -> %d\n",bps*8,dbps*8);
     printf("nchannels : %d\n",nch);
     printf("length : %d bytes, %g secs\n",length,(double)length/bps/nch/sfrq);
+    printf("threads : %d%s\n",nthreads,segments || nthreads > 1 ? ", segments" : "");
     if (dither == -1) {
       printf("dither type : none\n");
       }
@@ -1859,7 +1442,20 @@ int main (int argc, char **argv)
     printf("\n");
     }
     //}}}
-  if (twopass) {
+  if (benchmark) {
+    benchmark_threads(sfn,ftell(fpi),nch,bps,sfrq,dfrq,length/bps/nch);
+    exit(0);
+    }
+  if (verify) {
+    int mismatches = verify_reference();
+    if (verify_engine(sfn,ftell(fpi),nch,bps,sfrq,dfrq,length/bps/nch) != 0) mismatches++;
+    exit(mismatches == 0 ? 0 : 1);
+    }
+
+  // (--prescan converts twice, rather than keeping pass 1 in a temporary file; without resampling, there is nothing to save)
+  if (prescan && sfrq == dfrq) prescan = 0;
+
+  if (twopass && !prescan) {
     //{{{  twopass
     if (tmpfn) {
       fpt = fopen(tmpfn,"w+b");
@@ -1917,16 +1513,6 @@ int main (int argc, char **argv)
     fwrite_int(fpo,dword);
   }
   //}}}
-  //{{{  fact
-  {
-  int i,j;
-  for (i=0;i<=M;i++) {
-    fact[i] = 1;
-    for(j=1;j<=i;j++)
-      fact[i] *= j;
-    }
-  }
-  //}}}
   if (dither != -1) {
     //{{{  dither
     int min,max;
@@ -1945,26 +1531,15 @@ int main (int argc, char **argv)
     REAL gain = 1.0;
     int ch=0;
     unsigned int fptlen, sumread;
+    long datapos = ftell(fpi);
 
     if (!quiet)
       printf("Pass 1\n");
 
-    if (normalize) {
-      if (sfrq < dfrq)
-        peak = upsample (fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,1,length/bps/nch,twopass,dither);
-      else if (sfrq > dfrq)
-        peak = downsample (fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,1,length/bps/nch,twopass,dither);
-      else
-        peak = no_src (fpi,fpt,nch,bps,sizeof(REAL),1,length/bps/nch,twopass,dither);
-      }
-    else {
-      if (sfrq < dfrq)
-        peak = upsample(fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,pow(10,-att/20),length/bps/nch,twopass,dither);
-      else if (sfrq > dfrq)
-        peak = downsample(fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,pow(10,-att/20),length/bps/nch,twopass,dither);
-      else
-        peak = no_src(fpi,fpt,nch,bps,sizeof(REAL),pow(10,-att/20),length/bps/nch,twopass,dither);
-      }
+    if (normalize)
+      peak = convert(sfn,fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,1,length/bps/nch,twopass,dither);
+    else
+      peak = convert(sfn,fpi,fpt,nch,bps,sizeof(REAL),sfrq,dfrq,pow(10,-att/20),length/bps/nch,twopass,dither);
 
     if (!quiet)
       printf("\npeak : %gdB\n",20*log10(peak));
@@ -2008,76 +1583,83 @@ int main (int argc, char **argv)
         }
       }
 
-    setstarttime();
-
-    fptlen = ftell(fpt) / sizeof(REAL);
-    sumread = 0;
+    if (prescan) {
+      //{{{  convert again, applying the gain as the loop below does (quantize() scales by gain * full scale, as a REAL)
+      static const REAL fullscale[] = { 0, 0x7f, 0x7fff, 0x7fffff };
+      fseek(fpi,datapos,SEEK_SET);
+      shapedelay = 0; // (as pass 2 of --twopass, whose noise shapers only see the output)
+      convert(sfn,fpi,fpo,nch,bps,dbps,sfrq,dfrq,gain/(double)fullscale[dbps],length/bps/nch,0,dither);
+      if (!quiet)
+        printf("\n");
+      }
+      //}}}
+    else {
+      setstarttime();
 
-    fseek(fpt,0,SEEK_SET);
-    for(;;) {
-      REAL f;
-      int s;
+      fptlen = ftell(fpt) / sizeof(REAL);
+      sumread = 0;
 
-      if (fread(&f,sizeof(REAL),1,fpt) == 0)
-        break;
-      f *= gain;
-      sumread++;
+      fseek(fpt,0,SEEK_SET);
+      for(;;) {
+        REAL f;
+        int s;
 
-      switch(dbps) {
-        case 1: {
-          uint8_t buf[1];
-          s = dither != -1 ? do_shaping(f,&peak,dither,ch) : RINT(f);
-          buf[0] = s + 128;
-          fwrite(buf,sizeof(int8_t),1,fpo);
-          }
+        if (fread(&f,sizeof(REAL),1,fpt) == 0)
           break;
-        case 2: {
-          int8_t buf[2];
-          s = dither != -1 ? do_shaping(f,&peak,dither,ch) : RINT(f);
+        f *= gain;
+        sumread++;
+
+        switch(dbps) {
+          case 1: {
+            uint8_t buf[1];
+            s = dither != -1 ? do_shaping(f,&peak,dither,ch) : RINT(f);
+            buf[0] = s + 128;
+            fwrite(buf,sizeof(int8_t),1,fpo);
+            }
+            break;
+          case 2: {
+            int8_t buf[2];
+            s = dither != -1 ? do_shaping(f,&peak,dither,ch) : RINT(f);
 
-          buf[0] = s & 255; s >>= 8;
-          buf[1] = s & 255;
+            buf[0] = s & 255; s >>= 8;
+            buf[1] = s & 255;
 
-          fwrite(buf,sizeof(int8_t),2,fpo);
-          }
-          break;
-        case 3: {
-          int8_t buf[3];
-          s = dither != -1 ? do_shaping(f,&peak,dither,ch) : RINT(f);
+            fwrite(buf,sizeof(int8_t),2,fpo);
+            }
+            break;
+          case 3: {
+            int8_t buf[3];
+            s = dither != -1 ? do_shaping(f,&peak,dither,ch) : RINT(f);
 
-          buf[0] = s & 255; s >>= 8;
-          buf[1] = s & 255; s >>= 8;
-          buf[2] = s & 255;
+            buf[0] = s & 255; s >>= 8;
+            buf[1] = s & 255; s >>= 8;
+            buf[2] = s & 255;
 
-          fwrite(buf,sizeof(int8_t),3,fpo);
+            fwrite(buf,sizeof(int8_t),3,fpo);
+            }
+            break;
           }
-          break;
-        }
 
-      ch++;
-      if (ch == nch) ch = 0;
+        ch++;
+        if (ch == nch) ch = 0;
 
-      if ((sumread & 0x3ffff) == 0)
-        showprogress((double)sumread / fptlen);
-      }
+        if ((sumread & 0x3ffff) == 0)
+          showprogress((double)sumread / fptlen);
+        }
 
-    showprogress(1);
-    if (!quiet)
-      printf("\n");
-    fclose(fpt);
-    if (tmpfn != NULL) {
-      if (remove(tmpfn))
-        fprintf(stderr,"Failed to remove %s\n",tmpfn);
+      showprogress(1);
+      if (!quiet)
+        printf("\n");
+      fclose(fpt);
+      if (tmpfn != NULL) {
+        if (remove(tmpfn))
+          fprintf(stderr,"Failed to remove %s\n",tmpfn);
+        }
       }
     }
     //}}}
   else {
-    if (sfrq < dfrq)
-      peak = upsample (fpi,fpo,nch,bps,dbps,sfrq,dfrq,pow(10,-att/20),length/bps/nch,twopass,dither);
-    else if (sfrq > dfrq)
-      peak = downsample (fpi,fpo,nch,bps,dbps,sfrq,dfrq,pow(10,-att/20),length/bps/nch,twopass,dither);
-    else
-      peak = no_src (fpi,fpo,nch,bps,dbps,pow(10,-att/20),length/bps/nch,twopass,dither);
+    peak = convert(sfn,fpi,fpo,nch,bps,dbps,sfrq,dfrq,pow(10,-att/20),length/bps/nch,twopass,dither);
     if (!quiet)
       printf ("\n");
     }
@@ -0,0 +1,997 @@
+// ssrcengine.c : the SSRC sampling rate converter (upsample() and downsample() of ssrc.c), as an object
+// which converts interleaved blocks of samples pushed to it in memory
+//{{{
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "ssrcengine.h"
+#include "dft/sleefdft.h"
+//}}}
+//{{{
+typedef SSRCEngine_real REAL;
+
+#define M 30
+
+#ifndef M_PI
+  #define M_PI 3.1415926535897932384626433832795028842
+#endif
+
+#define MAGIC 0x5352431e
+
+// SLEEF_MODE_ESTIMATE, or SLEEF_MODE_MEASURE once a plan file is set (SSRCEngine_setPlanFile)
+static uint64_t planMode = SLEEF_MODE_ESTIMATE;
+//}}}
+//{{{
+typedef struct SSRCEngine {
+  uint32_t magic;
+
+  int nch, nthreads;
+  int64_t sfrq, dfrq;
+  int mode; // 0 : same rate (copy), 1 : upsample, 2 : downsample
+
+  int64_t frqgcd, osf, fs1, fs2;
+  int64_t n1, n2;
+  int64_t n1x, n1y, n2b; // upsample : stage 1 polyphase filter, stage 2 FFT length
+  int64_t n2x, n2y, n1b; // downsample : stage 2 polyphase filter, stage 1 FFT length
+  REAL **polyphase;      // upsample : stage 1, downsample : stage 2
+  int *order, *inc;      // (of the polyphase filter)
+  REAL *spectrum;        // upsample : stage 2, downsample : stage 1 (transformed)
+  struct SleefDFT **dftf, **dftb; // one pair of plans per channel : a plan owns its work area, so the channels can be transformed concurrently
+
+  REAL **buf1, **buf2;
+  REAL *inbuf, *outbuf;
+  int inbuflen;           // upsample : frames in inbuf before the current block
+  int need, nin;          // input frames of the current block : needed, pushed so far
+  int rp, s1p, osc;       // upsample state
+  int rps, s2p, rp2;      // downsample state
+  int delay, latency;     // output frames still to be discarded, and initially
+  int keepdelay;          // the delay is output rather than discarded (SSRCEngine_keepDelay)
+
+  int64_t sumread, sumwrite; // frames pushed, frames of output produced (after the delay, unless it's kept)
+  int ending;
+
+  REAL *fifo;             // output which hasn't been pulled
+  int64_t fifopos, fifolen, fifocap;
+} SSRCEngine;
+//}}}
+
+//{{{
+static int64_t gcd (int64_t x, int64_t y) {
+
+  int64_t t;
+  while (y != 0) {
+    t = x % y;
+    x = y;
+    y = t;
+    }
+
+  return x;
+  }
+//}}}
+//{{{
+static double alpha (double a) {
+
+  if (a <= 21)
+    return 0;
+  if (a <= 50)
+    return 0.5842 * pow (a-21,0.4) + 0.07886 * (a-21);
+
+  return 0.1102*(a-8.7);
+  }
+//}}}
+//{{{
+static double izero (double x, const double *fact) {
+
+  double ret = 1;
+  int m;
+
+  for(m = M; m >= 1; m--) {
+    double t = pow (x / 2, m) / fact[m];
+    ret += t*t;
+    }
+
+  return ret;
+  }
+//}}}
+//{{{
+static double win (double n, int len, double alp, double iza, const double *fact) {
+
+  return izero (alp * sqrt (1 - 4 * n * n / ((len - 1.0) * (len - 1.0))), fact) / iza;
+  }
+//}}}
+//{{{
+static double sinc (double x) {
+
+  return x == 0 ? 1 : sin(x)/x;
+  }
+//}}}
+//{{{
+static double hn_lpf (int n, double lpf,double fs)
+{
+  double t = 1/fs;
+  double omega = 2*M_PI*lpf;
+  return 2*lpf*t*sinc(n*omega*t);
+}
+//}}}
+
+//{{{
+static void upsample_init (SSRCEngine *thiz, double AA, double DF, const double *fact)
+{
+  int nch = thiz->nch;
+  int64_t sfrq = thiz->sfrq, dfrq = thiz->dfrq;
+  int64_t frqgcd,osf;
+  int64_t fs1, fs2, n2;
+  int64_t n1,n1x,n1y,n2b;
+
+  REAL **stage1,*stage2;
+  int filter2len;
+  int *f1order,*f1inc;
+  struct SleefDFT **dftf = NULL, **dftb = NULL;
+  int i,j;
+
+  filter2len = 1; /* stage 2 filter length */
+
+  /* Make stage 1 filter */
+
+  {
+    double aa = AA; /* stop band attenuation(dB) */
+    double lpf,delta,d,df,alp,iza;
+    double guard = 2;
+
+    frqgcd = gcd(sfrq,dfrq);
+
+    fs1 = (int64_t)sfrq / frqgcd * dfrq;
+
+    if (fs1/dfrq == 1) osf = 1;
+    else if (fs1/dfrq % 2 == 0) osf = 2;
+    else if (fs1/dfrq % 3 == 0) osf = 3;
+    else abort(); // (see SSRCEngine_isSupported())
+
+    df = (dfrq*osf/2 - sfrq/2) * 2 / guard;
+    lpf = sfrq/2 + (dfrq*osf/2 - sfrq/2)/guard;
+
+    delta = pow(10,-aa/20);
+    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
+
+    n1 = fs1/df*d+1;
+    if (n1 % 2 == 0) n1++;
+
+    alp = alpha (aa);
+    iza = izero (alp,fact);
+
+    n1y = fs1/sfrq;
+    n1x = n1/n1y+1;
+
+    f1order = calloc(n1y*osf,sizeof(int));
+    for(i=0;i<n1y*osf;i++) {
+      f1order[i] = fs1/sfrq-(i*(fs1/(dfrq*osf)))%(fs1/sfrq);
+      if (f1order[i] == fs1/sfrq) f1order[i] = 0;
+    }
+
+    f1inc = calloc(n1y*osf,sizeof(int));
+    for(i=0;i<n1y*osf;i++) {
+      f1inc[i] = f1order[i] < fs1/(dfrq*osf) ? nch : 0;
+    }
+
+    stage1 = malloc(n1y*sizeof(REAL *));
+    stage1[0] = calloc(n1x*n1y,sizeof(REAL));
+
+    for(i=1;i<n1y;i++) {
+      stage1[i] = &(stage1[0][n1x*i]);
+      for(j=0;j<n1x;j++) stage1[i][j] = 0;
+    }
+
+    for(i=-(n1/2);i<=n1/2;i++)
+      {
+  stage1[(i+n1/2)%n1y][(i+n1/2)/n1y] = win(i,n1,alp,iza,fact)*hn_lpf(i,lpf,fs1)*fs1/sfrq;
+      }
+  }
+
+  /* Make stage 2 filter */
+
+  {
+    double aa = AA; /* stop band attenuation(dB) */
+    double lpf,delta,d,df,alp,iza;
+    int ipsize,wsize;
+
+    delta = pow(10,-aa/20);
+    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
+
+    fs2 = (int64_t)dfrq*osf;
+
+    for(i=1;;i = i * 2)
+      {
+  n2 = filter2len * i;
+  if (n2 % 2 == 0) n2--;
+  df = (fs2*d)/(n2-1);
+  lpf = sfrq/2;
+  if (df < DF) break;
+      }
+
+    alp = alpha (aa);
+    iza = izero (alp,fact);
+
+    for(n2b=1;n2b<n2;n2b*=2);
+    n2b *= 2;
+
+    stage2 = SleefDFT_malloc(n2b * sizeof(REAL));
+
+    for(i=0;i<n2b;i++) stage2[i] = 0;
+
+    for(i=-(n2/2);i<=n2/2;i++) {
+      stage2[i+n2/2] = win(i,n2,alp,iza,fact)*hn_lpf(i,lpf,fs2)/n2b*2;
+    }
+
+    // one pair of plans per channel : a plan owns its work area, so the channels can be transformed concurrently
+    dftf = malloc(sizeof(struct SleefDFT *)*nch);
+    dftb = malloc(sizeof(struct SleefDFT *)*nch);
+    for(i=0;i<nch;i++) {
+      dftf[i] = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_FORWARD  | planMode, n2b);
+      dftb[i] = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_BACKWARD | planMode, n2b);
+    }
+
+    SleefDFT_execute(dftf[0], stage2, stage2);
+  }
+  thiz->frqgcd = frqgcd; thiz->osf = osf; thiz->fs1 = fs1; thiz->fs2 = fs2;
+  thiz->n1 = n1; thiz->n1x = n1x; thiz->n1y = n1y; thiz->n2 = n2; thiz->n2b = n2b;
+  thiz->polyphase = stage1; thiz->order = f1order; thiz->inc = f1inc;
+  thiz->spectrum = stage2;
+  thiz->dftf = dftf; thiz->dftb = dftb;
+
+  {
+    int n2b2 = n2b/2;
+
+    thiz->buf1 = malloc(nch*sizeof(REAL *));
+    for(i=0;i<nch;i++) thiz->buf1[i] = calloc((n2b2/osf+1),sizeof(REAL));
+
+    thiz->buf2 = malloc(sizeof(REAL *)*nch);
+    for(i=0;i<nch;i++) thiz->buf2[i] = SleefDFT_malloc(n2b * sizeof(REAL));
+
+    thiz->inbuf  = calloc(nch*(n2b2+n1x+2),sizeof(REAL));
+    thiz->outbuf = calloc(nch*(n2b2/osf+1),sizeof(REAL));
+
+    thiz->inbuflen = n1/2/(fs1/sfrq)+1;
+    thiz->delay = (double)n2/2/(fs2/dfrq);
+  }
+}
+//}}}
+//{{{
+static int upsample_need (SSRCEngine *thiz) {
+
+  return ceil((double)(thiz->n2b/2)*thiz->sfrq/(thiz->dfrq*thiz->osf))+1+thiz->n1x-thiz->inbuflen;
+  }
+//}}}
+//{{{
+// upsample_block : filter the current block (thiz->need frames at inbuf + nch*inbuflen), returns the number of frames in outbuf
+static int upsample_block (SSRCEngine *thiz)
+{
+  int nch = thiz->nch, nthreads = thiz->nthreads;
+  int64_t sfrq = thiz->sfrq, dfrq = thiz->dfrq;
+  int64_t frqgcd = thiz->frqgcd, osf = thiz->osf, fs1 = thiz->fs1;
+  int64_t n1x = thiz->n1x, n1y = thiz->n1y, n2b = thiz->n2b;
+  REAL **stage1 = thiz->polyphase, *stage2 = thiz->spectrum;
+  int *f1order = thiz->order, *f1inc = thiz->inc;
+  struct SleefDFT **dftf = thiz->dftf, **dftb = thiz->dftb;
+  REAL **buf1 = thiz->buf1, **buf2 = thiz->buf2;
+  REAL *inbuf = thiz->inbuf, *outbuf = thiz->outbuf;
+  int inbuflen = thiz->inbuflen + thiz->need;
+  int n2b2 = n2b/2;
+  int rp = thiz->rp, s1p = thiz->s1p, osc = thiz->osc;
+  int nsmplwrt1 = n2b2, nsmplwrt2 = 0;
+  REAL *ip,*ip_backup;
+  int s1p_backup,osc_backup;
+  int i,j,ch,p;
+
+  ip = &inbuf[((sfrq*(rp-1)+fs1)/fs1)*nch];
+
+  s1p_backup = s1p;
+  ip_backup  = ip;
+  osc_backup = osc;
+
+  // the channels are independent from here until the output is quantized, so they can be filtered concurrently.
+  // (every channel ends with the same s1p, osc and nsmplwrt2, so taking them from the last one gives the serial result)
+#pragma omp parallel for num_threads(nthreads) if(nthreads > 1 && nch > 1) private(i,j,p,ip) lastprivate(s1p,osc,nsmplwrt2)
+  for(ch=0;ch<nch;ch++)
+    {
+      REAL *op = &outbuf[ch];
+      int fdo = fs1/(dfrq*osf),no = n1y*osf;
+
+      s1p = s1p_backup; ip = ip_backup+ch;
+
+      switch(n1x)
+        {
+        case 7:
+    for(p=0;p<nsmplwrt1;p++)
+      {
+        int s1o = f1order[s1p];
+
+        buf2[ch][p] =
+          stage1[s1o][0] * *(ip+0*nch)+
+          stage1[s1o][1] * *(ip+1*nch)+
+          stage1[s1o][2] * *(ip+2*nch)+
+          stage1[s1o][3] * *(ip+3*nch)+
+          stage1[s1o][4] * *(ip+4*nch)+
+          stage1[s1o][5] * *(ip+5*nch)+
+          stage1[s1o][6] * *(ip+6*nch);
+
+        ip += f1inc[s1p];
+
+        s1p++;
+        if (s1p == no) s1p = 0;
+      }
+    break;
+
+        case 9:
+    for(p=0;p<nsmplwrt1;p++)
+      {
+        int s1o = f1order[s1p];
+
+        buf2[ch][p] =
+          stage1[s1o][0] * *(ip+0*nch)+
+          stage1[s1o][1] * *(ip+1*nch)+
+          stage1[s1o][2] * *(ip+2*nch)+
+          stage1[s1o][3] * *(ip+3*nch)+
+          stage1[s1o][4] * *(ip+4*nch)+
+          stage1[s1o][5] * *(ip+5*nch)+
+          stage1[s1o][6] * *(ip+6*nch)+
+          stage1[s1o][7] * *(ip+7*nch)+
+          stage1[s1o][8] * *(ip+8*nch);
+
+        ip += f1inc[s1p];
+
+        s1p++;
+        if (s1p == no) s1p = 0;
+      }
+    break;
+
+        default:
+    for(p=0;p<nsmplwrt1;p++)
+      {
+        REAL tmp = 0;
+        REAL *ip2=ip;
+
+        int s1o = f1order[s1p];
+
+        for(i=0;i<n1x;i++)
+          {
+      tmp += stage1[s1o][i] * *ip2;
+      ip2 += nch;
+          }
+        buf2[ch][p] = tmp;
+
+        ip += f1inc[s1p];
+
+        s1p++;
+        if (s1p == no) s1p = 0;
+      }
+    break;
+        }
+
+      osc = osc_backup;
+
+      // apply stage 2 filter
+
+      for(p=nsmplwrt1;p<n2b;p++) buf2[ch][p] = 0;
+
+      SleefDFT_execute(dftf[ch], buf2[ch], buf2[ch]);
+
+      buf2[ch][0] = stage2[0]*buf2[ch][0];
+      buf2[ch][1] = stage2[1]*buf2[ch][1];
+
+      for(i=1;i<n2b/2;i++)
+        {
+    REAL re,im;
+
+    re = stage2[i*2  ]*buf2[ch][i*2] - stage2[i*2+1]*buf2[ch][i*2+1];
+    im = stage2[i*2+1]*buf2[ch][i*2] + stage2[i*2  ]*buf2[ch][i*2+1];
+
+    buf2[ch][i*2  ] = re;
+    buf2[ch][i*2+1] = im;
+        }
+
+      SleefDFT_execute(dftb[ch], buf2[ch], buf2[ch]);
+
+      for(i=osc,j=0;i<n2b2;i+=osf,j++)
+        {
+    REAL f = (buf1[ch][j] + buf2[ch][i]);
+    op[j*nch] = f;
+        }
+
+      nsmplwrt2 = j;
+
+      osc = i - n2b2;
+
+      for(j=0;i<n2b;i+=osf,j++)
+        buf1[ch][j] = buf2[ch][i];
+    }
+
+  rp += nsmplwrt1 * (sfrq / frqgcd) / osf;
+
+  {
+    int ds = (rp-1)/(fs1/sfrq);
+
+    assert(inbuflen >= ds);
+
+    memmove(inbuf,inbuf+nch*ds,sizeof(REAL)*nch*(inbuflen-ds));
+    inbuflen -= ds;
+    rp -= ds*(fs1/sfrq);
+  }
+
+  thiz->inbuflen = inbuflen;
+  thiz->rp = rp;
+  thiz->s1p = s1p;
+  thiz->osc = osc;
+
+  return nsmplwrt2;
+}
+//}}}
+
+//{{{
+static void downsample_init (SSRCEngine *thiz, double AA, double DF, const double *fact)
+{
+  int nch = thiz->nch;
+  int64_t sfrq = thiz->sfrq, dfrq = thiz->dfrq;
+  int64_t frqgcd,osf;
+  int64_t fs1, fs2;
+  int64_t n2,n2x,n2y,n1,n1b;
+
+  REAL *stage1,**stage2;
+  int filter1len;
+  int *f2order,*f2inc;
+  struct SleefDFT **dftf = NULL, **dftb = NULL;
+  int i,j;
+
+  filter1len = 1; /* stage 1 filter length */
+
+  /* Make stage 1 filter */
+
+  {
+    double aa = AA; /* stop band attenuation(dB) */
+    double lpf,delta,d,df,alp,iza;
+    int ipsize,wsize;
+
+    frqgcd = gcd(sfrq,dfrq);
+
+    if (dfrq/frqgcd == 1) osf = 1;
+    else if (dfrq/frqgcd % 2 == 0) osf = 2;
+    else if (dfrq/frqgcd % 3 == 0) osf = 3;
+    else abort(); // (see SSRCEngine_isSupported())
+
+    fs1 = (int64_t)sfrq*osf;
+
+    delta = pow(10,-aa/20);
+    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
+
+    n1 = filter1len;
+    for(i=1;;i = i * 2)
+      {
+  n1 = filter1len * i;
+  if (n1 % 2 == 0) n1--;
+  df = (fs1*d)/(n1-1);
+  lpf = (dfrq-df)/2;
+  if (df < DF) break;
+      }
+
+    alp = alpha(aa);
+    iza = izero(alp,fact);
+
+    for(n1b=1;n1b<n1;n1b*=2);
+    n1b *= 2;
+
+    stage1 = SleefDFT_malloc(n1b * sizeof(REAL));
+
+    for(i=0;i<n1b;i++) stage1[i] = 0;
+
+    for(i=-(n1/2);i<=n1/2;i++) {
+      stage1[i+n1/2] = win(i,n1,alp,iza,fact)*hn_lpf(i,lpf,fs1)*fs1/sfrq/n1b*2;
+    }
+
+    // one pair of plans per channel (see upsample())
+    dftf = malloc(sizeof(struct SleefDFT *)*nch);
+    dftb = malloc(sizeof(struct SleefDFT *)*nch);
+    for(i=0;i<nch;i++) {
+      dftf[i] = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_FORWARD  | planMode, n1b);
+      dftb[i] = SleefDFT_init(SLEEF_MODE_REAL | SLEEF_MODE_ALT | SLEEF_MODE_BACKWARD | planMode, n1b);
+    }
+
+    SleefDFT_execute(dftf[0], stage1, stage1);
+  }
+
+  /* Make stage 2 filter */
+
+  if (osf == 1) {
+    fs2 = (int64_t)sfrq/frqgcd*dfrq;
+    n2 = 1;
+    n2y = n2x = 1;
+    f2order = calloc(n2y,sizeof(int));
+    f2order[0] = 0;
+    f2inc = calloc(n2y,sizeof(int));
+    f2inc[0] = sfrq/dfrq;
+    stage2 = malloc(sizeof(REAL *)*n2y);
+    stage2[0] = calloc(n2x*n2y,sizeof(REAL));
+    stage2[0][0] = 1;
+  } else {
+    double aa = AA; /* stop band attenuation(dB) */
+    double lpf,delta,d,df,alp,iza;
+    double guard = 2;
+
+    fs2 = (int64_t)sfrq / frqgcd * dfrq;
+
+    df = (fs1/2 - sfrq/2) * 2 / guard;
+    lpf = sfrq/2 + (fs1/2 - sfrq/2)/guard;
+
+    delta = pow(10,-aa/20);
+    if (aa <= 21) d = 0.9222; else d = (aa-7.95)/14.36;
+
+    n2 = (int64_t)fs2/df*d+1;
+    if (n2 % 2 == 0) n2++;
+
+    alp = alpha(aa);
+    iza = izero(alp,fact);
+
+    n2y = fs2/fs1; // non-zero samples are at intervals of n2y at fs2
+    n2x = n2/n2y+1;
+
+    f2order = calloc(n2y,sizeof(int));
+    for(i=0;i<n2y;i++) {
+      f2order[i] = fs2/fs1-(i*(fs2/dfrq))%(fs2/fs1);
+      if (f2order[i] == fs2/fs1) f2order[i] = 0;
+    }
+
+    f2inc = calloc(n2y,sizeof(int));
+    for(i=0;i<n2y;i++) {
+      f2inc[i] = (fs2/dfrq-f2order[i])/(fs2/fs1)+1;
+      if (f2order[i+1==n2y ? 0 : i+1] == 0) f2inc[i]--;
+    }
+
+    stage2 = malloc(sizeof(REAL *)*n2y);
+    stage2[0] = calloc(n2x*n2y,sizeof(REAL));
+
+    for(i=1;i<n2y;i++) {
+      stage2[i] = &(stage2[0][n2x*i]);
+      for(j=0;j<n2x;j++) stage2[i][j] = 0;
+    }
+
+    for(i=-(n2/2);i<=n2/2;i++)
+      {
+  stage2[(i+n2/2)%n2y][(i+n2/2)/n2y] = win(i,n2,alp,iza,fact)*hn_lpf(i,lpf,fs2)*fs2/fs1;
+      }
+  }
+  thiz->frqgcd = frqgcd; thiz->osf = osf; thiz->fs1 = fs1; thiz->fs2 = fs2;
+  thiz->n1 = n1; thiz->n1b = n1b; thiz->n2 = n2; thiz->n2x = n2x; thiz->n2y = n2y;
+  thiz->polyphase = stage2; thiz->order = f2order; thiz->inc = f2inc;
+  thiz->spectrum = stage1;
+  thiz->dftf = dftf; thiz->dftb = dftb;
+
+  {
+    int n1b2 = n1b/2;
+
+    //    |....B....|....C....|   buf1      n1b2+n1b2
+    //|.A.|....D....|             buf2  n2x+n1b2
+    //
+    // B : the input, zero-stuffed to fs1 ; C : zero
+    // BC : apply the stage 1 filter (by FFT)
+    // D : B + the tail (C) of the previous block
+    // AD : apply the stage 2 filter (polyphase)
+    // A : the end of D ; the next D : C
+
+    thiz->buf1 = malloc(sizeof(REAL *)*nch);
+    for(i=0;i<nch;i++) thiz->buf1[i] = SleefDFT_malloc(sizeof(REAL) * n1b);
+
+    thiz->buf2 = malloc(sizeof(REAL *)*nch);
+    for(i=0;i<nch;i++) thiz->buf2[i] = calloc(n2x+1+n1b2,sizeof(REAL));
+
+    thiz->inbuf = calloc(nch*(n1b2/osf+osf+1),sizeof(REAL));
+    thiz->outbuf = calloc(nch*((double)n1b2*sfrq/dfrq+1),sizeof(REAL));
+
+    thiz->delay = (double)n1/2/((double)fs1/dfrq)+(double)n2/2/((double)fs2/dfrq);
+  }
+}
+//}}}
+//{{{
+static int downsample_need (SSRCEngine *thiz) {
+
+  return (thiz->n1b/2-thiz->rps-1)/thiz->osf+1;
+  }
+//}}}
+//{{{
+// downsample_block : filter the current block (thiz->need frames at inbuf), returns the number of frames in outbuf
+static int downsample_block (SSRCEngine *thiz)
+{
+  int nch = thiz->nch, nthreads = thiz->nthreads;
+  int64_t dfrq = thiz->dfrq;
+  int64_t osf = thiz->osf, fs1 = thiz->fs1, fs2 = thiz->fs2;
+  int64_t n2x = thiz->n2x, n2y = thiz->n2y, n1b = thiz->n1b;
+  REAL *stage1 = thiz->spectrum, **stage2 = thiz->polyphase;
+  int *f2order = thiz->order, *f2inc = thiz->inc;
+  struct SleefDFT **dftf = thiz->dftf, **dftb = thiz->dftb;
+  REAL **buf1 = thiz->buf1, **buf2 = thiz->buf2;
+  REAL *inbuf = thiz->inbuf, *op = thiz->outbuf;
+  int n1b2 = n1b/2;
+  int rps = thiz->rps, s2p = thiz->s2p, rp2 = thiz->rp2;
+  int nsmplwrt2 = 0;
+  REAL *bp;
+  int rps_backup,s2p_backup;
+  int i,j,k,ch,p;
+
+  rps_backup = rps;
+  s2p_backup = s2p;
+
+  // filter the channels concurrently (see upsample())
+#pragma omp parallel for num_threads(nthreads) if(nthreads > 1 && nch > 1) private(i,j,k,p,bp) lastprivate(rps,s2p,nsmplwrt2)
+  for(ch=0;ch<nch;ch++)
+    {
+      rps = rps_backup;
+
+      for(k=0;k<rps;k++) buf1[ch][k] = 0;
+
+      for(i=rps,j=0;i<n1b2;i+=osf,j++)
+        {
+    assert(j < ((n1b2-rps-1)/osf+1));
+
+    buf1[ch][i] = inbuf[j*nch+ch];
+
+    for(k=i+1;k<i+osf;k++) buf1[ch][k] = 0;
+        }
+
+      assert(j == ((n1b2-rps-1)/osf+1));
+
+      for(k=n1b2;k<n1b;k++) buf1[ch][k] = 0;
+
+      rps = i - n1b2;
+
+      SleefDFT_execute(dftf[ch], buf1[ch], buf1[ch]);
+
+      buf1[ch][0] = stage1[0]*buf1[ch][0];
+      buf1[ch][1] = stage1[1]*buf1[ch][1];
+
+      for(i=1;i<n1b2;i++)
+        {
+    REAL re,im;
+
+    re = stage1[i*2  ]*buf1[ch][i*2] - stage1[i*2+1]*buf1[ch][i*2+1];
+    im = stage1[i*2+1]*buf1[ch][i*2] + stage1[i*2  ]*buf1[ch][i*2+1];
+
+    buf1[ch][i*2  ] = re;
+    buf1[ch][i*2+1] = im;
+        }
+
+      SleefDFT_execute(dftb[ch], buf1[ch], buf1[ch]);
+
+      for(i=0;i<n1b2;i++) {
+        buf2[ch][n2x+1+i] += buf1[ch][i];
+      }
+
+      {
+        int t1 = rp2/(fs2/fs1);
+        if (rp2%(fs2/fs1) != 0) t1++;
+
+        bp = &(buf2[ch][t1]);
+      }
+
+      s2p = s2p_backup;
+
+      for(p=0;bp-buf2[ch]<n1b2+1;p++)
+        {
+    REAL tmp = 0;
+    REAL *bp2;
+    int s;
+    int s2o;
+
+    bp2 = bp;
+    s2o = f2order[s2p];
+    bp += f2inc[s2p];
+    s2p++;
+
+    if (s2p == n2y) s2p = 0;
+
+    assert((bp2-&(buf2[ch][0]))*(fs2/fs1)-(rp2+p*(fs2/dfrq)) == s2o);
+
+    for(i=0;i<n2x;i++)
+      tmp += stage2[s2o][i] * *bp2++;
+
+    op[p*nch+ch] = tmp;
+        }
+
+      nsmplwrt2 = p;
+    }
+
+  rp2 += nsmplwrt2 * (fs2 / dfrq);
+
+  {
+    int ds = (rp2-1)/(fs2/fs1);
+
+    if (ds > n1b2) ds = n1b2;
+
+    for(ch=0;ch<nch;ch++)
+      memmove(buf2[ch],buf2[ch]+ds,sizeof(REAL)*(n2x+1+n1b2-ds));
+
+    rp2 -= ds*(fs2/fs1);
+  }
+
+  for(ch=0;ch<nch;ch++)
+    memcpy(buf2[ch]+n2x+1,buf1[ch]+n1b2,sizeof(REAL)*n1b2);
+
+  thiz->rps = rps;
+  thiz->s2p = s2p;
+  thiz->rp2 = rp2;
+
+  return nsmplwrt2;
+}
+//}}}
+
+//{{{
+// output_end : the number of frames of output for the input pushed so far, floor(input frames * dfrq / sfrq) + 2
+// (and the delay, if it's kept)
+static int64_t output_end (SSRCEngine *thiz) {
+
+  return (int64_t)floor((double)thiz->sumread*thiz->dfrq/thiz->sfrq)+2 + (thiz->keepdelay ? thiz->latency : 0);
+  }
+//}}}
+//{{{
+// emit : append n frames of output to the fifo, after the delay, and up to the end of the output once flushed
+static void emit (SSRCEngine *thiz, const REAL *out, int64_t n) {
+
+  int nch = thiz->nch;
+  int64_t skip = n < thiz->delay ? n : thiz->delay;
+
+  if (thiz->keepdelay) skip = 0;
+  out += skip*nch;
+  n -= skip;
+  thiz->delay -= skip;
+
+  if (thiz->ending && thiz->mode != 0) {
+    int64_t end = output_end(thiz);
+    if (n > end-thiz->sumwrite) n = end-thiz->sumwrite;
+    }
+  if (n <= 0)
+    return;
+
+  if (thiz->fifopos > 0) {
+    memmove(thiz->fifo,thiz->fifo+thiz->fifopos*nch,sizeof(REAL)*nch*(thiz->fifolen-thiz->fifopos));
+    thiz->fifolen -= thiz->fifopos;
+    thiz->fifopos = 0;
+    }
+  if (thiz->fifolen+n > thiz->fifocap) {
+    while (thiz->fifolen+n > thiz->fifocap) thiz->fifocap *= 2;
+    thiz->fifo = realloc(thiz->fifo,sizeof(REAL)*nch*thiz->fifocap);
+    }
+
+  memcpy(thiz->fifo+thiz->fifolen*nch,out,sizeof(REAL)*nch*n);
+  thiz->fifolen += n;
+  thiz->sumwrite += n;
+  }
+//}}}
+//{{{
+// run_block : filter the current block. If it isn't full (at the end), upsampling pads it with zeros; downsampling
+// leaves the rest of the block as the previous block left it, as ssrc has always done, so that the output is unchanged
+static void run_block (SSRCEngine *thiz) {
+
+  int nch = thiz->nch;
+  int n;
+
+  if (thiz->mode == 1) {
+    memset(thiz->inbuf+nch*(thiz->inbuflen+thiz->nin),0,sizeof(REAL)*nch*(thiz->need-thiz->nin));
+    n = upsample_block(thiz);
+    thiz->nin = 0;
+    thiz->need = upsample_need(thiz);
+    }
+  else {
+    n = downsample_block(thiz);
+    thiz->nin = 0;
+    thiz->need = downsample_need(thiz);
+    }
+
+  emit(thiz,thiz->outbuf,n);
+  }
+//}}}
+
+//{{{
+void SSRCEngine_setPlanFile (const char *path) {
+
+  SleefDFT_setPlanFilePath(path,SLEEF_PLAN_AUTOMATIC);
+  planMode = path ? SLEEF_MODE_MEASURE : SLEEF_MODE_ESTIMATE;
+  }
+//}}}
+//{{{
+int SSRCEngine_isSupported (int64_t sfrq, int64_t dfrq) {
+
+  int64_t r;
+  if (sfrq <= 0 || dfrq <= 0) return 0;
+  if (sfrq == dfrq) return 1;
+
+  r = (sfrq < dfrq ? sfrq : dfrq) / gcd(sfrq,dfrq);
+  return r == 1 || r % 2 == 0 || r % 3 == 0;
+  }
+//}}}
+//{{{
+SSRCEngine *SSRCEngine_init (int nch, int64_t sfrq, int64_t dfrq, double stopband, double transition, int nthreads) {
+
+  SSRCEngine *thiz;
+  double fact[M+1];
+  int i,j;
+
+  if (nch <= 0 || !SSRCEngine_isSupported(sfrq,dfrq)) return NULL;
+
+  for (i=0;i<=M;i++) {
+    fact[i] = 1;
+    for(j=1;j<=i;j++)
+      fact[i] *= j;
+    }
+
+  if (sfrq < dfrq && transition < sfrq/24.0) transition = sfrq/24.0;
+  if (dfrq < sfrq && transition < dfrq/24.0) transition = dfrq/24.0;
+
+  thiz = calloc(1,sizeof(SSRCEngine));
+  thiz->magic = MAGIC;
+  thiz->nch = nch;
+  thiz->nthreads = nthreads < 1 ? 1 : nthreads;
+  thiz->sfrq = sfrq;
+  thiz->dfrq = dfrq;
+
+  if (sfrq < dfrq) {
+    thiz->mode = 1;
+    upsample_init(thiz,stopband,transition,fact);
+    thiz->need = upsample_need(thiz);
+    thiz->fifocap = 2*(thiz->n2b/2/thiz->osf+1);
+    }
+  else if (sfrq > dfrq) {
+    thiz->mode = 2;
+    downsample_init(thiz,stopband,transition,fact);
+    thiz->need = downsample_need(thiz);
+    thiz->fifocap = 2*(int64_t)((double)(thiz->n1b/2)*sfrq/dfrq+1);
+    }
+  else
+    thiz->fifocap = 4096;
+
+  thiz->latency = thiz->delay;
+  thiz->fifo = malloc(sizeof(REAL)*nch*thiz->fifocap);
+
+  return thiz;
+  }
+//}}}
+//{{{
+void SSRCEngine_dispose (SSRCEngine *thiz) {
+
+  int i;
+  assert(thiz != NULL && thiz->magic == MAGIC);
+
+  if (thiz->mode != 0) {
+    for(i=0;i<thiz->nch;i++) {
+      SleefDFT_dispose(thiz->dftf[i]);
+      SleefDFT_dispose(thiz->dftb[i]);
+      }
+    free(thiz->dftf);
+    free(thiz->dftb);
+
+    if (thiz->mode == 1) {
+      free(thiz->polyphase[0]);
+      free(thiz->polyphase);
+      SleefDFT_free(thiz->spectrum);
+      for(i=0;i<thiz->nch;i++) free(thiz->buf1[i]);
+      for(i=0;i<thiz->nch;i++) SleefDFT_free(thiz->buf2[i]);
+      }
+    else {
+      free(thiz->polyphase[0]);
+      free(thiz->polyphase);
+      SleefDFT_free(thiz->spectrum);
+      for(i=0;i<thiz->nch;i++) SleefDFT_free(thiz->buf1[i]);
+      for(i=0;i<thiz->nch;i++) free(thiz->buf2[i]);
+      }
+    free(thiz->buf1);
+    free(thiz->buf2);
+    free(thiz->order);
+    free(thiz->inc);
+    free(thiz->inbuf);
+    free(thiz->outbuf);
+    }
+
+  free(thiz->fifo);
+  thiz->magic = 0;
+  free(thiz);
+  }
+//}}}
+
+//{{{
+void SSRCEngine_push (SSRCEngine *thiz, const REAL *in, int64_t nframes) {
+
+  int nch = thiz->nch;
+  assert(thiz != NULL && thiz->magic == MAGIC && !thiz->ending);
+
+  thiz->sumread += nframes;
+
+  if (thiz->mode == 0) {
+    emit(thiz,in,nframes);
+    return;
+    }
+
+  while (nframes > 0) {
+    int64_t n = thiz->need-thiz->nin;
+    REAL *dst = thiz->inbuf + nch*((thiz->mode == 1 ? thiz->inbuflen : 0)+thiz->nin);
+
+    if (n > nframes) n = nframes;
+    memcpy(dst,in,sizeof(REAL)*nch*n);
+    thiz->nin += n;
+    in += n*nch;
+    nframes -= n;
+
+    if (thiz->nin == thiz->need)
+      run_block(thiz);
+    }
+  }
+//}}}
+//{{{
+void SSRCEngine_flush (SSRCEngine *thiz) {
+
+  int64_t end;
+  assert(thiz != NULL && thiz->magic == MAGIC);
+
+  if (thiz->ending) return;
+  thiz->ending = 1;
+  if (thiz->mode == 0) return;
+
+  end = output_end(thiz);
+  if (thiz->sumwrite > end) {
+    // (output beyond the end can't have been pulled : see SSRCEngine_getAvailable())
+    thiz->fifolen -= thiz->sumwrite-end;
+    thiz->sumwrite = end;
+    }
+  while (thiz->sumwrite < end)
+    run_block(thiz);
+  }
+//}}}
+//{{{
+int64_t SSRCEngine_getAvailable (SSRCEngine *thiz) {
+
+  int64_t avail = thiz->fifolen-thiz->fifopos;
+
+  if (!thiz->ending && thiz->mode != 0) {
+    // the end of the output is floor(input frames * dfrq / sfrq) + 2, which can't be known until the input ends
+    int64_t end = output_end(thiz);
+    int64_t pulled = thiz->sumwrite-avail;
+    if (avail > end-pulled) avail = end-pulled;
+    }
+
+  return avail;
+  }
+//}}}
+//{{{
+int64_t SSRCEngine_pull (SSRCEngine *thiz, REAL *out, int64_t maxframes) {
+
+  int64_t n = SSRCEngine_getAvailable(thiz);
+  assert(thiz != NULL && thiz->magic == MAGIC);
+
+  if (n > maxframes) n = maxframes;
+  if (n <= 0) return 0;
+
+  memcpy(out,thiz->fifo+thiz->fifopos*thiz->nch,sizeof(REAL)*thiz->nch*n);
+  thiz->fifopos += n;
+
+  return n;
+  }
+//}}}
+//{{{
+void SSRCEngine_keepDelay (SSRCEngine *thiz) {
+
+  assert(thiz != NULL && thiz->magic == MAGIC && thiz->sumread == 0);
+  if (thiz->mode != 0) thiz->keepdelay = 1;
+  }
+//}}}
+//{{{
+int SSRCEngine_getLatency (SSRCEngine *thiz) {
+
+  return thiz->latency;
+  }
+//}}}
+//{{{
+int SSRCEngine_getBlockSize (SSRCEngine *thiz) {
+
+  if (thiz->mode == 1) return ceil((double)(thiz->n2b/2/thiz->osf)*thiz->sfrq/thiz->dfrq);
+  if (thiz->mode == 2) return thiz->n1b/2/thiz->osf;
+  return 1;
+  }
+//}}}
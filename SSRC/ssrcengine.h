@@ -0,0 +1,48 @@
+// ssrcengine.h : SSRC sampling rate conversion of interleaved blocks of samples in memory
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HIGHPREC
+typedef float SSRCEngine_real;
+#else
+typedef double SSRCEngine_real;
+#endif
+
+// stopband : stop band attenuation (dB), transition : maximum transition band width (Hz)
+// (ssrc --profile : short 96 / 2000, normal 140 / 2000, long 150 / 200). nthreads : threads filtering the channels (with OpenMP)
+// Returns NULL if the conversion isn't supported (see SSRCEngine_isSupported)
+struct SSRCEngine *SSRCEngine_init(int nch, int64_t sfrq, int64_t dfrq, double stopband, double transition, int nthreads);
+void SSRCEngine_dispose(struct SSRCEngine *thiz);
+
+// FFT plans : by default, estimated. With a plan file, they are measured once and kept in the file (for all engines of
+// the process, and later runs); the path through the butterflies may differ, so the output may differ in the last bit
+void SSRCEngine_setPlanFile(const char *path);
+
+// sfrq/gcd(sfrq,dfrq) (upsampling) or dfrq/gcd(sfrq,dfrq) (downsampling) must be 1 or divisible by 2 or 3
+int SSRCEngine_isSupported(int64_t sfrq, int64_t dfrq);
+
+// push nframes of input; any number of frames may be pushed at a time
+void SSRCEngine_push(struct SSRCEngine *thiz, const SSRCEngine_real *in, int64_t nframes);
+// end of input : the remaining output (to floor(input frames * dfrq / sfrq) + 2 frames in all) becomes available
+void SSRCEngine_flush(struct SSRCEngine *thiz);
+// pull up to maxframes of output, returns the number of frames pulled
+int64_t SSRCEngine_pull(struct SSRCEngine *thiz, SSRCEngine_real *out, int64_t maxframes);
+int64_t SSRCEngine_getAvailable(struct SSRCEngine *thiz);
+
+// The delay of the filters, in output frames. It is removed from the start of the output (output frame n corresponds to
+// input frame n * sfrq / dfrq), so output becomes available this much later than the input, rounded up to a whole block
+int SSRCEngine_getLatency(struct SSRCEngine *thiz);
+// Output the delay of the filters (getLatency frames, before output frame 0) rather than discarding it, for callers which
+// have to run it through something with state, as ssrc does its noise shapers. Call it before the first push
+void SSRCEngine_keepDelay(struct SSRCEngine *thiz);
+// The number of input frames the filters process at a time
+int SSRCEngine_getBlockSize(struct SSRCEngine *thiz);
+
+#ifdef __cplusplus
+}
+#endif
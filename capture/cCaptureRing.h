@@ -0,0 +1,192 @@
+// cCaptureRing.h - single producer ring of fixed size frames, shared by one or more readers
+#pragma once
+//{{{  includes
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+//}}}
+
+// - each frame is written once and reference counted, every reader (writer thread) sees the same samples, no copies
+// - a reader more than skipLag frames behind skips, and releases, its oldest frames, so a slow reader loses frames
+//   on its own, the others keep them, skipLag 0 never skips
+// - the producer (capture thread) never blocks, a frame still held by a reader drops the new frame for every reader,
+//   with skipping that only happens if a reader holds one frame for longer than the numFrames - skipLag frames left,
+//   the drop is counted against every reader still holding it
+// - a reader blocks in waitRead, the producer only takes its mutex to wake it when it is waiting
+class cCaptureRing {
+public:
+  typedef std::chrono::steady_clock::time_point tTime;
+
+  //{{{
+  cCaptureRing (int numFrames, int frameSamples, int numReaders = 1, int skipLag = 0) :
+      mNumFrames(numFrames), mFrameSamples(frameSamples), mNumReaders(numReaders),
+      mSkipLag(((skipLag > 0) && (skipLag < numFrames)) ? skipLag : numFrames),
+      mSamples(numFrames * frameSamples), mTimes(numFrames),
+      mRefs(new std::atomic<int>[numFrames]), mReaders(new cReader[numReaders]) {
+
+    for (int i = 0; i < numFrames; i++)
+      mRefs[i].store (0, std::memory_order_relaxed);
+    }
+  //}}}
+
+  int getFrameSamples() const { return mFrameSamples; }
+  int getNumReaders() const { return mNumReaders; }
+  int64_t getDropped() const { return mDropped.load (std::memory_order_relaxed); }
+  //{{{
+  bool isFull() const {
+    return mRefs[mTail.load (std::memory_order_relaxed) % mNumFrames].load (std::memory_order_acquire) != 0;
+    }
+  //}}}
+
+  // per reader backpressure, frames it caused to be dropped, frames it skipped, most frames it has been behind
+  int64_t getBlocked (int reader) const { return mReaders[reader].mBlocked.load (std::memory_order_relaxed); }
+  int64_t getSkipped (int reader) const { return mReaders[reader].mSkipped.load (std::memory_order_relaxed); }
+  int64_t getMaxLag (int reader) const { return mReaders[reader].mMaxLag.load (std::memory_order_relaxed); }
+
+  // producer
+  //{{{
+  float* getWriteFrame() {
+  // frame to fill, or nullptr if a reader still holds it
+
+    const uint64_t tail = mTail.load (std::memory_order_relaxed);
+    if (mRefs[tail % mNumFrames].load (std::memory_order_acquire) != 0) {
+      mDropped.fetch_add (1, std::memory_order_relaxed);
+      for (int i = 0; i < mNumReaders; i++)
+        if (tail - mReaders[i].mHead.load (std::memory_order_relaxed) >= (uint64_t)mNumFrames)
+          mReaders[i].mBlocked.fetch_add (1, std::memory_order_relaxed);
+      return nullptr;
+      }
+
+    return &mSamples[(tail % mNumFrames) * mFrameSamples];
+    }
+  //}}}
+  //{{{
+  void commitWrite (tTime captureTime) {
+
+    const uint64_t tail = mTail.load (std::memory_order_relaxed);
+    mTimes[tail % mNumFrames] = captureTime;
+    mRefs[tail % mNumFrames].store (mNumReaders, std::memory_order_relaxed);
+    mTail.store (tail + 1, std::memory_order_seq_cst);
+
+    for (int i = 0; i < mNumReaders; i++) {
+      cReader& reader = mReaders[i];
+      const int64_t lag = (int64_t)(tail + 1 - reader.mHead.load (std::memory_order_relaxed));
+      if (lag > reader.mMaxLag.load (std::memory_order_relaxed))
+        reader.mMaxLag.store (lag, std::memory_order_relaxed);
+      if (reader.mWaiting.load (std::memory_order_seq_cst))
+        notify (reader);
+      }
+    }
+  //}}}
+  //{{{
+  bool write (const float* samples, tTime captureTime) {
+
+    float* frame = getWriteFrame();
+    if (!frame)
+      return false;
+
+    memcpy (frame, samples, mFrameSamples * sizeof(float));
+    commitWrite (captureTime);
+    return true;
+    }
+  //}}}
+  //{{{
+  void close() {
+
+    mClosed.store (true, std::memory_order_seq_cst);
+    for (int i = 0; i < mNumReaders; i++)
+      notify (mReaders[i]);
+    }
+  //}}}
+
+  // readers
+  //{{{
+  const float* waitRead (int readerIndex, tTime& captureTime) {
+  // next frame for this reader, waits for the producer, nullptr once closed and drained
+
+    cReader& reader = mReaders[readerIndex];
+    while (true) {
+      uint64_t head = reader.mHead.load (std::memory_order_relaxed);
+      const uint64_t tail = mTail.load (std::memory_order_acquire);
+      if (tail != head) {
+        if (tail - head > (uint64_t)mSkipLag) {
+          // too far behind, release the oldest frames unread, only this reader loses them
+          const uint64_t skipTo = tail - mSkipLag;
+          for (uint64_t frame = head; frame < skipTo; frame++)
+            mRefs[frame % mNumFrames].fetch_sub (1, std::memory_order_acq_rel);
+          reader.mSkipped.fetch_add ((int64_t)(skipTo - head), std::memory_order_relaxed);
+          reader.mHead.store (skipTo, std::memory_order_relaxed);
+          head = skipTo;
+          }
+        captureTime = mTimes[head % mNumFrames];
+        return &mSamples[(head % mNumFrames) * mFrameSamples];
+        }
+      if (mClosed.load (std::memory_order_acquire) && (mTail.load (std::memory_order_acquire) == head))
+        return nullptr;
+
+      std::unique_lock<std::mutex> lock (reader.mMutex);
+      reader.mWaiting.store (true, std::memory_order_seq_cst);
+      reader.mCondition.wait (lock, [&]() {
+        return (mTail.load (std::memory_order_seq_cst) != head) || mClosed.load (std::memory_order_seq_cst); });
+      reader.mWaiting.store (false, std::memory_order_relaxed);
+      }
+    }
+  //}}}
+  //{{{
+  void releaseRead (int readerIndex) {
+  // the last reader to release a frame frees it for the producer
+
+    cReader& reader = mReaders[readerIndex];
+    const uint64_t head = reader.mHead.load (std::memory_order_relaxed);
+    reader.mHead.store (head + 1, std::memory_order_relaxed);
+    mRefs[head % mNumFrames].fetch_sub (1, std::memory_order_acq_rel);
+    }
+  //}}}
+
+private:
+  //{{{
+  struct cReader {
+    std::atomic<uint64_t> mHead = { 0 };
+    std::atomic<int64_t> mBlocked = { 0 };
+    std::atomic<int64_t> mSkipped = { 0 };
+    std::atomic<int64_t> mMaxLag = { 0 };
+
+    std::atomic<bool> mWaiting = { false };
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+
+    // keeps readers off each other's cache lines, padding rather than alignas, new[] only aligns it from c++17
+    char mPad[64];
+    };
+  //}}}
+  //{{{
+  static void notify (cReader& reader) {
+
+    std::lock_guard<std::mutex> lock (reader.mMutex);
+    reader.mCondition.notify_one();
+    }
+  //}}}
+
+  const int mNumFrames;
+  const int mFrameSamples;
+  const int mNumReaders;
+  const int mSkipLag;
+
+  std::vector<float> mSamples;
+  std::vector<tTime> mTimes;
+  std::unique_ptr<std::atomic<int>[]> mRefs;
+  std::unique_ptr<cReader[]> mReaders;
+
+  // producer written, each on its own cache line
+  char mPadTail[64];
+  std::atomic<uint64_t> mTail = { 0 };
+  char mPadDropped[64];
+  std::atomic<int64_t> mDropped = { 0 };
+  std::atomic<bool> mClosed = { false };
+  };
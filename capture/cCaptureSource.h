@@ -0,0 +1,48 @@
+// cCaptureSource.h - source of captured interleaved float frames, device, file or synthetic
+#pragma once
+//{{{  includes
+#include <stdint.h>
+
+#include <chrono>
+#include <thread>
+//}}}
+
+class cCaptureSource {
+public:
+  //{{{
+  cCaptureSource (bool paced) : mPaced(paced) {
+
+    mStartTime = std::chrono::steady_clock::now();
+    }
+  //}}}
+  virtual ~cCaptureSource() {}
+
+  virtual int getChannels() = 0;
+  virtual int getSampleRate() = 0;
+
+  // frameSize samples interleaved, nullptr if not ready yet or finished
+  virtual float* getFrame (int frameSize) = 0;
+  virtual bool isFinished() { return false; }
+
+  // a paced source delivers samples no faster than its sample rate, an unpaced one as fast as it is asked
+  bool isPaced() const { return mPaced; }
+  int64_t getSamples() const { return mSamples; }
+
+protected:
+  //{{{
+  void pace (int frameSize) {
+  // count frameSize more samples delivered, if paced wait until they would have been captured
+
+    mSamples += frameSize;
+    if (mPaced)
+      std::this_thread::sleep_until (
+        mStartTime + std::chrono::microseconds ((int64_t)(mSamples * 1000000 / getSampleRate())));
+    }
+  //}}}
+
+private:
+  const bool mPaced;
+
+  std::chrono::steady_clock::time_point mStartTime;
+  int64_t mSamples = 0;
+  };
@@ -0,0 +1,174 @@
+// cFileSource.h - replays a WAV or raw float file as a capture source
+#pragma once
+//{{{  includes
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "cCaptureSource.h"
+//}}}
+
+// - WAV, PCM 8,16,24,32 bit or float 32,64 bit, WAVE_FORMAT_EXTENSIBLE
+// - anything else is raw interleaved float 32 bit, channels and sampleRate as given
+class cFileSource : public cCaptureSource {
+public:
+  //{{{
+  cFileSource (const std::string& filename, int channels, int sampleRate, bool paced) :
+      cCaptureSource(paced), mChannels(channels), mSampleRate(sampleRate) {
+
+    mFile = fopen (filename.c_str(), "rb");
+    if (!mFile)
+      return;
+
+    const size_t len = filename.size();
+    if ((len > 4) && ((filename.compare (len-4, 4, ".wav") == 0) || (filename.compare (len-4, 4, ".WAV") == 0)))
+      mOk = readHeader();
+    else
+      mOk = true;
+    }
+  //}}}
+  //{{{
+  virtual ~cFileSource() {
+
+    if (mFile)
+      fclose (mFile);
+    }
+  //}}}
+
+  bool isOk() const { return mOk; }
+
+  virtual int getChannels() { return mChannels; }
+  virtual int getSampleRate() { return mSampleRate; }
+  virtual bool isFinished() { return mFinished; }
+
+  //{{{
+  virtual float* getFrame (int frameSize) {
+  // a short last frame is padded with silence
+
+    if (!mOk || mFinished)
+      return nullptr;
+
+    const int bytesPerSample = mBits / 8;
+    mBytes.resize ((size_t)frameSize * mChannels * bytesPerSample);
+    size_t want = mBytes.size();
+    if ((mDataLeft >= 0) && ((int64_t)want > mDataLeft))
+      want = (size_t)mDataLeft;
+    const size_t got = fread (mBytes.data(), 1, want, mFile);
+    if (mDataLeft >= 0)
+      mDataLeft -= got;
+
+    const size_t samples = got / bytesPerSample;
+    if (samples == 0) {
+      mFinished = true;
+      return nullptr;
+      }
+
+    mFrame.assign ((size_t)frameSize * mChannels, 0.f);
+    const uint8_t* src = mBytes.data();
+    for (size_t i = 0; i < samples; i++, src += bytesPerSample)
+      mFrame[i] = toFloat (src);
+
+    pace (frameSize);
+    return mFrame.data();
+    }
+  //}}}
+
+private:
+  //{{{
+  static uint32_t get32 (const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+  //}}}
+  //{{{
+  static uint16_t get16 (const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+    }
+  //}}}
+  //{{{
+  bool readHeader() {
+
+    uint8_t riff[12];
+    if ((fread (riff, 1, 12, mFile) != 12) || memcmp (riff, "RIFF", 4) || memcmp (riff + 8, "WAVE", 4))
+      return false;
+
+    bool gotFormat = false;
+    uint8_t chunk[8];
+    while (fread (chunk, 1, 8, mFile) == 8) {
+      const uint32_t chunkSize = get32 (chunk + 4);
+      if (!memcmp (chunk, "fmt ", 4)) {
+        //{{{  format
+        uint8_t format[40] = { 0 };
+        const uint32_t formatSize = chunkSize < sizeof(format) ? chunkSize : sizeof(format);
+        if ((chunkSize < 16) || (fread (format, 1, formatSize, mFile) != formatSize))
+          return false;
+        fseek (mFile, (long)(((chunkSize + 1) & ~1u) - formatSize), SEEK_CUR);
+
+        uint16_t formatTag = get16 (format);
+        if ((formatTag == 0xFFFE) && (formatSize >= 26))
+          // WAVE_FORMAT_EXTENSIBLE, the tag is the start of the subformat guid
+          formatTag = get16 (format + 24);
+
+        mChannels = get16 (format + 2);
+        mSampleRate = (int)get32 (format + 4);
+        mBits = get16 (format + 14);
+        mFloat = formatTag == 3;
+        if ((formatTag != 1) && !mFloat)
+          return false;
+        if (mFloat ? ((mBits != 32) && (mBits != 64)) : ((mBits < 8) || (mBits > 32) || (mBits % 8)))
+          return false;
+        if ((mChannels < 1) || (mSampleRate < 1))
+          return false;
+
+        gotFormat = true;
+        }
+        //}}}
+      else if (!memcmp (chunk, "data", 4)) {
+        mDataLeft = chunkSize;
+        return gotFormat;
+        }
+      else
+        fseek (mFile, (long)((chunkSize + 1) & ~1u), SEEK_CUR);
+      }
+
+    return false;
+    }
+  //}}}
+  //{{{
+  float toFloat (const uint8_t* p) const {
+
+    if (mFloat) {
+      if (mBits == 32) {
+        float value;
+        memcpy (&value, p, 4);
+        return value;
+        }
+      double value;
+      memcpy (&value, p, 8);
+      return (float)value;
+      }
+
+    switch (mBits) {
+      case 8:  return (p[0] - 128) / 128.f;
+      case 16: return (int16_t)get16 (p) / 32768.f;
+      case 24: return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.f;
+      default: return (int32_t)get32 (p) / 2147483648.f;
+      }
+    }
+  //}}}
+
+  int mChannels;
+  int mSampleRate;
+  int mBits = 32;
+  bool mFloat = true;
+
+  FILE* mFile = nullptr;
+  bool mOk = false;
+  bool mFinished = false;
+  int64_t mDataLeft = -1;
+
+  std::vector<uint8_t> mBytes;
+  std::vector<float> mFrame;
+  };
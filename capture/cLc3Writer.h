@@ -0,0 +1,93 @@
+// cLc3Writer.h - LC3plus encode interleaved float samples to a file of length prefixed frames
+#pragma once
+//{{{  includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "../LC3plus/lc3.h"
+  }
+//}}}
+
+class cLc3Writer {
+public:
+  //{{{
+  cLc3Writer (const std::string& filename, int channels, int sampleRate, int bitrate) : mChannels(channels) {
+
+    if (!lc3_channels_supported (channels) || !lc3_samplerate_supported (sampleRate))
+      return;
+
+    // lc3_enc_free_memory frees the encoder too
+    mEncoder = (LC3_Enc*)malloc (lc3_enc_get_size (sampleRate, channels));
+    if ((lc3_enc_init (mEncoder, sampleRate, channels) != LC3_OK) ||
+        ((sampleRate == 96000) && (lc3_enc_set_hrmode (mEncoder, 1) != LC3_OK)) ||
+        (lc3_enc_set_bitrate (mEncoder, bitrate) != LC3_OK)) {
+      lc3_enc_free_memory (mEncoder);
+      mEncoder = nullptr;
+      return;
+      }
+
+    mFrameSize = lc3_enc_get_input_samples (mEncoder);
+    mSamples.resize (channels * mFrameSize);
+    for (int channel = 0; channel < channels; channel++)
+      mChannelPtrs.push_back (&mSamples[channel * mFrameSize]);
+    mBytes.resize (LC3_MAX_BYTES);
+
+    if (!filename.empty())
+      mFile = fopen (filename.c_str(), "wb");
+    }
+  //}}}
+  //{{{
+  ~cLc3Writer() {
+
+    if (mEncoder)
+      lc3_enc_free_memory (mEncoder);
+    if (mFile)
+      fclose (mFile);
+    }
+  //}}}
+
+  bool isOk() const { return mEncoder != nullptr; }
+
+  //{{{
+  void write (const float* samples, int numSamples) {
+  // deinterleave into 24 bit, encode every whole lc3 frame, the remainder waits for the next write
+
+    for (int i = 0; i < numSamples; i++) {
+      for (int channel = 0; channel < mChannels; channel++) {
+        float value = samples[i * mChannels + channel] * 8388608.f;
+        value = value > 8388607.f ? 8388607.f : value < -8388608.f ? -8388608.f : value;
+        mChannelPtrs[channel][mFill] = (int32_t)value;
+        }
+
+      if (++mFill == mFrameSize) {
+        int numBytes = 0;
+        lc3_enc24 (mEncoder, mChannelPtrs.data(), mBytes.data(), &numBytes);
+        if (mFile) {
+          const uint8_t length[2] = { (uint8_t)numBytes, (uint8_t)(numBytes >> 8) };
+          fwrite (length, 1, 2, mFile);
+          fwrite (mBytes.data(), 1, numBytes, mFile);
+          }
+        mFill = 0;
+        }
+      }
+    }
+  //}}}
+
+private:
+  const int mChannels;
+
+  LC3_Enc* mEncoder = nullptr;
+  int mFrameSize = 0;
+
+  std::vector<int32_t> mSamples;
+  std::vector<int32_t*> mChannelPtrs;
+  int mFill = 0;
+
+  std::vector<uint8_t> mBytes;
+  FILE* mFile = nullptr;
+  };
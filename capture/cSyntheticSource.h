@@ -0,0 +1,44 @@
+// cSyntheticSource.h - sine tone capture source, stands in for the device
+#pragma once
+//{{{  includes
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "cCaptureSource.h"
+//}}}
+
+class cSyntheticSource : public cCaptureSource {
+public:
+  cSyntheticSource (int channels, int sampleRate, bool paced) :
+    cCaptureSource(paced), mChannels(channels), mSampleRate(sampleRate) {}
+  virtual ~cSyntheticSource() {}
+
+  virtual int getChannels() { return mChannels; }
+  virtual int getSampleRate() { return mSampleRate; }
+
+  //{{{
+  virtual float* getFrame (int frameSize) {
+
+    mFrame.resize (frameSize * mChannels);
+
+    const double kTwoPi = 6.283185307179586;
+    const int64_t samples = getSamples();
+    for (int i = 0; i < frameSize; i++) {
+      for (int channel = 0; channel < mChannels; channel++)
+        mFrame[i * mChannels + channel] =
+          0.25f * (float)sin (kTwoPi * (440.0 + 110.0 * channel) * (double)(samples + i) / mSampleRate);
+      }
+
+    pace (frameSize);
+    return mFrame.data();
+    }
+  //}}}
+
+private:
+  const int mChannels;
+  const int mSampleRate;
+
+  std::vector<float> mFrame;
+  };
@@ -0,0 +1,24 @@
+// cWasapiSource.h - WASAPI capture device as a capture source
+#pragma once
+//{{{  includes
+#include "../../shared/utils/cCaptureWASAPI.h"
+
+#include "cCaptureSource.h"
+//}}}
+
+class cWasapiSource : public cCaptureSource {
+public:
+  // paced by the device itself
+  cWasapiSource (int bufferSize) : cCaptureSource(true), mCapture(new cCaptureWASAPI (bufferSize)) {}
+  virtual ~cWasapiSource() { delete mCapture; }
+
+  cCaptureWASAPI* getCapture() { return mCapture; }
+
+  virtual int getChannels() { return mCapture->getChannels(); }
+  virtual int getSampleRate() { return mCapture->getWaveFormatEx()->nSamplesPerSec; }
+
+  virtual float* getFrame (int frameSize) { return (float*)mCapture->getFrame (frameSize); }
+
+private:
+  cCaptureWASAPI* mCapture;
+  };
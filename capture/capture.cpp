@@ -1,45 +1,325 @@
 // capture.cpp
 //{{{  includes
-#define _CRT_SECURE_NO_WARNINGS
-#define WIN32_LEAN_AND_MEAN
+#ifdef _WIN32
+  #define _CRT_SECURE_NO_WARNINGS
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#endif
 
 #include <stdio.h>
-#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "../../shared/utils/cLog.h"
-#include "../../shared/utils/cCaptureWASAPI.h"
-#include "../../shared/utils/audioHelpers.h"
+#ifdef _WIN32
+  #include "../../shared/utils/audioHelpers.h"
+  #include "cWasapiSource.h"
+#endif
+
+#include "cCaptureRing.h"
+#include "cFileSource.h"
+#include "cLc3Writer.h"
+#include "cSyntheticSource.h"
 //}}}
 
-int main() {
-  CoInitializeEx (NULL, COINIT_MULTITHREADED);
+//{{{
+struct sSink {
+  sSink (const std::string& name, std::function<void (const float*, int)> write) : mName(name), mWrite(write) {}
+
+  std::string mName;
+  std::function<void (const float*, int)> mWrite;
+
+  std::atomic<int64_t> mFrames = { 0 };
+  std::atomic<int64_t> mLatencySumUs = { 0 };
+  std::atomic<int64_t> mLatencyMaxUs = { 0 };
+  };
+//}}}
+//{{{
+void sinkThread (cCaptureRing& ring, int reader, int frameSize, sSink& sink) {
+// wait for frames, write them, latency is from capture to written
+
+  cCaptureRing::tTime captureTime;
+  while (auto framePtr = ring.waitRead (reader, captureTime)) {
+    sink.mWrite (framePtr, frameSize);
+    ring.releaseRead (reader);
+
+    auto latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - captureTime).count();
+    sink.mFrames.fetch_add (1, std::memory_order_relaxed);
+    sink.mLatencySumUs.fetch_add (latencyUs, std::memory_order_relaxed);
+    if (latencyUs > sink.mLatencyMaxUs.load (std::memory_order_relaxed))
+      sink.mLatencyMaxUs.store (latencyUs, std::memory_order_relaxed);
+    }
+  }
+//}}}
+//{{{
+void logStats (cCaptureRing& ring, std::vector<std::unique_ptr<sSink>>& sinks) {
+
+  cLog::log (LOGINFO, "dropped:%lld", (long long)ring.getDropped());
+  for (int i = 0; i < (int)sinks.size(); i++) {
+    sSink& sink = *sinks[i];
+    const int64_t frames = sink.mFrames.load();
+    cLog::log (LOGINFO, "- %-13s frames:%lld blocked:%lld skipped:%lld maxLag:%lld latency avg:%.2fms max:%.2fms",
+               sink.mName.c_str(), (long long)frames, (long long)ring.getBlocked (i), (long long)ring.getSkipped (i),
+               (long long)ring.getMaxLag (i),
+               frames ? sink.mLatencySumUs.load() / 1000.0 / frames : 0.0, sink.mLatencyMaxUs.load() / 1000.0);
+    }
+  }
+//}}}
+//{{{
+std::vector<int> parseLoads (const char* arg) {
+// comma separated microseconds, one per sink, the last one repeats for the sinks after it
+
+  std::vector<int> loads;
+  for (const char* p = arg; *p; ) {
+    loads.push_back (std::max (0, atoi (p)));
+    while (*p && (*p != ','))
+      p++;
+    if (*p)
+      p++;
+    }
 
+  return loads;
+  }
+//}}}
+//{{{
+std::vector<int> parseBitrates (const char* arg) {
+// comma separated bitrates
+
+  std::vector<int> bitrates;
+  for (const char* p = arg; *p; ) {
+    int bitrate = atoi (p);
+    if (bitrate > 0)
+      bitrates.push_back (bitrate);
+    while (*p && (*p != ','))
+      p++;
+    if (*p)
+      p++;
+    }
+
+  return bitrates;
+  }
+//}}}
+
+int main (int argc, char** argv) {
   cLog::init (LOGINFO, false, "",  "capture");
+
+  //{{{  args
+  bool synthetic = false;
+  std::string filename;
+  bool paced = true;
+  int seconds = 0;
+  int ringFrames = 64;
+  int skipLag = -1;
+  std::vector<int> loadUs;
+  int channels = 2;
+  int sampleRate = 48000;
+  std::vector<int> aacBitrates = { 128000 };
+  std::vector<int> lc3Bitrates;
+#ifdef _WIN32
+  std::string outPrefix = "D:/Capture/capture";
+#else
+  std::string outPrefix;
+#endif
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--synthetic"))
+      synthetic = true;
+    else if (!strcmp (argv[i], "--file") && (i+1 < argc))
+      filename = argv[++i];
+    else if (!strcmp (argv[i], "--unpaced"))
+      paced = false;
+    else if (!strcmp (argv[i], "--seconds") && (i+1 < argc))
+      seconds = atoi (argv[++i]);
+    else if (!strcmp (argv[i], "--ring") && (i+1 < argc))
+      ringFrames = std::max (2, atoi (argv[++i]));
+    else if (!strcmp (argv[i], "--skip") && (i+1 < argc))
+      skipLag = std::max (0, atoi (argv[++i]));
+    else if (!strcmp (argv[i], "--load") && (i+1 < argc))
+      loadUs = parseLoads (argv[++i]);
+    else if (!strcmp (argv[i], "--channels") && (i+1 < argc))
+      channels = std::max (1, atoi (argv[++i]));
+    else if (!strcmp (argv[i], "--rate") && (i+1 < argc))
+      sampleRate = std::max (1, atoi (argv[++i]));
+    else if (!strcmp (argv[i], "--aac") && (i+1 < argc))
+      aacBitrates = parseBitrates (argv[++i]);
+    else if (!strcmp (argv[i], "--lc3") && (i+1 < argc))
+      lc3Bitrates = parseBitrates (argv[++i]);
+    else if (!strcmp (argv[i], "--out") && (i+1 < argc))
+      outPrefix = argv[++i];
+    else {
+      cLog::log (LOGERROR, "usage: %s [--synthetic | --file wav/raw] [--unpaced] [--seconds n] [--ring frames] [--skip frames] [--load us,..]"
+                           " [--channels n] [--rate hz] [--aac bitrate,..] [--lc3 bitrate,..] [--out prefix]", argv[0]);
+      return 1;
+      }
+    }
+  //}}}
+
+  //{{{  source
+  cCaptureSource* source = nullptr;
+  if (!filename.empty()) {
+    auto fileSource = new cFileSource (filename, channels, sampleRate, paced);
+    if (!fileSource->isOk()) {
+      cLog::log (LOGERROR, "can't read %s", filename.c_str());
+      delete fileSource;
+      return 1;
+      }
+    source = fileSource;
+    }
+  else if (synthetic || !paced)
+    source = new cSyntheticSource (channels, sampleRate, paced);
+
+#ifdef _WIN32
+  CoInitializeEx (NULL, COINIT_MULTITHREADED);
   av_log_set_level (AV_LOG_VERBOSE);
   av_log_set_callback (cLog::avLogCallback);
 
-  auto capture = new cCaptureWASAPI (0x80000000);
-  cWavWriter wavWriter ("D:/Capture/capture.wav", capture->getWaveFormatEx());
-  cAacWriter aacWriter ("D:/Capture/capture.aac", capture->getChannels(), 48000, 128000);
+  cWasapiSource* wasapiSource = source ? nullptr : new cWasapiSource (0x80000000);
+  if (wasapiSource)
+    source = wasapiSource;
+#else
+  // no device, no writers, the pipeline is load tested against the file or synthetic sources and --load
+  if (!source)
+    source = new cSyntheticSource (channels, sampleRate, paced);
+#endif
 
-  const int frameSize = aacWriter.getFrameSize();
-  cLog::log (LOGINFO, "capture and encode with frameSize:%d", frameSize);
+  channels = source->getChannels();
+  sampleRate = source->getSampleRate();
+  //}}}
 
-  while (true) {
-    auto framePtr = capture->getFrame (frameSize);
-    if (framePtr) {
-      wavWriter.write (framePtr, frameSize);
-      aacWriter.write (framePtr, frameSize);
+  //{{{  sinks, the first aac writer sets the frameSize
+  std::vector<std::unique_ptr<sSink>> sinks;
+  int frameSize = 1024;
+
+#ifdef _WIN32
+  std::unique_ptr<cWavWriter> wavWriter;
+  if (wasapiSource && !outPrefix.empty()) {
+    wavWriter.reset (new cWavWriter ((outPrefix + ".wav").c_str(), wasapiSource->getCapture()->getWaveFormatEx()));
+    auto writer = wavWriter.get();
+    sinks.emplace_back (new sSink ("wav", [=](const float* samples, int numSamples) {
+      writer->write ((float*)samples, numSamples); }));
+    }
+
+  std::vector<std::unique_ptr<cAacWriter>> aacWriters;
+  for (auto bitrate : aacBitrates) {
+    aacWriters.emplace_back (new cAacWriter ((outPrefix + "_" + std::to_string (bitrate / 1000) + "k.aac").c_str(),
+                                             channels, 48000, bitrate));
+    auto writer = aacWriters.back().get();
+    sinks.emplace_back (new sSink ("aac_" + std::to_string (bitrate / 1000) + "k", [=](const float* samples, int numSamples) {
+      writer->write ((float*)samples, numSamples); }));
+    }
+  if (!aacWriters.empty())
+    frameSize = aacWriters.front()->getFrameSize();
+#else
+  // no wav, aac writers, their stub sinks only take the --load time, they are named as such in the stats
+  sinks.emplace_back (new sSink ("wav_stub", [](const float*, int) {}));
+  for (auto bitrate : aacBitrates)
+    sinks.emplace_back (new sSink ("aac_" + std::to_string (bitrate / 1000) + "k_stub", [](const float*, int) {}));
+#endif
+
+  std::vector<std::unique_ptr<cLc3Writer>> lc3Writers;
+  for (auto bitrate : lc3Bitrates) {
+    lc3Writers.emplace_back (new cLc3Writer (
+      outPrefix.empty() ? "" : outPrefix + "_" + std::to_string (bitrate / 1000) + "k.lc3", channels, sampleRate, bitrate));
+    auto writer = lc3Writers.back().get();
+    if (!writer->isOk()) {
+      cLog::log (LOGERROR, "lc3 can't encode %d channels at %dHz %d", channels, sampleRate, bitrate);
+      return 1;
       }
-    else
-      Sleep (10);
+    sinks.emplace_back (new sSink ("lc3_" + std::to_string (bitrate / 1000) + "k", [=](const float* samples, int numSamples) {
+      writer->write (samples, numSamples); }));
     }
 
-  delete (capture);
+  // simulated encoder load, per sink
+  for (int i = 0; (i < (int)sinks.size()) && !loadUs.empty(); i++) {
+    const int sinkLoadUs = loadUs[std::min (i, (int)loadUs.size() - 1)];
+    if (sinkLoadUs) {
+      auto& sink = sinks[i];
+      auto write = sink->mWrite;
+      sink->mWrite = [=](const float* samples, int numSamples) {
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds (sinkLoadUs);
+        write (samples, numSamples);
+        while (std::chrono::steady_clock::now() < until) {}
+        };
+      }
+    }
+  //}}}
+
+  // one ring, every sink reads the same frames, a sink more than skipLag frames behind skips its oldest frames,
+  // - paced, the default is half the ring, the other half is how long one write can take before every sink drops frames
+  // - unpaced, the default is never, the producer waits for the slowest sink, to measure throughput
+  if (skipLag < 0)
+    skipLag = source->isPaced() ? ringFrames / 2 : 0;
+
+  cLog::log (LOGINFO, "capture and encode with frameSize:%d channels:%d rate:%d ring:%d skip:%d sinks:%d %s%s",
+                      frameSize, channels, sampleRate, ringFrames, skipLag, (int)sinks.size(),
+                      !filename.empty() ? filename.c_str() : (synthetic || !paced) ? "synthetic" : "device",
+                      source->isPaced() ? "" : " unpaced");
+
+  cCaptureRing ring (ringFrames, frameSize * channels, (int)sinks.size(), skipLag);
+  std::vector<std::thread> sinkThreads;
+  for (int i = 0; i < (int)sinks.size(); i++)
+    sinkThreads.emplace_back (sinkThread, std::ref (ring), i, frameSize, std::ref (*sinks[i]));
+
+  //{{{  producer
+  std::atomic<bool> running = { true };
+  std::atomic<bool> finished = { false };
+  std::thread producerThread ([&]() {
+    while (running && !source->isFinished()) {
+      // cCaptureWASAPI has no event to wait on, it is polled here, not in the sinks
+      auto framePtr = source->getFrame (frameSize);
+      if (framePtr) {
+        // an unpaced source waits for the sinks rather than dropping, to measure their throughput
+        if (!source->isPaced()) {
+          while (running && ring.isFull())
+            std::this_thread::yield();
+          if (!running)
+            break;
+          }
+
+        ring.write (framePtr, std::chrono::steady_clock::now());
+        }
+      else if (!source->isFinished())
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+      }
+
+    ring.close();
+    finished = true;
+    });
+  //}}}
+
+  auto startTime = std::chrono::steady_clock::now();
+  for (int second = 0; (!seconds || (second < seconds)) && !finished; second++) {
+    for (int ms = 0; (ms < 1000) && !finished; ms += 10)
+      std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    logStats (ring, sinks);
+    }
+
+  running = false;
+  producerThread.join();
+  for (auto& thread : sinkThreads)
+    thread.join();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  logStats (ring, sinks);
+  int64_t written = sinks.empty() ? 0 : sinks.front()->mFrames.load();
+  for (auto& sink : sinks)
+    written = std::min (written, sink->mFrames.load());
+  cLog::log (LOGINFO, "%lld frames in %.3fs, %.1f frames/s, %.2fx realtime",
+             (long long)written, elapsed, written / elapsed, written * frameSize / (elapsed * sampleRate));
 
+  delete source;
+#ifdef _WIN32
   CoUninitialize();
+#endif
   return 0;
   }
@@ -0,0 +1,97 @@
+// cAllocCounter.cpp
+//{{{  includes
+#include <errno.h>
+#include <stddef.h>
+#if defined(ALLOC_COUNTER) && defined(_MSC_VER) && defined(_DEBUG)
+  #include <crtdbg.h>
+#endif
+
+#include "cAllocCounter.h"
+//}}}
+
+#if defined(ALLOC_COUNTER) && defined(__GLIBC__)
+  //{{{  glibc, interpose the allocators, forward to glibc's own
+  // __thread, not thread_local, it must not allocate on first use
+  static __thread std::atomic<int64_t>* gCounter = nullptr;
+
+  static inline void count() {
+    if (gCounter)
+      gCounter->fetch_add (1, std::memory_order_relaxed);
+    }
+
+  extern "C" {
+    void* __libc_malloc (size_t size);
+    void* __libc_calloc (size_t num, size_t size);
+    void* __libc_realloc (void* ptr, size_t size);
+    void* __libc_memalign (size_t alignment, size_t size);
+    void __libc_free (void* ptr);
+
+    void* malloc (size_t size) { count(); return __libc_malloc (size); }
+    void* calloc (size_t num, size_t size) { count(); return __libc_calloc (num, size); }
+    void* realloc (void* ptr, size_t size) { count(); return __libc_realloc (ptr, size); }
+    void* memalign (size_t alignment, size_t size) { count(); return __libc_memalign (alignment, size); }
+    void* aligned_alloc (size_t alignment, size_t size) { count(); return __libc_memalign (alignment, size); }
+    void free (void* ptr) { __libc_free (ptr); }
+
+    //{{{
+    int posix_memalign (void** ptr, size_t alignment, size_t size) {
+    // av_malloc's allocator
+
+      if ((alignment % sizeof(void*)) || (alignment & (alignment - 1)))
+        return EINVAL;
+
+      count();
+      void* p = __libc_memalign (alignment, size);
+      if (!p && size)
+        return ENOMEM;
+
+      *ptr = p;
+      return 0;
+      }
+    //}}}
+    }
+
+  bool cAllocCounter::isAvailable() { return true; }
+  //}}}
+#elif defined(ALLOC_COUNTER) && defined(_MSC_VER) && defined(_DEBUG)
+  //{{{  msvc debug crt, hook its heap, FFmpeg's dlls have a crt of their own, their allocations aren't seen
+  static thread_local std::atomic<int64_t>* gCounter = nullptr;
+  static _CRT_ALLOC_HOOK gPreviousHook = nullptr;
+
+  //{{{
+  static int allocHook (int allocType, void* userData, size_t size, int blockType, long requestNumber,
+                        const unsigned char* filename, int lineNumber) {
+  // the crt's own blocks are its bookkeeping, not ours
+
+    if (gCounter && (blockType != _CRT_BLOCK) && ((allocType == _HOOK_ALLOC) || (allocType == _HOOK_REALLOC)))
+      gCounter->fetch_add (1, std::memory_order_relaxed);
+
+    return gPreviousHook ? gPreviousHook (allocType, userData, size, blockType, requestNumber, filename, lineNumber) : TRUE;
+    }
+  //}}}
+  //{{{
+  static bool installHook() {
+    gPreviousHook = _CrtSetAllocHook (allocHook);
+    return true;
+    }
+  //}}}
+  static const bool gHookInstalled = installHook();
+
+  bool cAllocCounter::isAvailable() { return gHookInstalled; }
+  //}}}
+#else
+  static thread_local std::atomic<int64_t>* gCounter = nullptr;
+
+  bool cAllocCounter::isAvailable() { return false; }
+#endif
+
+//{{{
+cAllocCounter::cScope::cScope (std::atomic<int64_t>& counter) : mPrevious(gCounter) {
+  gCounter = &counter;
+  }
+//}}}
+//{{{
+cAllocCounter::cScope::~cScope() {
+  gCounter = mPrevious;
+  }
+//}}}
@@ -0,0 +1,29 @@
+// cAllocCounter.h - count the heap allocations made on a job's threads, FFmpeg's own included
+#pragma once
+//{{{  includes
+#include <stdint.h>
+
+#include <atomic>
+//}}}
+
+// - glibc with ALLOC_COUNTER defined interposes malloc, calloc, realloc and the aligned allocators,
+//   operator new and av_malloc both end up in them, so the libraries' allocations are counted with the job's
+// - the msvc Debug build defines ALLOC_COUNTER, it hooks the debug crt heap with _CrtSetAllocHook,
+//   that counts this program's allocations, not those of FFmpeg's dlls, which have a crt of their own
+// - a thread counts into the counter of the innermost cScope it is in, threads outside any scope aren't counted
+// - anywhere else isAvailable() is false and nothing is counted
+class cAllocCounter {
+public:
+  static bool isAvailable();
+
+  //{{{
+  class cScope {
+  public:
+    cScope (std::atomic<int64_t>& counter);
+    ~cScope();
+
+  private:
+    std::atomic<int64_t>* mPrevious;
+    };
+  //}}}
+  };
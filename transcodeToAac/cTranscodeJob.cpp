@@ -0,0 +1,601 @@
+//{{{  based on transcode_aac.c example
+/*
+ * Copyright (c) 2013-2018 Andreas Unterweger
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+//}}}
+//{{{  includes
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+
+#include <thread>
+
+extern "C" {
+  #include "libavformat/avformat.h"
+  #include "libavformat/avio.h"
+
+  #include "libavcodec/avcodec.h"
+
+  #include "libavutil/audio_fifo.h"
+  #include "libavutil/avassert.h"
+  #include "libavutil/avstring.h"
+  #include "libavutil/frame.h"
+  #include "libavutil/opt.h"
+
+  #include "libswresample/swresample.h"
+  }
+
+#include "../../shared/utils/cLog.h"
+
+#include "cAllocCounter.h"
+#include "cTranscodeJob.h"
+//}}}
+
+// threaded, most output frames the decoder runs ahead of the encoder
+constexpr int kMaxFifoFrames = 16;
+
+//{{{
+cTranscodeJob::cTranscodeJob (const std::string& inFilename, const std::string& outFilename,
+                              int channels, int sampleRate, int bitRate) :
+    mInFilename(inFilename), mOutFilename(outFilename), mChannels(channels), mSampleRate(sampleRate), mBitRate(bitRate) {}
+//}}}
+//{{{
+cTranscodeJob::~cTranscodeJob() {
+  close();
+  }
+//}}}
+
+//{{{
+bool cTranscodeJob::run (bool threaded) {
+
+  mPts = 0;
+  mAllocations = 0;
+  mEncodedFrames = 0;
+
+  bool ok;
+  {
+  // count setup and transcode, not the teardown below
+  cAllocCounter::cScope allocScope (mAllocations);
+
+  ok = openInFile() && openOutFile() && openConverter();
+  if (ok && (avformat_write_header (mOutFormatContext, NULL) < 0)) {
+    cLog::log (LOGERROR, "error write header %s", mOutFilename.c_str());
+    ok = false;
+    }
+
+  if (ok)
+    ok = threaded ? transcodeThreaded() : transcode();
+  }
+
+  if (ok) {
+    // done, flush encoder delayed frames
+    bool flushingEncoder = true;
+    while (ok && flushingEncoder)
+      ok = encodeFrame (NULL, flushingEncoder);
+    }
+
+  if (ok)
+    ok = av_write_trailer (mOutFormatContext) >= 0;
+
+  close();
+  return ok;
+  }
+//}}}
+
+// private
+//{{{
+bool cTranscodeJob::openInFile() {
+
+  // Open the input file to read from it. */
+  int error = avformat_open_input (&mInFormatContext, mInFilename.c_str(), NULL, NULL);
+  if (error < 0) {
+    //{{{
+    cLog::log (LOGERROR, "Could not open input file %s", mInFilename.c_str());
+    mInFormatContext = NULL;
+    return false;
+    }
+    //}}}
+
+  // Get information on the input file (number of streams etc.). */
+  error = avformat_find_stream_info (mInFormatContext, NULL);
+  if (error < 0) {
+    //{{{
+    cLog::log (LOGINFO, "Could not open find stream info");
+    return false;
+    }
+    //}}}
+
+  // Make sure that there is only one stream in the input file. */
+  if (mInFormatContext->nb_streams != 1) {
+    //{{{
+    cLog::log (LOGERROR, "Expected one audio input stream, but found %d", mInFormatContext->nb_streams);
+    return false;
+    }
+    //}}}
+
+  // Find a decoder for the audio stream. */
+  AVCodec* input_codec = avcodec_find_decoder (mInFormatContext->streams[0]->codecpar->codec_id);
+  if (!input_codec) {
+    //{{{
+    cLog::log (LOGERROR, "Could not find input codec");
+    return false;
+    }
+    //}}}
+
+  // Allocate a new decoding context. */
+  mInCodecContext = avcodec_alloc_context3 (input_codec);
+  if (!mInCodecContext) {
+    //{{{
+    cLog::log (LOGERROR, "Could not allocate a decoding context");
+    return false;
+    }
+    //}}}
+
+  // Initialize the stream parameters with demuxer formation. */
+  error = avcodec_parameters_to_context (mInCodecContext, mInFormatContext->streams[0]->codecpar);
+  if (error < 0)
+    return false;
+
+  // Open the decoder for the audio stream to use it later. */
+  if ((error = avcodec_open2 (mInCodecContext, input_codec, NULL)) < 0) {
+    //{{{
+    cLog::log (LOGERROR, "Could not open input codec ");
+    return false;
+    }
+    //}}}
+
+  return true;
+  }
+//}}}
+//{{{
+bool cTranscodeJob::openOutFile() {
+
+  // Find the encoder to be used by its name
+  AVCodec* output_codec = avcodec_find_encoder (AV_CODEC_ID_AAC);
+  mOutCodecContext = avcodec_alloc_context3 (output_codec);
+
+  // Set the basic encoder parameters, input file's sample rate is used to avoid a sample rate conversion
+  mOutCodecContext->channels = mChannels;
+  mOutCodecContext->channel_layout = av_get_default_channel_layout (mChannels);
+  mOutCodecContext->sample_rate = mSampleRate;
+  mOutCodecContext->sample_fmt = output_codec->sample_fmts[0];
+  mOutCodecContext->bit_rate = mBitRate;
+  mOutCodecContext->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+
+  // Open the output file to write to it. */
+  AVIOContext* output_io_context = NULL;
+  if (avio_open (&output_io_context, mOutFilename.c_str(), AVIO_FLAG_WRITE) < 0) {
+    //{{{
+    cLog::log (LOGERROR, "Could not open output file %s", mOutFilename.c_str());
+    return false;
+    }
+    //}}}
+
+  // Create a new format context for the output container format
+  mOutFormatContext = avformat_alloc_context();
+  mOutFormatContext->pb = output_io_context;
+  mOutFormatContext->oformat = av_guess_format (NULL, mOutFilename.c_str(), NULL);
+
+  // Create a new audio stream in the output file container. */
+  AVStream* stream = avformat_new_stream (mOutFormatContext, NULL);
+  stream->time_base.den = mSampleRate;
+  stream->time_base.num = 1;
+
+  // Some container formats (like MP4) require global headers to be present
+  // Mark the encoder so that it behaves accordingly
+  if (mOutFormatContext->oformat->flags & AVFMT_GLOBALHEADER)
+    mOutCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+  // Open the encoder for the audio stream to use it later
+  //auto res = av_opt_set (codecContext->priv_data, "profile", "aac_he", 0);
+  //printf ("setopt %x", res);
+  if (avcodec_open2 (mOutCodecContext, output_codec, NULL) < 0) {
+    //{{{
+    cLog::log (LOGERROR, "Could not open output codec");
+    return false;
+    }
+    //}}}
+  avcodec_parameters_from_context (stream->codecpar, mOutCodecContext);
+
+  return true;
+  }
+//}}}
+//{{{
+bool cTranscodeJob::openConverter() {
+
+  // create swr_context for input to output conversion
+  mSwrContext = swr_alloc_set_opts (NULL,
+    av_get_default_channel_layout (mOutCodecContext->channels), mOutCodecContext->sample_fmt, mOutCodecContext->sample_rate,
+    av_get_default_channel_layout (mInCodecContext->channels), mInCodecContext->sample_fmt, mInCodecContext->sample_rate,
+    0, NULL);
+  if (!mSwrContext) {
+    //{{{
+    cLog::log (LOGERROR, "Could not allocate swr_contextt");
+    return false;
+    }
+    //}}}
+  if (swr_init (mSwrContext) < 0) {
+    //{{{
+    cLog::log (LOGERROR, "Could not init swr_context");
+    return false;
+    }
+    //}}}
+
+  // init converted samples FIFO, with room for the decoder to run ahead, it only grows if a decoded frame needs more
+  mFifo = av_audio_fifo_alloc (mOutCodecContext->sample_fmt, mOutCodecContext->channels,
+                               (kMaxFifoFrames + 2) * mOutCodecContext->frame_size);
+  if (!mFifo) {
+    //{{{
+    cLog::log (LOGERROR, "Could not allocate FIFO");
+    return false;
+    }
+    //}}}
+
+  // frames, packets reused for every decode, encode
+  mInFrame = av_frame_alloc();
+  mOutFrame = av_frame_alloc();
+  mInPacket = av_packet_alloc();
+  mOutPacket = av_packet_alloc();
+  if (!mInFrame || !mOutFrame || !mInPacket || !mOutPacket) {
+    //{{{
+    cLog::log (LOGERROR, "Could not allocate frames, packets");
+    return false;
+    }
+    //}}}
+
+  mOutFrame->nb_samples = mOutCodecContext->frame_size;
+  mOutFrame->channel_layout = mOutCodecContext->channel_layout;
+  mOutFrame->format = mOutCodecContext->sample_fmt;
+  mOutFrame->sample_rate = mOutCodecContext->sample_rate;
+  if (av_frame_get_buffer (mOutFrame, 0) < 0) {
+    //{{{
+    cLog::log (LOGERROR, "could not allocate output frame samples");
+    return false;
+    }
+    //}}}
+
+  // channel samples pointers for the conversion buffer, allocated by the first decoded frame
+  mConvertedSamples.assign (mOutCodecContext->channels, NULL);
+  mConvertedCapacity = 0;
+
+  return true;
+  }
+//}}}
+//{{{
+void cTranscodeJob::close() {
+
+  if (!mConvertedSamples.empty() && mConvertedSamples[0])
+    av_freep (&mConvertedSamples[0]);
+  mConvertedSamples.clear();
+  mConvertedCapacity = 0;
+
+  av_frame_free (&mInFrame);
+  av_frame_free (&mOutFrame);
+  av_packet_free (&mInPacket);
+  av_packet_free (&mOutPacket);
+
+  if (mFifo) {
+    av_audio_fifo_free (mFifo);
+    mFifo = NULL;
+    }
+
+  swr_free (&mSwrContext);
+
+  if (mOutCodecContext)
+    avcodec_free_context (&mOutCodecContext);
+
+  if (mOutFormatContext) {
+    avio_closep (&mOutFormatContext->pb);
+    avformat_free_context (mOutFormatContext);
+    mOutFormatContext = NULL;
+    }
+
+  if (mInCodecContext)
+    avcodec_free_context (&mInCodecContext);
+
+  if (mInFormatContext)
+    avformat_close_input (&mInFormatContext);
+  }
+//}}}
+
+//{{{
+bool cTranscodeJob::decodeFrame (AVFrame* frame, bool& hasData, bool& done) {
+
+  bool ok = false;
+  hasData = false;
+  done = false;
+
+  // Read one audio frame from the input file into the reused packet
+  int error = av_read_frame (mInFormatContext, mInPacket);
+  if (error < 0) {
+    // If we are at the end of the file, flush the decoder below
+    if (error == AVERROR_EOF)
+      done = true;
+    else {
+      cLog::log (LOGERROR, "error read frame");
+      return false;
+      }
+    }
+
+  // Send the audio frame stored in the packet to the decoder, input audio stream decoder is used to do this
+  error = avcodec_send_packet (mInCodecContext, mInPacket);
+  if (error < 0)
+    cLog::log (LOGERROR, "error send packet for decoding ");
+  else {
+    // Receive one frame from the decoder
+    // If the decoder asks for more data to be able to decode a frame, return indicating that no data is present
+    error = avcodec_receive_frame (mInCodecContext, frame);
+    if (error == AVERROR_EOF) {
+      ok = true;
+      done = true;
+      }
+    else if (error == AVERROR(EAGAIN))
+      ok = true;
+    else if (error < 0)
+      cLog::log (LOGERROR, "error decode frame");
+    else {
+      ok = true;
+      hasData = true;
+      }
+    }
+
+  av_packet_unref (mInPacket);
+  return ok;
+  }
+//}}}
+//{{{
+bool cTranscodeJob::readFileDecodeFrameConvertStoreFifo (bool& done) {
+
+  // decode into the reused input frame
+  bool hasData;
+  if (!decodeFrame (mInFrame, hasData, done))
+    return false;
+
+  // EOF, no more samples in decoder delayed, we are done but no error
+  if (done || !hasData) {
+    av_frame_unref (mInFrame);
+    return true;
+    }
+
+  // calc max numConvertedSamples
+  int numConvertedSamples = (int)av_rescale_rnd (
+    mInFrame->nb_samples + swr_get_delay (mSwrContext, mInFrame->sample_rate),
+    mOutCodecContext->sample_rate, mInFrame->sample_rate, AV_ROUND_UP);
+
+  if (numConvertedSamples > mConvertedCapacity) {
+    // grow conversion buffer, samples of all channels in one consecutive block
+    if (mConvertedSamples[0])
+      av_freep (&mConvertedSamples[0]);
+    if (av_samples_alloc (mConvertedSamples.data(), NULL, mOutCodecContext->channels,
+                          numConvertedSamples, mOutCodecContext->sample_fmt, 0) < 0) {
+      //{{{
+      cLog::log (LOGERROR, "error allocate converted samples");
+      av_frame_unref (mInFrame);
+      return false;
+      }
+      //}}}
+    mConvertedCapacity = numConvertedSamples;
+    }
+
+  // Convert input samples to output sample format
+  numConvertedSamples = swr_convert (mSwrContext, mConvertedSamples.data(), numConvertedSamples,
+                                     (const uint8_t**)mInFrame->extended_data, mInFrame->nb_samples);
+  cLog::log (LOGINFO1, "converted inputSampleRate:%d samples %d to %d",
+                       mInFrame->sample_rate, mInFrame->nb_samples, numConvertedSamples);
+  av_frame_unref (mInFrame);
+  if (numConvertedSamples < 0) {
+    //{{{
+    cLog::log (LOGERROR, "error convert input samples");
+    return false;
+    }
+    //}}}
+
+  // store converted samples, the encoder may be reading the fifo on another thread
+  std::lock_guard<std::mutex> lock (mFifoMutex);
+  if (av_audio_fifo_space (mFifo) < numConvertedSamples) {
+    // grow fifo, doubling
+    if (av_audio_fifo_realloc (mFifo, 2 * (av_audio_fifo_size (mFifo) + numConvertedSamples)) < 0) {
+      //{{{
+      cLog::log (LOGERROR, "error reallocate FIFO");
+      return false;
+      }
+      //}}}
+    }
+  if (av_audio_fifo_write (mFifo, (void**)mConvertedSamples.data(), numConvertedSamples) < numConvertedSamples) {
+    //{{{
+    cLog::log (LOGERROR, "error write FIFO");
+    return false;
+    }
+    //}}}
+
+  mFifoCondition.notify_all();
+  return true;
+  }
+//}}}
+
+//{{{
+bool cTranscodeJob::encodeFrame (AVFrame* frame, bool& hasData) {
+
+  bool ok = false;
+  hasData = false;
+
+  // Set a timestamp based on the sample rate for the container
+  if (frame) {
+    frame->pts = mPts;
+    mPts += frame->nb_samples;
+    }
+
+  // Send the audio frame to the encoder
+  // The output audio stream encoder is used to do this The encoder signals that it has nothing more to encode
+  int error = avcodec_send_frame (mOutCodecContext, frame);
+  if (error == AVERROR_EOF)
+    return true;
+  else if (error < 0) {
+    cLog::log (LOGERROR, "error send packet for encoding");
+    return false;
+    }
+
+  // Receive one encoded frame from the encoder into the reused packet
+  // If the encoder asks for more data to be able to provide an encoded frame, return indicating that no data is present
+  error = avcodec_receive_packet (mOutCodecContext, mOutPacket);
+  if (error == AVERROR(EAGAIN))
+    ok = true;
+  else if (error == AVERROR_EOF)
+    ok = true;
+  else if (error < 0)
+    cLog::log (LOGERROR, "error encode frame");
+  else {
+    ok = true;
+    hasData = true;
+    }
+
+  // Write one audio frame from the packet to the output file
+  if (hasData)
+    if (av_write_frame (mOutFormatContext, mOutPacket) < 0) {
+      ok = false;
+      cLog::log (LOGERROR, "error write frame");
+      }
+
+  av_packet_unref (mOutPacket);
+  return ok;
+  }
+//}}}
+//{{{
+bool cTranscodeJob::readFifoEncodeFrameWriteFile() {
+
+  // Use the maximum number of possible samples per frame.
+  // If there is less than the maximum possible frame size in the FIFO
+  // buffer use this number. Otherwise, use the maximum possible frame size
+  int frame_size;
+  {
+  std::lock_guard<std::mutex> lock (mFifoMutex);
+  frame_size = FFMIN (av_audio_fifo_size (mFifo), mOutCodecContext->frame_size);
+  }
+
+  // Reuse the output frame, it only needs new samples if the encoder still holds a reference to them
+  mOutFrame->nb_samples = mOutCodecContext->frame_size;
+  if (av_frame_make_writable (mOutFrame) < 0) {
+    //{{{
+    cLog::log (LOGERROR, "could not make output frame writable");
+    return false;
+    }
+    //}}}
+  mOutFrame->nb_samples = frame_size;
+
+  // Read as many samples from the FIFO buffer as required to fill the frame.
+  {
+  std::lock_guard<std::mutex> lock (mFifoMutex);
+  if (av_audio_fifo_read (mFifo, (void**)mOutFrame->data, frame_size) < frame_size) {
+    //{{{
+    cLog::log (LOGERROR, "could not read data from FIFO");
+    return false;
+    }
+    //}}}
+  mFifoCondition.notify_all();
+  }
+
+  // Encode one frame worth of audio samples
+  bool hasData = false;
+  if (!encodeFrame (mOutFrame, hasData))
+    return false;
+
+  if (mEncodedFrames < kSteadyFrames)
+    mFrameAllocations[mEncodedFrames] = mAllocations.load();
+  mEncodedFrames++;
+  return true;
+  }
+//}}}
+
+//{{{
+bool cTranscodeJob::transcode() {
+
+  bool inputDone = false;
+  while (!inputDone) {
+    // while some input and not enough output samples
+    while (!inputDone && (av_audio_fifo_size (mFifo) < mOutCodecContext->frame_size))
+      if (!readFileDecodeFrameConvertStoreFifo (inputDone))
+        return false;
+
+    // while enough output samples
+    while ((inputDone && (av_audio_fifo_size (mFifo) > 0)) || (av_audio_fifo_size (mFifo) >= mOutCodecContext->frame_size))
+      if (!readFifoEncodeFrameWriteFile())
+        return false;
+    }
+
+  return true;
+  }
+//}}}
+//{{{
+bool cTranscodeJob::transcodeThreaded() {
+// decode thread fills the fifo up to kMaxFifoFrames ahead, this thread encodes from it
+
+  const int frameSize = mOutCodecContext->frame_size;
+
+  bool inputDone = false;
+  bool decodeOk = true;
+  bool encodeFailed = false;
+
+  std::thread decodeThread ([&]() {
+    cAllocCounter::cScope allocScope (mAllocations);
+    bool done = false;
+    while (!done) {
+      {
+      std::unique_lock<std::mutex> lock (mFifoMutex);
+      mFifoCondition.wait (lock, [&]() {
+        return encodeFailed || (av_audio_fifo_size (mFifo) < kMaxFifoFrames * frameSize); });
+      if (encodeFailed)
+        break;
+      }
+
+      if (!readFileDecodeFrameConvertStoreFifo (done)) {
+        decodeOk = false;
+        break;
+        }
+      }
+
+    std::lock_guard<std::mutex> lock (mFifoMutex);
+    inputDone = true;
+    mFifoCondition.notify_all();
+    });
+
+  bool ok = true;
+  while (true) {
+    {
+    std::unique_lock<std::mutex> lock (mFifoMutex);
+    mFifoCondition.wait (lock, [&]() { return inputDone || (av_audio_fifo_size (mFifo) >= frameSize); });
+    if (inputDone && (!decodeOk || (av_audio_fifo_size (mFifo) == 0)))
+      break;
+    }
+
+    if (!readFifoEncodeFrameWriteFile()) {
+      ok = false;
+      break;
+      }
+    }
+
+  if (!ok) {
+    std::lock_guard<std::mutex> lock (mFifoMutex);
+    encodeFailed = true;
+    mFifoCondition.notify_all();
+    }
+
+  decodeThread.join();
+  return ok && decodeOk;
+  }
+//}}}
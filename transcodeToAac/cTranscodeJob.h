@@ -0,0 +1,100 @@
+// cTranscodeJob.h - transcode one audio file to aac, no global state, any number of jobs can run at once
+#pragma once
+//{{{  includes
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct AVAudioFifo;
+struct SwrContext;
+//}}}
+
+class cTranscodeJob {
+public:
+  cTranscodeJob (const std::string& inFilename, const std::string& outFilename,
+                 int channels = 2, int sampleRate = 44100, int bitRate = 128000);
+  ~cTranscodeJob();
+
+  // threaded : decode, convert on a thread of its own, encode, write on this one
+  bool run (bool threaded);
+
+  const std::string& getInFilename() const { return mInFilename; }
+  const std::string& getOutFilename() const { return mOutFilename; }
+
+  int64_t getOutSamples() const { return mPts; }
+  double getOutSeconds() const { return (double)mPts / mSampleRate; }
+
+  // frames, packets, conversion buffer, fifo are allocated once, grown only if a frame needs more,
+  // cAllocCounter counts the allocations made on the job's threads in a bench build, from opening the files to the last
+  // frame encoded, not the encoder flush, trailer and close. Steady state ones are those after the first kSteadyFrames
+  // encoded frames, or after the first half of a shorter file's.
+  // - the steady state ones are FFmpeg's own, its api has no way to avoid them, FFmpeg 4:
+  //   av_read_frame         - the demuxer gives each packet a new refcounted buffer, data, AVBuffer, AVBufferRef
+  //   avcodec_send_packet   - references the packet for the decoder, an AVBufferRef
+  //   avcodec_receive_frame - the decoder's frame buffers come from a pool, each plane still gets an AVBufferRef,
+  //                           and an AVBuffer before 4.4
+  //   avcodec_send_frame    - references mOutFrame for the encoder, an AVBufferRef a plane
+  //   avcodec_receive_packet- the aac encoder copies each packet into a new refcounted buffer, data, AVBuffer, AVBufferRef
+  int64_t getAllocations() const { return mAllocations; }
+  int64_t getSteadyAllocations() const {
+    return getWarmupFrames() ? mAllocations - mFrameAllocations[getWarmupFrames()-1] : 0; }
+  int64_t getSteadyFrames() const { return mEncodedFrames - getWarmupFrames(); }
+  int64_t getEncodedFrames() const { return mEncodedFrames; }
+
+private:
+  int64_t getWarmupFrames() const { return mEncodedFrames < 2*kSteadyFrames ? mEncodedFrames / 2 : kSteadyFrames; }
+
+  bool openInFile();
+  bool openOutFile();
+  bool openConverter();
+  void close();
+
+  bool decodeFrame (AVFrame* frame, bool& hasData, bool& done);
+  bool readFileDecodeFrameConvertStoreFifo (bool& done);
+
+  bool encodeFrame (AVFrame* frame, bool& hasData);
+  bool readFifoEncodeFrameWriteFile();
+
+  bool transcode();
+  bool transcodeThreaded();
+
+  const std::string mInFilename;
+  const std::string mOutFilename;
+  const int mChannels;
+  const int mSampleRate;
+  const int mBitRate;
+
+  AVFormatContext* mInFormatContext = nullptr;
+  AVCodecContext* mInCodecContext = nullptr;
+  AVFormatContext* mOutFormatContext = nullptr;
+  AVCodecContext* mOutCodecContext = nullptr;
+  SwrContext* mSwrContext = nullptr;
+  AVAudioFifo* mFifo = nullptr;
+
+  // reused
+  AVFrame* mInFrame = nullptr;
+  AVFrame* mOutFrame = nullptr;
+  AVPacket* mInPacket = nullptr;
+  AVPacket* mOutPacket = nullptr;
+  std::vector<uint8_t*> mConvertedSamples;
+  int mConvertedCapacity = 0;
+
+  int64_t mPts = 0;
+
+  static constexpr int kSteadyFrames = 16;
+  std::atomic<int64_t> mAllocations = { 0 };
+  int64_t mFrameAllocations[kSteadyFrames] = {}; // mAllocations after each of the first encoded frames
+  int64_t mEncodedFrames = 0;
+
+  // fifo shared by the decode and encode threads
+  std::mutex mFifoMutex;
+  std::condition_variable mFifoCondition;
+  };
@@ -24,390 +24,75 @@
 #define WIN32_LEAN_AND_MEAN
 
 #include <stdio.h>
-#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+  #include <windows.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
 extern "C" {
-  #include "libavformat/avformat.h"
-  #include "libavformat/avio.h"
-
-  #include "libavcodec/avcodec.h"
-
-  #include "libavutil/audio_fifo.h"
-  #include "libavutil/avassert.h"
-  #include "libavutil/avstring.h"
-  #include "libavutil/frame.h"
-  #include "libavutil/opt.h"
-
-  #include "libswresample/swresample.h"
+  #include "libavutil/log.h"
   }
 
-#include "../../shared/utils/utils.h"
 #include "../../shared/utils/cLog.h"
-#include "../../shared/utils/cBipBuffer.h"
-//}}}
-
-#define OUTPUT_CHANNELS 2
-#define OUTPUT_BIT_RATE 128000
-#define OUTPUT_SAMPLE_RATE 44100
 
-static int64_t pts = 0;
-
-//{{{
-bool openInFile (const char* filename, AVFormatContext*& formatContext, AVCodecContext*& codecContext) {
-
-  // Open the input file to read from it. */
-  int error = avformat_open_input (&formatContext, filename, NULL, NULL);
-  if (error < 0) {
-    //{{{
-    cLog::log (LOGERROR, "Could not open input file");
-    formatContext = NULL;
-    return false;
-    }
-    //}}}
-
-  // Get information on the input file (number of streams etc.). */
-  error = avformat_find_stream_info (formatContext, NULL);
-  if (error < 0) {
-    //{{{
-    cLog::log (LOGINFO, "Could not open find stream info");
-    avformat_close_input (&formatContext);
-    return false;
-    }
-    //}}}
-
-  // Make sure that there is only one stream in the input file. */
-  if (formatContext->nb_streams != 1) {
-    //{{{
-    cLog::log (LOGERROR, "Expected one audio input stream, but found %d", formatContext->nb_streams);
-    avformat_close_input (&formatContext);
-    return false;
-    }
-    //}}}
-
-  // Find a decoder for the audio stream. */
-  AVCodec* input_codec = avcodec_find_decoder (formatContext->streams[0]->codecpar->codec_id);
-  if (!input_codec) {
-    //{{{
-    cLog::log (LOGERROR, "Could not find input codec");
-    avformat_close_input (&formatContext);
-    return false;
-    }
-    //}}}
-
-  // Allocate a new decoding context. */
-  codecContext = avcodec_alloc_context3 (input_codec);
-  if (!codecContext) {
-    //{{{
-    cLog::log (LOGERROR, "Could not allocate a decoding context");
-    avformat_close_input (&formatContext);
-    return false;
-    }
-    //}}}
-
-  // Initialize the stream parameters with demuxer formation. */
-  error = avcodec_parameters_to_context (codecContext, formatContext->streams[0]->codecpar);
-  if (error < 0) {
-    avformat_close_input (&formatContext);
-    avcodec_free_context (&codecContext);
-    return false;
-    }
-
-  // Open the decoder for the audio stream to use it later. */
-  if ((error = avcodec_open2 (codecContext, input_codec, NULL)) < 0) {
-    //{{{
-    cLog::log (LOGERROR, "Could not open input codec ");
-    avcodec_free_context (&codecContext);
-    avformat_close_input (&formatContext);
-    return false;
-    }
-    //}}}
-
-  return true;
-  }
-//}}}
-//{{{
-bool openOutFile (const char* filename, AVFormatContext*& formatContext, AVCodecContext*& codecContext) {
-
-  // Find the encoder to be used by its name
-  AVCodec* output_codec = avcodec_find_encoder (AV_CODEC_ID_AAC);
-  codecContext = avcodec_alloc_context3 (output_codec);
-
-  // Set the basic encoder parameters, input file's sample rate is used to avoid a sample rate conversion
-  codecContext->channels = OUTPUT_CHANNELS;
-  codecContext->channel_layout = av_get_default_channel_layout (OUTPUT_CHANNELS);
-  codecContext->sample_rate = OUTPUT_SAMPLE_RATE;
-  codecContext->sample_fmt = output_codec->sample_fmts[0];
-  codecContext->bit_rate = OUTPUT_BIT_RATE;
-  codecContext->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
-
-  // Open the output file to write to it. */
-  AVIOContext* output_io_context;
-  int error = avio_open (&output_io_context, filename, AVIO_FLAG_WRITE);
-
-  // Create a new format context for the output container format
-  formatContext = avformat_alloc_context();
-  formatContext->pb = output_io_context;
-  formatContext->oformat = av_guess_format (NULL, filename, NULL);
-
-  // Create a new audio stream in the output file container. */
-  AVStream* stream = avformat_new_stream (formatContext, NULL);
-  stream->time_base.den = OUTPUT_SAMPLE_RATE;
-  stream->time_base.num = 1;
-
-  // Some container formats (like MP4) require global headers to be present
-  // Mark the encoder so that it behaves accordingly
-  if (formatContext->oformat->flags & AVFMT_GLOBALHEADER)
-    codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-
-  // Open the encoder for the audio stream to use it later
-  //auto res = av_opt_set (codecContext->priv_data, "profile", "aac_he", 0);
-  //printf ("setopt %x", res);
-  error = avcodec_open2 (codecContext, output_codec, NULL);
-  error = avcodec_parameters_from_context (stream->codecpar, codecContext);
-
-  return true;
-  }
+#include "cAllocCounter.h"
+#include "cTranscodeJob.h"
 //}}}
 
 //{{{
-bool decodeFrame (AVFrame* frame, AVFormatContext* inFormatContext, AVCodecContext* inCodecContext, bool& hasData, bool& done) {
+std::string aacFilename (const std::string& filename) {
+// filename with its extension replaced by .aac
 
-  bool ok = false;
-  hasData = false;
-  done = false;
+  size_t dot = filename.find_last_of ('.');
+  size_t slash = filename.find_last_of ("/\\");
+  if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash)))
+    return filename + ".aac";
 
-  // Packet used for temporary storage
-  AVPacket packet;
-  av_init_packet (&packet);
-  packet.data = NULL;
-  packet.size = 0;
-
-  // Read one audio frame from the input file into a temporary packet
-  int error = av_read_frame (inFormatContext, &packet);
-  if (error < 0) {
-    // If we are at the end of the file, flush the decoder below
-    if (error == AVERROR_EOF)
-      done = true;
-    else {
-      cLog::log (LOGERROR, "error read frame");
-      return false;
-      }
-    }
-
-  // Send the audio frame stored in the temporary packet to the decoder, input audio stream decoder is used to do this
-  error = avcodec_send_packet (inCodecContext, &packet);
-  if (error < 0)
-    cLog::log (LOGERROR, "error send packet for decoding ");
-  else {
-    // Receive one frame from the decoder
-    // If the decoder asks for more data to be able to decode a frame, return indicating that no data is present
-    error = avcodec_receive_frame (inCodecContext, frame);
-    if (error == AVERROR_EOF) {
-      ok = true;
-      done = true;
-      }
-    else if (error == AVERROR(EAGAIN))
-      ok = true;
-    else if (error < 0)
-      cLog::log (LOGERROR, "error decode frame");
-    else {
-      ok = true;
-      hasData = true;
-      }
-    }
-
-  av_packet_unref (&packet);
-  return ok;
+  return filename.substr (0, dot) + ".aac";
   }
 //}}}
 //{{{
-bool readFileDecodeFrameConvertStoreFifo (AVFormatContext* inFormatContext, AVCodecContext* inCodecContext,
-                                          AVCodecContext* outCodecContext, SwrContext* swrContext,
-                                          AVAudioFifo* fifo, bool& done) {
-
-  bool ok = false;
-  uint8_t** convertedSamples = NULL;
+bool readManifest (const char* filename, std::vector<std::pair<std::string,std::string>>& files) {
+// a line per file, input, or input <tab> output, paths as they are, spaces included
+// - output defaults to input.aac, blank lines and lines starting with # are ignored
 
-  // Initialize temporary storage for one input frame, decode it
-  AVFrame* frame = av_frame_alloc();
-  if (!frame) {
-    //{{{
-    cLog::log (LOGERROR, "error allocate input frame");
-    goto cleanup;
-    }
-    //}}}
-
-  bool hasData;
-  if (!decodeFrame (frame, inFormatContext, inCodecContext, hasData, done))
-    goto cleanup;
-
-  // EOF, no more samples in decoder delayed, we are done but no error
-  if (!done) {
-    // If decoded data, convert and store it
-    if (hasData) {
-      // calc max numConvertedSamples
-      int numConvertedSamples = (int)av_rescale_rnd (
-        frame->nb_samples + swr_get_delay (swrContext, frame->sample_rate),
-        OUTPUT_SAMPLE_RATE, frame->sample_rate, AV_ROUND_UP);
-
-      // allocate channel samples pointers, may point to planar data per channel or NULL if interleaved
-      convertedSamples = (uint8_t**)calloc (outCodecContext->channels, sizeof(convertedSamples));
-
-      // allocate memory for samples of all channels in one consecutive block
-      av_samples_alloc (convertedSamples, NULL, outCodecContext->channels,
-        numConvertedSamples, outCodecContext->sample_fmt, 0);
-
-      // Convert input samples to output sample format
-      numConvertedSamples = swr_convert (swrContext, convertedSamples, numConvertedSamples,
-                                                     (const uint8_t**)frame->extended_data, frame->nb_samples);
-      if (numConvertedSamples < 0) {
-        //{{{
-        cLog::log (LOGERROR, "error convert input samples");
-        goto cleanup;
-        }
-        //}}}
-
-      cLog::log (LOGINFO1, "converted inputSampleRate:%d samples %d to %d",
-                           frame->sample_rate, frame->nb_samples, numConvertedSamples);
-
-      // extend fifo to fit in converted samples, store them
-      if (av_audio_fifo_realloc (fifo, av_audio_fifo_size (fifo) + numConvertedSamples) < 0) {
-        //{{{
-        cLog::log (LOGERROR, "error reallocate FIFO");
-        goto cleanup;
-        }
-        //}}}
-      if (av_audio_fifo_write (fifo, (void**)convertedSamples, numConvertedSamples) < numConvertedSamples) {
-        //{{{
-        cLog::log (LOGERROR, "error write FIFO");
-        goto cleanup;
-        }
-        //}}}
-      }
-    }
-  ok = true;
-
-cleanup:
-  if (convertedSamples) {
-    av_freep (&convertedSamples[0]);
-    free (convertedSamples);
-    }
-
-  av_frame_free (&frame);
-  return ok;
-  }
-//}}}
-
-//{{{
-bool encodeFrame (AVFrame* frame, AVFormatContext* outFormatContext, AVCodecContext* outCodecContext, bool& hasData) {
-
-  bool ok = false;
-  hasData = false;
-
-  // Packet used for temporary storage
-  AVPacket packet;
-  av_init_packet (&packet);
-  packet.data = NULL;
-  packet.size = 0;
-
-  // Set a timestamp based on the sample rate for the container
-  if (frame) {
-    frame->pts = pts;
-    pts += frame->nb_samples;
-    }
-
-  // Send the audio frame stored in the temporary packet to the encoder
-  // The output audio stream encoder is used to do this The encoder signals that it has nothing more to encode
-  int error = avcodec_send_frame (outCodecContext, frame);
-  if (error == AVERROR_EOF) {
-    ok = true;
-    goto cleanup;
-    }
-  else if (error < 0) {
-    cLog::log (LOGERROR, "error send packet for encoding");
-    goto cleanup;
-    }
-
-  // Receive one encoded frame from the encoder
-  // If the encoder asks for more data to be able to provide an encoded frame, return indicating that no data is present
-  error = avcodec_receive_packet (outCodecContext, &packet);
-  if (error == AVERROR(EAGAIN))
-    ok = true;
-  else if (error == AVERROR_EOF)
-    ok = true;
-  else if (error < 0)
-    cLog::log (LOGERROR, "error encode frame");
-  else {
-    ok = true;
-    hasData = true;
-    }
-
-  // Write one audio frame from the temporary packet to the output file
-  if (hasData)
-    if (av_write_frame (outFormatContext, &packet) < 0) {
-      ok = false;
-      cLog::log (LOGERROR, "error write frame");
-      }
-
-cleanup:
-  av_packet_unref (&packet);
-  return ok;
-  }
-//}}}
-//{{{
-bool readFifoEncodeFrameWriteFile (AVAudioFifo* fifo, AVFormatContext* outFormatContext, AVCodecContext* outCodecContext) {
-
-  // Temporary storage of the output samples of the frame written to the file
-  // Use the maximum number of possible samples per frame.
-  // If there is less than the maximum possible frame size in the FIFO
-  // buffer use this number. Otherwise, use the maximum possible frame size
-  const int frame_size = FFMIN (av_audio_fifo_size(fifo), outCodecContext->frame_size);
-
-  // Initialize temporary storage for one output frame
-  // Set the frame's parameters, especially its size and format.
-  // av_frame_get_buffer needs this to allocate memory for the audio samples of the frame.
-  // Default channel layouts based on the number of channels are assumed for simplicity
-  AVFrame* frame = av_frame_alloc();
-  if (!frame) {
-    //{{{
-    cLog::log (LOGERROR, "could not allocate output frame");
+  FILE* file = fopen (filename, "r");
+  if (!file) {
+    cLog::log (LOGERROR, "Could not open manifest %s", filename);
     return false;
     }
-    //}}}
 
-  frame->nb_samples = frame_size;
-  frame->channel_layout = outCodecContext->channel_layout;
-  frame->format = outCodecContext->sample_fmt;
-  frame->sample_rate = outCodecContext->sample_rate;
+  std::string line;
+  char buffer[1024];
+  while (fgets (buffer, sizeof(buffer), file)) {
+    line += buffer;
+    if ((line.back() != '\n') && !feof (file))
+      continue; // (longer than the buffer, read the rest of the line)
 
-  // Allocate samples for created frame, makes sure audio frame can hold all the samples
-  int error = av_frame_get_buffer (frame, 0);
-  if (error < 0) {
-    //{{{
-    cLog::log (LOGERROR, "could not allocate output frame samples");
-    av_frame_free (&frame);
-    return false;
-    }
-    //}}}
+    while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r')))
+      line.pop_back();
 
-  // Read as many samples from the FIFO buffer as required to fill the frame.
-  // The samples are stored in the frame temporarily
-  if (av_audio_fifo_read (fifo, (void**)frame->data, frame_size) < frame_size) {
-    //{{{
-    cLog::log (LOGERROR, "could not read data from FIFO");
-    av_frame_free (&frame);
-    return false;
-    }
-    //}}}
+    size_t first = line.find_first_not_of (" \t");
+    if ((first != std::string::npos) && (line[first] != '#')) {
+      size_t tab = line.find ('\t');
+      if ((tab == std::string::npos) || (tab+1 == line.size()))
+        files.push_back ({ line.substr (0, tab), aacFilename (line.substr (0, tab)) });
+      else
+        files.push_back ({ line.substr (0, tab), line.substr (tab+1) });
+      }
 
-  // Encode one frame worth of audio samples
-  bool hasData = false;
-  if (!encodeFrame (frame, outFormatContext, outCodecContext, hasData)) {
-    av_frame_free (&frame);
-    return false;
+    line.clear();
     }
 
-  av_frame_free (&frame);
+  fclose (file);
   return true;
   }
 //}}}
@@ -421,110 +106,102 @@ int main (int argc, char **argv) {
   av_log_set_level (AV_LOG_ERROR);
   av_log_set_callback (cLog::avLogCallback);
 
-  AVFormatContext* inFormatContext = NULL;
-  AVFormatContext* outFormatContext = NULL;
-  AVCodecContext* inCodecContext = NULL;
-  AVCodecContext* outCodecContext = NULL;
-  SwrContext* swrContext = NULL;
-  AVAudioFifo* fifo = NULL;
-
-  int ret = AVERROR_EXIT;
-
-  if (argc != 2) {
-    //{{{
-    cLog::log (LOGINFO, "Usage: %s <input file> <output file>", argv[0]);
-    exit(1);
-    }
-    //}}}
-
-  if (!openInFile (argv[1], inFormatContext, inCodecContext))
-    goto cleanup;
-
-  auto len = strlen (argv[1]);
-  auto outFilename = (char*)malloc (len);
-  strcpy (outFilename, argv[1]);
-  outFilename[len-3] = 'a';
-  outFilename[len-2] = 'a';
-  outFilename[len-1] = 'c';
-  if (!openOutFile (outFilename, outFormatContext, outCodecContext))
-    goto cleanup;
-
-  // create swr_context for input to output conversion
-  swrContext = swr_alloc_set_opts (NULL,
-    av_get_default_channel_layout (outCodecContext->channels), outCodecContext->sample_fmt, outCodecContext->sample_rate,
-    av_get_default_channel_layout (inCodecContext->channels), inCodecContext->sample_fmt, inCodecContext->sample_rate,
-    0, NULL);
-  if (!swrContext) {
-    //{{{
-    cLog::log (LOGERROR, "Could not allocate swr_contextt");
-    goto cleanup;
-    }
-    //}}}
-  if (swr_init (swrContext) < 0) {
-    //{{{
-    cLog::log (LOGERROR, "Could not init swr_context");
-    swr_free (&swrContext);
-    goto cleanup;
+  //{{{  args
+  int numWorkers = 1;
+  bool split = false;
+  bool bench = false;
+  std::vector<std::pair<std::string,std::string>> files;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "-j") && (i+1 < argc))
+      numWorkers = std::max (1, atoi (argv[++i]));
+    else if (!strcmp (argv[i], "--split"))
+      split = true;
+    else if (!strcmp (argv[i], "--bench"))
+      bench = true;
+    else if (argv[i][0] == '@') {
+      if (!readManifest (argv[i]+1, files))
+        return 1;
+      }
+    else
+      files.push_back ({ argv[i], aacFilename (argv[i]) });
     }
-    //}}}
 
-  // init converted samples FIFO
-  fifo = av_audio_fifo_alloc (outCodecContext->sample_fmt, outCodecContext->channels, 1);
-  if (!fifo) {
+  if (files.empty()) {
     //{{{
-    cLog::log (LOGERROR, "Could not allocate FIFO");
-    goto cleanup;
+    cLog::log (LOGINFO, "Usage: %s [-j workers] [--split] [--bench] <input file | @manifest> ...", argv[0]);
+    cLog::log (LOGINFO, "  -j      : transcode this many files at once");
+    cLog::log (LOGINFO, "  --split : decode and encode each file on threads of their own");
+    cLog::log (LOGINFO, "  --bench : report each file's allocations, setup and steady state, and sample throughput");
+    cLog::log (LOGINFO, "            allocations are counted with ALLOC_COUNTER defined, glibc, or the msvc debug build");
+    cLog::log (LOGINFO, "  manifest: a line per file, input, or input <tab> output, output defaults to input.aac");
+    cLog::log (LOGINFO, "            paths are taken as they are, spaces included, # lines are comments");
+    return 1;
     }
     //}}}
-
-  if (avformat_write_header (outFormatContext, NULL) < 0)
-    goto cleanup;
-
-  bool inputDone = false;
-  while (!inputDone) {
-    // while some input and not enough output samples
-    while (!inputDone && (av_audio_fifo_size (fifo) < outCodecContext->frame_size))
-      if (!readFileDecodeFrameConvertStoreFifo (inFormatContext, inCodecContext, outCodecContext, swrContext, fifo, inputDone))
-        goto cleanup;
-
-    // while enough output samples
-    while ((inputDone && (av_audio_fifo_size (fifo) > 0) || (av_audio_fifo_size (fifo) >= outCodecContext->frame_size)))
-      if (!readFifoEncodeFrameWriteFile (fifo, outFormatContext, outCodecContext))
-        goto cleanup;
-    }
-
-  // done, flush encoder delayed frames
-  bool flushingEncoder = true;
-  while (flushingEncoder)
-    if (!encodeFrame (NULL, outFormatContext, outCodecContext, flushingEncoder))
-      goto cleanup;
-
-  if (av_write_trailer (outFormatContext) >= 0)
-    ret = 0;
-
-cleanup:
-  cLog::log (LOGINFO, "done");
-
-  if (fifo)
-    av_audio_fifo_free (fifo);
-
-  swr_free (&swrContext);
-
-  if (outCodecContext)
-    avcodec_free_context (&outCodecContext);
-
-  if (outFormatContext) {
-    avio_closep (&outFormatContext->pb);
-    avformat_free_context (outFormatContext);
-    }
-
-  if (inCodecContext)
-    avcodec_free_context (&inCodecContext);
-
-  if (inFormatContext)
-    avformat_close_input (&inFormatContext);
-
+  numWorkers = std::min (numWorkers, (int)files.size());
+  //}}}
+
+  // workers take the next file until there are none left
+  std::atomic<int> nextFile = { 0 };
+  std::atomic<int> numFailed = { 0 };
+  std::vector<double> seconds (files.size(), 0.0);
+  std::vector<int64_t> samples (files.size(), 0);
+  std::atomic<int64_t> totalAllocations = { 0 };
+  std::atomic<int64_t> steadyAllocations = { 0 };
+  std::atomic<int64_t> steadyFrames = { 0 };
+
+  auto startTime = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> workers;
+  for (int worker = 0; worker < numWorkers; worker++)
+    workers.emplace_back ([&]() {
+      for (int index = nextFile++; index < (int)files.size(); index = nextFile++) {
+        cTranscodeJob job (files[index].first, files[index].second);
+        if (job.run (split)) {
+          seconds[index] = job.getOutSeconds();
+          samples[index] = job.getOutSamples();
+          cLog::log (LOGINFO, "%s -> %s %.1fs", files[index].first.c_str(), files[index].second.c_str(), seconds[index]);
+          if (bench && cAllocCounter::isAvailable())
+            cLog::log (LOGINFO, "- frames:%lld allocations:%lld steady:%lld over %lld frames", (long long)job.getEncodedFrames(),
+                       (long long)job.getAllocations(), (long long)job.getSteadyAllocations(), (long long)job.getSteadyFrames());
+          totalAllocations += job.getAllocations();
+          steadyAllocations += job.getSteadyAllocations();
+          steadyFrames += job.getSteadyFrames();
+          }
+        else {
+          cLog::log (LOGERROR, "%s failed", files[index].first.c_str());
+          numFailed++;
+          }
+        }
+      });
+
+  for (auto& worker : workers)
+    worker.join();
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  double totalSeconds = 0.0;
+  for (auto fileSeconds : seconds)
+    totalSeconds += fileSeconds;
+  int64_t totalSamples = 0;
+  for (auto fileSamples : samples)
+    totalSamples += fileSamples;
+
+  cLog::log (LOGINFO, "%d files, %d failed, %d workers%s in %.3fs, %.2f files/s, %.1fx realtime",
+             (int)files.size(), numFailed.load(), numWorkers, split ? " split" : "",
+             elapsed, files.size() / elapsed, totalSeconds / elapsed);
+  if (bench) {
+    if (cAllocCounter::isAvailable())
+      cLog::log (LOGINFO, "%.0f samples/s, allocations:%lld steady state:%lld, %.1f a frame",
+                 totalSamples / elapsed, (long long)totalAllocations.load(), (long long)steadyAllocations.load(),
+                 steadyFrames ? (double)steadyAllocations / steadyFrames : 0.0);
+    else
+      cLog::log (LOGINFO, "%.0f samples/s, allocations not counted, not built with ALLOC_COUNTER", totalSamples / elapsed);
+    }
+
+#ifdef _WIN32
   Sleep (5000);
-  return ret;
+#endif
+  return numFailed ? 1 : 0;
   }
 //}}}